@@ -0,0 +1,260 @@
+#include "Analyzer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// GCC vector extensions, compiled to NEON or SSE where the target has them,
+// and to plain float code otherwise.
+typedef float v4f __attribute__(( vector_size( 16 ) ));
+
+namespace {
+
+// The real N point FFT of a block is computed as a complex FFT of M = N/2
+// points, with even samples in the real and odd samples in the imaginary part.
+enum { N = Analyzer::BlockFrames, M = N / 2 };
+
+const float sFullScale = 32768;
+const float sLowestBandHz = 40, sHighestBandHz = 16000;
+
+inline v4f Load( const float* p )
+{
+  v4f v;
+  ::memcpy( &v, p, sizeof( v ) );
+  return v;
+}
+
+inline void Store( float* p, v4f v )
+{
+  ::memcpy( p, &v, sizeof( v ) );
+}
+
+float Db( double powerRatio )
+{
+  if( powerRatio <= 0 )
+    return Analyzer::sFloorDb;
+  return std::max<float>( Analyzer::sFloorDb, 10 * ::log10( powerRatio ) );
+}
+
+} // namespace
+
+const float Analyzer::sFloorDb = -90;
+
+struct Analyzer::Private
+{
+  float mWindow[N];
+  int mBitReverse[M];
+  // Twiddles of the stage with half size h are at offset h - 1.
+  float mTwiddleRe[M], mTwiddleIm[M];
+  // Twiddles of the final real split, e^(-2 pi i k/N).
+  float mSplitRe[M], mSplitIm[M];
+  int mBandEdge[Bands + 1];
+  float mRe[M], mIm[M];
+
+  int mBlocks = 0;
+  float mPeak[2] = { 0, 0 };
+  double mSumSq[2] = { 0, 0 };
+  double mBandPower[Bands] = { 0 };
+
+  Private( int sampleRate );
+  void Fft();
+};
+
+Analyzer::Private::Private( int sampleRate )
+{
+  for( int n = 0; n < N; ++n )
+    mWindow[n] = 0.5f - 0.5f * ::cos( 2 * M_PI * n / N );
+
+  int bits = 0;
+  while( (1 << bits) < M )
+    ++bits;
+  for( int n = 0; n < M; ++n )
+  {
+    int r = 0;
+    for( int b = 0; b < bits; ++b )
+      if( n & (1 << b) )
+        r |= 1 << (bits - 1 - b);
+    mBitReverse[n] = r;
+  }
+
+  for( int h = 1; h < M; h *= 2 )
+    for( int j = 0; j < h; ++j )
+    {
+      mTwiddleRe[h - 1 + j] = ::cos( M_PI * j / h );
+      mTwiddleIm[h - 1 + j] = -::sin( M_PI * j / h );
+    }
+  for( int k = 0; k < M; ++k )
+  {
+    mSplitRe[k] = ::cos( 2 * M_PI * k / N );
+    mSplitIm[k] = -::sin( 2 * M_PI * k / N );
+  }
+
+  float binHz = float( sampleRate ) / N,
+        highest = std::min( sHighestBandHz, sampleRate / 2.0f );
+  mBandEdge[0] = std::max( 1, int( sLowestBandHz / binHz + 0.5f ) );
+  for( int b = 1; b <= Bands; ++b )
+  {
+    float hz = sLowestBandHz * ::pow( highest / sLowestBandHz, float( b ) / Bands );
+    mBandEdge[b] = std::max( mBandEdge[b - 1] + 1, int( hz / binHz + 0.5f ) );
+  }
+  for( int b = 0; b <= Bands; ++b )
+    mBandEdge[b] = std::min<int>( mBandEdge[b], M );
+}
+
+// Radix-2 decimation in time, on data in bit reversed order. Stages with
+// at least four butterflies per group run four butterflies per vector.
+void
+Analyzer::Private::Fft()
+{
+  for( int h = 1; h < M; h *= 2 )
+  {
+    const float* wr = mTwiddleRe + h - 1, *wi = mTwiddleIm + h - 1;
+    for( int k = 0; k < M; k += 2 * h )
+    {
+      float* ar = mRe + k, *ai = mIm + k, *br = ar + h, *bi = ai + h;
+      if( h >= 4 )
+      {
+        for( int j = 0; j < h; j += 4 )
+        {
+          v4f xr = Load( br + j ), xi = Load( bi + j ),
+              cr = Load( wr + j ), ci = Load( wi + j ),
+              tr = xr * cr - xi * ci, ti = xr * ci + xi * cr,
+              yr = Load( ar + j ), yi = Load( ai + j );
+          Store( ar + j, yr + tr );
+          Store( ai + j, yi + ti );
+          Store( br + j, yr - tr );
+          Store( bi + j, yi - ti );
+        }
+      }
+      else
+      {
+        for( int j = 0; j < h; ++j )
+        {
+          float tr = br[j] * wr[j] - bi[j] * wi[j],
+                ti = br[j] * wi[j] + bi[j] * wr[j];
+          br[j] = ar[j] - tr;
+          bi[j] = ai[j] - ti;
+          ar[j] += tr;
+          ai[j] += ti;
+        }
+      }
+    }
+  }
+}
+
+Analyzer::Analyzer( int sampleRate )
+: p( new Private( sampleRate ) )
+{
+}
+
+Analyzer::~Analyzer()
+{
+  delete p;
+}
+
+void
+Analyzer::PeakSumSq( const int16_t* in, int frames, float peak[2], float sumSq[2] )
+{
+  // Lanes hold L R L R.
+  v4f pk = { 0, 0, 0, 0 }, sq = { 0, 0, 0, 0 };
+  int i = 0;
+  for( ; i + 2 <= frames; i += 2 )
+  {
+    const int16_t* s = in + 2 * i;
+    v4f f = { float( s[0] ), float( s[1] ), float( s[2] ), float( s[3] ) };
+    v4f a = f < 0 ? -f : f;
+    pk = a > pk ? a : pk;
+    sq += f * f;
+  }
+  for( int c = 0; c < 2; ++c )
+  {
+    peak[c] = std::max( pk[c], pk[c + 2] );
+    sumSq[c] = sq[c] + sq[c + 2];
+  }
+  for( ; i < frames; ++i )
+    for( int c = 0; c < 2; ++c )
+    {
+      float f = in[2 * i + c];
+      peak[c] = std::max( peak[c], std::fabs( f ) );
+      sumSq[c] += f * f;
+    }
+}
+
+void
+Analyzer::Spectrum( const int16_t* in, float bandPower[Bands] )
+{
+  for( int n = 0; n < M; ++n )
+  {
+    const int16_t* s = in + 4 * n;
+    int r = p->mBitReverse[n];
+    p->mRe[r] = 0.5f * (s[0] + s[1]) * p->mWindow[2 * n];
+    p->mIm[r] = 0.5f * (s[2] + s[3]) * p->mWindow[2 * n + 1];
+  }
+  p->Fft();
+
+  // Separate the spectrum of the real input, and sum up bin powers per band.
+  // A full scale sine has a magnitude of N/4 (Hann window) in its bin.
+  const float ref = 1 / (sFullScale * N / 4);
+  float power[M];
+  for( int k = 1; k < M; ++k )
+  {
+    float ar = p->mRe[k], ai = p->mIm[k],
+          br = p->mRe[M - k], bi = p->mIm[M - k],
+          er = 0.5f * (ar + br), ei = 0.5f * (ai - bi),
+          or_ = 0.5f * (ai + bi), oi = -0.5f * (ar - br),
+          wr = p->mSplitRe[k], wi = p->mSplitIm[k],
+          xr = (er + wr * or_ - wi * oi) * ref,
+          xi = (ei + wr * oi + wi * or_) * ref;
+    power[k] = xr * xr + xi * xi;
+  }
+  for( int b = 0; b < Bands; ++b )
+  {
+    float sum = 0;
+    for( int k = p->mBandEdge[b]; k < p->mBandEdge[b + 1]; ++k )
+      sum += power[k];
+    bandPower[b] = sum;
+  }
+}
+
+void
+Analyzer::Process( const int16_t* block )
+{
+  float peak[2], sumSq[2], bandPower[Bands];
+  PeakSumSq( block, BlockFrames, peak, sumSq );
+  Spectrum( block, bandPower );
+  for( int c = 0; c < 2; ++c )
+  {
+    p->mPeak[c] = std::max( p->mPeak[c], peak[c] );
+    p->mSumSq[c] += sumSq[c];
+  }
+  for( int b = 0; b < Bands; ++b )
+    p->mBandPower[b] += bandPower[b];
+  ++p->mBlocks;
+}
+
+int
+Analyzer::Blocks() const
+{
+  return p->mBlocks;
+}
+
+void
+Analyzer::Take( Levels& levels )
+{
+  int blocks = std::max( p->mBlocks, 1 );
+  for( int c = 0; c < 2; ++c )
+  {
+    float peak = p->mPeak[c] / sFullScale;
+    levels.Peak[c] = Db( peak * peak );
+    // Relative to a full scale sine, as in AES17.
+    levels.Rms[c] = Db( 2 * p->mSumSq[c] / (double( blocks ) * N * sFullScale * sFullScale) );
+    p->mPeak[c] = 0;
+    p->mSumSq[c] = 0;
+  }
+  for( int b = 0; b < Bands; ++b )
+  {
+    levels.Spectrum[b] = Db( p->mBandPower[b] / blocks );
+    p->mBandPower[b] = 0;
+  }
+  p->mBlocks = 0;
+}
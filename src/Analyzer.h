@@ -0,0 +1,37 @@
+#ifndef ANALYZER_H
+#define ANALYZER_H
+
+#include <cstdint>
+
+// Level metering and spectrum analysis of interleaved 16 bit stereo PCM,
+// processed in fixed-size blocks. Results accumulate over blocks until
+// taken, so they can be decimated to the display rate.
+class Analyzer
+{
+public:
+  enum { BlockFrames = 1024, Bands = 16 };
+  static const float sFloorDb;
+
+  struct Levels
+  {
+    float Peak[2], Rms[2]; // dBFS, per channel
+    float Spectrum[Bands]; // dBFS, log spaced bands
+  };
+
+  Analyzer( int sampleRate = 44100 );
+  ~Analyzer();
+
+  void Process( const int16_t* block ); // BlockFrames frames
+  int Blocks() const; // since last Take()
+  void Take( Levels& );
+
+  // Kernels, exposed for benchmarking.
+  static void PeakSumSq( const int16_t*, int frames, float peak[2], float sumSq[2] );
+  void Spectrum( const int16_t*, float bandPower[Bands] );
+
+private:
+  struct Private;
+  Private* p;
+};
+
+#endif // ANALYZER_H
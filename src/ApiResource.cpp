@@ -0,0 +1,379 @@
+#include "ApiResource.h"
+#include "ControlResource.h"
+#include "Hardware.h"
+#include "Player.h"
+#include "StreamCatalog.h"
+#include "Clock.h"
+#include <Wt/Http/Request>
+#include <Wt/Http/Response>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <cmath>
+
+static const int sTickMs = 1000; // picks up time shift delay, equalizer
+static const int sKeepAliveSeconds = 20;
+// Event streams end after a while, and browsers reconnect after sRetryMs;
+// server listeners are removed when no client has been seen for
+// sClientTimeoutSeconds.
+static const int sStreamSeconds = 300;
+static const int sRetryMs = 2000;
+static const int sClientTimeoutSeconds = sStreamSeconds + 60;
+static const int sDefaultStreamLimit = 50;
+
+static const char* sStringKeys[] = { "Source", "Stream", "Title" };
+static const char* sArrayKeys[] = { "Queue" };
+
+template<size_t N> static bool Contains( const char* (&keys)[N], const std::string& key )
+{
+  for( auto k : keys )
+    if( key == k )
+      return true;
+  return false;
+}
+
+struct ApiResource::Private
+{
+  ApiResource* mpSelf;
+  std::mutex mMutex;
+  std::condition_variable mCond;
+  std::thread mThread;
+  bool mStop = false, mDirty = false, mListening = false;
+  // Used by the thread only
+  int mHardwareListener = 0, mPlayerListener = 0;
+  int64_t mLastClientUs = 0;
+  std::shared_ptr<const std::string> mJson = std::make_shared<std::string>();
+  uint64_t mVersion = 0;
+
+  struct Stream { uint64_t version; int64_t beginUs; };
+
+  Private( ApiResource* pSelf ) : mpSelf( pSelf ) {}
+  ~Private();
+
+  void Notify();
+  bool Update();
+  uint64_t Current( std::shared_ptr<const std::string>& );
+  void ThreadFunc();
+
+  void State( const Wt::Http::Request&, Wt::Http::Response& );
+  void Events( const Wt::Http::Request&, Wt::Http::Response& );
+  void Streams( const Wt::Http::Request&, Wt::Http::Response& );
+};
+
+ApiResource::Private::~Private()
+{
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    mStop = true;
+    mCond.notify_one();
+  }
+  if( mThread.joinable() )
+    mThread.join();
+  if( mListening )
+  {
+    Hardware::Instance()->RemoveServerListener( mHardwareListener );
+    Player::Instance()->RemoveServerListener( mPlayerListener );
+  }
+}
+
+// Called from broadcasting threads.
+void
+ApiResource::Private::Notify()
+{
+  std::lock_guard<std::mutex> lock( mMutex );
+  mDirty = true;
+  mCond.notify_one();
+}
+
+// Renders the state, returns true if it changed.
+bool
+ApiResource::Private::Update()
+{
+  std::ostringstream kv, json;
+  ControlResource::WriteAll( kv );
+  std::istringstream is( kv.str() );
+  KeyValueToJson( is, json );
+  std::lock_guard<std::mutex> lock( mMutex );
+  if( json.str() == *mJson )
+    return false;
+  mJson = std::make_shared<const std::string>( json.str() );
+  ++mVersion;
+  return true;
+}
+
+// Counts as client activity. Renders right away while not listening.
+uint64_t
+ApiResource::Private::Current( std::shared_ptr<const std::string>& json )
+{
+  bool listening = false;
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    mLastClientUs = Clock::NowUs();
+    listening = mListening;
+    if( !mThread.joinable() )
+      mThread = std::thread( &Private::ThreadFunc, this );
+  }
+  if( !listening )
+  {
+    Update();
+    Notify();
+  }
+  std::lock_guard<std::mutex> lock( mMutex );
+  json = mJson;
+  return mVersion;
+}
+
+void
+ApiResource::Private::ThreadFunc()
+{
+  int64_t lastPushUs = Clock::NowUs();
+  std::unique_lock<std::mutex> lock( mMutex );
+  while( !mStop )
+  {
+    mCond.wait_for( lock, std::chrono::milliseconds( sTickMs ), [this]{ return mStop || mDirty; } );
+    if( mStop )
+      break;
+    mDirty = false;
+    int64_t now = Clock::NowUs();
+    bool active = mLastClientUs && now - mLastClientUs < sClientTimeoutSeconds * 1000000LL;
+    bool listen = active && !mListening, unlisten = !active && mListening;
+    mListening = active;
+    lock.unlock();
+
+    if( listen )
+    {
+      mHardwareListener = Hardware::Instance()->AddServerListener( boost::bind( &Private::Notify, this ) );
+      mPlayerListener = Player::Instance()->AddServerListener( boost::bind( &Private::Notify, this ) );
+    }
+    else if( unlisten )
+    {
+      Hardware::Instance()->RemoveServerListener( mHardwareListener );
+      Player::Instance()->RemoveServerListener( mPlayerListener );
+    }
+    bool push = active && Update();
+    push = push || (active && now - lastPushUs > sKeepAliveSeconds * 1000000LL);
+    if( push )
+    {
+      mpSelf->haveMoreData();
+      lastPushUs = now;
+    }
+
+    lock.lock();
+  }
+}
+
+void
+ApiResource::Private::State( const Wt::Http::Request& req, Wt::Http::Response& rsp )
+{
+  int zone = ControlResource::Zone( req.getParameterMap() );
+  if( zone < 0 )
+  {
+    rsp.setStatus( 404 );
+    return;
+  }
+  if( req.path().find( "control" ) != std::string::npos )
+  {
+    if( !ControlResource::Control( req.getParameterMap() ) )
+      rsp.setStatus( 409 );
+    else if( zone == 0 && Update() )
+      mpSelf->haveMoreData();
+  }
+  rsp.setMimeType( "application/json" );
+  rsp.addHeader( "Cache-Control", "no-store" );
+  // Zones other than the first are rendered per request, without events.
+  if( zone != 0 )
+  {
+    std::ostringstream kv;
+    ControlResource::WriteAll( kv, zone );
+    std::istringstream is( kv.str() );
+    KeyValueToJson( is, rsp.out() );
+    rsp.out() << "\n";
+    return;
+  }
+  std::shared_ptr<const std::string> json;
+  Current( json );
+  rsp.out() << *json << "\n";
+}
+
+// Each continuation is resumed by haveMoreData(), and sends the state if it
+// changed, or a comment line to keep the connection open.
+void
+ApiResource::Private::Events( const Wt::Http::Request& req, Wt::Http::Response& rsp )
+{
+  std::shared_ptr<const std::string> json;
+  uint64_t version = Current( json );
+  Stream s;
+  auto cont = req.continuation();
+  if( cont )
+    s = boost::any_cast<Stream>( cont->data() );
+  else
+  {
+    rsp.setMimeType( "text/event-stream" );
+    rsp.addHeader( "Cache-Control", "no-store" );
+    rsp.out() << "retry: " << sRetryMs << "\n";
+    s.version = 0;
+    s.beginUs = Clock::NowUs();
+  }
+  if( s.version != version )
+  {
+    rsp.out() << "data: " << *json << "\n\n";
+    s.version = version;
+  }
+  else
+    rsp.out() << ":\n\n";
+  if( Clock::NowUs() - s.beginUs < sStreamSeconds * 1000000LL )
+  {
+    cont = rsp.createContinuation();
+    cont->setData( s );
+    cont->waitForMoreData();
+  }
+}
+
+void
+ApiResource::Private::Streams( const Wt::Http::Request& req, Wt::Http::Response& rsp )
+{
+  const auto& params = req.getParameterMap();
+  std::string query;
+  auto q = params.find( "q" );
+  if( q != params.end() )
+    query = q->second.back();
+  int limit = sDefaultStreamLimit;
+  auto l = params.find( "limit" );
+  if( l != params.end() )
+    limit = std::max( 0, ::atoi( l->second.back().c_str() ) );
+
+  const StreamCatalog& catalog = *StreamCatalog::Instance();
+  std::vector<uint32_t> rows;
+  catalog.Search( query, limit, rows );
+  rsp.setMimeType( "application/json" );
+  std::ostream& os = rsp.out();
+  os << '[';
+  for( size_t i = 0; i < rows.size(); ++i )
+  {
+    os << (i ? ",[" : "[");
+    WriteJsonString( os, catalog.Name( rows[i] ) );
+    os << ',';
+    WriteJsonString( os, catalog.Url( rows[i] ) );
+    os << ']';
+  }
+  os << "]\n";
+}
+
+ApiResource::ApiResource(Wt::WObject *parent)
+: Wt::WStreamResource(parent),
+  p( new Private( this ) )
+{
+}
+
+ApiResource::~ApiResource()
+{
+  beingDeleted();
+  delete p;
+}
+
+void
+ApiResource::handleRequest( const Wt::Http::Request& req, Wt::Http::Response& rsp )
+{
+  const std::string& path = req.path();
+  if( path.find( "events" ) != std::string::npos )
+    p->Events( req, rsp );
+  else if( path.find( "streams" ) != std::string::npos )
+    p->Streams( req, rsp );
+  else
+    p->State( req, rsp );
+}
+
+void
+ApiResource::WriteJsonString( std::ostream& os, const std::string& s )
+{
+  os << '"';
+  for( unsigned char c : s )
+    switch( c )
+    {
+      case '"':
+        os << "\\\"";
+        break;
+      case '\\':
+        os << "\\\\";
+        break;
+      case '\n':
+        os << "\\n";
+        break;
+      case '\r':
+        os << "\\r";
+        break;
+      case '\t':
+        os << "\\t";
+        break;
+      default:
+        if( c < 0x20 )
+        {
+          char buf[8];
+          ::sprintf( buf, "\\u%04x", c );
+          os << buf;
+        }
+        else
+          os << c;
+    }
+  os << '"';
+}
+
+static void WriteJsonValue( std::ostream& os, const std::string& key, const std::string& value )
+{
+  char* end = nullptr;
+  double d = ::strtod( value.c_str(), &end );
+  if( !Contains( sStringKeys, key ) && !value.empty() && !*end && std::isfinite( d ) )
+    os << d;
+  else
+    ApiResource::WriteJsonString( os, value );
+}
+
+// Keys keep their order, repeated keys and sArrayKeys become arrays.
+void
+ApiResource::KeyValueToJson( std::istream& is, std::ostream& os )
+{
+  std::vector<std::pair<std::string, std::vector<std::string>>> fields;
+  std::string line;
+  while( std::getline( is, line ) )
+  {
+    size_t pos = line.find( '=' );
+    if( pos == std::string::npos )
+      continue;
+    std::string key = line.substr( 0, pos );
+    auto i = std::find_if( fields.begin(), fields.end(),
+      [&key]( const decltype(fields.front())& f ) { return f.first == key; } );
+    if( i == fields.end() )
+      i = fields.insert( fields.end(), std::make_pair( key, std::vector<std::string>() ) );
+    i->second.push_back( line.substr( pos + 1 ) );
+  }
+  for( auto key : sArrayKeys )
+    if( std::none_of( fields.begin(), fields.end(),
+        [key]( const decltype(fields.front())& f ) { return f.first == key; } ) )
+      fields.push_back( std::make_pair( key, std::vector<std::string>() ) );
+
+  os << '{';
+  for( size_t i = 0; i < fields.size(); ++i )
+  {
+    const auto& f = fields[i];
+    if( i )
+      os << ',';
+    WriteJsonString( os, f.first );
+    os << ':';
+    if( f.second.size() == 1 && !Contains( sArrayKeys, f.first ) )
+      WriteJsonValue( os, f.first, f.second.back() );
+    else
+    {
+      os << '[';
+      for( size_t j = 0; j < f.second.size(); ++j )
+      {
+        if( j )
+          os << ',';
+        WriteJsonValue( os, f.first, f.second[j] );
+      }
+      os << ']';
+    }
+  }
+  os << "}";
+}
@@ -0,0 +1,33 @@
+#ifndef API_RESOURCE_H
+#define API_RESOURCE_H
+
+#include <Wt/WStreamResource>
+#include <iostream>
+
+// JSON state and control for the static page at /lite, with no
+// session per client:
+//  /api/state    the state as listed by /state, as a JSON object
+//  /api/control  parameters as for /control, answers with the new state
+//  /api/events   server-sent events, one JSON state per change
+//  /api/streams  catalog search, ?q=<words>&limit=<n>, [[name, url], ...]
+// The state is rendered once per change, and shared by all clients.
+// State and control take Zone=<n> for other zones, see Hardware.h; events
+// are those of the first zone.
+class ApiResource : public Wt::WStreamResource
+{
+public:
+  ApiResource(Wt::WObject *parent = 0);
+  ~ApiResource();
+  void handleRequest( const Wt::Http::Request&, Wt::Http::Response& );
+
+  // Converts key=value lines, as written by ControlResource::WriteAll(),
+  // into a JSON object.
+  static void KeyValueToJson( std::istream&, std::ostream& );
+  static void WriteJsonString( std::ostream&, const std::string& );
+
+private:
+  struct Private;
+  Private* p;
+};
+
+#endif // API_RESOURCE_H
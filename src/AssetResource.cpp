@@ -0,0 +1,92 @@
+#include "AssetResource.h"
+#include "Assets.h"
+#include <Wt/Http/Request>
+#include <Wt/Http/Response>
+
+static const size_t sChunkSize = 64000;
+
+namespace
+{
+  struct Chunk
+  {
+    const char* data;
+    size_t size, offset;
+  };
+}
+
+AssetResource::AssetResource(Wt::WObject *parent)
+: Wt::WStreamResource(parent)
+{
+}
+
+AssetResource::AssetResource(const std::string& path, Wt::WObject *parent)
+: Wt::WStreamResource(parent),
+  mPath( path )
+{
+}
+
+AssetResource::~AssetResource()
+{
+  beingDeleted();
+}
+
+// Large files go out in chunks, from memory mapped once.
+static void Write( Chunk c, Wt::Http::Response& rsp )
+{
+  size_t count = std::min( sChunkSize, c.size - c.offset );
+  rsp.out().write( c.data + c.offset, count );
+  c.offset += count;
+  if( c.offset < c.size )
+    rsp.createContinuation()->setData( c );
+}
+
+void
+AssetResource::handleRequest( const Wt::Http::Request& req, Wt::Http::Response& rsp )
+{
+  auto cont = req.continuation();
+  if( cont )
+  {
+    Write( boost::any_cast<Chunk>( cont->data() ), rsp );
+    return;
+  }
+
+  const Assets::File* f = nullptr;
+  if( mPath.empty() )
+  {
+    std::string name = req.pathInfo();
+    if( !name.empty() && name[0] == '/' )
+      name = name.substr( 1 );
+    f = Assets::Instance()->Find( name );
+  }
+  else
+    f = Assets::Instance()->FindSource( mPath );
+  if( !f )
+  {
+    rsp.setStatus( 404 );
+    rsp.setMimeType( "text/plain" );
+    rsp.out() << "Not found" << std::endl;
+    return;
+  }
+
+  Assets::Encoding e = Assets::Negotiate( *f, req.headerValue( "Accept-Encoding" ) );
+  std::string etag = "\"" + f->Hash;
+  if( e != Assets::Identity )
+    etag += std::string( "-" ) + Assets::EncodingName( e );
+  etag += "\"";
+  rsp.addHeader( "ETag", etag );
+  rsp.addHeader( "Vary", "Accept-Encoding" );
+  rsp.addHeader( "Cache-Control", mPath.empty() ? "public, max-age=31536000, immutable" : "no-cache" );
+  // Variants share the hash, and are all current.
+  if( req.headerValue( "If-None-Match" ).find( "\"" + f->Hash ) != std::string::npos )
+  {
+    rsp.setStatus( 304 );
+    return;
+  }
+
+  rsp.setMimeType( f->MimeType );
+  if( e != Assets::Identity )
+    rsp.addHeader( "Content-Encoding", Assets::EncodingName( e ) );
+  rsp.setContentLength( f->Variants[e].Size );
+  if( req.method() != "HEAD" )
+    Write( Chunk{ f->Variants[e].Data, f->Variants[e].Size, 0 }, rsp );
+}
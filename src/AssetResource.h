@@ -0,0 +1,23 @@
+#ifndef ASSET_RESOURCE_H
+#define ASSET_RESOURCE_H
+
+#include <Wt/WStreamResource>
+
+// Serves files built by "make assets", see Assets.h, in the smallest
+// encoding the client accepts. Without a path, serves hashed names below
+// the path it is added at, e.g. /assets/style.0123456789ab.css, to be
+// cached for good. With a path, serves the latest build of that file, to
+// be revalidated through its ETag.
+class AssetResource : public Wt::WStreamResource
+{
+public:
+  AssetResource(Wt::WObject *parent = 0);
+  AssetResource(const std::string& path, Wt::WObject *parent = 0);
+  ~AssetResource();
+  void handleRequest( const Wt::Http::Request&, Wt::Http::Response& );
+
+private:
+  std::string mPath;
+};
+
+#endif // ASSET_RESOURCE_H
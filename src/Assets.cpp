@@ -0,0 +1,185 @@
+#include "Assets.h"
+#include "Log.h"
+
+#include <Wt/WServer>
+#include <fstream>
+#include <map>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static Assets::Settings sSettings;
+
+static const struct { const char* ext; const char* type; }
+sMimeTypes[] =
+{
+  { "css", "text/css; charset=utf-8" },
+  { "html", "text/html; charset=utf-8" },
+  { "js", "application/javascript; charset=utf-8" },
+  { "pdf", "application/pdf" },
+  { "png", "image/png" },
+  { "svg", "image/svg+xml" },
+};
+
+static const char* sSuffixes[Assets::NumEncodings] = { "", ".gz", ".br" };
+static const char* sNames[Assets::NumEncodings] = { "identity", "gzip", "br" };
+
+struct Assets::Private
+{
+  std::map<std::string, File> mFiles; // by hashed name
+  std::map<std::string, std::string> mSources; // path -> hashed name
+  std::vector<std::pair<void*, size_t>> mMaps;
+
+  ~Private()
+  {
+    for( const auto& m : mMaps )
+      ::munmap( m.first, m.second );
+  }
+  bool Map( const std::string& path, const char*& data, size_t& size );
+  void Load( const std::string& dir );
+};
+
+bool
+Assets::Private::Map( const std::string& path, const char*& data, size_t& size )
+{
+  int fd = ::open( path.c_str(), O_RDONLY | O_CLOEXEC );
+  struct stat st;
+  if( fd < 0 || ::fstat( fd, &st ) < 0 || st.st_size == 0 )
+  {
+    if( fd >= 0 )
+      ::close( fd );
+    return false;
+  }
+  void* base = ::mmap( nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+  ::close( fd );
+  if( base == MAP_FAILED )
+    return false;
+  mMaps.push_back( std::make_pair( base, size_t( st.st_size ) ) );
+  data = static_cast<const char*>( base );
+  size = st.st_size;
+  return true;
+}
+
+void
+Assets::Private::Load( const std::string& dir )
+{
+  std::ifstream manifest( dir + "manifest" );
+  std::string path, name;
+  while( manifest >> path >> name )
+  {
+    File& f = mFiles[name];
+    f.Name = name;
+    // The hash is part of the name, "<name>.<hash>.<ext>".
+    size_t ext = name.rfind( '.' ), hash = name.rfind( '.', ext - 1 );
+    f.Hash = name.substr( hash + 1, ext - hash - 1 );
+    f.MimeType = "application/octet-stream";
+    for( const auto& m : sMimeTypes )
+      if( !name.compare( ext + 1, std::string::npos, m.ext ) )
+        f.MimeType = m.type;
+    for( int i = Identity; i < NumEncodings; ++i )
+      Map( dir + name + sSuffixes[i], f.Variants[i].Data, f.Variants[i].Size );
+    if( f.Variants[Identity].Data )
+      mSources[path] = name;
+    else
+    {
+      LOG( Web, Error, "Missing asset {1}", dir + name );
+      mFiles.erase( name );
+    }
+  }
+}
+
+void
+Assets::Configure( const Settings& s )
+{
+  sSettings = s;
+}
+
+Assets*
+Assets::Instance()
+{
+  static Assets sInstance;
+  return &sInstance;
+}
+
+Assets::Assets()
+: p( new Private )
+{
+  std::string dir = sSettings.Directory;
+  if( dir.empty() && Wt::WServer::instance() )
+    dir = Wt::WServer::instance()->appRoot() + "assets";
+  if( !dir.empty() && dir.back() != '/' )
+    dir += '/';
+  p->Load( dir );
+  LOG( Web, Info, "{1} assets in {2}", int( p->mFiles.size() ), dir );
+}
+
+Assets::~Assets()
+{
+  delete p;
+}
+
+const Assets::File*
+Assets::Find( const std::string& name ) const
+{
+  auto i = p->mFiles.find( name );
+  return i == p->mFiles.end() ? nullptr : &i->second;
+}
+
+const Assets::File*
+Assets::FindSource( const std::string& path ) const
+{
+  auto i = p->mSources.find( path );
+  return i == p->mSources.end() ? nullptr : Find( i->second );
+}
+
+std::string
+Assets::Url( const std::string& path ) const
+{
+  auto i = p->mSources.find( path );
+  return i == p->mSources.end() ? "/" + path : "/assets/" + i->second;
+}
+
+// Codings with q=0 are refused, others, and those matching "*", accepted.
+Assets::Encoding
+Assets::Negotiate( const File& f, const std::string& acceptEncoding )
+{
+  enum { Unspecified = -1 };
+  int accepted[NumEncodings] = { true, Unspecified, Unspecified }, any = false;
+  size_t pos = 0;
+  while( pos < acceptEncoding.length() )
+  {
+    size_t end = acceptEncoding.find( ',', pos );
+    if( end == std::string::npos )
+      end = acceptEncoding.length();
+    std::string item = acceptEncoding.substr( pos, end - pos );
+    pos = end + 1;
+    size_t semicolon = item.find( ';' );
+    std::string coding = item.substr( 0, semicolon );
+    coding.erase( 0, coding.find_first_not_of( " \t" ) );
+    coding.erase( coding.find_last_not_of( " \t" ) + 1 );
+    bool refused = false;
+    if( semicolon != std::string::npos )
+    {
+      size_t q = item.find( "q=", semicolon );
+      refused = q != std::string::npos && ::atof( item.c_str() + q + 2 ) <= 0;
+    }
+    if( coding == "*" )
+      any = !refused;
+    for( int i = Gzip; i < NumEncodings; ++i )
+      if( coding == sNames[i] )
+        accepted[i] = !refused;
+  }
+  Encoding best = Identity;
+  for( int i = Gzip; i < NumEncodings; ++i )
+    if( ( accepted[i] == true || ( accepted[i] == Unspecified && any ) )
+        && f.Variants[i].Data && f.Variants[i].Size < f.Variants[best].Size )
+      best = Encoding( i );
+  return best;
+}
+
+const char*
+Assets::EncodingName( Encoding e )
+{
+  return sNames[e];
+}
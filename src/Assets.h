@@ -0,0 +1,44 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include <string>
+
+// Static files with content-hashed names, and gzip and brotli variants,
+// as built by "make assets" (tools/assets.sh) into <app root>/assets.
+// Files are mapped into memory once, and served by AssetResource.
+class Assets
+{
+public:
+  struct Settings
+  {
+    std::string Directory; // empty for <app root>/assets
+  };
+  static void Configure( const Settings& ); // call before Instance()
+  static Assets* Instance();
+
+  enum Encoding { Identity, Gzip, Brotli, NumEncodings };
+  struct File
+  {
+    std::string Name, MimeType, Hash;
+    struct { const char* Data = nullptr; size_t Size = 0; } Variants[NumEncodings];
+  };
+  // By hashed name, or by path relative to the app root, e.g. "src/style.css".
+  // Returns null if not built.
+  const File* Find( const std::string& name ) const;
+  const File* FindSource( const std::string& path ) const;
+  // Url of the hashed file, or "/<path>" if not built.
+  std::string Url( const std::string& path ) const;
+
+  // The smallest variant allowed by an Accept-Encoding header.
+  static Encoding Negotiate( const File&, const std::string& acceptEncoding );
+  static const char* EncodingName( Encoding );
+
+private:
+  Assets();
+  ~Assets();
+
+  struct Private;
+  Private* p;
+};
+
+#endif // ASSETS_H
@@ -0,0 +1,580 @@
+#include "AudioPipeline.h"
+#include "Crossfader.h"
+#include "Hardware.h"
+#include "Loudness.h"
+#include "SlaveProcess.h"
+#include "Log.h"
+#include "Recorder.h"
+#include "Trace.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static AudioPipeline::Settings sSettings;
+
+static const int sSampleRate = 44100;
+static const int sUpdateHz = 15;
+static const int sPollMs = 100;
+// Output is closed when no audio arrives during this interval.
+static const int sIdleTimeoutMs = 500;
+
+static const float sReferenceLufs = -18;
+static const float sMaxGainOffset = 12;
+// Measurements shorter than this are discarded, longer ones are merged
+// into the index in chunks of sCommitSeconds.
+static const double sMinSeconds = 10;
+static const double sCommitSeconds = 60;
+// Older measurements weigh at most this much, so the index follows changes.
+static const double sMaxWeightSeconds = 3600;
+
+static const size_t sFrameBytes = 2 * sizeof( int16_t ),
+  sBlockBytes = Analyzer::BlockFrames * sFrameBytes;
+
+namespace {
+
+// Buffered audio of a decoder, allocated once.
+struct PcmRing
+{
+  std::vector<char> data;
+  size_t head = 0, bytes = 0;
+
+  void Clear() { head = bytes = 0; }
+  // Reads what is available without blocking, up to the free space.
+  void Fill( int fd )
+  {
+    while( bytes < data.size() )
+    {
+      size_t tail = (head + bytes) % data.size(),
+             n = std::min( data.size() - bytes, data.size() - tail );
+      ssize_t r = ::read( fd, data.data() + tail, n );
+      if( r <= 0 )
+        break;
+      bytes += r;
+    }
+  }
+  void Take( char* dest, size_t n )
+  {
+    size_t first = std::min( n, data.size() - head );
+    std::memcpy( dest, data.data() + head, first );
+    std::memcpy( dest + first, data.data(), n - first );
+    head = (head + n) % data.size();
+    bytes -= n;
+  }
+};
+
+} // namespace
+
+struct AudioPipeline::Private
+{
+  AudioPipeline* mpSelf;
+  Analyzer mAnalyzer { sSampleRate };
+  Equalizer mEqualizer { sSampleRate };
+  SlaveProcess mOutput;
+  int mFifo[NumDecoders] = { -1, -1 }, mFifoWriter[NumDecoders] = { -1, -1 };
+  size_t mFill = 0;
+
+  // Switching between decoders, on the audio thread. A decoder's ring is
+  // read before its fifo, and holds its audio from the start of a switch
+  // until the ring has been played out.
+  int mCurrent = 0, mIncoming = -1, mSwitchSeen = 0;
+  bool mFading = false;
+  PcmRing mRings[NumDecoders];
+  Crossfader mCrossfader { sSampleRate, sSettings.CrossfadeMs };
+  int16_t mIncomingBlock[2 * Analyzer::BlockFrames];
+  std::thread* mpThread = nullptr;
+  std::atomic<bool> mTerminating { false };
+
+  mutable std::mutex mMutex;
+  Analyzer::Levels mLevels = {};
+  bool mActive = false;
+  int mRequested = 0, mSwitchSerial = 0;
+  boost::function<void( int )> mSwitchListener;
+
+  // Loudness of the current stream, and the index of measured streams.
+  struct Measurement { float lufs; double seconds; };
+  Loudness mLoudness { sSampleRate };
+  std::string mStream, mNextStream;
+  std::map<std::string, Measurement> mIndex;
+
+  static void ThreadFunc( Private* );
+  bool OpenFifo( int decoder );
+  bool ReadBlock( int16_t* );
+  void UpdateSwitch();
+  void Crossfade( int16_t* );
+  void Promote();
+  void Output( const int16_t* );
+  void Publish( bool active );
+  void Measure( const int16_t* );
+  void Commit();
+  void LoadIndex();
+  void SaveIndex();
+};
+
+void
+AudioPipeline::Private::ThreadFunc( Private* p )
+{
+  Trace::SetThreadName( "AudioPipeline" );
+  // A failing aplay must not raise SIGPIPE.
+  sigset_t mask;
+  sigemptyset( &mask );
+  sigaddset( &mask, SIGPIPE );
+  pthread_sigmask( SIG_BLOCK, &mask, nullptr );
+
+  int16_t block[2 * Analyzer::BlockFrames];
+  const int framesPerUpdate = sSampleRate / sUpdateHz;
+  while( !p->mTerminating )
+  {
+    p->UpdateSwitch();
+    if( !p->ReadBlock( block ) )
+    {
+      if( p->mIncoming >= 0 && p->mRings[p->mIncoming].bytes > 0 )
+      {
+        p->Promote();
+        continue;
+      }
+      if( p->mActive )
+      {
+        p->mOutput.Kill();
+        p->Publish( false );
+        p->Commit();
+      }
+      continue;
+    }
+    {
+      TRACE_SCOPE( "AudioPipeline::Process" );
+      if( p->mFading )
+        p->Crossfade( block );
+      p->Measure( block );
+      p->mEqualizer.Process( block, Analyzer::BlockFrames );
+      p->mAnalyzer.Process( block );
+    }
+    p->Output( block );
+    if( p->mAnalyzer.Blocks() * Analyzer::BlockFrames >= framesPerUpdate )
+      p->Publish( true );
+  }
+}
+
+static std::string FifoPath( int decoder )
+{
+  return decoder ? sSettings.Fifo + "." + std::to_string( decoder + 1 ) : sSettings.Fifo;
+}
+
+bool
+AudioPipeline::Private::OpenFifo( int decoder )
+{
+  std::string fifo = FifoPath( decoder );
+  const char* path = fifo.c_str();
+  struct stat st;
+  if( ::stat( path, &st ) == 0 && !S_ISFIFO( st.st_mode ) )
+  {
+    LOG( Audio, Error, "{1} exists and is not a fifo", path );
+    return false;
+  }
+  if( ::mkfifo( path, 0600 ) < 0 && errno != EEXIST )
+  {
+    LOG( Audio, Error, "Could not create {1}: {2}", path, ::strerror( errno ) );
+    return false;
+  }
+  mFifo[decoder] = ::open( path, O_RDONLY | O_NONBLOCK | O_CLOEXEC );
+  // Holding the write end open avoids end-of-file between tracks.
+  mFifoWriter[decoder] = ::open( path, O_WRONLY | O_NONBLOCK | O_CLOEXEC );
+  if( mFifo[decoder] < 0 || mFifoWriter[decoder] < 0 )
+  {
+    LOG( Audio, Error, "Could not open {1}: {2}", path, ::strerror( errno ) );
+    return false;
+  }
+  return true;
+}
+
+// Returns false when no complete block arrived before the idle timeout.
+bool
+AudioPipeline::Private::ReadBlock( int16_t* block )
+{
+  const size_t size = sBlockBytes;
+  char* buf = reinterpret_cast<char*>( block );
+  const int fifo = mFifo[mCurrent];
+  PcmRing& ring = mRings[mCurrent];
+  if( ring.bytes > 0 )
+  {
+    ring.Fill( fifo );
+    size_t n = std::min( size, ring.bytes );
+    ring.Take( buf, n );
+    if( n == size )
+      return true;
+    mFill = n; // the rest follows from the fifo
+  }
+  int idleMs = 0;
+  while( mFill < size )
+  {
+    if( mTerminating )
+      return false;
+    struct pollfd fd = { fifo, POLLIN, 0 };
+    int r = ::poll( &fd, 1, sPollMs );
+    if( r == 0 )
+    {
+      idleMs += sPollMs;
+      if( idleMs >= sIdleTimeoutMs )
+      {
+        mFill = 0;
+        return false;
+      }
+      continue;
+    }
+    ssize_t n = ::read( fifo, buf + mFill, size - mFill );
+    if( n > 0 )
+    {
+      mFill += n;
+      idleMs = 0;
+    }
+    else if( n < 0 && errno != EINTR && errno != EAGAIN )
+    {
+      LOG( Audio, Error, "Could not read {1}: {2}", FifoPath( mCurrent ), ::strerror( errno ) );
+      ::usleep( 1000 * sPollMs );
+    }
+  }
+  mFill = 0;
+  return true;
+}
+
+// Picks up switch requests, and buffers the incoming decoder's audio.
+void
+AudioPipeline::Private::UpdateSwitch()
+{
+  int requested, serial;
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    requested = mRequested;
+    serial = mSwitchSerial;
+  }
+  if( serial != mSwitchSeen )
+  {
+    mSwitchSeen = serial;
+    mFading = false;
+    if( mIncoming >= 0 )
+      mRings[mIncoming].Clear();
+    mIncoming = -1;
+    if( requested != mCurrent )
+    {
+      // Discard what a previous player left in the fifo.
+      char discard[sBlockBytes];
+      while( ::read( mFifo[requested], discard, sizeof( discard ) ) > 0 )
+        ;
+      mIncoming = requested;
+    }
+  }
+  if( mIncoming < 0 )
+    return;
+  PcmRing& ring = mRings[mIncoming];
+  ring.Fill( mFifo[mIncoming] );
+  if( !mFading && ring.bytes >= sFrameBytes * mCrossfader.FadeFrames() )
+  {
+    mCrossfader.Start();
+    mFading = true;
+  }
+}
+
+// Mixes a block of the incoming audio into the current block. The ring
+// holds the whole fade when it starts, and runs short only when the
+// incoming stream is slower than real time; it is then padded with silence.
+void
+AudioPipeline::Private::Crossfade( int16_t* block )
+{
+  PcmRing& ring = mRings[mIncoming];
+  size_t n = std::min( sBlockBytes, ring.bytes - ring.bytes % sFrameBytes );
+  char* buf = reinterpret_cast<char*>( mIncomingBlock );
+  ring.Take( buf, n );
+  std::memset( buf + n, 0, sBlockBytes - n );
+  mCrossfader.Mix( block, mIncomingBlock, Analyzer::BlockFrames );
+  if( !mCrossfader.Active() )
+    Promote();
+}
+
+void
+AudioPipeline::Private::Promote()
+{
+  mCurrent = mIncoming;
+  mIncoming = -1;
+  mFading = false;
+  mFill = 0;
+  boost::function<void( int )> listener;
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    listener = mSwitchListener;
+  }
+  LOG( Audio, Debug, "Switched to decoder {1}", mCurrent );
+  if( listener )
+    listener( mCurrent );
+}
+
+void
+AudioPipeline::Private::Output( const int16_t* block )
+{
+  TRACE_SCOPE( "AudioPipeline::Output" );
+  if( !mOutput.Running() )
+  {
+    std::vector<std::string> args =
+    { "/usr/bin/aplay", "-q", "-t", "raw", "-f", "cd", "-D", sSettings.Device };
+    if( !mOutput.Exec( args ) )
+    {
+      LOG( Audio, Error, "Could not run {1}: {2}", args[0], ::strerror( errno ) );
+      return;
+    }
+  }
+  mOutput.Input().write( reinterpret_cast<const char*>( block ), 2 * Analyzer::BlockFrames * sizeof( *block ) );
+  mOutput.Input().flush();
+  if( !mOutput.Input() )
+  {
+    LOG( Audio, Warning, "Audio output interrupted" );
+    mOutput.Kill();
+    return;
+  }
+  // aplay reports underruns on its output
+  std::string line;
+  while( mOutput.WaitForOutputMs( 0 ) && std::getline( mOutput.Output(), line ) )
+    LOG( Audio, Debug, "aplay: {1}", line );
+}
+
+void
+AudioPipeline::Private::Publish( bool active )
+{
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    mAnalyzer.Take( mLevels );
+    mActive = active;
+  }
+  if( mpSelf->ListenerCount() > 0 )
+  {
+    TRACE_SCOPE( "AudioPipeline::Broadcast" );
+    mpSelf->Broadcast();
+  }
+}
+
+void
+AudioPipeline::Private::Measure( const int16_t* block )
+{
+  std::string stream;
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    stream = mNextStream;
+  }
+  if( stream != mStream )
+  {
+    Commit();
+    mStream = stream;
+  }
+  if( mStream.empty() )
+    return;
+  mLoudness.Process( block, Analyzer::BlockFrames );
+  if( mLoudness.Seconds() >= sCommitSeconds )
+    Commit();
+}
+
+void
+AudioPipeline::Private::Commit()
+{
+  float lufs;
+  if( !mStream.empty() && mLoudness.Seconds() >= sMinSeconds && mLoudness.Integrated( lufs ) )
+  {
+    double seconds = mLoudness.Seconds();
+    {
+      std::lock_guard<std::mutex> lock( mMutex );
+      auto i = mIndex.find( mStream );
+      if( i != mIndex.end() )
+      {
+        // Average in the power domain, weighted by duration.
+        double weight = std::min( i->second.seconds, sMaxWeightSeconds ),
+               power = weight * ::pow( 10, i->second.lufs / 10 ) + seconds * ::pow( 10, lufs / 10 );
+        seconds += weight;
+        lufs = 10 * ::log10( power / seconds );
+      }
+      mIndex[mStream] = Measurement { lufs, seconds };
+    }
+    LOG( Audio, Debug, "{1}: {2} LUFS over {3}s", mStream, lufs, seconds );
+    SaveIndex();
+  }
+  mLoudness.Reset();
+}
+
+// One line per stream: loudness, measured seconds, url.
+void
+AudioPipeline::Private::LoadIndex()
+{
+  std::ifstream f( sSettings.LoudnessIndex );
+  Measurement m;
+  std::string url;
+  while( f >> m.lufs >> m.seconds && f.ignore() && std::getline( f, url ) )
+    mIndex[url] = m;
+}
+
+void
+AudioPipeline::Private::SaveIndex()
+{
+  std::string tmp = sSettings.LoudnessIndex + ".tmp";
+  std::ofstream f( tmp );
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    for( const auto& i : mIndex )
+      f << i.second.lufs << ' ' << i.second.seconds << ' ' << i.first << '\n';
+  }
+  f.close();
+  if( f.fail() || ::rename( tmp.c_str(), sSettings.LoudnessIndex.c_str() ) < 0 )
+    LOG( Audio, Error, "Could not save {1}: {2}", sSettings.LoudnessIndex, ::strerror( errno ) );
+}
+
+void
+AudioPipeline::Configure( const Settings& s )
+{
+  sSettings = s;
+}
+
+bool
+AudioPipeline::Enabled()
+{
+  return sSettings.Enabled;
+}
+
+bool
+AudioPipeline::Crossfades()
+{
+  return sSettings.Enabled && sSettings.CrossfadeMs > 0;
+}
+
+AudioPipeline*
+AudioPipeline::Instance()
+{
+  static AudioPipeline sInstance;
+  return &sInstance;
+}
+
+AudioPipeline::AudioPipeline()
+: p( new Private )
+{
+  p->mpSelf = this;
+  Equalizer::Settings eq;
+  if( !Recorder::Replaying() )
+  {
+    p->LoadIndex();
+    if( Equalizer::Load( sSettings.EqualizerFile, eq ) )
+      p->mEqualizer.Set( eq );
+  }
+  // The rings hold the fade, and what arrives while it plays.
+  if( Crossfades() )
+    for( auto& ring : p->mRings )
+      ring.data.resize( 2 * sFrameBytes * p->mCrossfader.FadeFrames() + sBlockBytes );
+  bool ok = sSettings.Enabled && !Recorder::Replaying();
+  for( int i = 0; ok && i < (Crossfades() ? NumDecoders : 1); ++i )
+    ok = p->OpenFifo( i );
+  if( ok )
+    p->mpThread = new std::thread( &Private::ThreadFunc, p );
+}
+
+AudioPipeline::~AudioPipeline()
+{
+  p->mTerminating = true;
+  if( p->mpThread && p->mpThread->joinable() )
+    p->mpThread->join();
+  delete p->mpThread;
+  for( int i = 0; i < NumDecoders; ++i )
+    for( int fd : { p->mFifo[i], p->mFifoWriter[i] } )
+      if( fd >= 0 )
+        ::close( fd );
+  delete p;
+}
+
+std::vector<std::string>
+AudioPipeline::PlayerArgs( int decoder ) const
+{
+  std::ostringstream af;
+  af << "resample=" << sSampleRate << ",channels=2,format=s16le";
+  return
+  {
+    "-ao", "pcm:nowaveheader:file=" + FifoPath( decoder ),
+    "-af", af.str(),
+  };
+}
+
+void
+AudioPipeline::SwitchTo( int decoder )
+{
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  p->mRequested = decoder;
+  ++p->mSwitchSerial;
+}
+
+void
+AudioPipeline::SetSwitchListener( const boost::function<void( int )>& listener )
+{
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  p->mSwitchListener = listener;
+}
+
+bool
+AudioPipeline::GetLevels( Analyzer::Levels& levels ) const
+{
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  levels = p->mLevels;
+  return p->mActive;
+}
+
+void
+AudioPipeline::SetStream( const std::string& url )
+{
+  float offset = 0;
+  std::string data;
+  if( Recorder::Replaying() )
+  {
+    if( Recorder::Replay( Recorder::StreamGainOffset, data ) )
+      offset = ::atof( data.c_str() );
+  }
+  else
+  {
+    offset = GainOffset( url );
+    Recorder::Record( Recorder::StreamGainOffset, std::to_string( offset ) );
+  }
+  {
+    std::lock_guard<std::mutex> lock( p->mMutex );
+    p->mNextStream = url;
+  }
+  if( offset != 0 )
+    LOG( Audio, Info, "Gain offset {1}dB for {2}", offset, url );
+  Hardware::Instance()->SetNetworkGainOffset( offset );
+}
+
+float
+AudioPipeline::GainOffset( const std::string& url ) const
+{
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  auto i = p->mIndex.find( url );
+  if( i == p->mIndex.end() || i->second.seconds < sMinSeconds )
+    return 0;
+  float offset = sReferenceLufs - i->second.lufs;
+  offset = std::max( -sMaxGainOffset, std::min( sMaxGainOffset, offset ) );
+  return ::floor( offset * 10 + 0.5 ) / 10;
+}
+
+void
+AudioPipeline::SetEqualizer( const Equalizer::Settings& s )
+{
+  p->mEqualizer.Set( s );
+  Equalizer::Settings eq;
+  p->mEqualizer.Get( eq );
+  if( !Equalizer::Save( sSettings.EqualizerFile, eq ) )
+    LOG( Audio, Error, "Could not save {1}: {2}", sSettings.EqualizerFile, ::strerror( errno ) );
+  Broadcast();
+}
+
+void
+AudioPipeline::GetEqualizer( Equalizer::Settings& s ) const
+{
+  p->mEqualizer.Get( s );
+}
@@ -0,0 +1,67 @@
+#ifndef AUDIO_PIPELINE_H
+#define AUDIO_PIPELINE_H
+
+#include "Broadcaster.h"
+#include "Analyzer.h"
+#include "Equalizer.h"
+#include <string>
+#include <vector>
+
+// Optional PCM tap: mplayer writes decoded audio into a fifo instead of the
+// sound device, and goldstard meters it before passing it on to aplay.
+// Listeners are notified whenever new levels are available.
+//
+// The loudness of each stream is measured in the background and kept in an
+// index file, and applied as a network gain offset when the stream starts.
+// An equalizer stage processes the audio before it is metered and output.
+//
+// For crossfaded station switching, a second decoder writes into its own
+// fifo while the current one plays on; its audio is buffered until the
+// fade length is available, and then crossfaded in.
+class AudioPipeline : public Broadcaster
+{
+public:
+  struct Settings
+  {
+    bool Enabled = false;
+    std::string Fifo = "/tmp/" APPNAME ".pcm",
+      Device = "default",
+      LoudnessIndex = "/var/local/" APPNAME "/loudness",
+      EqualizerFile = "/var/local/" APPNAME "/equalizer";
+    int CrossfadeMs = 0; // 0 switches streams without crossfade
+  };
+  static void Configure( const Settings& ); // call before Instance()
+  static bool Enabled();
+  static bool Crossfades();
+  static AudioPipeline* Instance();
+
+  // mplayer arguments that route its output into the tap.
+  enum { NumDecoders = 2 };
+  std::vector<std::string> PlayerArgs( int decoder = 0 ) const;
+  // Starts buffering audio from the given decoder, and crossfades to it
+  // once the fade length is buffered, or right away when the current
+  // decoder falls silent. The listener is then called from the audio
+  // thread. Switching to the current decoder cancels a switch.
+  void SwitchTo( int decoder );
+  void SetSwitchListener( const boost::function<void( int decoder )>& );
+  // Returns false while no audio is flowing.
+  bool GetLevels( Analyzer::Levels& ) const;
+
+  // Called when the player starts a stream.
+  void SetStream( const std::string& url );
+  // Gain offset towards the reference loudness, 0 if not measured yet.
+  float GainOffset( const std::string& url ) const;
+
+  // Equalizer settings are saved, and listeners notified, on change.
+  void SetEqualizer( const Equalizer::Settings& );
+  void GetEqualizer( Equalizer::Settings& ) const;
+
+private:
+  AudioPipeline();
+  ~AudioPipeline();
+
+  struct Private;
+  Private* p;
+};
+
+#endif // AUDIO_PIPELINE_H
@@ -1,6 +1,14 @@
 #include "AudioWidget.h"
 #include "Hardware.h"
 #include "Player.h"
+#include "AudioPipeline.h"
+#include "TimeShift.h"
+#include "MediaLibrary.h"
+#include "StreamCatalog.h"
+#include "StreamCatalogModel.h"
+#include "StreamProber.h"
+#include "Scenes.h"
+#include "Trace.h"
 
 #include <Wt/WPushButton>
 #include <Wt/WCheckBox>
@@ -8,8 +16,11 @@
 #include <Wt/WButtonGroup>
 #include <Wt/WRadioButton>
 #include <Wt/WComboBox>
+#include <Wt/WSelectionBox>
+#include <Wt/WLineEdit>
 #include <Wt/WTemplate>
 #include <Wt/WLabel>
+#include <Wt/WText>
 #include <Wt/WTimer>
 
 #include <fstream>
@@ -39,6 +50,8 @@ namespace Key
     Stream_label = Stream + delta,
     CoupleLR,
     NetworkPlay, NetworkStop,
+    NetworkPause, NetworkRewind, NetworkLive,
+    NetworkNext, LibraryEnqueue,
     NumControlKeys,
   };
 }
@@ -69,9 +82,20 @@ static const Control<Wt::WPushButton> sPushButtons[] =
   { Key::CDRandom, "cd-random-button", "Random" },
   { Key::NetworkPlay, "network-play-button", "Play" },
   { Key::NetworkStop, "network-stop-button", "Stop" },
+  { Key::NetworkPause, "network-pause-button", "Pause" },
+  { Key::NetworkRewind, "network-rewind-button", "-30s" },
+  { Key::NetworkLive, "network-live-button", "Live" },
+  { Key::NetworkNext, "network-next-button", "Next" },
+  { Key::LibraryEnqueue, "library-enqueue-button", "Enqueue" },
   { 0 }
 };
 
+// Library search results shown, and rows visible.
+static const size_t sLibraryResults = 50;
+static const int sLibraryRows = 8;
+// Catalogs larger than this get a filter box above the stream drop down.
+static const size_t sStreamFilterMin = 20;
+
 static const Control<Wt::WComboBox> sDropDowns[] =
 {
   { Key::Stream, "stream-dropdown", "", },
@@ -113,17 +137,63 @@ static const Control<Wt::WLabel> sLabels[] =
   { 0 }
 };
 
+// Draws level meters and spectrum into a canvas. Levels arrive as whole dB
+// below full scale: peak L/R, RMS L/R, then spectrum bands. Empty when idle.
+static const int sMeterRangeDb = 60; // as r in the script
+static const char* sLevelsJs =
+  "function(id, d) {"
+  "  var e = document.getElementById(id);"
+  "  if (!e) return;"
+  "  var c = e.firstChild;"
+  "  if (!c) {"
+  "    c = document.createElement('canvas');"
+  "    c.width = e.clientWidth || 240; c.height = e.clientHeight || 48;"
+  "    e.appendChild(c);"
+  "  }"
+  "  var g = c.getContext('2d'), w = c.width, h = c.height, r = 60, bh = 5;"
+  "  g.clearRect(0, 0, w, h);"
+  "  g.fillStyle = '#4a4';"
+  "  if (d.length < 4) return;"
+  "  for (var i = 0; i < 2; ++i) {"
+  "    var y = i * (bh + 2);"
+  "    g.fillRect(0, y, w * (r - d[2 + i]) / r, bh);"
+  "    g.fillRect(Math.max(0, w * (r - d[i]) / r - 2), y, 2, bh);"
+  "  }"
+  "  var n = d.length - 4, bw = w / n, top = 2 * (bh + 2) + 2;"
+  "  for (var i = 0; i < n; ++i) {"
+  "    var v = (h - top) * (r - d[4 + i]) / r;"
+  "    g.fillRect(i * bw + 1, h - v, bw - 2, v);"
+  "  }"
+  "}";
+
 struct AudioWidget::Private
 {
   AudioWidget* mpSelf;
   Wt::WTemplate* mpTemplate;
   Wt::WButtonGroup* mpSourceGroup;
   std::map<int, Wt::WWidget*> mWidgets;
+  Wt::WContainerWidget* mpMeter;
+  Wt::WText* mpTitle;
+  std::string mLevels;
+  Wt::WSlider* mpEqSliders[Equalizer::NumBands];
+  Wt::WLabel* mpEqLabels[Equalizer::NumBands];
+  Equalizer::Settings mEqualizer;
+  Wt::WLineEdit* mpLibrarySearch = nullptr;
+  Wt::WSelectionBox* mpLibraryResults = nullptr;
+  std::vector<std::string> mLibraryPaths;
   bool mCoupleLR;
-  std::vector<std::string> mStreams;
+  StreamCatalogModel* mpStreams;
+  Wt::WLineEdit* mpStreamFilter = nullptr;
+  Wt::WCheckBox* mpStreamSort = nullptr;
   Hardware::State mState;
-
-  Private( AudioWidget* );
+  // The zone's amplifier and player; the PCM tap, with level meter and
+  // equalizer, and time shifting belong to the first zone.
+  int mZone;
+  Hardware* mpHardware;
+  Player* mpPlayer;
+  bool mPipeline;
+
+  Private( AudioWidget*, int zone );
   ~Private();
   template<class T> void Create( const Control<T>* );
   template<class T> void Configure( T*, const Control<T>* );
@@ -133,10 +203,21 @@ struct AudioWidget::Private
   void SetControlsFromState();
   void OnHardwareChanged();
   void OnPlayerChanged();
+  void OnTitleChanged( const std::string& );
+  void OnStreamFilter();
+  void OnStreamsProbed();
+  void OnLibrarySearch();
+  void OnLibrarySelected( int );
+  void OnPipelineChanged();
+  void OnEqualizerMoved( int band, int value );
+  void OnScene( const std::string& );
+  void SetEqualizerControls();
   void OnAction( Wt::WObject*, int );
 };
 
-AudioWidget::Private::Private( AudioWidget* pSelf )
+AudioWidget::Private::Private( AudioWidget* pSelf, int zone )
+: mZone( zone ), mpHardware( Hardware::Instance( zone ) ), mpPlayer( Player::Instance( zone ) ),
+  mPipeline( zone == 0 && AudioPipeline::Enabled() )
 {
   mpSelf = pSelf;
 
@@ -154,23 +235,105 @@ AudioWidget::Private::Private( AudioWidget* pSelf )
   mpSourceGroup = new Wt::WButtonGroup(mpSelf);
   for( int i = Key::SourceCD; i <= Key::SourceNetwork; ++i )
     mpSourceGroup->addButton( Widget<Wt::WRadioButton>(i) );
+  mpMeter = new Wt::WContainerWidget;
+  mpMeter->setStyleClass( "meter" );
+  mpTemplate->bindWidget( "level-meter", mpMeter );
+  mpTitle = new Wt::WText;
+  mpTitle->setTextFormat( Wt::PlainText );
+  mpTemplate->bindWidget( "stream-title", mpTitle );
+  mpTemplate->setCondition( "if-equalizer", mPipeline );
+  mpTemplate->setCondition( "if-timeshift", zone == 0 && TimeShift::Enabled() );
+  if( mPipeline )
+  {
+    wApp->declareJavaScriptFunction( "levels", sLevelsJs );
+    for( int i = 0; i < Equalizer::NumBands; ++i )
+    {
+      std::string name = "eq-" + std::to_string( i + 1 );
+      mpEqSliders[i] = new Wt::WSlider;
+      mpEqSliders[i]->setRange( -Equalizer::sMaxGain, Equalizer::sMaxGain );
+      mpEqSliders[i]->setHeight( 20 );
+      mpEqSliders[i]->sliderMoved().connect( boost::bind(&Private::OnEqualizerMoved, this, i, _1) );
+      mpTemplate->bindWidget( name + "-slider", mpEqSliders[i] );
+      mpEqLabels[i] = new Wt::WLabel;
+      mpTemplate->bindWidget( name + "-label", mpEqLabels[i] );
+    }
+    AudioPipeline::Instance()->GetEqualizer( mEqualizer );
+    SetEqualizerControls();
+    AudioPipeline::Instance()->AddListener( boost::bind(&Private::OnPipelineChanged, this) );
+  }
+  else
+    mpMeter->hide();
 
-  Hardware::Instance()->AddListener( boost::bind(&Private::OnHardwareChanged, this) );
-  Player::Instance()->AddListener( boost::bind(&Private::OnPlayerChanged, this) );
-  Hardware::Instance()->GetState(mState);
-  mCoupleLR = (mState.VolumeL == mState.VolumeR);
+  mpTemplate->setCondition( "if-zones", Hardware::Zones() > 1 );
+  if( Hardware::Zones() > 1 )
+  {
+    std::ostringstream links;
+    for( int i = 0; i < Hardware::Zones(); ++i )
+      if( i == zone )
+        links << "<b>" << i << "</b> ";
+      else
+        links << "<a href='?zone=" << i << "'>" << i << "</a> ";
+    mpTemplate->bindWidget( "zone-links", new Wt::WText( links.str(), Wt::XHTMLText ) );
+  }
 
-  f.open(wApp->appRoot() + "etc/network_streams.conf");
-  while(std::getline(f, s))
+  const Scenes& scenes = *Scenes::Instance();
+  mpTemplate->setCondition( "if-scenes", scenes.Count() > 0 );
+  if( scenes.Count() > 0 )
   {
-    size_t pos = s.find('=');
-    if(pos < s.length())
+    Wt::WContainerWidget* pButtons = new Wt::WContainerWidget;
+    for( size_t i = 0; i < scenes.Count(); ++i )
     {
-      Widget<Wt::WComboBox>(Key::Stream)->addItem(Wt::WString::fromUTF8(s.substr(0, pos)));
-      mStreams.push_back(s.substr(pos + 1));
+      Wt::WPushButton* pButton = new Wt::WPushButton( Wt::WString::fromUTF8( scenes.Name( i ) ), pButtons );
+      pButton->clicked().connect( boost::bind( &Private::OnScene, this, scenes.Name( i ) ) );
     }
+    mpTemplate->bindWidget( "scene-buttons", pButtons );
+  }
+
+  mpTemplate->setCondition( "if-library", MediaLibrary::Enabled() );
+  if( MediaLibrary::Enabled() )
+  {
+    mpLibrarySearch = new Wt::WLineEdit;
+    mpLibrarySearch->setStyleClass( "fill" );
+    mpLibrarySearch->setPlaceholderText( "Search artist, album, title" );
+    mpLibrarySearch->textInput().connect( boost::bind(&Private::OnLibrarySearch, this) );
+    mpTemplate->bindWidget( "library-search", mpLibrarySearch );
+    mpLibraryResults = new Wt::WSelectionBox;
+    mpLibraryResults->setStyleClass( "fill" );
+    mpLibraryResults->setVerticalSize( sLibraryRows );
+    mpLibraryResults->activated().connect( boost::bind(&Private::OnLibrarySelected, this, _1) );
+    mpTemplate->bindWidget( "library-results", mpLibraryResults );
+    OnLibrarySearch();
+    MediaLibrary::Instance()->AddListener( boost::bind(&Private::OnLibrarySearch, this) );
+  }
+
+  mpHardware->AddListener( boost::bind(&Private::OnHardwareChanged, this) );
+  mpPlayer->AddListener( boost::bind(&Private::OnPlayerChanged, this) );
+  mpPlayer->AddTitleListener( boost::bind(&Private::OnTitleChanged, this, _1) );
+  mpTitle->setText( Wt::WString::fromUTF8( mpPlayer->StreamTitle() ) );
+  mpHardware->GetState(mState);
+  mCoupleLR = (mState.VolumeL == mState.VolumeR);
+
+  mpStreams = new StreamCatalogModel( mpSelf );
+  Widget<Wt::WComboBox>(Key::Stream)->setModel( mpStreams );
+  bool probe = StreamProber::Enabled(),
+       filter = probe || StreamCatalog::Instance()->Count() > sStreamFilterMin;
+  mpTemplate->setCondition( "if-stream-filter", filter );
+  mpTemplate->setCondition( "if-stream-sort", probe );
+  if( filter )
+  {
+    mpStreamFilter = new Wt::WLineEdit;
+    mpStreamFilter->setStyleClass( "fill" );
+    mpStreamFilter->setPlaceholderText( "Find station" );
+    mpStreamFilter->textInput().connect( boost::bind(&Private::OnStreamFilter, this) );
+    mpTemplate->bindWidget( "stream-filter", mpStreamFilter );
+  }
+  if( probe )
+  {
+    mpStreamSort = new Wt::WCheckBox( "Fastest first" );
+    mpStreamSort->changed().connect( boost::bind(&Private::OnStreamFilter, this) );
+    mpTemplate->bindWidget( "stream-sort", mpStreamSort );
+    StreamProber::Instance()->AddListener( boost::bind(&Private::OnStreamsProbed, this) );
   }
-  f.close();
 
   // workaround: sliders must be enabled on load or won't work
   Wt::WTimer::singleShot(10, this, &AudioWidget::Private::OnHardwareChanged);
@@ -186,7 +349,15 @@ AudioWidget::Private::Private( AudioWidget* pSelf )
 
 AudioWidget::Private::~Private()
 {
-  Hardware::Instance()->RemoveListener();
+  mpHardware->RemoveListener();
+  mpPlayer->RemoveListener();
+  mpPlayer->RemoveTitleListener();
+  if( mPipeline )
+    AudioPipeline::Instance()->RemoveListener();
+  if( MediaLibrary::Enabled() )
+    MediaLibrary::Instance()->RemoveListener();
+  if( StreamProber::Enabled() )
+    StreamProber::Instance()->RemoveListener();
 }
 
 template<class T> void
@@ -239,14 +410,14 @@ AudioWidget::Private::Id( Wt::WObject* c )
 void
 AudioWidget::Private::OnHardwareChanged()
 {
-  Hardware::Instance()->GetState( mState );
+  mpHardware->GetState( mState );
   SetControlsFromState();
 }
 
 void
 AudioWidget::Private::OnPlayerChanged()
 {
-  Player& player = *Player::Instance();
+  Player& player = *mpPlayer;
   std::string time, info;
   if( player.IsPlaying() )
   {
@@ -294,6 +465,12 @@ AudioWidget::Private::OnPlayerChanged()
       oss << " Bitrate: " << f << "kbps ";
 
     info = oss.str();
+    if( player.IsTimeShifted() )
+    {
+      int delay = ::floor( player.TimeShiftDelay() + 0.5 );
+      if( delay > 0 )
+        time += "&nbsp;-" + std::to_string( delay ) + "s";
+    }
     Widget<Wt::WPushButton>(Key::NetworkPlay)->setEnabled(false);
     Widget<Wt::WPushButton>(Key::NetworkStop)->setEnabled(true);
   }
@@ -302,11 +479,140 @@ AudioWidget::Private::OnPlayerChanged()
     Widget<Wt::WPushButton>(Key::NetworkPlay)->setEnabled(!mState.Stream.empty() && player.IsIdle());
     Widget<Wt::WPushButton>(Key::NetworkStop)->setEnabled(false);
   }
+  bool shifted = player.IsPlaying() && player.IsTimeShifted();
+  Widget<Wt::WPushButton>(Key::NetworkPause)->setEnabled(shifted);
+  Widget<Wt::WPushButton>(Key::NetworkPause)->setText(player.IsPaused() ? "Resume" : "Pause");
+  Widget<Wt::WPushButton>(Key::NetworkRewind)->setEnabled(shifted);
+  Widget<Wt::WPushButton>(Key::NetworkLive)->setEnabled(shifted);
+  std::vector<std::string> queue = player.Queue();
+  std::string queued;
+  for( const auto& q : queue )
+    queued += q + "\n";
+  Widget<Wt::WPushButton>(Key::NetworkNext)->setEnabled(!queue.empty() || player.IsPlaying());
+  Widget<Wt::WPushButton>(Key::NetworkNext)->setText(
+    queue.empty() ? Wt::WString( "Next" ) : Wt::WString( "Next ({1})" ).arg( int( queue.size() ) ) );
+  Widget<Wt::WPushButton>(Key::NetworkNext)->setToolTip( Wt::WString::fromUTF8( queued ) );
   Widget<Wt::WLabel>( Key::Stream_label )->setText( time );
   Widget<Wt::WLabel>( Key::Stream_label )->setToolTip( info );
   wApp->triggerUpdate();
 }
 
+void
+AudioWidget::Private::OnTitleChanged( const std::string& title )
+{
+  mpTitle->setText( Wt::WString::fromUTF8( title ) );
+  wApp->triggerUpdate();
+}
+
+void
+AudioWidget::Private::OnLibrarySearch()
+{
+  std::vector<MediaLibrary::Track> tracks;
+  MediaLibrary::Instance()->Search( mpLibrarySearch->text().toUTF8(), sLibraryResults, tracks );
+  mpLibraryResults->clear();
+  mLibraryPaths.clear();
+  for( const auto& t : tracks )
+  {
+    mpLibraryResults->addItem( Wt::WString::fromUTF8( t.Artist + " - " + t.Album + " - " + t.Title ) );
+    mLibraryPaths.push_back( t.Path );
+  }
+  wApp->triggerUpdate();
+}
+
+// The drop down shows the matching streams, and keeps the current one.
+void
+AudioWidget::Private::OnStreamFilter()
+{
+  mpStreams->SetFilter( mpStreamFilter->text().toUTF8() );
+  mpStreams->SetSortByResponse( mpStreamSort && mpStreamSort->isChecked() );
+  Widget<Wt::WComboBox>(Key::Stream)->setCurrentIndex( mpStreams->Row( mState.Stream ) );
+  wApp->triggerUpdate();
+}
+
+void
+AudioWidget::Private::OnStreamsProbed()
+{
+  mpStreams->Refresh();
+  Widget<Wt::WComboBox>(Key::Stream)->setCurrentIndex( mpStreams->Row( mState.Stream ) );
+  wApp->triggerUpdate();
+}
+
+// Like choosing a stream: the track becomes the network stream, and is
+// played with the network play button.
+void
+AudioWidget::Private::OnLibrarySelected( int index )
+{
+  if( index < 0 || size_t( index ) >= mLibraryPaths.size() )
+    return;
+  mState.Stream = mLibraryPaths[index];
+  mpPlayer->Stop();
+  mpHardware->SetState( mState );
+}
+
+void
+AudioWidget::Private::OnEqualizerMoved( int band, int value )
+{
+  mEqualizer.Bands[band].Gain = value;
+  SetEqualizerControls();
+  AudioPipeline::Instance()->SetEqualizer( mEqualizer );
+}
+
+void
+AudioWidget::Private::SetEqualizerControls()
+{
+  for( int i = 0; i < Equalizer::NumBands; ++i )
+  {
+    const Equalizer::Band& b = mEqualizer.Bands[i];
+    std::ostringstream freq;
+    if( b.Freq >= 1000 )
+      freq << b.Freq / 1000 << "kHz";
+    else
+      freq << b.Freq << "Hz";
+    mpTemplate->bindString( "eq-" + std::to_string( i + 1 ) + "-freq", freq.str() );
+    const char* plus = (b.Gain > 0) ? "+" : "";
+    mpEqLabels[i]->setText( Wt::WString("{1}{2}dB").arg(plus).arg(b.Gain) );
+    mpEqSliders[i]->setValue( ::floor( b.Gain + 0.5 ) );
+  }
+  wApp->triggerUpdate();
+}
+
+// Called with new levels, and when the equalizer changed.
+void
+AudioWidget::Private::OnPipelineChanged()
+{
+  Equalizer::Settings eq;
+  AudioPipeline::Instance()->GetEqualizer( eq );
+  if( eq != mEqualizer )
+  {
+    mEqualizer = eq;
+    SetEqualizerControls();
+  }
+
+  Analyzer::Levels levels;
+  std::ostringstream oss;
+  oss << "[";
+  if( AudioPipeline::Instance()->GetLevels( levels ) )
+  {
+    std::vector<float> values( levels.Peak, levels.Peak + 2 );
+    values.insert( values.end(), levels.Rms, levels.Rms + 2 );
+    values.insert( values.end(), levels.Spectrum, levels.Spectrum + Analyzer::Bands );
+    const char* sep = "";
+    for( float db : values )
+    {
+      int below = ::floor( 0.5 - db );
+      oss << sep << std::max( 0, std::min( sMeterRangeDb, below ) );
+      sep = ",";
+    }
+  }
+  oss << "]";
+  // Unchanged levels, e.g. silence, are not sent again.
+  if( oss.str() == mLevels )
+    return;
+  mLevels = oss.str();
+  wApp->doJavaScript( wApp->javaScriptClass() + ".levels('" + mpMeter->id() + "'," + mLevels + ");" );
+  wApp->triggerUpdate();
+}
+
 void
 AudioWidget::Private::SetControlsFromState()
 {
@@ -336,19 +642,14 @@ AudioWidget::Private::SetControlsFromState()
       p->setDisabled( !mState.Power );
   }
   Widget<Wt::WCheckBox>( Key::Mute )->setChecked( mState.Mute );
-  int streamId = std::find(mStreams.begin(), mStreams.end(), mState.Stream) - mStreams.begin();
   auto pDropDown = Widget<Wt::WComboBox>(Key::Stream);
-  if(streamId == mStreams.size())
-  {
-    mStreams.push_back(mState.Stream);
-    pDropDown->addItem(mState.Stream);
-  }
-  pDropDown->setCurrentIndex(streamId);
+  mpStreams->SetCurrent( mState.Stream );
+  pDropDown->setCurrentIndex( mpStreams->Row( mState.Stream ) );
   pDropDown->setToolTip(mState.Stream);
   if(mState.Power)
   {
-    Widget<Wt::WPushButton>(Key::NetworkPlay)->setEnabled(!mState.Stream.empty() && Player::Instance()->IsIdle());
-    Widget<Wt::WPushButton>(Key::NetworkStop)->setEnabled(Player::Instance()->IsPlaying());
+    Widget<Wt::WPushButton>(Key::NetworkPlay)->setEnabled(!mState.Stream.empty() && mpPlayer->IsIdle());
+    Widget<Wt::WPushButton>(Key::NetworkStop)->setEnabled(mpPlayer->IsPlaying());
   }
   Widget<Wt::WCheckBox>( Key::CoupleLR )->setChecked( mCoupleLR );
   mpSourceGroup->setSelectedButtonIndex( mState.Source - Key::SourceCD );
@@ -375,20 +676,29 @@ AudioWidget::Private::SetStateFromControls()
   mState.Source = Key::SourceCD + mpSourceGroup->selectedButtonIndex();
   mCoupleLR = Widget<Wt::WCheckBox>( Key::CoupleLR )->isChecked();
   auto pDropDown = Widget<Wt::WComboBox>(Key::Stream);
-  if(pDropDown->isEnabled() && pDropDown->currentIndex() < mStreams.size())
+  std::string stream = mpStreams->Url( pDropDown->currentIndex() );
+  if(pDropDown->isEnabled() && !stream.empty())
   {
-    if(mState.Stream != mStreams[pDropDown->currentIndex()])
+    if(mState.Stream != stream)
     {
-      mState.Stream = mStreams[pDropDown->currentIndex()];
+      mState.Stream = stream;
       pDropDown->setToolTip(mState.Stream);
       wApp->triggerUpdate();
     }
   }
 }
 
+// The scene comes back through OnHardwareChanged(), and OnPlayerChanged().
+void
+AudioWidget::Private::OnScene( const std::string& name )
+{
+  Scenes::Instance()->Apply( name, mZone );
+}
+
 void
 AudioWidget::Private::OnAction( Wt::WObject* obj, int value )
 {
+  TRACE_SCOPE( "AudioWidget::OnAction" );
   SetStateFromControls();
   int objectID = Id(obj);
   switch( objectID )
@@ -440,25 +750,53 @@ AudioWidget::Private::OnAction( Wt::WObject* obj, int value )
       break;
     case Key::NetworkPlay:
       Widget<Wt::WPushButton>(Key::NetworkPlay)->setEnabled(false);
-      Player::Instance()->Play(mState.Stream);
+      mpPlayer->Play(mState.Stream);
+      break;
+    case Key::NetworkPause:
+      mpPlayer->Pause();
+      OnPlayerChanged();
+      break;
+    case Key::NetworkRewind:
+      mpPlayer->Rewind( 30 );
       break;
+    case Key::NetworkLive:
+      mpPlayer->GoLive();
+      break;
+    case Key::NetworkNext:
+      mpPlayer->Next();
+      break;
+    case Key::LibraryEnqueue:
+    {
+      int index = mpLibraryResults ? mpLibraryResults->currentIndex() : -1;
+      if( index >= 0 && size_t( index ) < mLibraryPaths.size() )
+        mpPlayer->Enqueue( mLibraryPaths[index] );
+      break;
+    }
     case Key::Stream:
-      mState.Stream = mStreams[Widget<Wt::WComboBox>(Key::Stream)->currentIndex()];
+      mState.Stream = mpStreams->Url( Widget<Wt::WComboBox>(Key::Stream)->currentIndex() );
+      // A stream that does not answer is marked down soon.
+      StreamProber::Instance()->Probe( mState.Stream );
+      // With crossfading, a playing stream changes over without stopping.
+      if( mPipeline && AudioPipeline::Crossfades() && mpPlayer->IsPlaying() )
+      {
+        mpPlayer->Switch( mState.Stream );
+        break;
+      }
       /* fall through */
     case Key::NetworkStop:
-      Player::Instance()->Stop();
+      mpPlayer->Stop();
       break;
     case Key::Power:
       if( !mState.Power )
-        Player::Instance()->Stop();
+        mpPlayer->Stop();
       break;
   }
-  Hardware::Instance()->SetState( mState );
+  mpHardware->SetState( mState );
   mState.RemoteKey = Key::None;
 }
 
-AudioWidget::AudioWidget( WContainerWidget* parent )
-: WContainerWidget( parent ), p( new Private( this ) )
+AudioWidget::AudioWidget( WContainerWidget* parent, int zone )
+: WContainerWidget( parent ), p( new Private( this, zone ) )
 {
 }
 
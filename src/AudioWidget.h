@@ -6,7 +6,8 @@
 class AudioWidget : public Wt::WContainerWidget
 {
 public:
-  AudioWidget( Wt::WContainerWidget* parent );
+  // Controls the given zone, see Hardware.h.
+  AudioWidget( Wt::WContainerWidget* parent, int zone = 0 );
   ~AudioWidget();
 private:
   void OnAction_int( int );
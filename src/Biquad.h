@@ -0,0 +1,43 @@
+#ifndef BIQUAD_H
+#define BIQUAD_H
+
+// Second order IIR filter on stereo samples. Both channels go through the
+// filter side by side, as lanes of a GCC vector, which maps to NEON/SSE
+// where available and to paired VFP instructions otherwise.
+typedef float v2f __attribute__(( vector_size( 8 ) ));
+
+struct Biquad
+{
+  v2f b0, b1, b2, a1, a2;
+  v2f z1, z2;
+
+  Biquad() { SetIdentity(); }
+
+  void Set( const double b[3], const double a[3] )
+  {
+    b0 = v2f{} + float( b[0] / a[0] );
+    b1 = v2f{} + float( b[1] / a[0] );
+    b2 = v2f{} + float( b[2] / a[0] );
+    a1 = v2f{} + float( a[1] / a[0] );
+    a2 = v2f{} + float( a[2] / a[0] );
+  }
+  void SetIdentity()
+  {
+    b0 = v2f{} + 1.f;
+    b1 = b2 = a1 = a2 = z1 = z2 = v2f{};
+  }
+  void Clear()
+  {
+    z1 = z2 = v2f{};
+  }
+  // Transposed direct form II
+  v2f operator()( v2f x )
+  {
+    v2f y = b0 * x + z1;
+    z1 = b1 * x - a1 * y + z2;
+    z2 = b2 * x - a2 * y;
+    return y;
+  }
+};
+
+#endif // BIQUAD_H
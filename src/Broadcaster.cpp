@@ -3,30 +3,14 @@
 #include <Wt/WApplication>
 #include <Wt/WServer>
 
-int
-Broadcaster::AddListener( const boost::function< void()>& func )
+std::string
+BroadcasterBase::SessionId()
 {
-  std::lock_guard<std::mutex> lock( mMutex );
-  mListeners.push_back( std::make_pair( wApp->sessionId(), func ) );
-  return mListeners.size();
-}
-
-int
-Broadcaster::RemoveListener()
-{
-  std::lock_guard<std::mutex> lock( mMutex );
-  std::remove_if(
-    mListeners.begin(), mListeners.end(),
-    [](decltype(mListeners.front())& c)
-    { return c.first == wApp->sessionId(); }
-  );
-  return mListeners.size();
+  return wApp->sessionId();
 }
 
 void
-Broadcaster::Broadcast()
+BroadcasterBase::Post( const std::string& sessionId, const boost::function<void()>& func )
 {
-  std::lock_guard<std::mutex> lock( mMutex );
-  for( auto c : mListeners )
-    Wt::WServer::instance()->post(c.first, c.second);
+  Wt::WServer::instance()->post( sessionId, func );
 }
@@ -1,22 +1,114 @@
 #ifndef BROADCASTER_H
 #define BROADCASTER_H
 
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <mutex>
+#include <boost/bind.hpp>
 #include <boost/function.hpp>
 
-class Broadcaster
+// Session access, kept out of the template below.
+class BroadcasterBase
+{
+protected:
+  static std::string SessionId(); // of the current session
+  static void Post( const std::string& sessionId, const boost::function<void()>& );
+};
+
+// Calls listeners with the arguments of each broadcast, in the session
+// that added them.
+template<class... Args>
+class BasicBroadcaster : BroadcasterBase
 {
 public:
-  int AddListener( const boost::function< void()>& );
+  typedef boost::function<void( Args... )> Listener;
+  int AddListener( const Listener& );
   int RemoveListener();
-  int ListenerCount() const { return mListeners.size(); }
+  // Listeners outside of sessions, e.g. of resources shared by all clients,
+  // are called in the broadcasting thread, and must return quickly. They
+  // are called under the lock of the broadcaster, so that none is called
+  // anymore once removed, and must not add or remove listeners themselves.
+  int AddServerListener( const Listener& ); // returns an id
+  int RemoveServerListener( int id );
+  int ListenerCount() const;
 protected:
-  void Broadcast();
+  void Broadcast( const Args&... );
 private:
-  std::vector<std::pair< std::string, boost::function<void()> >> mListeners;
-  std::mutex mMutex;
+  struct Subscription
+  {
+    std::string sessionId; // empty for server listeners
+    int id;
+    Listener func;
+  };
+  std::vector<Subscription> mListeners;
+  int mLastId = 0;
+  mutable std::mutex mMutex;
 };
 
+typedef BasicBroadcaster<> Broadcaster;
+
+template<class... Args>
+int
+BasicBroadcaster<Args...>::AddListener( const Listener& func )
+{
+  std::lock_guard<std::mutex> lock( mMutex );
+  mListeners.push_back( Subscription{ SessionId(), 0, func } );
+  return mListeners.size();
+}
+
+template<class... Args>
+int
+BasicBroadcaster<Args...>::RemoveListener()
+{
+  std::lock_guard<std::mutex> lock( mMutex );
+  std::string sessionId = SessionId();
+  mListeners.erase( std::remove_if(
+    mListeners.begin(), mListeners.end(),
+    [&sessionId]( const Subscription& e ) { return e.sessionId == sessionId; }
+  ), mListeners.end() );
+  return mListeners.size();
+}
+
+template<class... Args>
+int
+BasicBroadcaster<Args...>::AddServerListener( const Listener& func )
+{
+  std::lock_guard<std::mutex> lock( mMutex );
+  mListeners.push_back( Subscription{ std::string(), ++mLastId, func } );
+  return mLastId;
+}
+
+template<class... Args>
+int
+BasicBroadcaster<Args...>::RemoveServerListener( int id )
+{
+  std::lock_guard<std::mutex> lock( mMutex );
+  mListeners.erase( std::remove_if(
+    mListeners.begin(), mListeners.end(),
+    [id]( const Subscription& e ) { return e.sessionId.empty() && e.id == id; }
+  ), mListeners.end() );
+  return mListeners.size();
+}
+
+template<class... Args>
+int
+BasicBroadcaster<Args...>::ListenerCount() const
+{
+  std::lock_guard<std::mutex> lock( mMutex );
+  return mListeners.size();
+}
+
+template<class... Args>
+void
+BasicBroadcaster<Args...>::Broadcast( const Args&... args )
+{
+  std::lock_guard<std::mutex> lock( mMutex );
+  for( const auto& e : mListeners )
+    if( e.sessionId.empty() )
+      e.func( args... );
+    else
+      Post( e.sessionId, boost::bind( e.func, args... ) );
+}
+
 #endif // BROADCASTER_H
@@ -0,0 +1,60 @@
+#include "Clock.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+static std::atomic<bool> sVirtual( false );
+static std::atomic<int64_t> sVirtualNowUs( 0 );
+static int64_t sVirtualBaseUs = 0;
+static time_t sVirtualBaseTime = 0;
+
+int64_t
+Clock::NowUs()
+{
+  if( sVirtual )
+    return sVirtualNowUs;
+  struct timespec t;
+  ::clock_gettime( CLOCK_MONOTONIC, &t );
+  return t.tv_sec * int64_t( 1000000 ) + t.tv_nsec / 1000;
+}
+
+time_t
+Clock::Now()
+{
+  if( sVirtual )
+    return sVirtualBaseTime + (sVirtualNowUs - sVirtualBaseUs) / 1000000;
+  return ::time( nullptr );
+}
+
+void
+Clock::SleepMs( int ms )
+{
+  if( sVirtual )
+    sVirtualNowUs += ms * int64_t( 1000 );
+  else
+    std::this_thread::sleep_for( std::chrono::milliseconds( ms ) );
+}
+
+bool
+Clock::IsVirtual()
+{
+  return sVirtual;
+}
+
+void
+Clock::SetVirtual( int64_t nowUs, time_t wallClock )
+{
+  sVirtualBaseUs = nowUs;
+  sVirtualBaseTime = wallClock;
+  sVirtualNowUs = nowUs;
+  sVirtual = true;
+}
+
+void
+Clock::AdvanceTo( int64_t us )
+{
+  int64_t now = sVirtualNowUs;
+  while( us > now && !sVirtualNowUs.compare_exchange_weak( now, us ) )
+    ;
+}
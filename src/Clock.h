@@ -0,0 +1,21 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <cstdint>
+#include <ctime>
+
+// Time source for the hardware and player state machines.
+// Under replay, time is virtual and advanced by the replay driver.
+class Clock
+{
+public:
+  static int64_t NowUs(); // monotonic
+  static time_t Now(); // wall clock, as ::time()
+  static void SleepMs( int );
+
+  static bool IsVirtual();
+  static void SetVirtual( int64_t nowUs, time_t wallClock );
+  static void AdvanceTo( int64_t us );
+};
+
+#endif // CLOCK_H
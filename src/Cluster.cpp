@@ -0,0 +1,689 @@
+#include "Cluster.h"
+#include "ControlResource.h"
+#include "Log.h"
+#include "Player.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static Cluster::Settings sSettings;
+
+static const int sHeartbeatMs = 1000;
+static const int sPeerTimeoutSeconds = 10;
+// Group parameters that could not be applied, e.g. during a power
+// transition, are retried with each heartbeat for this long.
+static const int sRetrySeconds = 30;
+// Older changes are not applied.
+static const int sApplySeconds = 60;
+static const size_t sMaxDatagram = 1400, sMaxValue = 1024;
+// Clock sync: the offset is that of the round trip with the least delay
+// among the last few, and the drift is fitted to these offsets once they
+// span long enough.
+static const size_t sSyncWindow = 8, sSyncPoints = 64;
+static const int64_t sMinFitSpanUs = 10000000;
+static const double sMaxDrift = 500e-6;
+
+// Datagram: "gs", version, type, node, field count, then per field: name
+// index into sFieldNames, time (us since the epoch), origin node, value
+// length, and value, as in /control. Numbers are big endian.
+static const char sMagic[] = { 'g', 's', 1 };
+static const char* const sFieldNames[] =
+{
+  "Power", "Mute", "Source",
+  "GainCD", "GainAUX", "GainNetwork",
+  "VolumeL", "VolumeR", "Treble", "Bass",
+  "Stream", "Scene", "StartAt",
+};
+static const int sNumFields = sizeof( sFieldNames ) / sizeof( *sFieldNames );
+
+static int FieldIndex( const std::string& name )
+{
+  for( int i = 0; i < sNumFields; ++i )
+    if( name == sFieldNames[i] )
+      return i;
+  return -1;
+}
+
+static int64_t LocalUs()
+{
+  struct timespec t;
+  ::clock_gettime( CLOCK_REALTIME, &t );
+  return t.tv_sec * int64_t( 1000000 ) + t.tv_nsec / 1000 + sSettings.ClockSkewMs * 1000LL;
+}
+
+static void Put( std::string& s, uint64_t value, int bytes )
+{
+  while( bytes-- )
+    s += char( value >> ( 8 * bytes ) );
+}
+
+static bool Get( const std::string& s, size_t& pos, uint64_t& value, int bytes )
+{
+  if( pos + bytes > s.length() )
+    return false;
+  value = 0;
+  while( bytes-- )
+    value = value << 8 | uint8_t( s[pos++] );
+  return true;
+}
+
+static std::string ToString( const sockaddr_in& addr )
+{
+  char buf[INET_ADDRSTRLEN] = "";
+  ::inet_ntop( AF_INET, &addr.sin_addr, buf, sizeof( buf ) );
+  return std::string( buf ) + ":" + std::to_string( ntohs( addr.sin_port ) );
+}
+
+static bool Resolve( const std::string& hostPort, sockaddr_in& addr )
+{
+  size_t colon = hostPort.rfind( ':' );
+  if( colon == std::string::npos )
+    return false;
+  struct addrinfo hints = {}, *ai = nullptr;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  if( ::getaddrinfo( hostPort.substr( 0, colon ).c_str(), hostPort.substr( colon + 1 ).c_str(), &hints, &ai ) || !ai )
+    return false;
+  std::memcpy( &addr, ai->ai_addr, sizeof( addr ) );
+  ::freeaddrinfo( ai );
+  return true;
+}
+
+static bool operator==( const sockaddr_in& a, const sockaddr_in& b )
+{
+  return a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port;
+}
+
+struct Cluster::Private
+{
+  Cluster* mpSelf;
+  uint32_t mNodeId;
+  int64_t mStartUs = LocalUs();
+  int mSocket = -1;
+  sockaddr_in mGroup = {};
+  std::vector<sockaddr_in> mConfigured;
+  std::thread mThread;
+  std::atomic<bool> mRunning { true };
+
+  mutable std::mutex mMutex;
+  struct Version
+  {
+    std::string Value;
+    int64_t TimeUs = 0;
+    uint32_t Origin = 0;
+    bool operator<( const Version& v ) const
+    { return TimeUs < v.TimeUs || ( TimeUs == v.TimeUs && Origin < v.Origin ); }
+  };
+  Version mVersions[sNumFields];
+  // Fields to apply, by index, with the version they are waiting with.
+  std::map<int, std::pair<Version, int64_t>> mPending;
+  struct PeerInfo
+  {
+    sockaddr_in Address;
+    int64_t LastSeenUs;
+  };
+  std::map<uint32_t, PeerInfo> mPeers;
+
+  // Shared clock: offset(t) = mOffsetUs + mDrift * (t - mBaseUs) for
+  // local time t, 0 on the reference node.
+  struct Sample { int64_t LocalUs, OffsetUs, DelayUs; };
+  std::deque<Sample> mSamples, mFiltered;
+  uint32_t mReference = 0;
+  int64_t mBaseUs = 0, mOffsetUs = 0;
+  double mDrift = 0;
+
+  bool Open();
+  uint32_t Reference(); // locked
+  int64_t OffsetUs( int64_t localUs ) const; // locked
+  void Ping();
+  void OnTimes( int type, uint32_t node, const std::vector<int64_t>&,
+                const sockaddr_in& from, int64_t receivedUs );
+  void Fit(); // locked
+  void ThreadFunc();
+  void Receive();
+  void Send( int type, const std::vector<Field>& );
+  void SendHeartbeat();
+  std::vector<Field> Merge( const std::vector<Field>& );
+  void Apply( const std::vector<Field>& );
+  void Retry();
+};
+
+bool
+Cluster::Private::Open()
+{
+  mSocket = ::socket( AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0 );
+  if( mSocket < 0 )
+    return false;
+  int one = 1;
+  ::setsockopt( mSocket, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl( INADDR_ANY );
+  addr.sin_port = htons( sSettings.Port );
+  if( ::bind( mSocket, reinterpret_cast<sockaddr*>( &addr ), sizeof( addr ) ) < 0 )
+  {
+    LOG( Cluster, Error, "Could not bind port {1}: {2}", sSettings.Port, ::strerror( errno ) );
+    return false;
+  }
+  if( !sSettings.Group.empty() )
+  {
+    ip_mreq mreq = {};
+    if( ::inet_pton( AF_INET, sSettings.Group.c_str(), &mreq.imr_multiaddr ) != 1 )
+    {
+      LOG( Cluster, Error, "Invalid multicast group {1}", sSettings.Group );
+      return false;
+    }
+    mreq.imr_interface.s_addr = htonl( INADDR_ANY );
+    unsigned char ttl = 1, loop = 1;
+    if( ::setsockopt( mSocket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof( mreq ) ) < 0 )
+      LOG( Cluster, Error, "Could not join {1}: {2}", sSettings.Group, ::strerror( errno ) );
+    ::setsockopt( mSocket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof( ttl ) );
+    ::setsockopt( mSocket, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof( loop ) );
+    mGroup.sin_family = AF_INET;
+    mGroup.sin_addr = mreq.imr_multiaddr;
+    mGroup.sin_port = htons( sSettings.Port );
+  }
+  for( const auto& peer : sSettings.Peers )
+  {
+    sockaddr_in a;
+    if( Resolve( peer, a ) )
+      mConfigured.push_back( a );
+    else
+      LOG( Cluster, Error, "Could not resolve peer {1}", peer );
+  }
+  return true;
+}
+
+void
+Cluster::Private::ThreadFunc()
+{
+  Trace::SetThreadName( "Cluster" );
+  int64_t nextHeartbeatUs = 0;
+  while( mRunning )
+  {
+    int64_t now = LocalUs();
+    if( now >= nextHeartbeatUs )
+    {
+      SendHeartbeat();
+      Ping();
+      Retry();
+      nextHeartbeatUs = now + sHeartbeatMs * 1000LL;
+    }
+    pollfd fd = { mSocket, POLLIN, 0 };
+    int timeoutMs = std::max<int64_t>( 0, ( nextHeartbeatUs - now ) / 1000 );
+    if( ::poll( &fd, 1, timeoutMs ) > 0 )
+      Receive();
+  }
+}
+
+void
+Cluster::Private::Receive()
+{
+  char buf[sMaxDatagram];
+  sockaddr_in from = {};
+  socklen_t len = sizeof( from );
+  ssize_t n = ::recvfrom( mSocket, buf, sizeof( buf ), 0, reinterpret_cast<sockaddr*>( &from ), &len );
+  int64_t receivedUs = LocalUs();
+  int type;
+  uint32_t node;
+  std::vector<Field> fields;
+  std::vector<int64_t> times;
+  if( n > 0 && DecodeTimes( std::string( buf, n ), type, node, times ) )
+  {
+    if( node != mNodeId )
+      OnTimes( type, node, times, from, receivedUs );
+    return;
+  }
+  if( n <= 0 || !Decode( std::string( buf, n ), type, node, fields ) )
+    return;
+  if( node == mNodeId )
+    return; // looped back from the multicast group
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    auto i = mPeers.find( node );
+    if( i == mPeers.end() )
+      LOG( Cluster, Info, "Peer {1} at {2}", int64_t( node ), ToString( from ) );
+    mPeers[node] = PeerInfo{ from, receivedUs };
+  }
+  Apply( Merge( fields ) );
+}
+
+// Datagrams go to the configured peers, and to the multicast group, or
+// without one, to the peers found.
+void
+Cluster::Private::Send( int type, const std::vector<Field>& fields )
+{
+  std::string data = Encode( type, mNodeId, fields );
+  std::vector<sockaddr_in> targets = mConfigured;
+  if( mGroup.sin_family )
+    targets.push_back( mGroup );
+  else
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    for( const auto& peer : mPeers )
+      if( std::find( targets.begin(), targets.end(), peer.second.Address ) == targets.end() )
+        targets.push_back( peer.second.Address );
+  }
+  for( const auto& addr : targets )
+    ::sendto( mSocket, data.data(), data.size(), MSG_DONTWAIT,
+              reinterpret_cast<const sockaddr*>( &addr ), sizeof( addr ) );
+}
+
+void
+Cluster::Private::SendHeartbeat()
+{
+  std::vector<Field> fields;
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    for( int i = 0; i < sNumFields; ++i )
+      if( mVersions[i].TimeUs )
+        fields.push_back( Field{ sFieldNames[i], mVersions[i].Value, mVersions[i].TimeUs, mVersions[i].Origin } );
+    int64_t expired = LocalUs() - sPeerTimeoutSeconds * 1000000LL;
+    for( auto i = mPeers.begin(); i != mPeers.end(); )
+      if( i->second.LastSeenUs < expired )
+      {
+        LOG( Cluster, Info, "Peer {1} gone", int64_t( i->first ) );
+        i = mPeers.erase( i );
+      }
+      else
+        ++i;
+  }
+  Send( Heartbeat, fields );
+}
+
+// Returns the fields that won, and are recent enough to be applied.
+std::vector<Cluster::Field>
+Cluster::Private::Merge( const std::vector<Field>& fields )
+{
+  std::vector<Field> winners;
+  std::lock_guard<std::mutex> lock( mMutex );
+  int64_t now = LocalUs(), offset = OffsetUs( now ),
+          oldest = std::max<int64_t>( mStartUs, now - sApplySeconds * 1000000LL ) + offset;
+  for( const auto& f : fields )
+  {
+    int i = FieldIndex( f.Name );
+    Version v;
+    v.Value = f.Value;
+    v.TimeUs = f.TimeUs;
+    v.Origin = f.Origin;
+    if( i < 0 || !( mVersions[i] < v ) )
+      continue;
+    mVersions[i] = v;
+    mPending.erase( i );
+    if( v.TimeUs >= oldest )
+      winners.push_back( f );
+  }
+  return winners;
+}
+
+// Power goes first, on its own, as /control ignores other parameters
+// while power is changing. Whatever is ignored waits for a retry. A
+// stream starts when the group's change says.
+void
+Cluster::Private::Apply( const std::vector<Field>& fields )
+{
+  Wt::Http::ParameterMap power, params;
+  int64_t startUs = 0;
+  for( const auto& f : fields )
+    if( f.Name == "StartAt" )
+      startUs = ::atoll( f.Value.c_str() );
+    else
+      ( f.Name == "Power" ? power : params )[f.Name].push_back( f.Value );
+  bool powerOk = power.empty() || ControlResource::Control( power ),
+       ok = powerOk && ( params.empty() || ControlResource::Control( params ) );
+  if( !fields.empty() )
+    LOG( Cluster, Debug, "Applied {1} fields: {2}", int( fields.size() ), ok );
+  auto stream = params.find( "Stream" );
+  if( ok && startUs && stream != params.end() && !stream->second.back().empty() )
+    Player::Instance( ControlResource::Zone( params ) )->Synchronize( startUs, [this]{ return mpSelf->TimeUs(); } );
+  int64_t deadline = LocalUs() + sRetrySeconds * 1000000LL;
+  std::lock_guard<std::mutex> lock( mMutex );
+  for( const auto& f : fields )
+  {
+    int i = FieldIndex( f.Name );
+    if( mVersions[i].TimeUs != f.TimeUs || mVersions[i].Origin != f.Origin )
+      continue; // superseded, and no longer pending
+    if( ok || ( f.Name == "Power" && powerOk ) )
+      mPending.erase( i );
+    else // a retry keeps the deadline of the first attempt
+      mPending.emplace( i, std::make_pair( mVersions[i], deadline ) );
+  }
+}
+
+void
+Cluster::Private::Retry()
+{
+  std::vector<Field> fields;
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    int64_t now = LocalUs();
+    for( auto i = mPending.begin(); i != mPending.end(); )
+    {
+      if( i->second.second < now )
+      {
+        LOG( Cluster, Warning, "Gave up applying {1}", sFieldNames[i->first] );
+        i = mPending.erase( i );
+        continue;
+      }
+      const Version& v = i->second.first;
+      fields.push_back( Field{ sFieldNames[i->first], v.Value, v.TimeUs, v.Origin } );
+      ++i;
+    }
+  }
+  if( !fields.empty() )
+    Apply( fields );
+}
+
+// The node with the lowest id among those heard of.
+uint32_t
+Cluster::Private::Reference()
+{
+  uint32_t reference = mNodeId;
+  for( const auto& peer : mPeers )
+    reference = std::min( reference, peer.first );
+  if( reference != mReference )
+  {
+    LOG( Cluster, Info, "Clock reference is node {1}", int64_t( reference ) );
+    mReference = reference;
+    mSamples.clear();
+    mFiltered.clear();
+    mBaseUs = mOffsetUs = 0;
+    mDrift = 0;
+  }
+  return reference;
+}
+
+int64_t
+Cluster::Private::OffsetUs( int64_t localUs ) const
+{
+  return mOffsetUs + int64_t( mDrift * ( localUs - mBaseUs ) );
+}
+
+void
+Cluster::Private::Ping()
+{
+  sockaddr_in to;
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    uint32_t reference = Reference();
+    if( reference == mNodeId )
+      return;
+    to = mPeers[reference].Address;
+  }
+  std::string data = EncodeTimes( Cluster::Ping, mNodeId, { LocalUs() } );
+  ::sendto( mSocket, data.data(), data.size(), MSG_DONTWAIT, reinterpret_cast<const sockaddr*>( &to ), sizeof( to ) );
+}
+
+// Pings are answered by any node, pongs from the reference are samples
+// of the offset of its clock, t2 - t1 and t3 - t4 averaged, with the
+// delay of the round trip less the time the reference took.
+void
+Cluster::Private::OnTimes( int type, uint32_t node, const std::vector<int64_t>& t,
+                           const sockaddr_in& from, int64_t receivedUs )
+{
+  if( type == Cluster::Ping )
+  {
+    std::string data = EncodeTimes( Pong, mNodeId, { t[0], receivedUs, LocalUs() } );
+    ::sendto( mSocket, data.data(), data.size(), MSG_DONTWAIT, reinterpret_cast<const sockaddr*>( &from ), sizeof( from ) );
+    return;
+  }
+  std::lock_guard<std::mutex> lock( mMutex );
+  if( node != Reference() )
+    return;
+  Sample sample;
+  sample.LocalUs = receivedUs;
+  sample.OffsetUs = ( ( t[1] - t[0] ) + ( t[2] - receivedUs ) ) / 2;
+  sample.DelayUs = ( receivedUs - t[0] ) - ( t[2] - t[1] );
+  if( sample.DelayUs < 0 )
+    return;
+  mSamples.push_back( sample );
+  if( mSamples.size() > sSyncWindow )
+    mSamples.pop_front();
+  Fit();
+}
+
+// Called locked.
+void
+Cluster::Private::Fit()
+{
+  const Sample& best = *std::min_element( mSamples.begin(), mSamples.end(),
+    []( const Sample& a, const Sample& b ) { return a.DelayUs < b.DelayUs; } );
+  if( mFiltered.empty() || mFiltered.back().LocalUs != best.LocalUs )
+    mFiltered.push_back( best );
+  if( mFiltered.size() > sSyncPoints )
+    mFiltered.pop_front();
+  int64_t span = mFiltered.back().LocalUs - mFiltered.front().LocalUs;
+  if( mFiltered.size() < 4 || span < sMinFitSpanUs )
+  {
+    mBaseUs = best.LocalUs;
+    mOffsetUs = best.OffsetUs;
+    mDrift = 0;
+    return;
+  }
+  // Least squares, relative to the first point to keep precision.
+  double n = mFiltered.size(), sx = 0, sy = 0, sxx = 0, sxy = 0;
+  const Sample& first = mFiltered.front();
+  for( const auto& f : mFiltered )
+  {
+    double x = f.LocalUs - first.LocalUs, y = f.OffsetUs - first.OffsetUs;
+    sx += x; sy += y; sxx += x * x; sxy += x * y;
+  }
+  double slope = ( n * sxy - sx * sy ) / ( n * sxx - sx * sx );
+  mDrift = std::max( -sMaxDrift, std::min( sMaxDrift, slope ) );
+  mBaseUs = first.LocalUs + int64_t( sx / n );
+  mOffsetUs = first.OffsetUs + int64_t( sy / n );
+}
+
+std::string
+Cluster::EncodeTimes( int type, uint32_t node, const std::vector<int64_t>& times )
+{
+  std::string s( sMagic, sizeof( sMagic ) );
+  Put( s, type, 1 );
+  Put( s, node, 4 );
+  for( int64_t t : times )
+    Put( s, t, 8 );
+  return s;
+}
+
+bool
+Cluster::DecodeTimes( const std::string& s, int& type, uint32_t& node, std::vector<int64_t>& times )
+{
+  size_t pos = sizeof( sMagic );
+  if( s.compare( 0, pos, sMagic, pos ) )
+    return false;
+  uint64_t t, n, value;
+  if( !Get( s, pos, t, 1 ) || ( t != Ping && t != Pong ) || !Get( s, pos, n, 4 ) )
+    return false;
+  times.clear();
+  while( times.size() < ( t == Ping ? 1u : 3u ) )
+  {
+    if( !Get( s, pos, value, 8 ) )
+      return false;
+    times.push_back( value );
+  }
+  type = t;
+  node = n;
+  return true;
+}
+
+std::string
+Cluster::Encode( int type, uint32_t node, const std::vector<Field>& fields )
+{
+  std::string s( sMagic, sizeof( sMagic ) );
+  Put( s, type, 1 );
+  Put( s, node, 4 );
+  size_t countPos = s.length();
+  Put( s, 0, 1 );
+  int count = 0;
+  for( const auto& f : fields )
+  {
+    int i = FieldIndex( f.Name );
+    size_t length = std::min( f.Value.length(), sMaxValue );
+    if( i < 0 || s.length() + 15 + length > sMaxDatagram || count == 255 )
+      continue;
+    Put( s, i, 1 );
+    Put( s, f.TimeUs, 8 );
+    Put( s, f.Origin, 4 );
+    Put( s, length, 2 );
+    s.append( f.Value, 0, length );
+    ++count;
+  }
+  s[countPos] = char( count );
+  return s;
+}
+
+bool
+Cluster::Decode( const std::string& s, int& type, uint32_t& node, std::vector<Field>& fields )
+{
+  size_t pos = sizeof( sMagic );
+  if( s.compare( 0, pos, sMagic, pos ) )
+    return false;
+  uint64_t t, n, count;
+  if( !Get( s, pos, t, 1 ) || !Get( s, pos, n, 4 ) || !Get( s, pos, count, 1 ) )
+    return false;
+  if( t != Update && t != Heartbeat )
+    return false;
+  type = t;
+  node = n;
+  fields.clear();
+  while( count-- )
+  {
+    uint64_t index, time, origin, length;
+    if( !Get( s, pos, index, 1 ) || !Get( s, pos, time, 8 ) || !Get( s, pos, origin, 4 )
+        || !Get( s, pos, length, 2 ) || pos + length > s.length() )
+      return false;
+    if( index < uint64_t( sNumFields ) )
+      fields.push_back( Field{ sFieldNames[index], s.substr( pos, length ), int64_t( time ), uint32_t( origin ) } );
+    pos += length;
+  }
+  return true;
+}
+
+void
+Cluster::Configure( const Settings& s )
+{
+  sSettings = s;
+}
+
+bool
+Cluster::Enabled()
+{
+  return sSettings.Port > 0;
+}
+
+Cluster*
+Cluster::Instance()
+{
+  static Cluster sInstance;
+  return &sInstance;
+}
+
+Cluster::Cluster()
+: p( new Private )
+{
+  p->mpSelf = this;
+  p->mNodeId = sSettings.NodeId;
+  while( !p->mNodeId )
+    p->mNodeId = std::random_device()();
+  if( !Enabled() || !p->Open() )
+    return;
+  LOG( Cluster, Info, "Node {1} on port {2}", int64_t( p->mNodeId ), sSettings.Port );
+  p->mThread = std::thread( &Private::ThreadFunc, p );
+}
+
+Cluster::~Cluster()
+{
+  p->mRunning = false;
+  if( p->mThread.joinable() )
+    p->mThread.join();
+  if( p->mSocket >= 0 )
+    ::close( p->mSocket );
+  delete p;
+}
+
+bool
+Cluster::Control( const Wt::Http::ParameterMap& params )
+{
+  std::vector<Field> fields;
+  int64_t now = TimeUs();
+  for( const auto& param : params )
+    if( FieldIndex( param.first ) >= 0 && param.first != "StartAt" && !param.second.empty() )
+      fields.push_back( Field{ param.first, param.second.back(), now, p->mNodeId } );
+  auto stream = params.find( "Stream" );
+  bool play = stream != params.end() && !stream->second.empty() && !stream->second.back().empty();
+  int64_t startUs = now + sSettings.StartDelayMs * 1000LL;
+  if( play )
+    fields.push_back( Field{ "StartAt", std::to_string( startUs ), now, p->mNodeId } );
+  p->Merge( fields );
+  if( p->mSocket >= 0 )
+    p->Send( Update, fields );
+  bool ok = ControlResource::Control( params );
+  if( ok && play )
+    Player::Instance( ControlResource::Zone( params ) )->Synchronize( startUs, [this]{ return TimeUs(); } );
+  if( !ok )
+    p->Apply( fields ); // Power first, then retries
+  return ok;
+}
+
+uint32_t
+Cluster::NodeId() const
+{
+  return p->mNodeId;
+}
+
+int64_t
+Cluster::TimeUs() const
+{
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  int64_t now = LocalUs();
+  return now + p->OffsetUs( now );
+}
+
+Cluster::SyncInfo
+Cluster::Sync() const
+{
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  SyncInfo info;
+  info.Reference = p->mReference ? p->mReference : p->mNodeId;
+  info.OffsetUs = p->OffsetUs( LocalUs() );
+  info.DelayUs = p->mSamples.empty() ? 0 : p->mSamples.back().DelayUs;
+  info.DriftPpm = p->mDrift * 1e6;
+  return info;
+}
+
+std::vector<Cluster::Peer>
+Cluster::Peers() const
+{
+  std::vector<Peer> peers;
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  int64_t now = LocalUs();
+  for( const auto& i : p->mPeers )
+    peers.push_back( Peer{ i.first, ToString( i.second.Address ), ( now - i.second.LastSeenUs ) / 1000 } );
+  return peers;
+}
+
+void
+Cluster::WriteVersions( std::ostream& os ) const
+{
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  for( int i = 0; i < sNumFields; ++i )
+  {
+    const Private::Version& v = p->mVersions[i];
+    if( v.TimeUs )
+      os << sFieldNames[i] << "=" << v.Value << "\t" << v.TimeUs << "\t" << v.Origin << "\n";
+  }
+}
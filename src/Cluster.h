@@ -0,0 +1,90 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <Wt/Http/Request>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Group control of several goldstard nodes, e.g. all rooms off, or the same
+// station everywhere: /control?Group=1&... sets the audio parameters given
+// (Power, Mute, Source, gains, volumes, tone, Stream, and Scene, which each
+// node looks up in its own scenes) on all nodes, in their first zone.
+// Each group parameter carries the wall clock time and node of its last
+// change, and the latest change wins, so that nodes agree whatever the
+// order of arrival.
+// Changes go out over UDP at once, and all versions are repeated every
+// second, which bounds the delay after a lost datagram. Peers are given by
+// address, or found through a multicast group, or both. Changes older than
+// a minute, or than the start of a node, are taken note of, not applied.
+// Nodes keep a shared clock, that of the node with the lowest id, from
+// NTP-style round trips once a second: the offset of the round trip with
+// the least delay among the last few, and the drift fitted over the last
+// minutes. A local file set for the group starts at the same time on all
+// nodes, a little later, and follows the shared clock, see Player.h;
+// network streams start at that time, and are not followed after.
+class Cluster
+{
+public:
+  struct Settings
+  {
+    int Port = 0; // UDP, 0 disables the cluster
+    std::vector<std::string> Peers; // host:port, IPv4
+    std::string Group; // multicast address, e.g. 239.255.71.71
+    uint32_t NodeId = 0; // 0 for a random id
+    int StartDelayMs = 1500; // of streams set for the group
+    int ClockSkewMs = 0; // added to the local clock, for testing on one host
+  };
+  static void Configure( const Settings& ); // call before Instance()
+  static bool Enabled();
+  static Cluster* Instance();
+
+  // Applies parameters here, and sends their group parameters to all peers.
+  // Group parameters are those of the first zone of each node.
+  // Returns the local result, as ControlResource::Control().
+  bool Control( const Wt::Http::ParameterMap& );
+
+  uint32_t NodeId() const;
+  // The shared clock, in microseconds since the epoch.
+  int64_t TimeUs() const;
+  struct SyncInfo
+  {
+    uint32_t Reference; // node
+    int64_t OffsetUs, DelayUs; // of the local clock, last round trip
+    double DriftPpm;
+  };
+  SyncInfo Sync() const;
+  struct Peer
+  {
+    uint32_t NodeId;
+    std::string Address;
+    int64_t LastSeenMs; // ago
+  };
+  std::vector<Peer> Peers() const;
+  // Group parameters as "name=value" lines, with time (us) and node.
+  void WriteVersions( std::ostream& ) const;
+
+  // Datagrams, see Cluster.cpp. Decode() skips fields of unknown names.
+  enum { Update = 1, Heartbeat = 2, Ping = 3, Pong = 4 };
+  struct Field
+  {
+    std::string Name, Value;
+    int64_t TimeUs;
+    uint32_t Origin;
+  };
+  static std::string Encode( int type, uint32_t node, const std::vector<Field>& );
+  static bool Decode( const std::string&, int& type, uint32_t& node, std::vector<Field>& );
+  // Ping: sent time; pong: the ping's sent time, received time, and sent time.
+  static std::string EncodeTimes( int type, uint32_t node, const std::vector<int64_t>& );
+  static bool DecodeTimes( const std::string&, int& type, uint32_t& node, std::vector<int64_t>& );
+
+private:
+  Cluster();
+  ~Cluster();
+
+  struct Private;
+  Private* p;
+};
+
+#endif // CLUSTER_H
@@ -0,0 +1,36 @@
+#include "ClusterResource.h"
+#include "Cluster.h"
+#include <Wt/Http/Response>
+
+ClusterResource::ClusterResource(Wt::WObject *parent)
+: Wt::WStreamResource(parent)
+{
+}
+
+ClusterResource::~ClusterResource()
+{
+  beingDeleted();
+}
+
+// This node and its clock sync, then one peer per line: node, address, and milliseconds since
+// it was last heard of, separated by tabs, then the group parameters, with
+// the time and node of their last change.
+void
+ClusterResource::handleRequest( const Wt::Http::Request& req, Wt::Http::Response& rsp )
+{
+  rsp.setMimeType( "text/plain" );
+  if( Cluster::Enabled() )
+  {
+    Cluster& cluster = *Cluster::Instance();
+    Cluster::SyncInfo sync = cluster.Sync();
+    rsp.out() << "Node=" << cluster.NodeId() << "\n";
+    rsp.out() << "ClockReference=" << sync.Reference << "\n";
+    rsp.out() << "ClockOffsetUs=" << sync.OffsetUs << "\n";
+    rsp.out() << "ClockDelayUs=" << sync.DelayUs << "\n";
+    rsp.out() << "ClockDriftPpm=" << sync.DriftPpm << "\n";
+    for( const auto& peer : cluster.Peers() )
+      rsp.out() << "Peer=" << peer.NodeId << '\t' << peer.Address << '\t' << peer.LastSeenMs << '\n';
+    cluster.WriteVersions( rsp.out() );
+  }
+  rsp.out() << std::endl;
+}
@@ -0,0 +1,14 @@
+#ifndef CLUSTER_RESOURCE_H
+#define CLUSTER_RESOURCE_H
+
+#include <Wt/WStreamResource>
+
+class ClusterResource : public Wt::WStreamResource
+{
+public:
+  ClusterResource(Wt::WObject *parent = 0);
+  ~ClusterResource();
+  void handleRequest( const Wt::Http::Request&, Wt::Http::Response& );
+};
+
+#endif // CLUSTER_RESOURCE_H
@@ -1,6 +1,10 @@
 #include "ControlResource.h"
 #include "Hardware.h"
 #include "Player.h"
+#include "AudioPipeline.h"
+#include "TimeShift.h"
+#include "Scenes.h"
+#include "Cluster.h"
 #include <Wt/Http/Response>
 
 ControlResource::ControlResource(Wt::WObject *parent)
@@ -13,100 +17,297 @@ ControlResource::~ControlResource()
   beingDeleted();
 }
 
-void
-ControlResource::handleRequest( const Wt::Http::Request& req, Wt::Http::Response& rsp )
+static const struct { const char* name; float Hardware::State::* value; }
+sNumbers[] =
 {
-  rsp.setMimeType( "text/plain" );
-  bool control = req.path().find( "control" ) != std::string::npos;
-
-  Hardware::State state;
-  Hardware::Instance()->GetState(state);
-
-  static const struct { const char* name; float Hardware::State::* value; }
-  numbers[] =
-  {
 #define _(x) { #x, &Hardware::State::x },
-    _(VolumeL) _(VolumeR) _(Treble) _(Bass) _(GainCD) _(GainAUX) _(GainNetwork) _(AutoPowerOff)
+  _(VolumeL) _(VolumeR) _(Treble) _(Bass) _(GainCD) _(GainAUX) _(GainNetwork) _(AutoPowerOff)
 #undef _
-  };
+};
 
-  if( control )
-  {
-    bool ok = true;
-    const auto& params = req.getParameterMap();
+static int Hex( unsigned char c )
+{
+  if( c >= '0' && c <= '9' )
+    return c - '0';
+  if( c >= 'a' && c <= 'f' )
+    return c - 'a' + 10;
+  if( c >= 'A' && c <= 'F' )
+    return c - 'A' + 10;
+  return -1;
+}
 
-    auto power = params.find( "Power" );
-    if( power != params.end() )
+std::string
+ControlResource::Unescape( const std::string& s )
+{
+  std::string result;
+  for( size_t i = 0; i < s.length(); ++i )
+  {
+    if( s[i] == '%' && i + 2 < s.length() && Hex( s[i+1] ) >= 0 && Hex( s[i+2] ) >= 0 )
     {
-      bool newValue = ::atoi( power->second.back().c_str() );
-      if( !(newValue && state.Power) && params.size() > 1 )
-        ok = false;
-      state.Power = newValue;
+      result += char( Hex( s[i+1] ) << 4 | Hex( s[i+2] ) );
+      i += 2;
     }
-    else if( !state.Power )
+    else
+      result += s[i];
+  }
+  return result;
+}
+
+bool
+ControlResource::ApplyParameters( const Wt::Http::ParameterMap& params,
+                                  Hardware::State& state, bool& streamChanged )
+{
+  bool ok = true;
+
+  auto power = params.find( "Power" );
+  if( power != params.end() )
+  {
+    bool newValue = ::atoi( power->second.back().c_str() );
+    if( !(newValue && state.Power) && params.size() > 1 + params.count( "Zone" ) )
       ok = false;
+    state.Power = newValue;
+  }
+  else if( !state.Power )
+    ok = false;
+
+  for( const auto& n : sNumbers )
+  {
+    auto param = params.find( n.name );
+    if( param != params.end() )
+      state.*n.value = ::atof( param->second.back().c_str() );
+  }
+
+  auto mute = params.find( "Mute" );
+  if( mute != params.end() )
+    state.Mute = ::atoi( mute->second.back().c_str() );
 
-    for( const auto& n : numbers )
+  auto source = params.find( "Source" );
+  if( source != params.end() )
+  {
+    int id = Key::SourceTape;
+    if( source->second.back() == "CD" )
+      id = Key::SourceCD;
+    else if( source->second.back() == "AUX" )
+      id = Key::SourceAUX;
+    else if( source->second.back() == "Network" )
+      id = Key::SourceNetwork;
+    state.Source = id;
+  }
+
+  streamChanged = false;
+  auto stream = params.find( "Stream" );
+  if( stream != params.end() && stream->second.back() != state.Stream )
+  {
+    state.Stream = stream->second.back();
+    streamChanged = true;
+  }
+  return ok;
+}
+
+void
+ControlResource::WriteState( std::ostream& os, const Hardware::State& state )
+{
+  std::string s = "Tape";
+  switch( state.Source )
+  {
+    case Key::SourceCD:
+      s = "CD";
+      break;
+    case Key::SourceAUX:
+      s = "AUX";
+      break;
+    case Key::SourceNetwork:
+      s = "Network";
+      break;
+  }
+  os << "Power=" << state.Power << "\n";
+  os << "Mute=" << state.Mute << "\n";
+  os << "Source=" << s << "\n";
+  for( const auto& n : sNumbers )
+    os << n.name << "=" << state.*n.value << "\n";
+  os << "Stream=" << state.Stream << "\n";
+}
+
+static const struct { const char* name; float Equalizer::Band::* value; }
+sBandNumbers[] =
+{
+#define _(x) { #x, &Equalizer::Band::x },
+  _(Gain) _(Freq) _(Q)
+#undef _
+};
+
+bool
+ControlResource::ApplyEqualizer( const Wt::Http::ParameterMap& params, Equalizer::Settings& eq )
+{
+  bool found = false;
+  for( int i = 0; i < Equalizer::NumBands; ++i )
+    for( const auto& n : sBandNumbers )
     {
-      auto param = params.find( n.name );
+      auto param = params.find( "EQ" + std::to_string( i + 1 ) + n.name );
       if( param != params.end() )
-        state.*n.value = ::atof( param->second.back().c_str() );
+      {
+        eq.Bands[i].*n.value = ::atof( param->second.back().c_str() );
+        found = true;
+      }
     }
+  return found;
+}
 
-    auto mute = params.find( "Mute" );
-    if( mute != params.end() )
-      state.Mute = ::atoi( mute->second.back().c_str() );
+void
+ControlResource::WriteEqualizer( std::ostream& os, const Equalizer::Settings& eq )
+{
+  for( int i = 0; i < Equalizer::NumBands; ++i )
+    for( const auto& n : sBandNumbers )
+      os << "EQ" << i + 1 << n.name << "=" << eq.Bands[i].*n.value << "\n";
+}
 
-    auto source = params.find( "Source" );
-    if( source != params.end() )
-    {
-      int id = Key::SourceTape;
-      if( source->second.back() == "CD" )
-        id = Key::SourceCD;
-      else if( source->second.back() == "AUX" )
-        id = Key::SourceAUX;
-      else if( source->second.back() == "Network" )
-        id = Key::SourceNetwork;
-      state.Source = id;
-    }
+void
+ControlResource::ApplyTimeShift( const Wt::Http::ParameterMap& params )
+{
+  Player& player = *Player::Instance();
+  if( !player.IsTimeShifted() )
+    return;
+  auto rewind = params.find( "Rewind" );
+  if( rewind != params.end() )
+    player.Rewind( ::atoi( rewind->second.back().c_str() ) );
+  auto live = params.find( "Live" );
+  if( live != params.end() && ::atoi( live->second.back().c_str() ) )
+    player.GoLive();
+  auto pause = params.find( "Pause" );
+  if( pause != params.end() && bool( ::atoi( pause->second.back().c_str() ) ) != player.IsPaused() )
+    player.Pause();
+}
 
-    bool streamChanged = false;
-    auto stream = params.find( "Stream" );
-    if( stream != params.end() && stream->second.back() != state.Stream )
-    {
-      state.Stream = stream->second.back();
-      streamChanged = true;
-    }
-    ok = ok && Hardware::Instance()->SetState( state );
-    if( ok && streamChanged )
-    {
-      Player::Instance()->Stop();
-      if( !state.Stream.empty() )
-        Player::Instance()->Play( state.Stream );
-    }
-    rsp.out() << ok << std::endl;
+void
+ControlResource::WriteTimeShift( std::ostream& os )
+{
+  Player& player = *Player::Instance();
+  os << "Paused=" << player.IsPaused() << "\n";
+  os << "TimeShift=" << int( player.TimeShiftDelay() + 0.5 ) << "\n";
+}
+
+void
+ControlResource::ApplyQueue( const Wt::Http::ParameterMap& params, int zone )
+{
+  Player& player = *Player::Instance( zone );
+  auto clear = params.find( "ClearQueue" );
+  if( clear != params.end() && ::atoi( clear->second.back().c_str() ) )
+    player.ClearQueue();
+  auto enqueue = params.find( "Enqueue" );
+  if( enqueue != params.end() )
+    for( const auto& url : enqueue->second )
+      if( !url.empty() )
+        player.Enqueue( url );
+  auto next = params.find( "Next" );
+  if( next != params.end() && ::atoi( next->second.back().c_str() ) )
+    player.Next();
+}
+
+void
+ControlResource::WriteQueue( std::ostream& os, int zone )
+{
+  for( const auto& url : Player::Instance( zone )->Queue() )
+    os << "Queue=" << url << "\n";
+}
+
+int
+ControlResource::Zone( const Wt::Http::ParameterMap& params )
+{
+  auto zone = params.find( "Zone" );
+  if( zone == params.end() )
+    return 0;
+  const std::string& value = zone->second.back();
+  char* end = nullptr;
+  long n = ::strtol( value.c_str(), &end, 10 );
+  if( value.empty() || *end || n < 0 || n >= Hardware::Zones() )
+    return -1;
+  return n;
+}
+
+bool
+ControlResource::Control( const Wt::Http::ParameterMap& params )
+{
+  if( params.count( "Group" ) )
+  {
+    if( params.count( "Zone" ) )
+      return false; // not replicated, nodes apply group changes to their first zone
+    Wt::Http::ParameterMap local = params;
+    local.erase( "Group" );
+    return Cluster::Enabled() ? Cluster::Instance()->Control( local ) : Control( local );
+  }
+  int zone = Zone( params );
+  if( zone < 0 )
+    return false;
+  Hardware::State state;
+  Hardware::Instance( zone )->GetState(state);
+  std::string stream = state.Stream, registers;
+
+  // A scene goes first, further parameters change it, and its registers.
+  auto scene = params.find( "Scene" );
+  if( scene != params.end() && !Scenes::Instance()->Get( scene->second.back(), state, registers ) )
+    return false;
+  if( params.size() > 1 + params.count( "Zone" ) )
+    registers.clear();
+
+  bool streamChanged = false;
+  bool ok = ApplyParameters( params, state, streamChanged );
+  streamChanged = state.Stream != stream;
+  ok = ok && Hardware::Instance( zone )->SetState( state, registers );
+  if( ok && streamChanged )
+  {
+    if( state.Stream.empty() )
+      Player::Instance( zone )->Stop();
+    else
+      Player::Instance( zone )->Switch( state.Stream );
   }
-  else
+  // The equalizer and time shifting belong to the first zone's player.
+  if( ok && zone == 0 && AudioPipeline::Enabled() )
   {
-    std::string s = "Tape";
-    switch( state.Source )
-    {
-      case Key::SourceCD:
-        s = "CD";
-        break;
-      case Key::SourceAUX:
-        s = "AUX";
-        break;
-      case Key::SourceNetwork:
-        s = "Network";
-        break;
-    }
-    rsp.out() << "Power=" << state.Power << "\n";
-    rsp.out() << "Mute=" << state.Mute << "\n";
-    rsp.out() << "Source=" << s << "\n";
-    for( const auto& n : numbers )
-      rsp.out() << n.name << "=" << state.*n.value << "\n";
-    rsp.out() << "Stream=" << state.Stream << "\n";
+    Equalizer::Settings eq;
+    AudioPipeline::Instance()->GetEqualizer( eq );
+    if( ApplyEqualizer( params, eq ) )
+      AudioPipeline::Instance()->SetEqualizer( eq );
+  }
+  if( ok && zone == 0 && !streamChanged && TimeShift::Enabled() )
+    ApplyTimeShift( params );
+  if( ok )
+    ApplyQueue( params, zone );
+  return ok;
+}
+
+void
+ControlResource::WriteAll( std::ostream& os, int zone )
+{
+  Hardware::State state;
+  Hardware::Instance( zone )->GetState(state);
+
+  WriteState( os, state );
+  os << "Title=" << Player::Instance( zone )->StreamTitle() << "\n";
+  if( zone != 0 )
+  {
+    WriteQueue( os, zone );
+    return;
+  }
+  if( AudioPipeline::Enabled() )
+  {
+    Equalizer::Settings eq;
+    AudioPipeline::Instance()->GetEqualizer( eq );
+    WriteEqualizer( os, eq );
   }
+  if( TimeShift::Enabled() )
+    WriteTimeShift( os );
+  WriteQueue( os );
+}
+
+void
+ControlResource::handleRequest( const Wt::Http::Request& req, Wt::Http::Response& rsp )
+{
+  rsp.setMimeType( "text/plain" );
+  bool control = req.path().find( "control" ) != std::string::npos;
+  int zone = Zone( req.getParameterMap() );
+  if( control )
+    rsp.out() << Control( req.getParameterMap() ) << std::endl;
+  else if( zone >= 0 )
+    WriteAll( rsp.out(), zone );
   rsp.out() << std::endl;
 }
@@ -2,6 +2,9 @@
 #define CONTROL_RESOURCE_H
 
 #include <Wt/WStreamResource>
+#include <Wt/Http/Request>
+#include "Hardware.h"
+#include "Equalizer.h"
 
 class ControlResource : public Wt::WStreamResource
 {
@@ -9,6 +12,31 @@ public:
   ControlResource(Wt::WObject *parent = 0);
   ~ControlResource();
   void handleRequest( const Wt::Http::Request&, Wt::Http::Response& );
+
+  // Returns false if the request must be ignored in the current state.
+  static bool ApplyParameters( const Wt::Http::ParameterMap&, Hardware::State&, bool& streamChanged );
+  static void WriteState( std::ostream&, const Hardware::State& );
+  // EQ1Gain, EQ1Freq, EQ1Q, ... Returns true if any parameter was given.
+  static bool ApplyEqualizer( const Wt::Http::ParameterMap&, Equalizer::Settings& );
+  static void WriteEqualizer( std::ostream&, const Equalizer::Settings& );
+  // Pause=0/1, Rewind=<seconds>, Live=1 for time shifted streams, which
+  // only the first zone plays.
+  static void ApplyTimeShift( const Wt::Http::ParameterMap& );
+  static void WriteTimeShift( std::ostream& );
+  // ClearQueue=1, Enqueue=<url> (repeatable), Next=1, in this order.
+  static void ApplyQueue( const Wt::Http::ParameterMap&, int zone = 0 );
+  static void WriteQueue( std::ostream&, int zone = 0 );
+
+  // Zone=<n> selects a zone, see Hardware.h. Returns 0 if not given, and
+  // -1 if not a configured zone.
+  static int Zone( const Wt::Http::ParameterMap& );
+  // %-encoding as in URLs, for parameters given outside of requests.
+  static std::string Unescape( const std::string& );
+  // All of the above, as for /control and /state, after Scene=<name>,
+  // in the zone given. With Group=1, on the first zone of all nodes, see
+  // Cluster.h; Zone is refused then.
+  static bool Control( const Wt::Http::ParameterMap& );
+  static void WriteAll( std::ostream&, int zone = 0 );
 };
 
 #endif // CONTROL_RESOURCE_H
@@ -0,0 +1,40 @@
+#include "Crossfader.h"
+
+#include <algorithm>
+#include <cmath>
+
+Crossfader::Crossfader( int sampleRate, int fadeMs )
+: mLength( std::max( 1, int( int64_t( sampleRate ) * fadeMs / 1000 ) ) ), mPos( mLength )
+{
+}
+
+void
+Crossfader::Start()
+{
+  mPos = 0;
+}
+
+void
+Crossfader::Mix( int16_t* outgoing, const int16_t* incoming, int frames )
+{
+  if( !Active() )
+    return;
+  int fadeFrames = std::min( frames, mLength - mPos );
+  float t0 = float( mPos ) / mLength, t1 = float( mPos + fadeFrames ) / mLength;
+  float out = ::cosf( t0 * float( M_PI_2 ) ), in = ::sinf( t0 * float( M_PI_2 ) ),
+        dOut = (::cosf( t1 * float( M_PI_2 ) ) - out) / fadeFrames,
+        dIn = (::sinf( t1 * float( M_PI_2 ) ) - in) / fadeFrames;
+  for( int i = 0; i < fadeFrames; ++i )
+  {
+    for( int c = 0; c < 2; ++c )
+    {
+      float v = outgoing[2 * i + c] * out + incoming[2 * i + c] * in;
+      outgoing[2 * i + c] = int16_t( std::max( -32768.f, std::min( 32767.f, v ) ) );
+    }
+    out += dOut;
+    in += dIn;
+  }
+  // Past the end of the fade, only the incoming audio remains.
+  std::copy( incoming + 2 * fadeFrames, incoming + 2 * frames, outgoing + 2 * fadeFrames );
+  mPos += fadeFrames;
+}
@@ -0,0 +1,25 @@
+#ifndef CROSSFADER_H
+#define CROSSFADER_H
+
+#include <cstdint>
+
+// Equal-power crossfade between two 16 bit stereo PCM streams. Mix() fades
+// the outgoing audio in place against the incoming one, and does not
+// allocate; gains follow a quarter sine and cosine, and are interpolated
+// linearly within a call.
+class Crossfader
+{
+public:
+  Crossfader( int sampleRate, int fadeMs );
+
+  void Start();
+  bool Active() const { return mPos < mLength; }
+  int FadeFrames() const { return mLength; }
+
+  void Mix( int16_t* outgoing, const int16_t* incoming, int frames );
+
+private:
+  int mLength, mPos;
+};
+
+#endif // CROSSFADER_H
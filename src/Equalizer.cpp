@@ -0,0 +1,220 @@
+#include "Equalizer.h"
+#include "Biquad.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <mutex>
+
+const float Equalizer::sMaxGain = 12;
+
+// Frames are converted to float and filtered in chunks of this size.
+static const int sChunkFrames = 256;
+static const float sMinFreq = 20, sMinQ = 0.1f, sMaxQ = 10;
+
+namespace {
+
+// Filters by band number, and the numbers of the bands in use.
+struct Coefficients
+{
+  Biquad filters[Equalizer::NumBands];
+  int bands[Equalizer::NumBands];
+  int count = 0;
+  float preamp = 1;
+};
+
+// RBJ cookbook shelf and peaking filters.
+void Design( int band, const Equalizer::Band& s, int sampleRate, Biquad& f )
+{
+  double A = ::pow( 10, s.Gain / 40 ),
+         w0 = 2 * M_PI * s.Freq / sampleRate,
+         cosw = ::cos( w0 ),
+         alpha = ::sin( w0 ) / (2 * s.Q),
+         sqrtA2alpha = 2 * ::sqrt( A ) * alpha;
+  double b[3], a[3];
+  if( band == 0 )
+  {
+    b[0] = A * ((A + 1) - (A - 1) * cosw + sqrtA2alpha);
+    b[1] = 2 * A * ((A - 1) - (A + 1) * cosw);
+    b[2] = A * ((A + 1) - (A - 1) * cosw - sqrtA2alpha);
+    a[0] = (A + 1) + (A - 1) * cosw + sqrtA2alpha;
+    a[1] = -2 * ((A - 1) + (A + 1) * cosw);
+    a[2] = (A + 1) + (A - 1) * cosw - sqrtA2alpha;
+  }
+  else if( band == Equalizer::NumBands - 1 )
+  {
+    b[0] = A * ((A + 1) + (A - 1) * cosw + sqrtA2alpha);
+    b[1] = -2 * A * ((A - 1) + (A + 1) * cosw);
+    b[2] = A * ((A + 1) + (A - 1) * cosw - sqrtA2alpha);
+    a[0] = (A + 1) - (A - 1) * cosw + sqrtA2alpha;
+    a[1] = 2 * ((A - 1) - (A + 1) * cosw);
+    a[2] = (A + 1) - (A - 1) * cosw - sqrtA2alpha;
+  }
+  else
+  {
+    b[0] = 1 + alpha * A;
+    b[1] = -2 * cosw;
+    b[2] = 1 - alpha * A;
+    a[0] = 1 + alpha / A;
+    a[1] = -2 * cosw;
+    a[2] = 1 - alpha / A;
+  }
+  f.Set( b, a );
+}
+
+} // namespace
+
+bool
+Equalizer::Settings::operator==( const Settings& s ) const
+{
+  return std::equal( Bands, Bands + NumBands, s.Bands );
+}
+
+struct Equalizer::Private
+{
+  int mSampleRate;
+  mutable std::mutex mMutex;
+  Settings mSettings;
+  Coefficients mPending;
+  std::atomic<bool> mChanged { false };
+
+  // Used by Process() only
+  Biquad mFilters[NumBands];
+  int mBands[NumBands];
+  int mActive = 0;
+  float mPreamp = 1;
+
+  void TakePending();
+};
+
+// Takes over new coefficients, keeping the filter state of each band that
+// stays in use for continuity. Bands coming into use start from rest.
+void
+Equalizer::Private::TakePending()
+{
+  bool active[NumBands] = {};
+  for( int i = 0; i < mActive; ++i )
+    active[mBands[i]] = true;
+  for( int i = 0; i < NumBands; ++i )
+  {
+    v2f z1 = mFilters[i].z1, z2 = mFilters[i].z2;
+    mFilters[i] = mPending.filters[i];
+    if( active[i] )
+    {
+      mFilters[i].z1 = z1;
+      mFilters[i].z2 = z2;
+    }
+  }
+  std::copy( mPending.bands, mPending.bands + mPending.count, mBands );
+  mActive = mPending.count;
+  mPreamp = mPending.preamp;
+}
+
+Equalizer::Equalizer( int sampleRate )
+: p( new Private )
+{
+  p->mSampleRate = sampleRate;
+}
+
+Equalizer::~Equalizer()
+{
+  delete p;
+}
+
+void
+Equalizer::Set( const Settings& s )
+{
+  Settings settings = s;
+  Coefficients c;
+  float maxBoost = 0;
+  for( int i = 0; i < NumBands; ++i )
+  {
+    Band& b = settings.Bands[i];
+    b.Gain = std::max( -sMaxGain, std::min( sMaxGain, b.Gain ) );
+    b.Freq = std::max( sMinFreq, std::min( 0.45f * p->mSampleRate, b.Freq ) );
+    b.Q = std::max( sMinQ, std::min( sMaxQ, b.Q ) );
+    if( b.Gain != 0 )
+    {
+      Design( i, b, p->mSampleRate, c.filters[i] );
+      c.bands[c.count++] = i;
+    }
+    maxBoost = std::max( maxBoost, b.Gain );
+  }
+  // Headroom for the largest boost, so that full scale input does not clip.
+  c.preamp = ::pow( 10, -maxBoost / 20 );
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  p->mSettings = settings;
+  p->mPending = c;
+  p->mChanged.store( true, std::memory_order_release );
+}
+
+void
+Equalizer::Get( Settings& s ) const
+{
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  s = p->mSettings;
+}
+
+void
+Equalizer::Process( int16_t* pcm, int frames )
+{
+  if( p->mChanged.load( std::memory_order_acquire ) && p->mMutex.try_lock() )
+  {
+    p->TakePending();
+    p->mChanged = false;
+    p->mMutex.unlock();
+  }
+  if( p->mActive == 0 )
+    return;
+
+  const float in = p->mPreamp / 32768;
+  const v2f out = v2f{} + 32768.f, hi = v2f{} + 32767.f, lo = v2f{} - 32768.f;
+  v2f buf[sChunkFrames];
+  for( int done = 0, n = 0; done < frames; done += n )
+  {
+    n = std::min( sChunkFrames, frames - done );
+    int16_t* s = pcm + 2 * done;
+    for( int i = 0; i < n; ++i )
+      buf[i] = v2f{ s[2 * i] * in, s[2 * i + 1] * in };
+    for( int b = 0; b < p->mActive; ++b )
+    {
+      Biquad& filter = p->mFilters[p->mBands[b]];
+      Biquad f = filter;
+      for( int i = 0; i < n; ++i )
+        buf[i] = f( buf[i] );
+      filter = f;
+    }
+    for( int i = 0; i < n; ++i )
+    {
+      v2f y = buf[i] * out;
+      y = y > hi ? hi : y;
+      y = y < lo ? lo : y;
+      s[2 * i] = ::lrintf( y[0] );
+      s[2 * i + 1] = ::lrintf( y[1] );
+    }
+  }
+}
+
+// One line per band: gain, frequency, Q.
+bool
+Equalizer::Load( const std::string& path, Settings& s )
+{
+  std::ifstream f( path );
+  Settings settings;
+  for( auto& b : settings.Bands )
+    f >> b.Gain >> b.Freq >> b.Q;
+  if( f.fail() )
+    return false;
+  s = settings;
+  return true;
+}
+
+bool
+Equalizer::Save( const std::string& path, const Settings& s )
+{
+  std::ofstream f( path );
+  for( const auto& b : s.Bands )
+    f << b.Gain << ' ' << b.Freq << ' ' << b.Q << '\n';
+  return !f.fail();
+}
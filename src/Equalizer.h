@@ -0,0 +1,46 @@
+#ifndef EQUALIZER_H
+#define EQUALIZER_H
+
+#include <cstdint>
+#include <string>
+
+// Parametric equalizer for 16 bit stereo PCM: a low shelf, peaking bands,
+// and a high shelf, as a cascade of biquads (RBJ audio EQ cookbook).
+// Settings may be changed from any thread; Process() does not allocate
+// or block, and picks up new settings at its next call.
+class Equalizer
+{
+public:
+  enum { NumBands = 5 };
+  static const float sMaxGain;
+  struct Band
+  {
+    float Gain, Freq, Q;
+    bool operator==( const Band& b ) const
+    { return Gain == b.Gain && Freq == b.Freq && Q == b.Q; }
+  };
+  struct Settings
+  {
+    Band Bands[NumBands] =
+    {
+      { 0, 60, 0.7f }, { 0, 250, 1 }, { 0, 1000, 1 }, { 0, 4000, 1 }, { 0, 12000, 0.7f },
+    };
+    bool operator==( const Settings& ) const;
+    bool operator!=( const Settings& s ) const { return !(*this == s); }
+  };
+  static bool Load( const std::string& path, Settings& );
+  static bool Save( const std::string& path, const Settings& );
+
+  Equalizer( int sampleRate = 44100 );
+  ~Equalizer();
+
+  void Set( const Settings& );
+  void Get( Settings& ) const;
+  void Process( int16_t*, int frames );
+
+private:
+  struct Private;
+  Private* p;
+};
+
+#endif // EQUALIZER_H
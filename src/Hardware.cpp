@@ -1,10 +1,17 @@
 #include "Hardware.h"
 
 #include "Broadcaster.h"
+#include "Clock.h"
+#include "Log.h"
+#include "Recorder.h"
 
 #include "RemoteControl.h"
+#include "SharedState.h"
 #include "TDA7318.h"
+#include "Trace.h"
 
+#include <atomic>
+#include <mutex>
 #include <thread>
 #include <condition_variable>
 #include <cassert>
@@ -17,34 +24,71 @@
 # define I2C_SLAVE 0x0703
 #endif
 
-static const char* sI2cBus = "/dev/i2c-1";
+static Hardware::Settings sSettings[Hardware::MaxZones];
+static int sZones = 1;
+static const char* const sThreadNames[Hardware::MaxZones] =
+  { "Hardware", "Hardware 1", "Hardware 2", "Hardware 3" };
 
 static const int sTimerIntervalMs = 500;
 static const int sStateUpdateIntervalSeconds = 2;
 
-static bool SaveState( const Hardware::State& s, const std::string& path )
+static void WriteState( std::ostream& f, const Hardware::State& s )
 {
-  std::ofstream f( path );
   union { const void* p; const char* c; }
     begin = { &s },
     end = { &s.Stream };
   f.write( begin.c, end.c - begin.c );
   f.write( s.Stream.c_str(), s.Stream.length() + 1 );
-  return f;
 }
 
-static bool RestoreState( Hardware::State& s, const std::string& path )
+static void ReadState( std::istream& f, Hardware::State& s )
 {
-  std::ifstream f( path );
   union { void* p; char* c; }
     begin = { &s },
     end = { &s.Stream };
   f.read( begin.c, end.c - begin.c );
   std::getline( f, s.Stream, '\0' );
-  return f;
 }
 
-static int StateToTDA7318(const Hardware::State& s, char* buf, bool mutedTransition)
+static std::string EncodeState( const Hardware::State& s )
+{
+  std::ostringstream oss;
+  WriteState( oss, s );
+  return oss.str();
+}
+
+static bool DecodeState( const std::string& data, Hardware::State& s )
+{
+  std::istringstream iss( data );
+  ReadState( iss, s );
+  return !iss.fail();
+}
+
+static bool SaveState( const Hardware::State& s, const std::string& path )
+{
+  if( Recorder::Replaying() )
+    return true;
+  std::ofstream f( path );
+  WriteState( f, s );
+  return !f.fail();
+}
+
+static bool RestoreState( Hardware::State& s, const std::string& path, bool recorded )
+{
+  std::string data;
+  if( recorded && Recorder::Replaying() )
+    return Recorder::Replay( Recorder::RestoredState, data ) && DecodeState( data, s );
+  std::ifstream f( path );
+  ReadState( f, s );
+  if( f.fail() )
+    return false;
+  if( recorded )
+    Recorder::Record( Recorder::RestoredState, EncodeState( s ) );
+  return true;
+}
+
+int
+Hardware::StateToTDA7318(const State& s, char* buf, bool mutedTransition)
 {
   unsigned int source = 0;
   float gain = 0;
@@ -138,7 +182,11 @@ struct Hardware::Private : Broadcaster
     time_t ts = 0, change_ts = 0;
     using State::operator=;
   } mCurrentState, mNextState;
-  std::string mStatePath = "/var/local/" APPNAME "/state";
+  // Register image of mNextState given with it, empty if none.
+  std::string mNextRegisters;
+  const int mZone;
+  const Settings& mSettings;
+  std::string mStatePath;
 
   bool mPowerTransition = false;
   RemoteControl mRemote;
@@ -148,7 +196,17 @@ struct Hardware::Private : Broadcaster
 
   std::thread* mpThread;
   int mTimerInterval = -1;
-  enum { None, SetState, Wakeup, Stop };
+  int64_t mWaitBeginUs = 0;
+  int mReplayListeners = 0;
+  std::atomic<float> mNetworkGainOffset { 0 };
+
+  // To listeners, and to the shared state, see SharedState.h.
+  void Broadcast()
+  {
+    Broadcaster::Broadcast();
+    SharedState::Changed();
+  }
+  enum { None, SetState, Wakeup, ApplyGain, Stop };
   struct
   {
     void Set( int code )
@@ -157,6 +215,15 @@ struct Hardware::Private : Broadcaster
       what = code;
       cond.notify_one();
     }
+    void SetIfNone( int code )
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if( what == None )
+      {
+        what = code;
+        cond.notify_one();
+      }
+    }
     int Wait( int timeoutMs )
     {
       auto wakeIf = [this](){ return what != None; };
@@ -169,26 +236,28 @@ struct Hardware::Private : Broadcaster
       what = None;
       return result;
     }
+    int Take()
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      int result = what;
+      what = None;
+      return result;
+    }
     int what;
     std::mutex mutex;
     std::condition_variable cond;
   } mTrigger;
 
-  Private()
-  : mpThread( nullptr )
+  Private( int zone )
+  : mZone( zone ), mSettings( sSettings[zone] ), mStatePath( mSettings.StateFile ),
+    mRemote( mSettings.LircSocket, Recorded() ), mTDA7318( -1 ), mpThread( nullptr )
   {
-    mTDA7318 = ::open( sI2cBus, O_RDWR );
-    if( mTDA7318 >= 0 && ::ioctl( mTDA7318, I2C_SLAVE, TDA7318::Address ) < 0 )
-    {
-      ::close( mTDA7318 );
-      mTDA7318 = -1;
-    }
-    if( mTDA7318 < 0 )
-      Wt::log("error") << "Could not open " << sI2cBus << ": " << ::strerror(errno);
-    if( RestoreState( mCurrentState, mStatePath ) )
-      Wt::log("info") << "Restored state from " << mStatePath;
+    if( !Replaying() )
+      OpenBus();
+    if( RestoreState( mCurrentState, mStatePath, Recorded() ) )
+      LOG( Hardware, Info, "Restored state from {1}", mStatePath );
     else
-      Wt::log("error") << "Could not restore state from " << mStatePath;
+      LOG( Hardware, Error, "Could not restore state from {1}", mStatePath );
     mCurrentState.Power = IsPoweredOn();
   }
 
@@ -198,6 +267,22 @@ struct Hardware::Private : Broadcaster
     ::close(mTDA7318);
   }
 
+  void OpenBus()
+  {
+    const char* bus = mSettings.I2cBus.c_str();
+    mTDA7318 = ::open( bus, O_RDWR | O_CLOEXEC );
+    // A regular file stands in for the bus when testing without hardware.
+    struct stat st;
+    if( mTDA7318 >= 0 && !::fstat( mTDA7318, &st ) && S_ISCHR( st.st_mode )
+        && ::ioctl( mTDA7318, I2C_SLAVE, mSettings.I2cAddress ) < 0 )
+    {
+      ::close( mTDA7318 );
+      mTDA7318 = -1;
+    }
+    if( mTDA7318 < 0 )
+      LOG( Hardware, Error, "Could not open {1}: {2}", bus, ::strerror(errno) );
+  }
+
   void StartThread()
   {
     if( !mpThread )
@@ -209,43 +294,140 @@ struct Hardware::Private : Broadcaster
 
   void StopThread()
   {
+    if( !mpThread )
+      return;
     mTrigger.Set(Stop);
     mpThread->join();
     delete mpThread;
     mpThread = nullptr;
   }
 
+  // For callers not holding mNextState.mutex, e.g. scheduled ones: writes
+  // a copy of the next state, taken under the lock, without holding it.
   bool ApplyAudioConfig( int maxTries )
   {
+    State next;
+    std::string registers;
+    {
+      std::lock_guard<std::mutex> lock( mNextState.mutex );
+      next = mNextState;
+      registers = mNextRegisters;
+    }
+    return WriteAudioConfig( next, registers, maxTries );
+  }
+
+  // With mNextState.mutex held, or with copies of mNextState and mNextRegisters.
+  bool WriteAudioConfig( State s, const std::string& registers, int maxTries )
+  {
+    TRACE_SCOPE( "Hardware::ApplyAudioConfig" );
     char buf[8];
-    int len = StateToTDA7318(mNextState, buf, mNextState.Source != mCurrentState.Source);
-    while( ::write(mTDA7318, buf, len) != len && --maxTries > 0 )
-      std::this_thread::sleep_for( std::chrono::milliseconds(50) );
+    const char* data = buf;
+    bool transition = s.Source != mCurrentState.Source;
+    int len = 0;
+    // A precomputed image holds no transition, and no network gain offset.
+    if( !registers.empty() && !transition
+        && ( s.Source != Key::SourceNetwork || mNetworkGainOffset == 0 ) )
+    {
+      data = registers.data();
+      len = registers.length();
+    }
+    else
+    {
+      if( s.Source == Key::SourceNetwork )
+        s.GainNetwork += mNetworkGainOffset;
+      len = StateToTDA7318(s, buf, transition);
+    }
+    while( !WriteI2c( data, len ) && --maxTries > 0 )
+      Clock::SleepMs( 50 );
     if( maxTries <= 0 )
-      Wt::log("error") << "i2c: " << ::strerror(errno);
+      LOG( Hardware, Error, "i2c: {1}", ::strerror(errno) );
     return maxTries > 0;
   }
 
+  // Recording and replay cover the first zone.
+  bool Recorded() const { return mZone == 0; }
+  bool Replaying() const { return Recorded() && Recorder::Replaying(); }
+  void Record( int event, const std::string& data )
+  {
+    if( Recorded() )
+      Recorder::Record( event, data );
+  }
+  void Record( int event, bool data )
+  {
+    if( Recorded() )
+      Recorder::Record( event, data );
+  }
+
+  bool WriteI2c( const char* buf, int len )
+  {
+    if( Replaying() )
+      return Recorder::Replay( Recorder::I2cWrite, true );
+    bool ok = ::write(mTDA7318, buf, len) == len;
+    Record( Recorder::I2cWrite, ok );
+    return ok;
+  }
+
   static void ThreadFunc( Private* p )
   {
+    Trace::SetThreadName( sThreadNames[p->mZone] );
     p->mTimerInterval = -1;
-    while( true ) switch( p->mTrigger.Wait( p->mTimerInterval ) )
+    int what;
+    while( (what = p->Wait()) != Stop )
+      p->Dispatch( what );
+  }
+
+  void Dispatch( int what )
+  {
+    switch( what )
     {
       case None:
-        p->OnTimer();
+        OnTimer();
         break;
       case SetState:
-        p->OnSetState();
+        OnSetState();
         break;
       case Wakeup:
-        Wt::log("info") << "Hardware: Waking up";
-        p->mTimerInterval = sTimerIntervalMs;
+        LOG( Hardware, Info, "Waking up" );
+        mTimerInterval = sTimerIntervalMs;
         break;
-      case Stop:
-        return;
+      case ApplyGain:
+        OnApplyGain();
+        break;
+    }
+  }
+
+  // Replay counterpart of ThreadFunc, runs whatever is due at the current
+  // virtual time, and returns the time of the next timer event, or -1.
+  int64_t ProcessEvents()
+  {
+    while( true )
+    {
+      int what = mTrigger.Take();
+      if( what == None )
+      {
+        if( mTimerInterval < 0 )
+          return -1;
+        int64_t due = mWaitBeginUs + mTimerInterval * int64_t( 1000 );
+        if( Clock::NowUs() < due )
+          return due;
+      }
+      if( what != Stop )
+        Dispatch( what );
+      mWaitBeginUs = Clock::NowUs();
     }
   }
 
+  int Listeners() const
+  {
+    return Replaying() ? mReplayListeners : ListenerCount();
+  }
+
+  int Wait()
+  {
+    TRACE_SCOPE( "Hardware::Wait" );
+    return mTrigger.Wait( mTimerInterval );
+  }
+
   void Schedule( time_t when, const boost::function<void()>& what )
   {
     mSchedule.push_back( std::make_pair( when, what ) );
@@ -253,8 +435,9 @@ struct Hardware::Private : Broadcaster
 
   void OnTimer()
   {
+    TRACE_SCOPE( "Hardware::OnTimer" );
     bool changed = false;
-    time_t now = ::time( nullptr );
+    time_t now = Clock::Now();
     if( mPowerTransition || (now > mCurrentState.ts + sStateUpdateIntervalSeconds) )
     {
       std::lock_guard<std::mutex> lock( mCurrentState.mutex );
@@ -268,9 +451,9 @@ struct Hardware::Private : Broadcaster
           if(!poweredOn)
           {
             if( SaveState( mCurrentState, mStatePath ) )
-              Wt::log("info") << "Saved state to " << mStatePath;
+              LOG( Hardware, Info, "Saved state to {1}", mStatePath );
             else
-              Wt::log("error") << "Could not save state to " << mStatePath;
+              LOG( Hardware, Error, "Could not save state to {1}", mStatePath );
           }
         }
         if(poweredOn)
@@ -306,9 +489,9 @@ struct Hardware::Private : Broadcaster
           }
         }
       }
-      if( ListenerCount() == 0 && !poweredOn )
+      if( Listeners() == 0 && !poweredOn )
       {
-        Wt::log("info") << "Hardware: Going to sleep";
+        LOG( Hardware, Info, "Going to sleep" );
         mTimerInterval = -1;
       }
     }
@@ -332,6 +515,7 @@ struct Hardware::Private : Broadcaster
 
   void OnSetState()
   {
+    TRACE_SCOPE( "Hardware::OnSetState" );
     bool changed = false;
     {
       std::lock_guard<std::mutex> lock1( mCurrentState.mutex );
@@ -356,12 +540,12 @@ struct Hardware::Private : Broadcaster
       {
         changed = true;
         mRemote.SendOnce( key );
-        Schedule( ::time(nullptr) + 1, boost::bind( &Private::ApplyAudioConfig, this, 10 ) );
+        Schedule( Clock::Now() + 1, boost::bind( &Private::ApplyAudioConfig, this, 10 ) );
       }
 
       if( mCurrentState.Power && mNextState.Power )
       {
-        if( ApplyAudioConfig( 10 ) )
+        if( WriteAudioConfig( mNextState, mNextRegisters, 10 ) )
         {
           changed = true;
           mCurrentState.State::operator=( mNextState );
@@ -371,34 +555,70 @@ struct Hardware::Private : Broadcaster
     if( changed )
     {
       Broadcast();
-      mCurrentState.change_ts = ::time(nullptr);
+      mCurrentState.change_ts = Clock::Now();
     }
   }
 
+  void OnApplyGain()
+  {
+    std::lock_guard<std::mutex> lock1( mCurrentState.mutex );
+    std::lock_guard<std::mutex> lock2( mNextState.mutex );
+    if( mCurrentState.Power && mNextState.Power && !mPowerTransition )
+      WriteAudioConfig( mNextState, mNextRegisters, 10 );
+  }
+
   bool IsPoweredOn()
   {
-    int fd = ::open("/var/local/" APPNAME "/powersensor", O_RDONLY | O_CLOEXEC);
+    if( Replaying() )
+      return Recorder::Replay( Recorder::PowerSensor, false );
+    bool on = ReadPowerSensor();
+    Record( Recorder::PowerSensor, on );
+    return on;
+  }
+
+  bool ReadPowerSensor()
+  {
+    int fd = ::open(mSettings.PowerSensor.c_str(), O_RDONLY | O_CLOEXEC);
     if(fd < 0)
       return false;
     char c = '0';
-    if(::read(fd, &c, 1) != 1)
-      return false;
+    int r = ::read(fd, &c, 1);
     ::close(fd);
-    return c == '1';
+    return r == 1 && c == '1';
   }
 };
 
+void
+Hardware::Configure( const Settings& s, int zone )
+{
+  sSettings[zone] = s;
+  sZones = std::max( sZones, zone + 1 );
+}
+
+int
+Hardware::Zones()
+{
+  return sZones;
+}
+
 Hardware*
-Hardware::Instance()
+Hardware::Instance( int zone )
 {
-  static Hardware sHardware;
-  return &sHardware;
+  static struct Instances
+  {
+    Hardware* zones[MaxZones] = {};
+    std::once_flag once[MaxZones];
+    ~Instances() { for( auto p : zones ) delete p; }
+  } sInstances;
+  std::call_once( sInstances.once[zone], [zone]{ sInstances.zones[zone] = new Hardware( zone ); } );
+  return sInstances.zones[zone];
 }
 
-Hardware::Hardware()
-: p( new Private )
+Hardware::Hardware( int zone )
+: p( new Private( zone ) )
 {
-  p->StartThread();
+  if( !p->Replaying() )
+    p->StartThread();
 }
 
 Hardware::~Hardware()
@@ -410,27 +630,66 @@ Hardware::~Hardware()
 void
 Hardware::AddListener( const boost::function<void()>& func )
 {
-  if( p->AddListener( func ) == 1 )
+  int count = p->AddListener( func );
+  p->Record( Recorder::Listeners, std::to_string( count ) );
+  if( count == 1 )
     p->mTrigger.Set( Private::Wakeup );
 }
 
 void
 Hardware::RemoveListener()
 {
-  p->RemoveListener();
+  int count = p->RemoveListener();
+  p->Record( Recorder::Listeners, std::to_string( count ) );
+}
+
+int
+Hardware::AddServerListener( const boost::function<void()>& func )
+{
+  int id = p->AddServerListener( func ), count = p->ListenerCount();
+  p->Record( Recorder::Listeners, std::to_string( count ) );
+  if( count == 1 )
+    p->mTrigger.Set( Private::Wakeup );
+  return id;
+}
+
+void
+Hardware::RemoveServerListener( int id )
+{
+  int count = p->RemoveServerListener( id );
+  p->Record( Recorder::Listeners, std::to_string( count ) );
 }
 
 bool
 Hardware::SetState( const State& s )
 {
+  return SetState( s, "" );
+}
+
+bool
+Hardware::SetState( const State& s, const std::string& registers )
+{
+  TRACE_SCOPE( "Hardware::SetState" );
+  if( p->Recorded() && Recorder::Recording() )
+    Recorder::Record( Recorder::ControlState, EncodeState( s ) );
   std::lock_guard<std::mutex> lock( p->mNextState.mutex );
   if( p->mPowerTransition )
     return false;
   p->mNextState = s;
+  p->mNextRegisters = registers;
   p->mTrigger.Set( Private::SetState );
   return true;
 }
 
+void
+Hardware::SetNetworkGainOffset( float offset )
+{
+  if( p->mNetworkGainOffset.exchange( offset ) == offset )
+    return;
+  // A pending state change applies the offset as well.
+  p->mTrigger.SetIfNone( Private::ApplyGain );
+}
+
 void
 Hardware::GetState( State& s )
 {
@@ -438,4 +697,31 @@ Hardware::GetState( State& s )
   s = p->mCurrentState;
 }
 
+void
+Hardware::Replay( int event, const std::string& data )
+{
+  switch( event )
+  {
+    case Recorder::ControlState:
+    {
+      State s;
+      if( DecodeState( data, s ) )
+        SetState( s );
+      break;
+    }
+    case Recorder::Listeners:
+    {
+      int count = ::atoi( data.c_str() );
+      if( count > p->mReplayListeners && count == 1 )
+        p->mTrigger.Set( Private::Wakeup );
+      p->mReplayListeners = count;
+      break;
+    }
+  }
+}
 
+int64_t
+Hardware::ProcessEvents()
+{
+  return p->ProcessEvents();
+}
@@ -1,7 +1,9 @@
 #ifndef HARDWARE_H
 #define HARDWARE_H
 
+#include "TDA7318.h"
 #include <string>
+#include <cstdint>
 
 namespace Key
 {
@@ -18,6 +20,18 @@ namespace Key
 
     Count
   };
+
+  // Sources as numbered on the wire, from 0 for SourceCD to 3 for
+  // SourceTape, see UdpProtocol.h and StateSegment.h; 4 if unknown.
+  enum { NumSources = SourceTape - SourceCD + 1 };
+  inline int SourceIndex( int source )
+  {
+    return source >= SourceCD && source <= SourceTape ? source - SourceCD : NumSources;
+  }
+  inline int SourceAt( int index )
+  {
+    return index >= 0 && index < NumSources ? SourceCD + index : SourceUnknown;
+  }
 } // namespace
 
 class Hardware
@@ -33,15 +47,47 @@ public:
     std::string Stream;
     float AutoPowerOff = 4*24*3600;
   };
-  static Hardware* Instance();
+  // Device and file locations, may be pointed at stand-ins for testing.
+  struct Settings
+  {
+    std::string I2cBus = "/dev/i2c-1",
+      StateFile = "/var/local/" APPNAME "/state",
+      PowerSensor = "/var/local/" APPNAME "/powersensor",
+      LircSocket = "/var/run/lirc/lircd";
+    int I2cAddress = TDA7318::Address;
+  };
+  // Each zone is an amplifier of its own, with its own bus or address,
+  // state file, and remote control. Zones are numbered from 0, which is
+  // the zone that recording and replay cover, see Recorder.h.
+  enum { MaxZones = 4 };
+  static void Configure( const Settings&, int zone = 0 ); // call before Instance()
+  static int Zones(); // configured zones
+  static Hardware* Instance( int zone = 0 );
 
   void AddListener( const boost::function<void()>& );
   void RemoveListener();
+  // See Broadcaster.h, keeps the hardware awake like session listeners.
+  int AddServerListener( const boost::function<void()>& ); // returns an id
+  void RemoveServerListener( int id );
   bool SetState( const State& );
+  // With the register image of the state, as computed by StateToTDA7318()
+  // without a muted transition, to be written as is when it applies.
+  bool SetState( const State&, const std::string& registers );
   void GetState( State& );
+  // Added to GainNetwork when writing registers, not part of the state.
+  void SetNetworkGainOffset( float );
+
+  // Encodes a state into TDA7318 register writes, returns the number of bytes.
+  static int StateToTDA7318( const State&, char* buf, bool mutedTransition );
+
+  // Replay of recorded inputs under the virtual clock, see Recorder.h.
+  // Without a worker thread, ProcessEvents() runs what is due, and returns
+  // the time of the next timer event, or -1.
+  void Replay( int event, const std::string& data );
+  int64_t ProcessEvents();
 
 private:
-  Hardware();
+  Hardware( int zone );
   ~Hardware();
 
   struct Private;
@@ -0,0 +1,128 @@
+#include "HttpStream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+bool
+HttpStream::ParseUrl( const std::string& url, Url& u )
+{
+  if( url.compare( 0, 7, "http://" ) )
+    return false;
+  u.HostPort = url.substr( 7 );
+  u.Path = "/";
+  size_t slash = u.HostPort.find( '/' );
+  if( slash != std::string::npos )
+  {
+    u.Path = u.HostPort.substr( slash );
+    u.HostPort.erase( slash );
+  }
+  u.Host = u.HostPort;
+  u.Port = "80";
+  size_t colon = u.HostPort.rfind( ':' );
+  if( colon != std::string::npos && u.HostPort.find( ']' ) == std::string::npos )
+  {
+    u.Host = u.HostPort.substr( 0, colon );
+    u.Port = u.HostPort.substr( colon + 1 );
+  }
+  return !u.Host.empty();
+}
+
+std::string
+HttpStream::Resolve( const std::string& base, const std::string& ref )
+{
+  if( ref.find( "://" ) != std::string::npos )
+    return ref;
+  size_t hostEnd = base.find( '/', base.find( "://" ) + 3 );
+  std::string origin = base.substr( 0, hostEnd );
+  if( !ref.empty() && ref[0] == '/' )
+    return origin + ref;
+  if( hostEnd == std::string::npos )
+    return origin + "/" + ref;
+  return base.substr( 0, base.rfind( '/' ) + 1 ) + ref;
+}
+
+std::string
+HttpStream::Request( const Url& u, bool icyMetadata )
+{
+  return "GET " + u.Path + " HTTP/1.0\r\n"
+    "Host: " + u.HostPort + "\r\n"
+    "User-Agent: " APPNAME "\r\n"
+    "Accept: */*\r\n"
+    + std::string( icyMetadata ? "Icy-MetaData: 1\r\n" : "" ) +
+    "\r\n";
+}
+
+bool
+HttpStream::ParseResponse( const std::string& headers, Response& r )
+{
+  r = Response();
+  std::istringstream iss( headers );
+  std::string line, protocol;
+  if( !std::getline( iss, line ) )
+    return false;
+  std::istringstream( line ) >> protocol >> r.Status;
+  if( protocol.compare( 0, 5, "HTTP/" ) && protocol != "ICY" )
+    return false;
+  while( std::getline( iss, line ) && line != "\r" )
+  {
+    size_t pos = line.find( ':' );
+    if( pos == std::string::npos )
+      continue;
+    std::string name = line.substr( 0, pos ), value = line.substr( pos + 1 );
+    for( auto& c : name )
+      c = ::tolower( c );
+    value.erase( 0, value.find_first_not_of( " \t" ) );
+    value.erase( value.find_last_not_of( "\r \t" ) + 1 );
+    if( name == "location" )
+      r.Location = value;
+    else if( name == "content-type" )
+    {
+      r.ContentType = value.substr( 0, value.find( ';' ) );
+      for( auto& c : r.ContentType )
+        c = ::tolower( c );
+    }
+    else if( name == "icy-metaint" )
+      r.MetaInt = std::max( ::atoi( value.c_str() ), 0 );
+    else if( name == "icy-br" )
+      r.Bitrate = std::max( ::atoi( value.c_str() ), 0 );
+  }
+  return true;
+}
+
+bool
+HttpStream::IsPlaylist( const std::string& contentType, const std::string& path )
+{
+  static const char* types[] =
+  {
+    "audio/x-mpegurl", "audio/mpegurl", "application/x-mpegurl", "application/vnd.apple.mpegurl",
+    "audio/x-scpls", "application/pls+xml",
+  };
+  for( auto t : types )
+    if( contentType == t )
+      return true;
+  std::string p = path.substr( 0, path.find( '?' ) );
+  for( auto ext : { ".m3u", ".m3u8", ".pls" } )
+    if( p.length() > ::strlen( ext ) && !p.compare( p.length() - ::strlen( ext ), std::string::npos, ext ) )
+      return true;
+  return false;
+}
+
+bool
+HttpStream::FirstEntry( const std::string& playlist, std::string& entry )
+{
+  std::istringstream iss( playlist );
+  std::string line;
+  while( std::getline( iss, line ) && !iss.eof() )
+  {
+    line.erase( line.find_last_not_of( "\r \t" ) + 1 );
+    line.erase( 0, line.find_first_not_of( " \t" ) );
+    if( !line.compare( 0, 4, "File" ) && line.find( '=' ) != std::string::npos )
+      entry = line.substr( line.find( '=' ) + 1 ); // pls
+    else if( !line.empty() && line[0] != '#' && line[0] != '[' && line.find( '=' ) == std::string::npos )
+      entry = line; // m3u
+    if( !entry.empty() )
+      return true;
+  }
+  return false;
+}
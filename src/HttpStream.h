@@ -0,0 +1,40 @@
+#ifndef HTTP_STREAM_H
+#define HTTP_STREAM_H
+
+#include <string>
+
+// The parts of an HTTP/1.0 client for network streams that the stream
+// front end (TimeShift) and the stream probes (StreamProbe) share: urls,
+// requests, response headers including ICY ones, and playlists. Sockets
+// are left to the callers, which wait on them differently.
+class HttpStream
+{
+public:
+  struct Url
+  {
+    std::string HostPort, Host, Port, Path;
+  };
+  // http:// urls only
+  static bool ParseUrl( const std::string&, Url& );
+  // Locations and playlist entries may be relative.
+  static std::string Resolve( const std::string& base, const std::string& ref );
+  static std::string Request( const Url&, bool icyMetadata );
+
+  struct Response
+  {
+    int Status = 0;
+    std::string Location,
+      ContentType; // lower case, without parameters
+    int MetaInt = 0, // icy-metaint, 0 without ICY metadata
+      Bitrate = 0; // icy-br in kbit/s, 0 if not announced
+  };
+  // From the status line up to the empty line; false if neither HTTP nor ICY.
+  static bool ParseResponse( const std::string& headers, Response& );
+
+  // m3u and pls, by content type, or by the extension of the path.
+  static bool IsPlaylist( const std::string& contentType, const std::string& path );
+  // The first entry among the complete lines of a playlist.
+  static bool FirstEntry( const std::string& playlist, std::string& entry );
+};
+
+#endif // HTTP_STREAM_H
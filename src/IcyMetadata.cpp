@@ -0,0 +1,71 @@
+#include "IcyMetadata.h"
+
+#include <algorithm>
+
+void
+IcyMetadata::Reset( int metaInt )
+{
+  mMetaInt = std::max( metaInt, 0 );
+  mAudioLeft = mMetaInt;
+  mMetaLeft = 0;
+  mMetadata.clear();
+}
+
+bool
+IcyMetadata::OnMetadata()
+{
+  std::string title;
+  if( !ParseTitle( mMetadata, title ) || title == mTitle )
+    return false;
+  mTitle = title;
+  return true;
+}
+
+// Titles are UTF-8 mostly, and Latin-1 with some older servers.
+static bool IsUtf8( const std::string& s )
+{
+  for( size_t i = 0; i < s.length(); )
+  {
+    unsigned char c = s[i++];
+    int n = c < 0x80 ? 0 : (c >> 5) == 0x6 ? 1 : (c >> 4) == 0xe ? 2 : (c >> 3) == 0x1e ? 3 : -1;
+    if( n < 0 || i + n > s.length() )
+      return false;
+    for( ; n > 0; --n )
+      if( (s[i++] & 0xc0) != 0x80 )
+        return false;
+  }
+  return true;
+}
+
+bool
+IcyMetadata::ParseTitle( const std::string& metadata, std::string& title )
+{
+  static const char tag[] = "StreamTitle='";
+  size_t begin = metadata.find( tag );
+  if( begin == std::string::npos )
+    return false;
+  begin += sizeof( tag ) - 1;
+  // Titles may contain quotes, so the value ends at the first "';",
+  // or at the last quote before padding.
+  size_t end = metadata.find( "';", begin );
+  if( end == std::string::npos )
+    end = metadata.rfind( '\'' );
+  if( end == std::string::npos || end < begin )
+    return false;
+  std::string s = metadata.substr( begin, end - begin );
+  if( IsUtf8( s ) )
+    title = s;
+  else
+  {
+    title.clear();
+    for( unsigned char c : s )
+      if( c < 0x80 )
+        title += c;
+      else
+      {
+        title += char( 0xc0 | c >> 6 );
+        title += char( 0x80 | (c & 0x3f) );
+      }
+  }
+  return true;
+}
@@ -0,0 +1,76 @@
+#ifndef ICY_METADATA_H
+#define ICY_METADATA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+
+// Separates SHOUTcast/Icecast metadata from stream data. With a metadata
+// interval n, each n bytes of audio are followed by a length byte, and
+// 16 times that many bytes of metadata, e.g. "StreamTitle='...';".
+// Audio is passed on in place, as spans of the received buffer; only
+// metadata is copied.
+class IcyMetadata
+{
+public:
+  // For a new connection, 0 if the stream has no metadata. Keeps the title.
+  void Reset( int metaInt );
+
+  // Calls audio( const char*, size_t ) for each span of audio in the data.
+  // Returns true if a metadata block changed the title.
+  template<class Sink> bool Feed( const char* data, size_t length, Sink audio );
+  const std::string& Title() const { return mTitle; }
+
+  // Extracts StreamTitle from a metadata block, as UTF-8.
+  static bool ParseTitle( const std::string& metadata, std::string& title );
+
+private:
+  bool OnMetadata();
+
+  size_t mMetaInt = 0, mAudioLeft = 0, mMetaLeft = 0;
+  std::string mMetadata, mTitle;
+};
+
+template<class Sink>
+bool
+IcyMetadata::Feed( const char* data, size_t length, Sink audio )
+{
+  if( !mMetaInt )
+  {
+    audio( data, length );
+    return false;
+  }
+  bool changed = false;
+  const char* end = data + length;
+  while( data < end )
+  {
+    if( mAudioLeft )
+    {
+      size_t n = std::min<size_t>( mAudioLeft, end - data );
+      audio( data, n );
+      data += n;
+      mAudioLeft -= n;
+    }
+    else if( mMetaLeft )
+    {
+      size_t n = std::min<size_t>( mMetaLeft, end - data );
+      mMetadata.append( data, n );
+      data += n;
+      if( !(mMetaLeft -= n) )
+      {
+        changed |= OnMetadata();
+        mAudioLeft = mMetaInt;
+      }
+    }
+    else
+    {
+      mMetaLeft = 16 * static_cast<unsigned char>( *data++ );
+      mMetadata.clear();
+      if( !mMetaLeft )
+        mAudioLeft = mMetaInt;
+    }
+  }
+  return changed;
+}
+
+#endif // ICY_METADATA_H
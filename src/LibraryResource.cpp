@@ -0,0 +1,48 @@
+#include "LibraryResource.h"
+#include "MediaLibrary.h"
+#include <Wt/Http/Request>
+#include <Wt/Http/Response>
+
+static const int sDefaultLimit = 100;
+
+static std::string Field( std::string s )
+{
+  for( auto& c : s )
+    if( c == '\t' || c == '\n' || c == '\r' )
+      c = ' ';
+  return s;
+}
+
+LibraryResource::LibraryResource(Wt::WObject *parent)
+: Wt::WStreamResource(parent)
+{
+}
+
+LibraryResource::~LibraryResource()
+{
+  beingDeleted();
+}
+
+// One track per line: path, artist, album, title, separated by tabs.
+void
+LibraryResource::handleRequest( const Wt::Http::Request& req, Wt::Http::Response& rsp )
+{
+  rsp.setMimeType( "text/plain; charset=utf-8" );
+  const auto& params = req.getParameterMap();
+  std::string query;
+  auto q = params.find( "q" );
+  if( q != params.end() )
+    query = q->second.back();
+  int limit = sDefaultLimit;
+  auto l = params.find( "limit" );
+  if( l != params.end() )
+    limit = std::max( 0, ::atoi( l->second.back().c_str() ) );
+
+  std::vector<MediaLibrary::Track> tracks;
+  if( MediaLibrary::Enabled() )
+    MediaLibrary::Instance()->Search( query, limit, tracks );
+  for( const auto& t : tracks )
+    rsp.out() << Field( t.Path ) << '\t' << Field( t.Artist ) << '\t'
+              << Field( t.Album ) << '\t' << Field( t.Title ) << '\n';
+  rsp.out() << std::endl;
+}
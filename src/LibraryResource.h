@@ -0,0 +1,14 @@
+#ifndef LIBRARY_RESOURCE_H
+#define LIBRARY_RESOURCE_H
+
+#include <Wt/WStreamResource>
+
+class LibraryResource : public Wt::WStreamResource
+{
+public:
+  LibraryResource(Wt::WObject *parent = 0);
+  ~LibraryResource();
+  void handleRequest( const Wt::Http::Request&, Wt::Http::Response& );
+};
+
+#endif // LIBRARY_RESOURCE_H
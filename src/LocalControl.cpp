@@ -0,0 +1,359 @@
+#include "LocalControl.h"
+#include "ControlResource.h"
+#include "Player.h"
+#include "Log.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <sstream>
+#include <utility>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <grp.h>
+#include <poll.h>
+#include <pwd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static LocalControl::Settings sSettings;
+
+// Subscribers are sent changes as Hardware and Player broadcast them, and
+// the time shift, which grows while paused without a broadcast, this often.
+static const int sTimeShiftMs = 1000;
+static const size_t sMaxClients = 32, sMaxLine = 4096,
+                    // Clients that do not read their answers are dropped.
+                    sMaxPending = 256 * 1024;
+
+struct LocalControl::Private
+{
+  int mSocket = -1;
+  gid_t mGroup = gid_t( -1 );
+  std::thread mThread;
+  std::atomic<bool> mRunning { true };
+  // Written to by listeners, and to stop the thread.
+  int mWake[2] = { -1, -1 };
+  std::atomic<bool> mChanged { false };
+  std::vector<std::pair<int, int>> mListeners; // of Hardware and Player, by zone
+
+  // Used by the thread only.
+  struct Client
+  {
+    int Fd;
+    std::string In, Out;
+    int Zone = -1; // subscribed to
+    std::string Sent; // state, when subscribed
+  };
+  std::vector<Client> mClients;
+
+  bool Open();
+  bool Allowed( int fd );
+  void ThreadFunc();
+  void Accept();
+  bool Read( Client& ); // false when closed
+  void Command( Client&, const std::string& );
+  void Notify( Client& );
+  void OnChanged();
+  void Wake();
+};
+
+bool
+LocalControl::Private::Open()
+{
+  const std::string& path = sSettings.Path;
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if( path.length() >= sizeof( addr.sun_path ) )
+  {
+    LOG( General, Error, "Socket path too long: {1}", path );
+    return false;
+  }
+  path.copy( addr.sun_path, path.length() );
+  if( !sSettings.Group.empty() )
+  {
+    struct group* pGroup = ::getgrnam( sSettings.Group.c_str() );
+    if( !pGroup )
+    {
+      LOG( General, Error, "Unknown group: {1}", sSettings.Group );
+      return false;
+    }
+    mGroup = pGroup->gr_gid;
+  }
+  // A socket left over from an earlier run.
+  struct stat st;
+  if( ::lstat( path.c_str(), &st ) == 0 && S_ISSOCK( st.st_mode ) )
+    ::unlink( path.c_str() );
+  mSocket = ::socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+  bool bound = mSocket >= 0 && ::bind( mSocket, reinterpret_cast<sockaddr*>( &addr ), sizeof( addr ) ) == 0;
+  if( bound && ::chown( path.c_str(), sSettings.Uid, mGroup ) == 0
+      && ::chmod( path.c_str(), mGroup == gid_t( -1 ) ? 0600 : 0660 ) == 0
+      && ::listen( mSocket, 16 ) == 0 )
+    return true;
+  LOG( General, Error, "Could not listen on {1}: {2}", path, ::strerror( errno ) );
+  // Without a socket, there is no thread, and nothing to remove later.
+  if( bound )
+    ::unlink( path.c_str() );
+  if( mSocket >= 0 )
+    ::close( mSocket );
+  mSocket = -1;
+  return false;
+}
+
+// Root, the daemon's user, and members of the socket's group.
+bool
+LocalControl::Private::Allowed( int fd )
+{
+  struct ucred cred;
+  socklen_t len = sizeof( cred );
+  if( ::getsockopt( fd, SOL_SOCKET, SO_PEERCRED, &cred, &len ) < 0 )
+    return false;
+  if( cred.uid == 0 || cred.uid == ::geteuid() )
+    return true;
+  if( mGroup == gid_t( -1 ) )
+    return false;
+  if( cred.gid == mGroup )
+    return true;
+  struct passwd pw, *pPw = nullptr;
+  char buf[1024];
+  if( ::getpwuid_r( cred.uid, &pw, buf, sizeof( buf ), &pPw ) || !pPw )
+    return false;
+  gid_t groups[64];
+  int count = sizeof( groups ) / sizeof( *groups );
+  if( ::getgrouplist( pPw->pw_name, pPw->pw_gid, groups, &count ) < 0 )
+    return false;
+  return std::find( groups, groups + count, mGroup ) != groups + count;
+}
+
+void
+LocalControl::Private::ThreadFunc()
+{
+  Trace::SetThreadName( "LocalControl" );
+  std::vector<pollfd> fds;
+  while( mRunning )
+  {
+    fds.assign( { pollfd{ mSocket, POLLIN, 0 }, pollfd{ mWake[0], POLLIN, 0 } } );
+    for( const auto& c : mClients )
+      fds.push_back( pollfd{ c.Fd, short( c.Out.empty() ? POLLIN : POLLIN | POLLOUT ), 0 } );
+    bool timeShift = Player::Instance()->IsTimeShifted()
+      && std::any_of( mClients.begin(), mClients.end(), []( const Client& c ) { return c.Zone == 0; } );
+    int ready = ::poll( fds.data(), fds.size(), timeShift ? sTimeShiftMs : -1 );
+    if( ready < 0 && errno != EINTR )
+      break;
+    char buf[64];
+    while( ::read( mWake[0], buf, sizeof( buf ) ) > 0 )
+      ;
+    bool changed = mChanged.exchange( false ) || ready == 0;
+    // Clients in the order of fds, new ones come last.
+    size_t count = mClients.size();
+    if( fds[0].revents & POLLIN )
+      Accept();
+    for( size_t i = 0, j = 0; j < count; ++j )
+    {
+      Client& c = mClients[i];
+      bool open = !( fds[j + 2].revents & ( POLLIN | POLLHUP | POLLERR ) ) || Read( c );
+      if( open && c.Zone >= 0 && changed )
+        Notify( c );
+      if( open && !c.Out.empty() )
+      {
+        ssize_t n = ::send( c.Fd, c.Out.data(), c.Out.size(), MSG_DONTWAIT | MSG_NOSIGNAL );
+        if( n > 0 )
+          c.Out.erase( 0, n );
+        else if( n < 0 && errno != EAGAIN && errno != EWOULDBLOCK )
+          open = false;
+        open = open && c.Out.size() < sMaxPending;
+      }
+      if( open )
+        ++i;
+      else
+      {
+        ::close( c.Fd );
+        mClients.erase( mClients.begin() + i );
+      }
+    }
+  }
+}
+
+void
+LocalControl::Private::Accept()
+{
+  int fd = ::accept4( mSocket, nullptr, nullptr, SOCK_CLOEXEC );
+  if( fd < 0 )
+    return;
+  if( !Allowed( fd ) || mClients.size() >= sMaxClients )
+  {
+    struct ucred cred = {};
+    socklen_t len = sizeof( cred );
+    ::getsockopt( fd, SOL_SOCKET, SO_PEERCRED, &cred, &len );
+    LOG( General, Warning, "Refused local connection of uid {1}, pid {2}", int64_t( cred.uid ), int64_t( cred.pid ) );
+    ::close( fd );
+    return;
+  }
+  Client c;
+  c.Fd = fd;
+  mClients.push_back( c );
+}
+
+bool
+LocalControl::Private::Read( Client& c )
+{
+  char buf[4096];
+  ssize_t n = ::recv( c.Fd, buf, sizeof( buf ), MSG_DONTWAIT );
+  if( n <= 0 )
+    return n < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR );
+  c.In.append( buf, n );
+  size_t pos;
+  while( ( pos = c.In.find( '\n' ) ) != std::string::npos )
+  {
+    std::string line = c.In.substr( 0, pos );
+    c.In.erase( 0, pos + 1 );
+    if( !line.empty() && line.back() == '\r' )
+      line.pop_back();
+    Command( c, line );
+  }
+  return c.In.length() <= sMaxLine;
+}
+
+void
+LocalControl::Private::Command( Client& c, const std::string& line )
+{
+  TRACE_SCOPE( "LocalControl::Command" );
+  std::istringstream is( line );
+  std::string name, arg;
+  if( !( is >> name ) )
+    return;
+  Wt::Http::ParameterMap params;
+  while( is >> arg )
+  {
+    size_t eq = arg.find( '=' );
+    params[ControlResource::Unescape( arg.substr( 0, eq ) )].push_back(
+      eq == std::string::npos ? "" : ControlResource::Unescape( arg.substr( eq + 1 ) ) );
+  }
+  std::ostringstream os;
+  int zone = ControlResource::Zone( params );
+  if( name == "set" )
+    os << ControlResource::Control( params ) << "\n";
+  else if( name == "get" && zone >= 0 )
+    ControlResource::WriteAll( os, zone );
+  else if( name == "subscribe" && zone >= 0 )
+  {
+    c.Zone = zone;
+    c.Sent.clear();
+    Notify( c );
+    return;
+  }
+  else if( name != "get" && name != "subscribe" )
+    os << "Unknown command: " << name << "\n";
+  LOG( General, Debug, "Local command {1}", line );
+  c.Out += os.str() + "\n";
+}
+
+void
+LocalControl::Private::Notify( Client& c )
+{
+  std::ostringstream os;
+  ControlResource::WriteAll( os, c.Zone );
+  if( os.str() == c.Sent )
+    return;
+  c.Sent = os.str();
+  c.Out += c.Sent + "\n";
+}
+
+// In the broadcasting thread.
+void
+LocalControl::Private::OnChanged()
+{
+  mChanged = true;
+  Wake();
+}
+
+void
+LocalControl::Private::Wake()
+{
+  char c = 0;
+  if( ::write( mWake[1], &c, 1 ) < 0 && errno != EAGAIN ) // EAGAIN: a wakeup is pending
+    LOG( General, Warning, "Could not wake control socket thread: {1}", ::strerror( errno ) );
+}
+
+void
+LocalControl::Configure( const Settings& s )
+{
+  sSettings = s;
+}
+
+bool
+LocalControl::Enabled()
+{
+  return !sSettings.Path.empty();
+}
+
+LocalControl*
+LocalControl::Instance()
+{
+  static LocalControl sInstance;
+  return &sInstance;
+}
+
+LocalControl::LocalControl()
+: p( new Private )
+{
+  if( Enabled() && p->Open() )
+    LOG( General, Info, "Control socket {1}", sSettings.Path );
+}
+
+LocalControl::~LocalControl()
+{
+  Stop();
+  for( const auto& c : p->mClients )
+    ::close( c.Fd );
+  if( p->mSocket >= 0 )
+  {
+    ::close( p->mSocket );
+    ::unlink( sSettings.Path.c_str() );
+  }
+  delete p;
+}
+
+void
+LocalControl::Start()
+{
+  if( p->mSocket < 0 || p->mThread.joinable() )
+    return;
+  if( ::pipe2( p->mWake, O_NONBLOCK | O_CLOEXEC ) < 0 )
+  {
+    LOG( General, Error, "Could not create pipe: {1}", ::strerror( errno ) );
+    return;
+  }
+  for( int i = 0; i < Hardware::Zones(); ++i )
+    p->mListeners.push_back( std::make_pair(
+      Hardware::Instance( i )->AddServerListener( boost::bind( &Private::OnChanged, p ) ),
+      Player::Instance( i )->AddServerListener( boost::bind( &Private::OnChanged, p ) ) ) );
+  p->mThread = std::thread( &Private::ThreadFunc, p );
+}
+
+void
+LocalControl::Stop()
+{
+  for( size_t i = 0; i < p->mListeners.size(); ++i )
+  {
+    Hardware::Instance( i )->RemoveServerListener( p->mListeners[i].first );
+    Player::Instance( i )->RemoveServerListener( p->mListeners[i].second );
+  }
+  p->mListeners.clear();
+  p->mRunning = false;
+  if( p->mThread.joinable() )
+  {
+    p->Wake();
+    p->mThread.join();
+  }
+  for( int& fd : p->mWake )
+    if( fd >= 0 )
+    {
+      ::close( fd );
+      fd = -1;
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef LOCAL_CONTROL_H
+#define LOCAL_CONTROL_H
+
+#include <string>
+
+// /control and /state on a unix socket, for scripts and daemons on the
+// same host, served by a thread of its own rather than by Wt. Commands
+// are lines of a name and /control parameters, separated by spaces, with
+// values %-encoded as in URLs:
+//   get [Zone=n]          the state, as /state
+//   set Power=1 ...       as /control, answered 1 or 0
+//   subscribe [Zone=n]    the state, and again on each change
+// Each answer ends with an empty line. Connections are accepted from
+// root, from the daemon's user, and from members of the socket's group.
+class LocalControl
+{
+public:
+  struct Settings
+  {
+    std::string Path; // e.g. /run/goldstard.sock, empty disables
+    std::string Group; // owner group of the socket, whose members may connect
+    int Uid = -1; // owner of the socket, the user the daemon runs as
+  };
+  static void Configure( const Settings& ); // call before Instance()
+  static bool Enabled();
+  // Creates the socket, before dropping privileges.
+  static LocalControl* Instance();
+  // Serves connections, once Hardware and Player are there, until Stop(),
+  // which is due before they go.
+  void Start();
+  void Stop();
+
+private:
+  LocalControl();
+  ~LocalControl();
+
+  struct Private;
+  Private* p;
+};
+
+#endif // LOCAL_CONTROL_H
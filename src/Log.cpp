@@ -0,0 +1,264 @@
+#include "Log.h"
+#include "Clock.h"
+
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+static const int sRecordCount = 1024; // power of 2
+static const int sFlushIntervalMs = 100;
+// Repeated messages from the same call site are dropped during this interval.
+static const int64_t sRateLimitUs[Log::NumLevels] = { 0, 0, 5000000, 5000000 };
+
+static const char* sSubsystemNames[Log::NumSubsystems] =
+{ "general", "hardware", "remote", "player", "web", "audio", "library", "cluster" };
+static const char* sLevelNames[Log::NumLevels] =
+{ "debug", "info", "warning", "error" };
+
+std::atomic<int> Log::sLevels[Log::NumSubsystems] =
+{ { Log::Info }, { Log::Info }, { Log::Info }, { Log::Info }, { Log::Info }, { Log::Info },
+  { Log::Info }, { Log::Info } };
+
+namespace {
+
+// Bounded multi-producer queue with per-slot sequence numbers,
+// consumed by a single writer thread.
+struct Queue
+{
+  struct Slot
+  {
+    std::atomic<uint64_t> seq;
+    Log::Record record;
+  } mSlots[sRecordCount];
+  std::atomic<uint64_t> mHead, mTail;
+  std::atomic<int> mDropped;
+
+  Queue()
+  : mHead( 0 ), mTail( 0 ), mDropped( 0 )
+  {
+    for( int i = 0; i < sRecordCount; ++i )
+      mSlots[i].seq = i;
+  }
+
+  bool Push( const Log::Record& r )
+  {
+    uint64_t pos = mTail.load( std::memory_order_relaxed );
+    while( true )
+    {
+      Slot& slot = mSlots[pos & (sRecordCount - 1)];
+      int64_t diff = int64_t( slot.seq.load( std::memory_order_acquire ) ) - int64_t( pos );
+      if( diff == 0 )
+      {
+        if( mTail.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+        {
+          ::memcpy( &slot.record, &r, sizeof(r) );
+          slot.seq.store( pos + 1, std::memory_order_release );
+          return true;
+        }
+      }
+      else if( diff < 0 )
+      {
+        ++mDropped;
+        return false;
+      }
+      else
+        pos = mTail.load( std::memory_order_relaxed );
+    }
+  }
+
+  bool Pop( Log::Record& r )
+  {
+    uint64_t pos = mHead.load( std::memory_order_relaxed );
+    Slot& slot = mSlots[pos & (sRecordCount - 1)];
+    if( slot.seq.load( std::memory_order_acquire ) != pos + 1 )
+      return false;
+    ::memcpy( &r, &slot.record, sizeof(r) );
+    slot.seq.store( pos + sRecordCount, std::memory_order_release );
+    mHead.store( pos + 1, std::memory_order_relaxed );
+    return true;
+  }
+};
+
+std::string Format( const Log::Record& r )
+{
+  std::ostringstream oss;
+  oss << "[" << sSubsystemNames[r.site->subsystem] << "] ";
+  for( const char* p = r.site->format; *p; ++p )
+  {
+    int idx = -1;
+    if( *p == '{' && ::isdigit( p[1] ) && p[2] == '}' )
+      idx = p[1] - '1';
+    if( idx < 0 || idx >= r.argc )
+    {
+      oss << *p;
+      continue;
+    }
+    const Log::Arg& a = r.args[idx];
+    switch( a.type )
+    {
+      case Log::Arg::Int:
+        oss << a.i;
+        break;
+      case Log::Arg::Float:
+        oss << a.f;
+        break;
+      case Log::Arg::Text:
+        oss.write( r.text + a.text.offset, a.text.length );
+        break;
+    }
+    p += 2;
+  }
+  if( r.suppressed )
+    oss << " (" << r.suppressed << " similar messages suppressed)";
+  return oss.str();
+}
+
+struct Writer
+{
+  Queue mQueue;
+  std::mutex mMutex;
+  std::condition_variable mCond;
+  bool mStop = false, mFlush = false;
+  std::thread mThread;
+
+  Writer()
+  : mThread( &Writer::ThreadFunc, this )
+  {
+  }
+
+  ~Writer()
+  {
+    {
+      std::lock_guard<std::mutex> lock( mMutex );
+      mStop = true;
+    }
+    mCond.notify_one();
+    mThread.join();
+  }
+
+  void Flush()
+  {
+    std::unique_lock<std::mutex> lock( mMutex );
+    mFlush = true;
+    mCond.notify_one();
+    mCond.wait( lock, [this]() { return !mFlush || mStop; } );
+  }
+
+  void WriteAll()
+  {
+    Log::Record r;
+    while( mQueue.Pop( r ) )
+      Wt::log( sLevelNames[r.site->level] ) << Format( r );
+    int dropped = mQueue.mDropped.exchange( 0 );
+    if( dropped )
+      Wt::log( "warning" ) << "[log] " << dropped << " records dropped";
+  }
+
+  void ThreadFunc()
+  {
+    std::unique_lock<std::mutex> lock( mMutex );
+    while( true )
+    {
+      mCond.wait_for( lock, std::chrono::milliseconds( sFlushIntervalMs ),
+                      [this]() { return mStop || mFlush; } );
+      lock.unlock();
+      WriteAll();
+      lock.lock();
+      if( mFlush )
+      {
+        mFlush = false;
+        mCond.notify_all();
+      }
+      if( mStop )
+        return;
+    }
+  }
+} sWriter;
+
+} // namespace
+
+void
+Log::SetLevel( int subsystem, int level )
+{
+  sLevels[subsystem] = level;
+}
+
+bool
+Log::SetLevels( const std::string& s )
+{
+  std::istringstream iss( s );
+  std::string item;
+  while( std::getline( iss, item, ',' ) )
+  {
+    size_t pos = item.find( '=' );
+    std::string name = item.substr( 0, pos ), level = item.substr( pos + 1 );
+    for( auto& c : name )
+      c = ::tolower( c );
+    int l = 0, n = 0;
+    while( l < NumLevels && level != sLevelNames[l] )
+      ++l;
+    while( n < NumSubsystems && name != sSubsystemNames[n] )
+      ++n;
+    if( pos == std::string::npos || l == NumLevels )
+      return false;
+    if( name == "all" || name == "*" )
+    {
+      for( n = 0; n < NumSubsystems; ++n )
+        SetLevel( n, l );
+    }
+    else if( n < NumSubsystems )
+      SetLevel( n, l );
+    else
+      return false;
+  }
+  return true;
+}
+
+void
+Log::Flush()
+{
+  sWriter.Flush();
+}
+
+bool
+Log::Begin( Site& site, Record& r )
+{
+  int64_t interval = sRateLimitUs[site.level];
+  if( interval )
+  {
+    // Monotonic, so that stepping the wall clock neither floods nor mutes.
+    int64_t now = Clock::NowUs(), last = site.lastUs.load( std::memory_order_relaxed );
+    if( ( last && now < last + interval ) || !site.lastUs.compare_exchange_strong( last, now ) )
+    {
+      ++site.suppressed;
+      return false;
+    }
+  }
+  r.site = &site;
+  r.suppressed = site.suppressed.exchange( 0 );
+  r.argc = 0;
+  r.textLength = 0;
+  return true;
+}
+
+void
+Log::Commit( const Record& r )
+{
+  sWriter.mQueue.Push( r );
+}
+
+void
+Log::PutText( Record& r, const char* s, size_t length )
+{
+  if( r.argc >= MaxArgs )
+    return;
+  length = std::min<size_t>( length, MaxText - r.textLength );
+  ::memcpy( r.text + r.textLength, s, length );
+  Arg& a = r.args[r.argc++];
+  a.type = Arg::Text;
+  a.text.offset = r.textLength;
+  a.text.length = length;
+  r.textLength += length;
+}
@@ -0,0 +1,97 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+// Asynchronous logging: call sites copy their arguments into a preallocated
+// ring of binary records, which a background thread formats and passes on
+// to Wt::log. Format strings use {1}, {2}, ... placeholders, and must be
+// string literals, as only the pointer is stored.
+class Log
+{
+public:
+  enum Subsystem { General, Hardware, Remote, Player, Web, Audio, Library, Cluster, NumSubsystems };
+  enum Level { Debug, Info, Warning, Error, NumLevels };
+  enum { MaxArgs = 4, MaxText = 96 };
+
+  struct Site
+  {
+    int subsystem, level;
+    const char* format;
+    std::atomic<int64_t> lastUs { 0 };
+    std::atomic<int> suppressed { 0 };
+  };
+
+  static void SetLevel( int subsystem, int level );
+  static bool SetLevels( const std::string& ); // e.g. "Hardware=debug,Player=warning"
+  static bool IsEnabled( const Site& s )
+  { return s.level >= sLevels[s.subsystem].load( std::memory_order_relaxed ); }
+  static void Flush();
+
+  template<class... Args> static void Write( Site& site, const Args&... args )
+  {
+    Record r;
+    if( !Begin( site, r ) )
+      return;
+    int dummy[] = { 0, (Put( r, args ), 0)... };
+    (void)dummy;
+    Commit( r );
+  }
+
+  struct Arg
+  {
+    enum { Int, Float, Text } type;
+    union { int64_t i; double f; struct { uint16_t offset, length; } text; };
+  };
+  struct Record
+  {
+    const Site* site;
+    int suppressed;
+    int argc, textLength;
+    Arg args[MaxArgs];
+    char text[MaxText];
+  };
+
+private:
+  static bool Begin( Site&, Record& );
+  static void Commit( const Record& );
+  static void PutText( Record&, const char*, size_t );
+
+  template<class T> static
+  typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type
+  Put( Record& r, const T& t )
+  {
+    if( r.argc < MaxArgs )
+    {
+      r.args[r.argc].type = Arg::Int;
+      r.args[r.argc++].i = t;
+    }
+  }
+  template<class T> static
+  typename std::enable_if<std::is_floating_point<T>::value>::type
+  Put( Record& r, const T& t )
+  {
+    if( r.argc < MaxArgs )
+    {
+      r.args[r.argc].type = Arg::Float;
+      r.args[r.argc++].f = t;
+    }
+  }
+  static void Put( Record& r, const char* s ) { PutText( r, s, s ? ::strlen( s ) : 0 ); }
+  static void Put( Record& r, const std::string& s ) { PutText( r, s.data(), s.length() ); }
+
+  static std::atomic<int> sLevels[NumSubsystems];
+};
+
+#define LOG(subsystem, level, format, ...) \
+  do { \
+    static Log::Site log_site_ = { Log::subsystem, Log::level, format }; \
+    if( Log::IsEnabled( log_site_ ) ) \
+      Log::Write( log_site_, ##__VA_ARGS__ ); \
+  } while( false )
+
+#endif // LOG_H
@@ -0,0 +1,167 @@
+#include "Loudness.h"
+#include "Biquad.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+const int sStepsPerBlock = 4; // 100ms steps of a 400ms block
+const float sAbsoluteGate = -70, sRelativeGate = -10;
+// Block loudness histogram from the absolute gate up to +5 LUFS.
+const float sHistogramStep = 0.1f;
+const int sHistogramBins = (5 - sAbsoluteGate) / sHistogramStep;
+
+float Lufs( double meanSquare )
+{
+  return -0.691 + 10 * ::log10( meanSquare );
+}
+
+} // namespace
+
+struct Loudness::Private
+{
+  Biquad mShelf, mHighpass;
+  int mStepFrames;
+  int mFrames = 0;
+  double mSteps[sStepsPerBlock] = { 0 };
+  int mStep = 0;
+  int64_t mTotalSteps = 0;
+  v2f mSum = v2f{};
+  std::vector<int> mCounts;
+  std::vector<double> mBinMeanSquare;
+  double mSeconds = 0, mSampleRate;
+
+  Private( int sampleRate );
+  void Clear();
+  void OnStep();
+};
+
+// Filter coefficients for arbitrary sample rates, as derived in libebur128.
+Loudness::Private::Private( int sampleRate )
+: mStepFrames( sampleRate / 10 ), mCounts( sHistogramBins ),
+  mBinMeanSquare( sHistogramBins ), mSampleRate( sampleRate )
+{
+  double f0 = 1681.974450955533, G = 3.999843853973347, Q = 0.7071752369554196,
+         K = ::tan( M_PI * f0 / sampleRate ),
+         Vh = ::pow( 10, G / 20 ), Vb = ::pow( Vh, 0.4996667741545416 );
+  double sb[3] = { Vh + Vb * K / Q + K * K, 2 * (K * K - Vh), Vh - Vb * K / Q + K * K },
+         sa[3] = { 1 + K / Q + K * K, 2 * (K * K - 1), 1 - K / Q + K * K };
+  mShelf.Set( sb, sa );
+
+  f0 = 38.13547087602444;
+  Q = 0.5003270373238773;
+  K = ::tan( M_PI * f0 / sampleRate );
+  double hb[3] = { 1, -2, 1 },
+         ha[3] = { 1 + K / Q + K * K, 2 * (K * K - 1), 1 - K / Q + K * K };
+  // Only the denominator is normalized, as in the reference implementation.
+  ha[1] /= ha[0];
+  ha[2] /= ha[0];
+  ha[0] = 1;
+  mHighpass.Set( hb, ha );
+
+  for( int i = 0; i < sHistogramBins; ++i )
+  {
+    double lufs = sAbsoluteGate + (i + 0.5) * sHistogramStep;
+    mBinMeanSquare[i] = ::pow( 10, (lufs + 0.691) / 10 );
+  }
+}
+
+void
+Loudness::Private::Clear()
+{
+  mShelf.Clear();
+  mHighpass.Clear();
+  mFrames = 0;
+  std::fill( mSteps, mSteps + sStepsPerBlock, 0 );
+  mStep = 0;
+  mTotalSteps = 0;
+  mSum = v2f{};
+  std::fill( mCounts.begin(), mCounts.end(), 0 );
+  mSeconds = 0;
+}
+
+void
+Loudness::Private::OnStep()
+{
+  mSteps[mStep] = (mSum[0] + mSum[1]) / mStepFrames;
+  mStep = (mStep + 1) % sStepsPerBlock;
+  mSum = v2f{};
+  mFrames = 0;
+  if( ++mTotalSteps < sStepsPerBlock )
+    return;
+  double meanSquare = 0;
+  for( double s : mSteps )
+    meanSquare += s;
+  meanSquare /= sStepsPerBlock;
+  if( meanSquare <= 0 )
+    return;
+  int bin = ::floor( (Lufs( meanSquare ) - sAbsoluteGate) / sHistogramStep );
+  if( bin >= 0 )
+    ++mCounts[std::min( bin, sHistogramBins - 1 )];
+}
+
+Loudness::Loudness( int sampleRate )
+: p( new Private( sampleRate ) )
+{
+}
+
+Loudness::~Loudness()
+{
+  delete p;
+}
+
+void
+Loudness::Process( const int16_t* in, int frames )
+{
+  const float scale = 1.0f / 32768;
+  for( int i = 0; i < frames; ++i )
+  {
+    v2f x = { in[2 * i] * scale, in[2 * i + 1] * scale };
+    v2f y = p->mHighpass( p->mShelf( x ) );
+    p->mSum += y * y;
+    if( ++p->mFrames == p->mStepFrames )
+      p->OnStep();
+  }
+  p->mSeconds += frames / p->mSampleRate;
+}
+
+void
+Loudness::Reset()
+{
+  p->Clear();
+}
+
+double
+Loudness::Seconds() const
+{
+  return p->mSeconds;
+}
+
+bool
+Loudness::Integrated( float& lufs ) const
+{
+  int64_t count = 0;
+  double sum = 0;
+  for( int i = 0; i < sHistogramBins; ++i )
+  {
+    count += p->mCounts[i];
+    sum += p->mCounts[i] * p->mBinMeanSquare[i];
+  }
+  if( count == 0 )
+    return false;
+  float gate = Lufs( sum / count ) + sRelativeGate;
+  int first = std::max<int>( 0, ::ceil( (gate - sAbsoluteGate) / sHistogramStep ) );
+  count = 0;
+  sum = 0;
+  for( int i = first; i < sHistogramBins; ++i )
+  {
+    count += p->mCounts[i];
+    sum += p->mCounts[i] * p->mBinMeanSquare[i];
+  }
+  if( count == 0 )
+    return false;
+  lufs = Lufs( sum / count );
+  return true;
+}
@@ -0,0 +1,27 @@
+#ifndef LOUDNESS_H
+#define LOUDNESS_H
+
+#include <cstdint>
+
+// Integrated loudness of 16 bit stereo PCM as in EBU R128 / ITU-R BS.1770:
+// K-weighted mean square over 400ms blocks with 75% overlap, gated at
+// -70 LUFS absolute and -10 LU relative. Gating uses a histogram of block
+// loudness, so memory does not grow with the measured duration.
+class Loudness
+{
+public:
+  Loudness( int sampleRate = 44100 );
+  ~Loudness();
+
+  void Process( const int16_t*, int frames );
+  void Reset();
+
+  double Seconds() const; // of audio processed since Reset()
+  bool Integrated( float& lufs ) const; // false if no block passed the gates
+
+private:
+  struct Private;
+  Private* p;
+};
+
+#endif // LOUDNESS_H
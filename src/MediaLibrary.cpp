@@ -0,0 +1,561 @@
+#include "MediaLibrary.h"
+#include "MediaTags.h"
+#include "Log.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static MediaLibrary::Settings sSettings;
+
+static const char sMagic[8] = { 'G', 'S', 'L', 'I', 'B', 0, 0, 1 };
+static const int sPollMs = 250;
+// Changes are applied once no more events arrived for this long, so that
+// files being copied are read when complete.
+static const int sSettleMs = 2000;
+static const char* sExtensions[] =
+{
+  "mp3", "flac", "ogg", "oga", "opus", "m4a", "aac", "wav", "wma", "mpc",
+};
+static const uint32_t sWatchMask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM
+                                   | IN_MOVED_TO | IN_DELETE_SELF | IN_ONLYDIR;
+
+namespace {
+
+// Index file layout: header, tracks, keys, then NUL terminated strings
+// that tracks and keys refer to by offset.
+struct Header
+{
+  char magic[8];
+  uint32_t count, keyCount, stringsSize, reserved;
+};
+struct TrackRecord
+{
+  uint32_t path, artist, album, title;
+  int64_t mtime, size;
+};
+struct KeyRecord
+{
+  uint32_t word, track;
+};
+
+struct Index
+{
+  void* base = MAP_FAILED;
+  size_t size = 0;
+  Header empty = {};
+  const Header* header = &empty;
+  const TrackRecord* tracks = nullptr;
+  const KeyRecord* keys = nullptr;
+  const char* strings = "";
+
+  ~Index()
+  {
+    if( base != MAP_FAILED )
+      ::munmap( base, size );
+  }
+  bool Map( const std::string& path );
+  const char* String( uint32_t offset ) const { return strings + offset; }
+};
+
+struct Entry
+{
+  std::string artist, album, title;
+  int64_t mtime = 0, size = 0;
+};
+typedef std::map<std::string, Entry> Entries; // by path
+
+struct FileInfo
+{
+  int64_t mtime, size;
+};
+typedef std::map<std::string, FileInfo> Files;
+
+bool
+Index::Map( const std::string& path )
+{
+  int fd = ::open( path.c_str(), O_RDONLY | O_CLOEXEC );
+  struct stat st;
+  if( fd < 0 || ::fstat( fd, &st ) < 0 || size_t( st.st_size ) < sizeof( Header ) )
+  {
+    if( fd >= 0 )
+      ::close( fd );
+    return false;
+  }
+  size = st.st_size;
+  base = ::mmap( nullptr, size, PROT_READ, MAP_SHARED, fd, 0 );
+  ::close( fd );
+  if( base == MAP_FAILED )
+    return false;
+  const Header* h = static_cast<const Header*>( base );
+  const char* p = static_cast<const char*>( base ) + sizeof( Header );
+  if( ::memcmp( h->magic, sMagic, sizeof( sMagic ) )
+      || size != sizeof( Header ) + h->count * sizeof( TrackRecord )
+                 + h->keyCount * sizeof( KeyRecord ) + h->stringsSize
+      || h->stringsSize == 0 )
+    return false;
+  const TrackRecord* t = reinterpret_cast<const TrackRecord*>( p );
+  const KeyRecord* k = reinterpret_cast<const KeyRecord*>( t + h->count );
+  const char* s = reinterpret_cast<const char*>( k + h->keyCount );
+  if( s[h->stringsSize - 1] )
+    return false;
+  for( uint32_t i = 0; i < h->count; ++i )
+    if( std::max( { t[i].path, t[i].artist, t[i].album, t[i].title } ) >= h->stringsSize )
+      return false;
+  for( uint32_t i = 0; i < h->keyCount; ++i )
+    if( k[i].word >= h->stringsSize || k[i].track >= h->count )
+      return false;
+  header = h;
+  tracks = t;
+  keys = k;
+  strings = s;
+  return true;
+}
+
+// Lower case words, split at ASCII punctuation and white space.
+void Words( const std::string& s, std::vector<std::string>& words )
+{
+  std::string word;
+  for( char c : s )
+  {
+    if( (c & 0x80) || ::isalnum( c ) )
+      word += ::tolower( c );
+    else if( !word.empty() )
+    {
+      words.push_back( word );
+      word.clear();
+    }
+  }
+  if( !word.empty() )
+    words.push_back( word );
+}
+
+std::string Lower( std::string s )
+{
+  for( auto& c : s )
+    c = ::tolower( c );
+  return s;
+}
+
+bool IsAudioFile( const std::string& name )
+{
+  size_t dot = name.rfind( '.' );
+  if( dot == std::string::npos )
+    return false;
+  std::string extension = Lower( name.substr( dot + 1 ) );
+  for( const char* e : sExtensions )
+    if( extension == e )
+      return true;
+  return false;
+}
+
+bool StartsWithPath( const std::string& path, const std::string& prefix )
+{
+  return !path.compare( 0, prefix.length(), prefix )
+         && (path.length() == prefix.length() || path[prefix.length()] == '/');
+}
+
+} // namespace
+
+struct MediaLibrary::Private
+{
+  MediaLibrary* mpSelf;
+  mutable std::mutex mMutex;
+  std::shared_ptr<const Index> mpIndex;
+
+  std::atomic<bool> mRunning { true };
+  std::thread* mpThread = nullptr;
+
+  // Used by the thread only
+  int mInotify = -1;
+  std::map<int, std::string> mWatches;
+  std::set<std::string> mDirty;
+
+  std::shared_ptr<const Index> Current() const;
+  static void ThreadFunc( Private* );
+  void Walk( const std::string& dir, Files& );
+  void Update( const std::set<std::string>& paths );
+  void ReadEvents( int64_t& lastEventMs );
+  static void ReadTags( std::vector<std::pair<const std::string*, Entry*>>& );
+  static bool Write( const std::string& path, const Entries& );
+  static void Load( const Index&, Entries& );
+};
+
+std::shared_ptr<const Index>
+MediaLibrary::Private::Current() const
+{
+  std::lock_guard<std::mutex> lock( mMutex );
+  return mpIndex;
+}
+
+void
+MediaLibrary::Private::Load( const Index& index, Entries& entries )
+{
+  for( uint32_t i = 0; i < index.header->count; ++i )
+  {
+    const TrackRecord& t = index.tracks[i];
+    Entry& e = entries[index.String( t.path )];
+    e.artist = index.String( t.artist );
+    e.album = index.String( t.album );
+    e.title = index.String( t.title );
+    e.mtime = t.mtime;
+    e.size = t.size;
+  }
+}
+
+bool
+MediaLibrary::Private::Write( const std::string& path, const Entries& entries )
+{
+  struct Sorted
+  {
+    std::string key;
+    const std::string* path;
+    const Entry* entry;
+    bool operator<( const Sorted& s ) const { return key < s.key; }
+  };
+  std::vector<Sorted> sorted;
+  sorted.reserve( entries.size() );
+  for( const auto& e : entries )
+  {
+    std::string key = Lower( e.second.artist ) + '\0' + Lower( e.second.album ) + '\0'
+                      + Lower( e.second.title ) + '\0' + e.first;
+    sorted.push_back( { key, &e.first, &e.second } );
+  }
+  std::sort( sorted.begin(), sorted.end() );
+
+  std::string strings( 1, '\0' );
+  std::unordered_map<std::string, uint32_t> offsets;
+  auto add = [&]( const std::string& s ) -> uint32_t
+  {
+    auto i = offsets.insert( std::make_pair( s, uint32_t( strings.length() ) ) );
+    if( i.second )
+      strings.append( s.c_str(), s.length() + 1 );
+    return i.first->second;
+  };
+  std::vector<TrackRecord> tracks;
+  std::vector<KeyRecord> keys;
+  std::vector<std::string> words;
+  for( const auto& s : sorted )
+  {
+    const Entry& e = *s.entry;
+    uint32_t track = tracks.size();
+    tracks.push_back( { add( *s.path ), add( e.artist ), add( e.album ), add( e.title ), e.mtime, e.size } );
+    words.clear();
+    Words( e.artist + ' ' + e.album + ' ' + e.title, words );
+    std::sort( words.begin(), words.end() );
+    words.erase( std::unique( words.begin(), words.end() ), words.end() );
+    for( const auto& w : words )
+      keys.push_back( { add( w ), track } );
+  }
+  std::sort( keys.begin(), keys.end(), [&strings]( const KeyRecord& a, const KeyRecord& b )
+  {
+    int c = ::strcmp( &strings[a.word], &strings[b.word] );
+    return c < 0 || (c == 0 && a.track < b.track);
+  } );
+
+  Header header = {};
+  ::memcpy( header.magic, sMagic, sizeof( sMagic ) );
+  header.count = tracks.size();
+  header.keyCount = keys.size();
+  header.stringsSize = strings.length();
+  std::string tmp = path + ".tmp";
+  std::ofstream f( tmp, std::ios::binary );
+  f.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+  f.write( reinterpret_cast<const char*>( tracks.data() ), tracks.size() * sizeof( TrackRecord ) );
+  f.write( reinterpret_cast<const char*>( keys.data() ), keys.size() * sizeof( KeyRecord ) );
+  f.write( strings.data(), strings.length() );
+  f.close();
+  return !f.fail() && ::rename( tmp.c_str(), path.c_str() ) == 0;
+}
+
+void
+MediaLibrary::Private::ReadTags( std::vector<std::pair<const std::string*, Entry*>>& items )
+{
+  std::atomic<size_t> next( 0 );
+  auto worker = [&items, &next]()
+  {
+    MediaTags tags;
+    for( size_t i; (i = next++) < items.size(); )
+    {
+      MediaTags::Read( *items[i].first, tags );
+      items[i].second->artist = tags.Artist;
+      items[i].second->album = tags.Album;
+      items[i].second->title = tags.Title;
+    }
+  };
+  size_t count = sSettings.Threads > 0 ? sSettings.Threads : std::thread::hardware_concurrency();
+  count = std::max<size_t>( 1, std::min( count, items.size() ) );
+  std::vector<std::thread> threads;
+  for( size_t i = 1; i < count; ++i )
+    threads.emplace_back( worker );
+  worker();
+  for( auto& t : threads )
+    t.join();
+}
+
+// Adds watches for all directories it visits.
+void
+MediaLibrary::Private::Walk( const std::string& root, Files& files )
+{
+  std::vector<std::string> dirs = { root };
+  while( !dirs.empty() && mRunning )
+  {
+    std::string dir = dirs.back();
+    dirs.pop_back();
+    int wd = ::inotify_add_watch( mInotify, dir.c_str(), sWatchMask );
+    if( wd >= 0 )
+      mWatches[wd] = dir;
+    else if( errno == ENOSPC )
+      LOG( Library, Warning, "Out of inotify watches at {1}", dir );
+    DIR* d = ::opendir( dir.c_str() );
+    if( !d )
+      continue;
+    while( struct dirent* e = ::readdir( d ) )
+    {
+      if( e->d_name[0] == '.' )
+        continue;
+      std::string path = dir + "/" + e->d_name;
+      struct stat st;
+      if( ::stat( path.c_str(), &st ) < 0 )
+        continue;
+      if( S_ISDIR( st.st_mode ) )
+        dirs.push_back( path );
+      else if( S_ISREG( st.st_mode ) && IsAudioFile( e->d_name ) )
+        files[path] = { int64_t( st.st_mtime ), int64_t( st.st_size ) };
+    }
+    ::closedir( d );
+  }
+}
+
+// Brings the index up to date for the given files and directories.
+void
+MediaLibrary::Private::Update( const std::set<std::string>& paths )
+{
+  TRACE_SCOPE( "MediaLibrary::Update" );
+  Entries entries;
+  Load( *Current(), entries );
+  Files files;
+  for( const auto& path : paths )
+  {
+    Files found;
+    struct stat st;
+    if( ::stat( path.c_str(), &st ) == 0 )
+    {
+      if( S_ISDIR( st.st_mode ) )
+        Walk( path, found );
+      else if( S_ISREG( st.st_mode ) && IsAudioFile( path ) )
+        found[path] = { int64_t( st.st_mtime ), int64_t( st.st_size ) };
+    }
+    for( auto i = entries.lower_bound( path ); i != entries.end() && !i->first.compare( 0, path.length(), path ); )
+    {
+      if( StartsWithPath( i->first, path ) && !found.count( i->first ) )
+        i = entries.erase( i );
+      else
+        ++i;
+    }
+    files.insert( found.begin(), found.end() );
+  }
+  std::vector<std::pair<const std::string*, Entry*>> changed;
+  for( const auto& f : files )
+  {
+    Entry& e = entries[f.first];
+    if( e.mtime != f.second.mtime || e.size != f.second.size )
+    {
+      e.mtime = f.second.mtime;
+      e.size = f.second.size;
+      changed.push_back( std::make_pair( &f.first, &e ) );
+    }
+  }
+  if( !mRunning )
+    return;
+  if( changed.empty() && entries.size() == Current()->header->count )
+    return;
+  ReadTags( changed );
+  if( !Write( sSettings.IndexFile, entries ) )
+  {
+    LOG( Library, Error, "Could not write {1}: {2}", sSettings.IndexFile, ::strerror( errno ) );
+    return;
+  }
+  auto index = std::make_shared<Index>();
+  if( !index->Map( sSettings.IndexFile ) )
+    return;
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    mpIndex = index;
+  }
+  LOG( Library, Info, "{1} tracks, {2} read", int( entries.size() ), int( changed.size() ) );
+  mpSelf->Broadcast();
+}
+
+void
+MediaLibrary::Private::ReadEvents( int64_t& lastEventMs )
+{
+  alignas( struct inotify_event ) char buf[4096];
+  ssize_t n;
+  while( (n = ::read( mInotify, buf, sizeof( buf ) )) > 0 )
+  {
+    for( char* p = buf; p < buf + n; )
+    {
+      const struct inotify_event* e = reinterpret_cast<const struct inotify_event*>( p );
+      p += sizeof( struct inotify_event ) + e->len;
+      if( e->mask & IN_Q_OVERFLOW )
+      {
+        mDirty.insert( sSettings.Directory );
+        continue;
+      }
+      auto w = mWatches.find( e->wd );
+      if( w == mWatches.end() )
+        continue;
+      if( e->mask & IN_IGNORED )
+      {
+        mWatches.erase( w );
+        continue;
+      }
+      if( (e->mask & IN_CREATE) && !(e->mask & IN_ISDIR) )
+        continue; // read on IN_CLOSE_WRITE
+      mDirty.insert( e->len ? w->second + "/" + e->name : w->second );
+    }
+    lastEventMs = Trace::NowUs() / 1000;
+  }
+}
+
+void
+MediaLibrary::Private::ThreadFunc( Private* p )
+{
+  Trace::SetThreadName( "MediaLibrary" );
+  p->mInotify = ::inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+  if( p->mInotify < 0 )
+    LOG( Library, Error, "inotify: {1}", ::strerror( errno ) );
+  p->Update( { sSettings.Directory } );
+  int64_t lastEventMs = 0;
+  while( p->mRunning && p->mInotify >= 0 )
+  {
+    struct pollfd pfd = { p->mInotify, POLLIN, 0 };
+    if( ::poll( &pfd, 1, sPollMs ) > 0 )
+      p->ReadEvents( lastEventMs );
+    if( !p->mDirty.empty() && Trace::NowUs() / 1000 > lastEventMs + sSettleMs )
+    {
+      std::set<std::string> dirty;
+      dirty.swap( p->mDirty );
+      p->Update( dirty );
+    }
+  }
+  if( p->mInotify >= 0 )
+    ::close( p->mInotify );
+}
+
+void
+MediaLibrary::Configure( const Settings& s )
+{
+  sSettings = s;
+  while( sSettings.Directory.length() > 1 && sSettings.Directory.back() == '/' )
+    sSettings.Directory.pop_back();
+}
+
+bool
+MediaLibrary::Enabled()
+{
+  return !sSettings.Directory.empty();
+}
+
+MediaLibrary*
+MediaLibrary::Instance()
+{
+  static MediaLibrary sInstance;
+  return &sInstance;
+}
+
+MediaLibrary::MediaLibrary()
+: p( new Private )
+{
+  p->mpSelf = this;
+  auto index = std::make_shared<Index>();
+  if( Enabled() && !index->Map( sSettings.IndexFile ) )
+    index = std::make_shared<Index>();
+  p->mpIndex = index;
+  if( Enabled() )
+    p->mpThread = new std::thread( &Private::ThreadFunc, p );
+}
+
+MediaLibrary::~MediaLibrary()
+{
+  p->mRunning = false;
+  if( p->mpThread && p->mpThread->joinable() )
+    p->mpThread->join();
+  delete p->mpThread;
+  delete p;
+}
+
+size_t
+MediaLibrary::Count() const
+{
+  return p->Current()->header->count;
+}
+
+void
+MediaLibrary::Search( const std::string& query, size_t limit, std::vector<Track>& result ) const
+{
+  TRACE_SCOPE( "MediaLibrary::Search" );
+  result.clear();
+  std::shared_ptr<const Index> index = p->Current();
+  const Index& x = *index;
+  std::vector<std::string> words;
+  Words( query, words );
+
+  std::vector<uint32_t> ids;
+  if( words.empty() )
+  {
+    for( uint32_t i = 0; i < x.header->count && i < limit; ++i )
+      ids.push_back( i );
+  }
+  else
+  {
+    // Candidates from the longest word, as the most selective.
+    auto longest = std::max_element( words.begin(), words.end(),
+      []( const std::string& a, const std::string& b ) { return a.length() < b.length(); } );
+    std::string prefix = *longest;
+    words.erase( longest );
+    const KeyRecord* begin = x.keys, *end = x.keys + x.header->keyCount;
+    const KeyRecord* k = std::lower_bound( begin, end, prefix,
+      [&x]( const KeyRecord& r, const std::string& s ) { return ::strcmp( x.String( r.word ), s.c_str() ) < 0; } );
+    for( ; k < end && !::strncmp( x.String( k->word ), prefix.c_str(), prefix.length() ); ++k )
+      ids.push_back( k->track );
+    std::sort( ids.begin(), ids.end() );
+    ids.erase( std::unique( ids.begin(), ids.end() ), ids.end() );
+  }
+
+  std::vector<std::string> trackWords;
+  for( uint32_t id : ids )
+  {
+    if( result.size() >= limit )
+      break;
+    const TrackRecord& t = x.tracks[id];
+    Track track = { x.String( t.path ), x.String( t.artist ), x.String( t.album ), x.String( t.title ) };
+    bool match = true;
+    if( !words.empty() )
+    {
+      trackWords.clear();
+      Words( track.Artist + ' ' + track.Album + ' ' + track.Title, trackWords );
+      for( const auto& w : words )
+        match = match && std::any_of( trackWords.begin(), trackWords.end(),
+          [&w]( const std::string& tw ) { return !tw.compare( 0, w.length(), w ); } );
+    }
+    if( match )
+      result.push_back( track );
+  }
+}
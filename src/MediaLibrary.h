@@ -0,0 +1,45 @@
+#ifndef MEDIA_LIBRARY_H
+#define MEDIA_LIBRARY_H
+
+#include "Broadcaster.h"
+#include <string>
+#include <vector>
+
+// Index of the audio files below a music directory. The index is a file
+// that is memory-mapped at startup, and searched in place: tracks sorted
+// by artist, album, and title, and a sorted table of the words in their
+// tags for prefix search.
+// A background thread brings the index up to date with the directory,
+// reading tags of new and changed files in parallel, and follows changes
+// through inotify. Listeners are notified whenever the index is replaced.
+class MediaLibrary : public Broadcaster
+{
+public:
+  struct Settings
+  {
+    std::string Directory; // empty disables the library
+    std::string IndexFile = "/var/local/" APPNAME "/library";
+    int Threads = 0; // for reading tags, 0 for one per core
+  };
+  static void Configure( const Settings& ); // call before Instance()
+  static bool Enabled();
+  static MediaLibrary* Instance();
+
+  struct Track
+  {
+    std::string Path, Artist, Album, Title;
+  };
+  // Tracks with a word starting with each word of the query, in index
+  // order. An empty query matches all tracks.
+  void Search( const std::string& query, size_t limit, std::vector<Track>& ) const;
+  size_t Count() const;
+
+private:
+  MediaLibrary();
+  ~MediaLibrary();
+
+  struct Private;
+  Private* p;
+};
+
+#endif // MEDIA_LIBRARY_H
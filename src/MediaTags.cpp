@@ -0,0 +1,292 @@
+#include "MediaTags.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Tags are read from the beginning of a file, which is read again up to
+// the maximum size if the first read does not cover them.
+static const size_t sHeadSize = 16 * 1024, sMaxHeadSize = 256 * 1024;
+static const size_t sId3v1Size = 128;
+
+namespace {
+
+struct File
+{
+  int fd;
+  explicit File( const std::string& path ) : fd( ::open( path.c_str(), O_RDONLY | O_CLOEXEC ) ) {}
+  ~File() { if( fd >= 0 ) ::close( fd ); }
+  bool Read( std::string& s, off_t offset, size_t length )
+  {
+    s.resize( length );
+    ssize_t n = ::pread( fd, &s[0], length, offset );
+    s.resize( n > 0 ? n : 0 );
+    return n > 0;
+  }
+};
+
+uint32_t Be32( const char* p )
+{
+  const unsigned char* u = reinterpret_cast<const unsigned char*>( p );
+  return u[0] << 24 | u[1] << 16 | u[2] << 8 | u[3];
+}
+
+uint32_t Le32( const char* p )
+{
+  const unsigned char* u = reinterpret_cast<const unsigned char*>( p );
+  return u[3] << 24 | u[2] << 16 | u[1] << 8 | u[0];
+}
+
+uint32_t SyncSafe( const char* p )
+{
+  const unsigned char* u = reinterpret_cast<const unsigned char*>( p );
+  return (u[0] & 0x7f) << 21 | (u[1] & 0x7f) << 14 | (u[2] & 0x7f) << 7 | (u[3] & 0x7f);
+}
+
+void AppendUtf8( std::string& s, uint32_t c )
+{
+  if( c < 0x80 )
+    s += char( c );
+  else if( c < 0x800 )
+  {
+    s += char( 0xc0 | c >> 6 );
+    s += char( 0x80 | (c & 0x3f) );
+  }
+  else if( c < 0x10000 )
+  {
+    s += char( 0xe0 | c >> 12 );
+    s += char( 0x80 | (c >> 6 & 0x3f) );
+    s += char( 0x80 | (c & 0x3f) );
+  }
+  else
+  {
+    s += char( 0xf0 | c >> 18 );
+    s += char( 0x80 | (c >> 12 & 0x3f) );
+    s += char( 0x80 | (c >> 6 & 0x3f) );
+    s += char( 0x80 | (c & 0x3f) );
+  }
+}
+
+std::string Latin1( const char* p, size_t n )
+{
+  std::string s;
+  for( size_t i = 0; i < n && p[i]; ++i )
+    AppendUtf8( s, static_cast<unsigned char>( p[i] ) );
+  return s;
+}
+
+std::string Utf16( const char* p, size_t n, bool bigEndian )
+{
+  if( n >= 2 && static_cast<unsigned char>( p[0] ) + static_cast<unsigned char>( p[1] ) == 0xff + 0xfe
+      && p[0] != p[1] )
+  {
+    bigEndian = static_cast<unsigned char>( p[0] ) == 0xfe;
+    p += 2;
+    n -= 2;
+  }
+  std::string s;
+  for( size_t i = 0; i + 1 < n; i += 2 )
+  {
+    uint32_t c = bigEndian ? (uint8_t( p[i] ) << 8 | uint8_t( p[i + 1] ))
+                           : (uint8_t( p[i + 1] ) << 8 | uint8_t( p[i] ));
+    if( c == 0 )
+      break;
+    if( c >= 0xd800 && c < 0xdc00 && i + 3 < n )
+    {
+      uint32_t low = bigEndian ? (uint8_t( p[i + 2] ) << 8 | uint8_t( p[i + 3] ))
+                               : (uint8_t( p[i + 3] ) << 8 | uint8_t( p[i + 2] ));
+      c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+      i += 2;
+    }
+    AppendUtf8( s, c );
+  }
+  return s;
+}
+
+// ID3v2 text frame content: an encoding byte, then the text.
+std::string Id3Text( const char* p, size_t n )
+{
+  if( n < 1 )
+    return "";
+  switch( p[0] )
+  {
+    case 1:
+      return Utf16( p + 1, n - 1, false );
+    case 2:
+      return Utf16( p + 1, n - 1, true );
+    case 3:
+      return std::string( p + 1, ::strnlen( p + 1, n - 1 ) );
+    default:
+      return Latin1( p + 1, n - 1 );
+  }
+}
+
+bool ReadId3v2( const std::string& head, MediaTags& tags )
+{
+  if( head.length() < 10 || head.compare( 0, 3, "ID3" ) )
+    return false;
+  int version = head[3], flags = head[5];
+  size_t end = std::min<size_t>( 10 + SyncSafe( &head[6] ), head.length() ), pos = 10;
+  if( version < 2 || version > 4 || (flags & 0x80) ) // unsynchronised tags are rare, and not supported
+    return false;
+  if( version > 2 && (flags & 0x40) && pos + 4 <= end ) // extended header
+    pos += (version == 3 ? Be32( &head[pos] ) + 4 : SyncSafe( &head[pos] ));
+  const size_t idLength = version == 2 ? 3 : 4, headerLength = version == 2 ? 6 : 10;
+  bool found = false;
+  while( pos + headerLength <= end && head[pos] )
+  {
+    std::string id = head.substr( pos, idLength );
+    size_t size = version == 2 ? (Be32( &head[pos + 2] ) & 0xffffff)
+                : version == 3 ? Be32( &head[pos + 4] )
+                : SyncSafe( &head[pos + 4] );
+    pos += headerLength;
+    if( size > end - pos )
+      break;
+    std::string* value = nullptr;
+    if( id == "TIT2" || id == "TT2" )
+      value = &tags.Title;
+    else if( id == "TPE1" || id == "TP1" )
+      value = &tags.Artist;
+    else if( id == "TALB" || id == "TAL" )
+      value = &tags.Album;
+    if( value )
+    {
+      *value = Id3Text( &head[pos], size );
+      found = true;
+    }
+    pos += size;
+  }
+  return found;
+}
+
+bool ReadId3v1( File& f, off_t fileSize, MediaTags& tags )
+{
+  std::string tail;
+  if( fileSize < off_t( sId3v1Size ) || !f.Read( tail, fileSize - sId3v1Size, sId3v1Size )
+      || tail.length() < sId3v1Size || tail.compare( 0, 3, "TAG" ) )
+    return false;
+  auto trim = []( std::string s ) { return s.erase( s.find_last_not_of( ' ' ) + 1 ); };
+  tags.Title = trim( Latin1( &tail[3], 30 ) );
+  tags.Artist = trim( Latin1( &tail[33], 30 ) );
+  tags.Album = trim( Latin1( &tail[63], 30 ) );
+  return true;
+}
+
+// Vendor string, then a count of "KEY=value" comments, with 32 bit
+// little endian lengths.
+bool ReadVorbisComments( const std::string& head, size_t pos, MediaTags& tags )
+{
+  if( pos + 4 > head.length() )
+    return false;
+  pos += 4 + Le32( &head[pos] );
+  if( pos + 4 > head.length() )
+    return false;
+  uint32_t count = Le32( &head[pos] );
+  pos += 4;
+  bool found = false;
+  for( uint32_t i = 0; i < count && pos + 4 <= head.length(); ++i )
+  {
+    size_t length = Le32( &head[pos] );
+    pos += 4;
+    if( length > head.length() - pos )
+      break;
+    std::string comment = head.substr( pos, length );
+    pos += length;
+    size_t eq = comment.find( '=' );
+    if( eq == std::string::npos )
+      continue;
+    std::string key = comment.substr( 0, eq );
+    for( auto& c : key )
+      c = ::toupper( c );
+    std::string* value = key == "TITLE" ? &tags.Title
+                       : key == "ARTIST" ? &tags.Artist
+                       : key == "ALBUM" ? &tags.Album
+                       : nullptr;
+    if( value && value->empty() )
+    {
+      *value = comment.substr( eq + 1 );
+      found = true;
+    }
+  }
+  return found;
+}
+
+bool ReadFlac( const std::string& head, MediaTags& tags )
+{
+  if( head.compare( 0, 4, "fLaC" ) )
+    return false;
+  for( size_t pos = 4; pos + 4 <= head.length(); )
+  {
+    int type = head[pos] & 0x7f;
+    bool last = head[pos] & 0x80;
+    size_t length = Be32( &head[pos] ) & 0xffffff;
+    pos += 4;
+    if( type == 4 )
+      return ReadVorbisComments( head.substr( pos, length ), 0, tags );
+    if( last )
+      break;
+    pos += length;
+  }
+  return false;
+}
+
+// The comment header is the second packet of a Vorbis or Opus stream,
+// and is assumed not to span pages, which holds without cover art.
+bool ReadOgg( const std::string& head, MediaTags& tags )
+{
+  if( head.compare( 0, 4, "OggS" ) )
+    return false;
+  static const std::string vorbis( "\x03vorbis", 7 ), opus( "OpusTags" );
+  size_t pos = head.find( vorbis );
+  if( pos != std::string::npos )
+    return ReadVorbisComments( head, pos + vorbis.length(), tags );
+  pos = head.find( opus );
+  if( pos != std::string::npos )
+    return ReadVorbisComments( head, pos + opus.length(), tags );
+  return false;
+}
+
+} // namespace
+
+bool
+MediaTags::Read( const std::string& path, MediaTags& tags )
+{
+  tags = MediaTags();
+  File f( path );
+  struct stat st;
+  std::string head;
+  bool found = false;
+  if( f.fd >= 0 && ::fstat( f.fd, &st ) == 0 && f.Read( head, 0, sHeadSize ) )
+  {
+    if( head.length() >= 10 && !head.compare( 0, 3, "ID3" ) && SyncSafe( &head[6] ) + 10 > head.length() )
+      f.Read( head, 0, std::min<size_t>( SyncSafe( &head[6] ) + 10, sMaxHeadSize ) );
+    found = ReadId3v2( head, tags ) || ReadFlac( head, tags ) || ReadOgg( head, tags );
+    if( !found && head.length() == sHeadSize && head.compare( 0, 3, "ID3" ) && f.Read( head, 0, sMaxHeadSize ) )
+      found = ReadFlac( head, tags ) || ReadOgg( head, tags );
+    found = found || ReadId3v1( f, st.st_size, tags );
+  }
+
+  // .../Artist/Album/NN Title.ext
+  size_t slash = path.rfind( '/' );
+  if( tags.Title.empty() )
+  {
+    std::string name = path.substr( slash + 1 );
+    tags.Title = name.substr( 0, name.rfind( '.' ) );
+  }
+  if( slash != std::string::npos && slash > 0 )
+  {
+    size_t albumSlash = path.rfind( '/', slash - 1 );
+    if( tags.Album.empty() && albumSlash != std::string::npos )
+      tags.Album = path.substr( albumSlash + 1, slash - albumSlash - 1 );
+    if( tags.Artist.empty() && albumSlash != std::string::npos && albumSlash > 0 )
+    {
+      size_t artistSlash = path.rfind( '/', albumSlash - 1 );
+      if( artistSlash != std::string::npos )
+        tags.Artist = path.substr( artistSlash + 1, albumSlash - artistSlash - 1 );
+    }
+  }
+  return found;
+}
@@ -0,0 +1,17 @@
+#ifndef MEDIA_TAGS_H
+#define MEDIA_TAGS_H
+
+#include <string>
+
+// Artist, album, and title of an audio file, from ID3v2 and ID3v1 tags
+// (mp3), or Vorbis comments (flac, ogg, opus). Values are UTF-8.
+struct MediaTags
+{
+  std::string Artist, Album, Title;
+
+  // Returns false if the file has no tags; missing values are then taken
+  // from the file name, and the names of the directories above it.
+  static bool Read( const std::string& path, MediaTags& );
+};
+
+#endif // MEDIA_TAGS_H
@@ -1,4 +1,5 @@
 #include "PipedResource.h"
+#include "Log.h"
 #include <Wt/Http/Response>
 #include <cstdio>
 
@@ -64,7 +65,7 @@ PipedResource::handleRequest( const Wt::Http::Request& req, Wt::Http::Response&
       {
         int err = ::pclose( fp );
         if( err )
-          Wt::log("error") << mCommand << ": " << ::strerror(err==-1?errno:err);
+          LOG( Web, Error, "{1}: {2}", mCommand, ::strerror(err==-1?errno:err) );
       }
     }
   }
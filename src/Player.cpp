@@ -1,8 +1,21 @@
 #include "Player.h"
 #include "SlaveProcess.h"
+#include "AudioPipeline.h"
+#include "Clock.h"
+#include "Hardware.h"
+#include "IcyMetadata.h"
+#include "Log.h"
+#include "Recorder.h"
+#include "SharedState.h"
+#include "TimeShift.h"
+#include "Trace.h"
 
+#include <algorithm>
 #include <atomic>
+#include <cmath>
+#include <deque>
 #include <map>
+#include <mutex>
 #include <thread>
 #include <signal.h>
 
@@ -13,150 +26,471 @@ static const char* sQueryProperties[] =
   "audio_bitrate",
   "audio_codec",
   "time_pos",
+  "time_length",
 };
 
+// The next queued item is handed to mplayer this long before the current
+// one ends, so that mplayer opens it while still playing.
+static const double sPrefetchSeconds = 10;
+
+// Synchronized playback, see Synchronize(): ahead by more than the pause
+// threshold, playback pauses for the difference; behind by more, it seeks
+// forward, at most every few seconds. Smaller differences are taken up by
+// playing slightly faster or slower, proportional to the difference.
+static const double sSyncPauseSeconds = 0.05, sSyncDeadBandSeconds = 0.002,
+                    sSyncGain = 0.1, sSyncMaxSpeedChange = 0.005;
+static const int64_t sSyncSeekIntervalUs = 3000000;
+
 enum { idle, playPending, playing, terminating, };
 enum { none, MPlayer, Audiocast };
+static Player::Settings sSettings[Hardware::MaxZones];
+static const char* const sThreadNames[Hardware::MaxZones] =
+  { "Player", "Player 1", "Player 2", "Player 3" };
+
 struct Player::Private
 {
   Player* mpSelf;
-  SlaveProcess mProcess;
+  // The first zone has the PCM tap, time shifting, and crossfading, and is
+  // the one that recording and replay cover.
+  int mZone = 0;
+  bool Recorded() const { return mZone == 0; }
+  bool Replaying() const { return Recorded() && Recorder::Replaying(); }
+  void Record( int event, const std::string& data = "" )
+  {
+    if( Recorded() )
+      Recorder::Record( event, data );
+  }
+  void Record( int event, bool data )
+  {
+    if( Recorded() )
+      Recorder::Record( event, data );
+  }
+  // mplayer instances for crossfaded switching, see AudioPipeline.h. The
+  // incoming one starts a new stream while the active one plays on.
+  struct Decoder
+  {
+    SlaveProcess process;
+    bool frontEnd = false;
+    std::string path;
+  };
+  Decoder mDecoders[AudioPipeline::NumDecoders];
+  std::atomic<int> mActive { 0 }, mSwitched { -1 };
+  int mIncoming = -1;
+  std::string mIncomingFile;
+  SlaveProcess& Process() { return mDecoders[mActive].process; }
   std::atomic<int> mProcessKind;
   std::thread* mpThread = nullptr;
 
   std::mutex mMutex;
   std::atomic<int> mState;
   bool mPosPending = false, mPaused = false;
+  std::string mTitle;
+  // Play queue. The handed off item is in mplayer's playlist already, and
+  // is stopped when it starts if the queue was cleared meanwhile.
+  std::deque<std::string> mQueue;
+  std::string mCurrent, mHandedOff;
+  bool mSkipHandedOff = false;
+  std::mutex mTitleMutex;
+  struct TitleBroadcaster : BasicBroadcaster<std::string>
+  {
+    using BasicBroadcaster::Broadcast;
+  } mTitleListeners;
   std::map<std::string, std::string> mProperties;
   int mUpdateIntervalMs = 500;
+  struct
+  {
+    int64_t StartUs = 0;
+    boost::function<int64_t()> ClockUs;
+    int Decoder = -1; // that plays the synchronized file
+    bool StartOnly = false; // a network stream, held until the start only
+    int64_t ResumeUs = 0, SeekUs = 0; // monotonic
+    double Speed = 1;
+  } mSync;
 
   static void ThreadFunc( Private* );
+  bool OnTimeout();
+  bool OnOutput( const std::vector<std::string>& );
+  void OnPosition();
+  bool OnPlaying( const std::string& file );
+  bool OnEndOfFile( int code );
+  bool OnSwitched( int decoder );
+  void OnSync();
+  void ClearSync();
+  int SyncWaitMs( int intervalMs );
+
+  bool Exec( int decoder, const std::vector<std::string>& );
+  bool Running();
+  std::vector<std::string> PlayerArgs( int decoder );
+  void Play( const std::string& );
+  void Switch( const std::string& );
+  bool StopIncoming();
+  void Pause();
+  void Stop();
+  void Seek( double secondsBehindLive );
+  void OnTitle( const std::string& );
+  void Enqueue( const std::string& );
+  void Next();
+  void ClearQueue();
 };
 
 void
 Player::Private::ThreadFunc( Private* p )
 {
+  static const int audiocastUpdateIntervalMs = 1000;
+  Trace::SetThreadName( sThreadNames[p->mZone] );
   while( true )
   {
+    int switched = p->mSwitched.exchange( -1 );
+    if( switched >= 0 )
+    {
+      p->Record( Recorder::PlayerSwitched, std::to_string( switched ) );
+      if( p->OnSwitched( switched ) )
+        p->mpSelf->Broadcast();
+    }
+    int kind = p->mProcessKind;
+    if( kind == none )
+    {
+      if( p->mState == terminating )
+        return;
+      p->Process().WaitForOutputMs(250);
+      continue;
+    }
     bool changed = false;
-    if(p->mProcessKind == MPlayer)
+    int intervalMs = (kind == MPlayer) ? p->mUpdateIntervalMs : audiocastUpdateIntervalMs;
+    intervalMs = p->SyncWaitMs( intervalMs );
+    if( !p->Process().WaitForOutputMs( intervalMs ) )
     {
-      if( !p->mProcess.WaitForOutputMs( p->mUpdateIntervalMs ) )
+      p->Record( Recorder::PlayerTimeout );
+      changed = p->OnTimeout();
+    }
+    else
+    {
+      // mplayer answers are read one at a time, audiocast statistics as a block
+      std::vector<std::string> lines;
+      std::string line;
+      do
       {
-        std::lock_guard<std::mutex> lock(p->mMutex);
-        if(!p->mProcess.Running())
-        {
-          p->mProcessKind = none;
-          p->mPosPending = false;
-          p->mState = idle;
-          p->mProperties.clear();
-          changed = true;
-        }
-        else if( p->mState == playing && !p->mPosPending )
-        {
-          p->mProcess.Input() << "get_time_pos" << std::endl;
-          p->mPosPending = true;
-        }
-      }
-      else
+        if( std::getline( p->Process().Output(), line ) )
+          lines.push_back( line );
+      } while( kind == Audiocast && p->Process().WaitForOutputMs(0) );
+      if( p->Recorded() && Recorder::Recording() )
       {
-        std::string line;
-        if( std::getline( p->mProcess.Output(), line ) )
-        {
-          static const std::string tag = "ANS_";
-          size_t pos = line.find("=");
-          if( line.find( tag ) == 0 && pos != std::string::npos )
-          {
-            std::string name = line.substr( tag.length(), pos - tag.length() ),
-              value = line.substr( pos + 1 );
-            if( !value.empty() && value.front() == '\'' && value.back() == '\'' )
-              value = value.substr( 1, value.length() - 2 );
-            for( auto& c : name )
-              c = ::tolower(c);
-            std::lock_guard<std::mutex> lock(p->mMutex);
-            p->mProperties[name] = value;
-            if( name == "time_position" )
-            {
-              p->mPosPending = false;
-              if( p->mState == playPending )
-                p->mState = playing;
-              changed = true;
-            }
-          }
-        }
+        std::string data;
+        for( const auto& l : lines )
+          data += l + "\n";
+        Recorder::Record( Recorder::PlayerOutput, data );
       }
+      changed = p->OnOutput( lines );
+    }
+    if( changed )
+    {
+      TRACE_SCOPE( "Player::Broadcast" );
+      p->mpSelf->Broadcast();
     }
-    else if(p->mProcessKind == Audiocast)
+  }
+}
+
+bool
+Player::Private::OnTimeout()
+{
+  TRACE_SCOPE( "Player::OnTimeout" );
+  std::lock_guard<std::mutex> lock(mMutex);
+  if(!Running())
+  {
+    mProcessKind = none;
+    mPosPending = false;
+    mState = idle;
+    mProperties.clear();
+    return true;
+  }
+  if( mState == playing && !mPosPending && !mSync.ResumeUs )
+  {
+    Process().Input() << (mProcessKind == MPlayer ? "get_time_pos" : "get_statistics") << std::endl;
+    mPosPending = true;
+  }
+  return false;
+}
+
+bool
+Player::Private::OnOutput( const std::vector<std::string>& lines )
+{
+  TRACE_SCOPE( "Player::OnOutput" );
+  bool changed = false;
+  std::string name, value;
+  if( mProcessKind == MPlayer )
+  {
+    for( const auto& line : lines )
     {
-      static const int audiocastUpdateIntervalMs = 1000;
-      if(!p->mProcess.WaitForOutputMs(audiocastUpdateIntervalMs))
+      if( ParseAnswer( line, name, value ) )
       {
-        std::lock_guard<std::mutex> lock(p->mMutex);
-        if(!p->mProcess.Running())
+        std::lock_guard<std::mutex> lock(mMutex);
+        mProperties[name] = value;
+        if( name == "time_position" )
         {
-          p->mProcessKind = none;
-          p->mPosPending = false;
-          p->mState = idle;
-          p->mProperties.clear();
+          mPosPending = false;
+          if( mState == playPending )
+            mState = playing;
+          OnPosition();
+          OnSync();
           changed = true;
         }
-        else if( p->mState == playing && !p->mPosPending )
-        {
-          p->mProcess.Input() << "get_statistics" << std::endl;
-          p->mPosPending = true;
-        }
       }
-      else
+      else if( line.compare( 0, 8, "Playing " ) == 0 )
       {
-        p->mPosPending = false;
-        if( p->mState == playPending )
-          p->mState = playing;
-        changed = true;
-
-        std::string line;
-        while(p->mProcess.WaitForOutputMs(0))
-        {
-          if(std::getline(p->mProcess.Output(), line))
-          {
-            std::lock_guard<std::mutex> lock(p->mMutex);
-            size_t pos = line.find('=');
-            if(pos < line.length())
-            {
-              std::string key = line.substr(0, pos);
-              p->mProperties[key] = line.substr(pos + 1);
-            }
-          }
-        }
+        // "Playing <file>."
+        std::string file = line.substr( 8 );
+        file.erase( file.find_last_not_of( "\r." ) + 1 );
+        changed |= OnPlaying( file );
+      }
+      else if( line.compare( 0, 10, "EOF code: " ) == 0 )
+        changed |= OnEndOfFile( ::atoi( line.c_str() + 10 ) );
+      else if( line.compare( 0, 10, "ICY Info: " ) == 0 )
+      {
+        // Titles of streams that mplayer fetches itself
+        std::string title;
+        if( IcyMetadata::ParseTitle( line.substr( 10 ), title ) )
+          OnTitle( title );
       }
     }
-    else if( p->mState == terminating )
-      return;
+  }
+  else if( mProcessKind == Audiocast )
+  {
+    mPosPending = false;
+    if( mState == playPending )
+      mState = playing;
+    changed = true;
+    for( const auto& line : lines )
+    {
+      if( ParseKeyValue(line, name, value) )
+      {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mProperties[name] = value;
+      }
+    }
+  }
+  return changed;
+}
+
+// Called locked, on each position update.
+void
+Player::Private::OnPosition()
+{
+  if( !mHandedOff.empty() || mQueue.empty() || mProcessKind != MPlayer )
+    return;
+  double length = ::atof( mProperties["length"].c_str() ),
+         pos = ::atof( mProperties["time_position"].c_str() );
+  if( length > 0 && length - pos < sPrefetchSeconds )
+  {
+    mHandedOff = mQueue.front();
+    mQueue.pop_front();
+    mSkipHandedOff = false;
+    Process().Input() << "loadfile " << mHandedOff << " 1" << std::endl;
+  }
+}
+
+// mplayer moved on to the next playlist item.
+bool
+Player::Private::OnPlaying( const std::string& file )
+{
+  std::string current;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if( mHandedOff.empty() || file == mCurrent )
+      return false;
+    mCurrent = mHandedOff;
+    mHandedOff.clear();
+    mProperties.clear();
+    if( mSkipHandedOff )
+    {
+      Process().Input() << "quit" << std::endl;
+      mState = idle;
+      return true;
+    }
+    for( const auto& s : sQueryProperties )
+      Process().Input() << "get_" << s << std::endl;
+    current = mCurrent;
+  }
+  if( mZone == 0 && AudioPipeline::Enabled() )
+    AudioPipeline::Instance()->SetStream( current );
+  return true;
+}
+
+// Code 1 is the end of a file, others are commands.
+bool
+Player::Private::OnEndOfFile( int code )
+{
+  std::string next;
+  int active = mActive;
+  bool frontEnd = false;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if( code != 1 || !mHandedOff.empty() )
+      return false; // mplayer continues with the next item
+    if( mQueue.empty() )
+    {
+      Process().Input() << "quit" << std::endl;
+      mState = idle;
+      mProperties.clear();
+      std::swap( frontEnd, mDecoders[active].frontEnd );
+    }
     else
-      p->mProcess.WaitForOutputMs(250);
-    if( changed )
-      p->mpSelf->Broadcast();
+    {
+      next = mQueue.front();
+      mQueue.pop_front();
+    }
+  }
+  if( next.empty() )
+  {
+    // As in Stop(), not locked.
+    if( frontEnd )
+      TimeShift::Instance( active )->Stop();
+    OnTitle( "" );
+    return true;
   }
+  // E.g. a stream that ended, or a track of unknown length
+  Play( next );
+  return true;
+}
+
+// The audio pipeline has crossfaded to the incoming decoder.
+bool
+Player::Private::OnSwitched( int decoder )
+{
+  int old;
+  bool oldFrontEnd = false, frontEnd;
+  std::string file;
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    if( decoder != mIncoming )
+      return false; // stopped meanwhile
+    old = mActive;
+    Process().Input() << "quit" << std::endl;
+    std::swap( oldFrontEnd, mDecoders[old].frontEnd );
+    mActive = decoder;
+    mIncoming = -1;
+    file = mIncomingFile;
+    frontEnd = mDecoders[decoder].frontEnd;
+    mCurrent = mDecoders[decoder].path;
+    // A handed off item was in the old player's playlist.
+    if( !mHandedOff.empty() && !mSkipHandedOff )
+      mQueue.push_front( mHandedOff );
+    mHandedOff.clear();
+    mPosPending = false;
+    mProperties.clear();
+    for( const auto& s : sQueryProperties )
+      Process().Input() << "get_" << s << std::endl;
+  }
+  if( oldFrontEnd )
+    TimeShift::Instance( old )->Stop();
+  if( mZone == 0 && AudioPipeline::Enabled() )
+    AudioPipeline::Instance()->SetStream( file );
+  // During replay, the recorded title follows.
+  if( !Replaying() )
+  {
+    std::string title = frontEnd ? TimeShift::Instance( decoder )->Title() : "";
+    Record( Recorder::StreamTitle, title );
+    OnTitle( title );
+  }
+  return true;
+}
+
+bool
+Player::Private::Exec( int decoder, const std::vector<std::string>& args )
+{
+  if( Replaying() )
+    return Recorder::Replay( Recorder::PlayerExec, true );
+  bool ok = mDecoders[decoder].process.Exec( args );
+  Record( Recorder::PlayerExec, ok );
+  return ok;
+}
+
+bool
+Player::Private::Running()
+{
+  if( Replaying() )
+    return Recorder::Replay( Recorder::PlayerRunning, false );
+  bool running = Process().Running();
+  Record( Recorder::PlayerRunning, running );
+  return running;
+}
+
+bool
+Player::ParseAnswer( const std::string& line, std::string& name, std::string& value )
+{
+  static const std::string tag = "ANS_";
+  size_t pos = line.find("=");
+  if( line.compare( 0, tag.length(), tag ) || pos == std::string::npos )
+    return false;
+  name.assign( line, tag.length(), pos - tag.length() );
+  value.assign( line, pos + 1, std::string::npos );
+  if( value.length() > 1 && value.front() == '\'' && value.back() == '\'' )
+    value = value.substr( 1, value.length() - 2 );
+  for( auto& c : name )
+    c = ::tolower(c);
+  return true;
+}
+
+bool
+Player::ParseKeyValue( const std::string& line, std::string& key, std::string& value )
+{
+  size_t pos = line.find('=');
+  if(pos >= line.length())
+    return false;
+  key.assign(line, 0, pos);
+  value.assign(line, pos + 1, std::string::npos);
+  return true;
+}
+
+void
+Player::Configure( const Settings& s, int zone )
+{
+  sSettings[zone] = s;
 }
 
 Player*
-Player::Instance()
+Player::Instance( int zone )
 {
-  static Player sPlayer;
-  return &sPlayer;
+  static struct Instances
+  {
+    Player* zones[Hardware::MaxZones] = {};
+    std::once_flag once[Hardware::MaxZones];
+    ~Instances() { for( auto p : zones ) delete p; }
+  } sInstances;
+  std::call_once( sInstances.once[zone], [zone]{ sInstances.zones[zone] = new Player( zone ); } );
+  return sInstances.zones[zone];
 }
 
-Player::Player()
+Player::Player( int zone )
 : p( new Private )
 {
   p->mpSelf = this;
+  p->mZone = zone;
   p->mProcessKind = none;
   p->mState = idle;
-  p->mpThread = new std::thread( &Private::ThreadFunc, p );
+  if( !p->Replaying() )
+    p->mpThread = new std::thread( &Private::ThreadFunc, p );
+  if( zone != 0 )
+    return;
+  // Titles of an incoming stream are picked up when it becomes active.
+  for( int i = 0; i < TimeShift::NumSlots; ++i )
+    TimeShift::Instance( i )->SetTitleListener( [this, i]( const std::string& title )
+    {
+      if( i != p->mActive )
+        return;
+      p->Record( Recorder::StreamTitle, title );
+      p->OnTitle( title );
+    } );
+  if( AudioPipeline::Crossfades() )
+    AudioPipeline::Instance()->SetSwitchListener( [this]( int decoder )
+    {
+      p->mSwitched = decoder;
+    } );
 }
 
 Player::~Player()
 {
   Stop();
+  p->mState = terminating;
   if( p->mpThread && p->mpThread->joinable() )
     p->mpThread->join();
   delete p->mpThread;
@@ -179,8 +513,140 @@ Player::SetUpdateIntervalMs( int interval )
 
 void
 Player::Play( const std::string& file )
+{
+  p->Record( Recorder::PlayerCommand, "play " + file );
+  p->Play( file );
+}
+
+void
+Player::Switch( const std::string& file )
+{
+  p->Record( Recorder::PlayerCommand, "switch " + file );
+  p->Switch( file );
+}
+
+void
+Player::Pause()
+{
+  p->Record( Recorder::PlayerCommand, "pause" );
+  p->Pause();
+}
+
+void
+Player::Stop()
+{
+  p->Record( Recorder::PlayerCommand, "stop" );
+  p->Stop();
+}
+
+void
+Player::Enqueue( const std::string& file )
+{
+  p->Record( Recorder::PlayerCommand, "enqueue " + file );
+  p->Enqueue( file );
+  Broadcast();
+}
+
+void
+Player::Next()
+{
+  p->Record( Recorder::PlayerCommand, "next" );
+  p->Next();
+}
+
+void
+Player::ClearQueue()
+{
+  p->Record( Recorder::PlayerCommand, "clearqueue" );
+  p->ClearQueue();
+  Broadcast();
+}
+
+void
+Player::Synchronize( int64_t startUs, const boost::function<int64_t()>& clockUs )
+{
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  p->ClearSync();
+  // The file just set, which is still the incoming one during a crossfade.
+  int decoder = p->mIncoming >= 0 ? p->mIncoming : int( p->mActive );
+  const std::string& file = p->mIncoming >= 0 ? p->mIncomingFile : p->mCurrent;
+  // The position of a network stream says nothing about its content.
+  p->mSync.StartOnly = p->mDecoders[decoder].frontEnd || file.find( "://" ) != std::string::npos;
+  p->mSync.Decoder = decoder;
+  p->mSync.StartUs = startUs;
+  p->mSync.ClockUs = clockUs;
+}
+
+void
+Player::Rewind( int seconds )
+{
+  p->Record( Recorder::PlayerCommand, "rewind " + std::to_string( seconds ) );
+  p->Seek( TimeShiftDelay() + seconds );
+}
+
+void
+Player::GoLive()
+{
+  p->Record( Recorder::PlayerCommand, "live" );
+  p->Seek( 0 );
+}
+
+void
+Player::Replay( int event, const std::string& data )
+{
+  bool changed = false;
+  switch( event )
+  {
+    case Recorder::PlayerCommand:
+      if( data.find( "play " ) == 0 )
+        p->Play( data.substr( 5 ) );
+      else if( data.find( "switch " ) == 0 )
+        p->Switch( data.substr( 7 ) );
+      else if( data == "pause" )
+        p->Pause();
+      else if( data == "stop" )
+        p->Stop();
+      else if( data.find( "rewind " ) == 0 )
+        p->Seek( TimeShiftDelay() + ::atoi( data.c_str() + 7 ) );
+      else if( data == "live" )
+        p->Seek( 0 );
+      else if( data.find( "enqueue " ) == 0 )
+        p->Enqueue( data.substr( 8 ) );
+      else if( data == "next" )
+        p->Next();
+      else if( data == "clearqueue" )
+        p->ClearQueue();
+      break;
+    case Recorder::StreamTitle:
+      p->OnTitle( data );
+      break;
+    case Recorder::PlayerSwitched:
+      changed = p->OnSwitched( ::atoi( data.c_str() ) );
+      break;
+    case Recorder::PlayerTimeout:
+      changed = p->OnTimeout();
+      break;
+    case Recorder::PlayerOutput:
+    {
+      std::vector<std::string> lines;
+      std::istringstream iss( data );
+      std::string line;
+      while( std::getline( iss, line ) )
+        lines.push_back( line );
+      changed = p->OnOutput( lines );
+      break;
+    }
+  }
+  if( changed )
+    Broadcast();
+}
+
+void
+Player::Private::Play( const std::string& file )
 {
   Stop();
+  if( !file.empty() && mZone == 0 && AudioPipeline::Enabled() )
+    AudioPipeline::Instance()->SetStream( file );
   std::string audiocast_tag = "audiocast://";
   if(file.find(audiocast_tag) == 0)
   {
@@ -195,65 +661,324 @@ Player::Play( const std::string& file )
       iss.ignore();
     while(std::getline(iss, s, '&'))
       args.push_back("--" + s);
-    if( !p->mProcess.Exec(args) )
+    if( !Exec( mActive, args ) )
     {
-      Wt::log("error") << "Could not run " << args[0] << ": " << ::strerror(errno);
+      LOG( Player, Error, "Could not run {1}: {2}", args[0], ::strerror(errno) );
       return;
     }
-    std::lock_guard<std::mutex> lock(p->mMutex);
-    p->mProcessKind = Audiocast;
-    p->mState = playing;
+    std::lock_guard<std::mutex> lock(mMutex);
+    mProcessKind = Audiocast;
+    mState = playing;
   }
   else if(!file.empty())
   {
-    std::vector<std::string> args =
-    { "/usr/bin/mplayer", "-idle", "-slave", "-quiet", "-ao", "alsa" };
-    if( !p->mProcess.Exec(args) )
+    int decoder = mActive;
+    std::vector<std::string> args = PlayerArgs( decoder );
+    if( !Exec( decoder, args ) )
     {
-      Wt::log("error") << "Could not run " << args[0] << ": " << ::strerror(errno);
+      LOG( Player, Error, "Could not run {1}: {2}", args[0], ::strerror(errno) );
       return;
     }
-    std::lock_guard<std::mutex> lock(p->mMutex);
-    p->mProcessKind = MPlayer;
-    p->mState = playPending;
-    p->mProcess.Input() << "loadfile " << file << std::endl;
+    // During replay, the recorded player output stands in for the stream.
+    std::string path = file;
+    bool frontEnd = mZone == 0 && TimeShift::Enabled() && TimeShift::Supports( file ) && !Replaying()
+                    && TimeShift::Instance( decoder )->Start( file, path );
+    std::lock_guard<std::mutex> lock(mMutex);
+    mProcessKind = MPlayer;
+    mState = playPending;
+    mDecoders[decoder].frontEnd = frontEnd;
+    mDecoders[decoder].path = path;
+    mCurrent = path;
+    mHandedOff.clear();
+    Process().Input() << "loadfile " << path << std::endl;
     for( const auto& s : sQueryProperties )
-      p->mProcess.Input() << "get_" << s << std::endl;
+      Process().Input() << "get_" << s << std::endl;
   }
 }
 
+std::vector<std::string>
+Player::Private::PlayerArgs( int decoder )
+{
+  std::vector<std::string> args =
+  { "/usr/bin/mplayer", "-idle", "-slave", "-quiet", "-gapless-audio", "-msglevel", "global=6" };
+  // mplayer takes ALSA device names with '=' for ':', and '.' for ','.
+  std::string device = sSettings[mZone].AlsaDevice;
+  std::replace( device.begin(), device.end(), ':', '=' );
+  std::replace( device.begin(), device.end(), ',', '.' );
+  std::vector<std::string> output = { "-ao", device.empty() ? "alsa" : "alsa:device=" + device };
+  if( mZone == 0 && AudioPipeline::Enabled() )
+    output = AudioPipeline::Instance()->PlayerArgs( decoder );
+  args.insert( args.end(), output.begin(), output.end() );
+  return args;
+}
+
+// Crossfading needs the PCM tap, and a stream playing in mplayer; only
+// the first zone has the PCM tap.
 void
-Player::Pause()
+Player::Private::Switch( const std::string& file )
 {
-  switch(p->mProcessKind)
+  int incoming = -1;
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    ClearSync();
+    if( mZone == 0 && AudioPipeline::Crossfades() && mProcessKind == MPlayer && mState == playing && !mPaused
+        && !file.empty() && file.find( "audiocast://" ) != 0 )
+      incoming = 1 - mActive;
+  }
+  if( incoming < 0 )
+  {
+    Play( file );
+    return;
+  }
+  StopIncoming(); // when switching on before the previous switch completed
+  std::vector<std::string> args = PlayerArgs( incoming );
+  if( !Exec( incoming, args ) )
+  {
+    LOG( Player, Error, "Could not run {1}: {2}", args[0], ::strerror(errno) );
+    return;
+  }
+  std::string path = file;
+  bool frontEnd = TimeShift::Enabled() && TimeShift::Supports( file ) && !Replaying()
+                  && TimeShift::Instance( incoming )->Start( file, path );
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    Decoder& d = mDecoders[incoming];
+    d.frontEnd = frontEnd;
+    d.path = path;
+    mIncoming = incoming;
+    mIncomingFile = file;
+    d.process.Input() << "loadfile " << path << std::endl;
+  }
+  AudioPipeline::Instance()->SwitchTo( incoming );
+}
+
+// Returns true if a switch was pending.
+bool
+Player::Private::StopIncoming()
+{
+  int incoming;
+  bool frontEnd = false;
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    incoming = mIncoming;
+    if( incoming < 0 )
+      return false;
+    mDecoders[incoming].process.Input() << "quit" << std::endl;
+    std::swap( frontEnd, mDecoders[incoming].frontEnd );
+    mIncoming = -1;
+  }
+  if( frontEnd )
+    TimeShift::Instance( incoming )->Stop();
+  return true;
+}
+
+// Called locked, on each position update. Compares the position with
+// the schedule, and pauses, seeks, or changes speed. A network stream
+// pauses until the start, and is left alone after.
+void
+Player::Private::OnSync()
+{
+  if( !mSync.ClockUs || mProcessKind != MPlayer || mSync.ResumeUs || mPaused
+      || mSync.Decoder != mActive || mIncoming >= 0 )
+    return; // not yet the synchronized file
+  double due = ( mSync.ClockUs() - mSync.StartUs ) * 1e-6,
+         error = ::atof( mProperties["time_position"].c_str() ) - due;
+  int64_t now = Clock::NowUs();
+  if( mSync.StartOnly )
+  {
+    if( -due > sSyncPauseSeconds )
+    {
+      Process().Input() << "pause" << std::endl;
+      mSync.ResumeUs = now + int64_t( -due * 1e6 );
+      LOG( Player, Debug, "Sync: holding stream {1}ms until the start", int( -due * 1e3 ) );
+    }
+    mSync.ClockUs.clear();
+    return;
+  }
+  if( error > sSyncPauseSeconds )
+  {
+    Process().Input() << "pause" << std::endl;
+    mSync.ResumeUs = now + int64_t( error * 1e6 );
+    LOG( Player, Debug, "Sync: {1}ms ahead, pausing", int( error * 1e3 ) );
+    return;
+  }
+  if( error < -sSyncPauseSeconds && now - mSync.SeekUs > sSyncSeekIntervalUs )
+  {
+    Process().Input() << "seek " << -error << " 0" << std::endl;
+    mSync.SeekUs = now;
+    LOG( Player, Debug, "Sync: {1}ms behind, seeking", int( -error * 1e3 ) );
+    return;
+  }
+  double speed = 1;
+  if( std::abs( error ) > sSyncDeadBandSeconds )
+    speed = 1 - std::max( -sSyncMaxSpeedChange, std::min( sSyncMaxSpeedChange, error * sSyncGain ) );
+  if( speed != mSync.Speed )
+  {
+    Process().Input() << "speed_set " << speed << std::endl;
+    mSync.Speed = speed;
+  }
+}
+
+// Called locked. Resumes playback paused for sync, at normal speed.
+void
+Player::Private::ClearSync()
+{
+  if( mProcessKind == MPlayer && mSync.ResumeUs )
+    Process().Input() << "pause" << std::endl;
+  if( mProcessKind == MPlayer && mSync.Speed != 1 )
+    Process().Input() << "speed_set 1" << std::endl;
+  mSync = decltype( mSync )();
+}
+
+// Shortens the wait for output to resume on time after a pause for sync,
+// and resumes when due.
+int
+Player::Private::SyncWaitMs( int intervalMs )
+{
+  std::lock_guard<std::mutex> lock( mMutex );
+  if( !mSync.ResumeUs )
+    return intervalMs;
+  int64_t left = mSync.ResumeUs - Clock::NowUs();
+  if( left > 0 )
+    return std::min<int64_t>( intervalMs, ( left + 999 ) / 1000 );
+  Process().Input() << "pause" << std::endl;
+  mSync.ResumeUs = 0;
+  return intervalMs;
+}
+
+void
+Player::Private::Pause()
+{
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    ClearSync();
+  }
+  switch(mProcessKind)
   {
   case MPlayer:
-    p->mProcess.Input() << "pause" << std::endl;
+    Process().Input() << "pause" << std::endl;
     break;
   case none:
     break;
   default:
-    p->mProcess.Raise(p->mPaused ? SIGCONT : SIGSTOP);
+    Process().Raise(mPaused ? SIGCONT : SIGSTOP);
   }
-  p->mPaused = !p->mPaused;
+  mPaused = !mPaused;
 }
 
 void
-Player::Stop()
+Player::Private::Stop()
 {
-  if( p->mPaused )
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    ClearSync();
+  }
+  if( mPaused )
     Pause(); // continue
-  std::lock_guard<std::mutex> lock( p->mMutex );
-  switch(p->mProcessKind)
+  bool switching = StopIncoming();
+  int active = mActive;
+  bool frontEnd = false;
   {
-  case none:
-    break;
-  case MPlayer:
-    p->mProcess.Input() << "quit" << std::endl;
-    break;
-  default:
-    p->mProcess.Kill();
+    std::lock_guard<std::mutex> lock( mMutex );
+    switch(mProcessKind)
+    {
+    case none:
+      break;
+    case MPlayer:
+      Process().Input() << "quit" << std::endl;
+      break;
+    default:
+      Process().Kill();
+    }
+    std::swap( frontEnd, mDecoders[active].frontEnd );
   }
+  // Not locked, the fetcher may be waiting in OnTitle().
+  if( frontEnd )
+    TimeShift::Instance( active )->Stop();
+  if( switching )
+    AudioPipeline::Instance()->SwitchTo( active );
+  OnTitle( "" );
+}
+
+// The feeder continues from the new position in the fifo that mplayer
+// keeps reading, so that mplayer does not see the stream end.
+void
+Player::Private::Seek( double secondsBehindLive )
+{
+  std::lock_guard<std::mutex> lock( mMutex );
+  const Decoder& d = mDecoders[mActive];
+  if( !d.frontEnd || !TimeShift::Enabled() || mProcessKind != MPlayer )
+    return;
+  TimeShift::Instance( mActive )->Seek( secondsBehindLive );
+  if( mPaused )
+    Process().Input() << "pause" << std::endl;
+  mPaused = false;
+}
+
+void
+Player::Private::Enqueue( const std::string& file )
+{
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    if( mState != idle )
+    {
+      mQueue.push_back( file );
+      OnPosition();
+      return;
+    }
+  }
+  Play( file );
+}
+
+void
+Player::Private::Next()
+{
+  std::string next;
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    if( !mHandedOff.empty() && !mSkipHandedOff && mProcessKind == MPlayer )
+    {
+      Process().Input() << "pt_step 1" << std::endl;
+      return;
+    }
+    if( !mQueue.empty() )
+    {
+      next = mQueue.front();
+      mQueue.pop_front();
+    }
+  }
+  if( next.empty() )
+    Stop();
+  else
+    Play( next );
+}
+
+void
+Player::Private::ClearQueue()
+{
+  std::lock_guard<std::mutex> lock( mMutex );
+  mQueue.clear();
+  mSkipHandedOff = !mHandedOff.empty();
+}
+
+// Title changes are pushed to title listeners, and to the listeners of
+// general player changes.
+void
+Player::Private::OnTitle( const std::string& title )
+{
+  std::lock_guard<std::mutex> lock( mTitleMutex );
+  if( title == mTitle )
+    return;
+  mTitle = title;
+  mTitleListeners.Broadcast( title );
+  mpSelf->Broadcast();
+}
+
+void
+Player::Broadcast()
+{
+  Broadcaster::Broadcast();
+  SharedState::Changed();
 }
 
 bool
@@ -270,6 +995,56 @@ Player::IsIdle() const
   return p->mState == idle;
 }
 
+bool
+Player::IsPaused() const
+{
+  std::lock_guard<std::mutex> lock(p->mMutex);
+  return p->mPaused;
+}
+
+bool
+Player::IsTimeShifted() const
+{
+  std::lock_guard<std::mutex> lock(p->mMutex);
+  return p->mDecoders[p->mActive].frontEnd && TimeShift::Enabled();
+}
+
+double
+Player::TimeShiftDelay() const
+{
+  return IsTimeShifted() ? TimeShift::Instance( p->mActive )->Delay() : 0;
+}
+
+std::vector<std::string>
+Player::Queue() const
+{
+  std::lock_guard<std::mutex> lock(p->mMutex);
+  std::vector<std::string> queue;
+  if( !p->mHandedOff.empty() && !p->mSkipHandedOff )
+    queue.push_back( p->mHandedOff );
+  queue.insert( queue.end(), p->mQueue.begin(), p->mQueue.end() );
+  return queue;
+}
+
+std::string
+Player::StreamTitle() const
+{
+  std::lock_guard<std::mutex> lock( p->mTitleMutex );
+  return p->mTitle;
+}
+
+int
+Player::AddTitleListener( const boost::function<void( const std::string& )>& func )
+{
+  return p->mTitleListeners.AddListener( func );
+}
+
+int
+Player::RemoveTitleListener()
+{
+  return p->mTitleListeners.RemoveListener();
+}
+
 std::string
 Player::StreamProperty( const std::string& name ) const
 {
@@ -2,27 +2,82 @@
 #define PLAYER_H
 
 #include "Broadcaster.h"
+#include <cstdint>
 #include <string>
+#include <vector>
 
 class Player : public Broadcaster
 {
 public:
-  static Player* Instance();
+  // One player per zone, see Hardware.h. The first zone plays through
+  // the PCM tap when the audio pipeline is enabled, see AudioPipeline.h,
+  // and is the only one with time shifting and crossfading.
+  struct Settings
+  {
+    std::string AlsaDevice; // e.g. "hw:1,0", empty for the default device
+  };
+  static void Configure( const Settings&, int zone = 0 ); // call before Instance()
+  static Player* Instance( int zone = 0 );
 
   int UpdateIntervalMs() const;
   void SetUpdateIntervalMs( int );
 
   void Play( const std::string& );
+  // Changes to another stream. With crossfading enabled, and a stream
+  // playing, the new stream starts in a second player and is crossfaded
+  // in once it has buffered enough, see AudioPipeline.h; otherwise, the
+  // same as Play().
+  void Switch( const std::string& );
   void Pause();
   void Stop();
 
+  // Play queue: queued items play in order after the current one, or
+  // right away when idle. With mplayer, the next item is queued in mplayer
+  // shortly before the current one ends, for a gapless transition.
+  void Enqueue( const std::string& );
+  void Next();
+  void ClearQueue();
+  std::vector<std::string> Queue() const;
+
+  // Keeps the position of the file just set at clockUs() - startUs, on a
+  // clock shared with other players, see Cluster.h: playback pauses until
+  // the start, and then follows the clock through small speed changes,
+  // from when the file is playing, after a crossfade. With mplayer only.
+  // Network streams start wherever their server's buffer puts them, so
+  // their positions do not match content across players: they pause until
+  // the start, and are not followed after.
+  // Play(), Switch(), Pause(), and Stop() end it.
+  void Synchronize( int64_t startUs, const boost::function<int64_t()>& clockUs );
+
+  // Time shifting of network streams, see TimeShift.h.
+  void Rewind( int seconds );
+  void GoLive();
+
   bool IsPlaying() const;
   bool IsIdle() const;
+  bool IsPaused() const;
+  bool IsTimeShifted() const;
+  double TimeShiftDelay() const; // seconds behind live
   std::string StreamProperty( const std::string& ) const;
 
+  // ICY stream title of the current network stream, if any. Title
+  // listeners are called in their session when the title changes.
+  std::string StreamTitle() const;
+  int AddTitleListener( const boost::function<void( const std::string& )>& );
+  int RemoveTitleListener();
+
+  // Parse output lines of mplayer (ANS_name=value), and audiocast (key=value).
+  static bool ParseAnswer( const std::string& line, std::string& name, std::string& value );
+  static bool ParseKeyValue( const std::string& line, std::string& key, std::string& value );
+
+  // Replay of recorded inputs, see Recorder.h.
+  void Replay( int event, const std::string& data );
+
 private:
-  Player();
+  Player( int zone );
   ~Player();
+  // To listeners, and to the shared state, see SharedState.h.
+  void Broadcast();
 
   struct Private;
   Private* p;
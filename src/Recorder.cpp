@@ -0,0 +1,189 @@
+#include "Recorder.h"
+#include "Clock.h"
+#include "Log.h"
+
+#include <atomic>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+static const char sMagic[4] = { 'G', 'S', 'R', 'L' };
+static const uint32_t sVersion = 4;
+static const int64_t sFlushIntervalUs = 1000000;
+
+namespace {
+
+void WriteVarint( std::ostream& os, uint64_t v )
+{
+  while( v >= 0x80 )
+  {
+    os.put( char( v | 0x80 ) );
+    v >>= 7;
+  }
+  os.put( char( v ) );
+}
+
+bool ReadVarint( std::istream& is, uint64_t& v )
+{
+  v = 0;
+  for( int shift = 0; shift < 64; shift += 7 )
+  {
+    int c = is.get();
+    if( c == EOF )
+      return false;
+    v |= uint64_t( c & 0x7f ) << shift;
+    if( !(c & 0x80) )
+      return true;
+  }
+  return false;
+}
+
+enum { idle, recording, replaying };
+std::atomic<int> sMode( idle );
+std::mutex sMutex;
+
+// recording
+std::ofstream sFile;
+int64_t sLastUs = 0, sLastFlushUs = 0;
+
+// replay
+std::deque<Recorder::Entry> sReceived;
+std::deque<std::string> sAskedFor[Recorder::NumEvents];
+
+} // namespace
+
+bool
+Recorder::StartRecording( const std::string& path, const Settings& settings )
+{
+  std::lock_guard<std::mutex> lock( sMutex );
+  sFile.open( path, std::ios::binary | std::ios::trunc );
+  if( !sFile )
+    return false;
+  int64_t now = Clock::NowUs(), wallClock = Clock::Now();
+  sFile.write( sMagic, sizeof(sMagic) );
+  sFile.write( reinterpret_cast<const char*>( &sVersion ), sizeof(sVersion) );
+  sFile.write( reinterpret_cast<const char*>( &now ), sizeof(now) );
+  sFile.write( reinterpret_cast<const char*>( &wallClock ), sizeof(wallClock) );
+  uint8_t pipeline = settings.AudioPipeline;
+  int32_t crossfadeMs = settings.CrossfadeMs;
+  sFile.write( reinterpret_cast<const char*>( &pipeline ), sizeof(pipeline) );
+  sFile.write( reinterpret_cast<const char*>( &crossfadeMs ), sizeof(crossfadeMs) );
+  sLastUs = sLastFlushUs = now;
+  sMode = recording;
+  LOG( General, Info, "Recording inputs to {1}", path );
+  return true;
+}
+
+bool
+Recorder::StartReplay( const std::string& path, Settings& settings )
+{
+  std::ifstream f( path, std::ios::binary );
+  char magic[sizeof(sMagic)];
+  uint32_t version = 0;
+  int64_t t = 0, wallClock = 0;
+  uint8_t pipeline = 0;
+  int32_t crossfadeMs = 0;
+  f.read( magic, sizeof(magic) );
+  f.read( reinterpret_cast<char*>( &version ), sizeof(version) );
+  f.read( reinterpret_cast<char*>( &t ), sizeof(t) );
+  f.read( reinterpret_cast<char*>( &wallClock ), sizeof(wallClock) );
+  f.read( reinterpret_cast<char*>( &pipeline ), sizeof(pipeline) );
+  f.read( reinterpret_cast<char*>( &crossfadeMs ), sizeof(crossfadeMs) );
+  if( !f || ::memcmp( magic, sMagic, sizeof(magic) ) || version != sVersion )
+    return false;
+  settings.AudioPipeline = pipeline;
+  settings.CrossfadeMs = crossfadeMs;
+
+  std::lock_guard<std::mutex> lock( sMutex );
+  int64_t start = t;
+  uint64_t delta, event, length;
+  while( ReadVarint( f, delta ) && ReadVarint( f, event ) && ReadVarint( f, length ) )
+  {
+    Entry e = { t += delta, int( event ), std::string( length, '\0' ) };
+    if( !f.read( &e.data[0], length ) || event >= NumEvents )
+      return false;
+    if( event >= PowerSensor )
+      sAskedFor[event].push_back( e.data );
+    else
+      sReceived.push_back( e );
+  }
+  Clock::SetVirtual( start, wallClock );
+  sMode = replaying;
+  return true;
+}
+
+bool
+Recorder::Recording()
+{
+  return sMode == recording;
+}
+
+bool
+Recorder::Replaying()
+{
+  return sMode == replaying;
+}
+
+void
+Recorder::Record( int event, const std::string& data )
+{
+  if( sMode != recording )
+    return;
+  std::lock_guard<std::mutex> lock( sMutex );
+  int64_t now = Clock::NowUs();
+  WriteVarint( sFile, now - sLastUs );
+  WriteVarint( sFile, event );
+  WriteVarint( sFile, data.length() );
+  sFile.write( data.data(), data.length() );
+  sLastUs = now;
+  if( now > sLastFlushUs + sFlushIntervalUs )
+  {
+    sFile.flush();
+    sLastFlushUs = now;
+  }
+}
+
+bool
+Recorder::Replay( int event, bool fallback )
+{
+  std::string data;
+  if( !Replay( event, data ) )
+    return fallback;
+  return data == "1";
+}
+
+bool
+Recorder::Replay( int event, std::string& data )
+{
+  std::lock_guard<std::mutex> lock( sMutex );
+  auto& values = sAskedFor[event];
+  if( values.empty() )
+    return false;
+  data = values.front();
+  values.pop_front();
+  return true;
+}
+
+bool
+Recorder::Next( Entry& e )
+{
+  std::lock_guard<std::mutex> lock( sMutex );
+  if( sReceived.empty() )
+    return false;
+  e = sReceived.front();
+  sReceived.pop_front();
+  return true;
+}
+
+int
+Recorder::Remaining( int event )
+{
+  std::lock_guard<std::mutex> lock( sMutex );
+  if( event >= PowerSensor )
+    return sAskedFor[event].size();
+  int n = 0;
+  for( const auto& e : sReceived )
+    n += (e.event == event);
+  return n;
+}
@@ -0,0 +1,57 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <cstdint>
+#include <string>
+
+// Records external inputs to the hardware and player state machines into
+// a compact binary log, and feeds them back during replay.
+//
+// Inputs the state machines receive (control calls, player output) are
+// replayed by a driver at their recorded time, see tools/Replay.cpp.
+// Inputs they ask for (sensor readings, lircd and I2C results) are
+// returned from the log in recorded order when the code asks again.
+class Recorder
+{
+public:
+  enum Event
+  {
+    None = 0,
+    // received
+    ControlState, Listeners, PlayerCommand, PlayerTimeout, PlayerOutput, StreamTitle,
+    PlayerSwitched,
+    // asked for
+    PowerSensor, LircReply, I2cWrite, PlayerExec, PlayerRunning, RestoredState,
+    StreamGainOffset,
+    NumEvents
+  };
+  struct Entry
+  {
+    int64_t timeUs;
+    int event;
+    std::string data;
+  };
+
+  // Settings that decide which inputs are asked for, kept in the log so
+  // that replay can follow the same path.
+  struct Settings
+  {
+    bool AudioPipeline = false; // the pcm tap, which asks for stream gain offsets
+    int CrossfadeMs = 0;
+  };
+  static bool StartRecording( const std::string& path, const Settings& );
+  static bool StartReplay( const std::string& path, Settings& ); // switches Clock to virtual time
+  static bool Recording();
+  static bool Replaying();
+
+  static void Record( int event, const std::string& data = "" );
+  static void Record( int event, bool value ) { Record( event, std::string( 1, value ? '1' : '0' ) ); }
+  // During replay, returns the next recorded value for the event, or the fallback.
+  static bool Replay( int event, bool fallback );
+  static bool Replay( int event, std::string& data );
+  // During replay, returns the next received input in recorded order.
+  static bool Next( Entry& );
+  static int Remaining( int event );
+};
+
+#endif // RECORDER_H
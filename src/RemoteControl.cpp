@@ -1,5 +1,8 @@
 #include "RemoteControl.h"
 #include "Hardware.h"
+#include "Log.h"
+#include "Recorder.h"
+#include "Trace.h"
 
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -68,7 +71,6 @@ static bool ReadLine( int fd, std::string& line )
 }
 
 
-static const char* sLircSocket = "/var/run/lirc/lircd";
 static const char* sRemoteName = "goldstard";
 
 static const struct
@@ -91,19 +93,27 @@ static const struct
 
 struct RemoteControl::Private
 {
+  std::string mLircSocket;
   int mLircFd = -1;
+  bool mRecorded = false;
+  bool Replaying() const { return mRecorded && Recorder::Replaying(); }
+  void Record( bool reply )
+  {
+    if( mRecorded )
+      Recorder::Record( Recorder::LircReply, reply );
+  }
+  bool Connect();
   bool Execute( const char*, int );
 };
 
 
-RemoteControl::RemoteControl()
+RemoteControl::RemoteControl( const std::string& lircSocket, bool recorded )
 : p( new Private )
 {
-  p->mLircFd = OpenUnixSocket( sLircSocket );
-  if( p->mLircFd < 0 )
-    Wt::log( "error" )
-      << "Could not connect to " << sLircSocket
-      << ": " << ::strerror( errno );
+  p->mLircSocket = lircSocket;
+  p->mRecorded = recorded;
+  if( !p->Replaying() )
+    p->Connect();
 }
 
 RemoteControl::~RemoteControl()
@@ -130,25 +140,49 @@ RemoteControl::StopRepeating( int key )
   return p->Execute( "SEND_STOP", key );
 }
 
+bool
+RemoteControl::Private::Connect()
+{
+  if( mLircFd < 0 )
+    mLircFd = OpenUnixSocket( mLircSocket.c_str() );
+  if( mLircFd < 0 )
+    LOG( Remote, Error, "Could not connect to {1}: {2}", mLircSocket, ::strerror( errno ) );
+  return mLircFd >= 0;
+}
+
 bool
 RemoteControl::Private::Execute( const char* inCmd, int inKey )
 {
+  TRACE_SCOPE( "RemoteControl::Execute" );
   const char* pCode = nullptr;
   for( const auto& c : sRcCodes )
     if( c.key == inKey )
       pCode = c.code;
   
+  if( pCode && Replaying() )
+    return Recorder::Replay( Recorder::LircReply, false );
   if( pCode )
   {
+    if( !Connect() )
+    {
+      Record( false );
+      return false;
+    }
     std::string cmd = inCmd;
     cmd += " ";
     cmd += sRemoteName;
     cmd += " ";
     cmd += pCode;
     if( !WriteLine( mLircFd, cmd ) )
+    {
+      LOG( Remote, Error, "lircd: {1}: {2}", cmd, ::strerror( errno ) );
+      ::close( mLircFd );
+      mLircFd = -1;
+      Record( false );
       return false;
-    std::string response = "lircd: ", line;
-    bool done = false;
+    }
+    std::string line, message;
+    bool done = false, data = false;
     enum { unknown, success, error } result = unknown;
     while( !done && ReadLine( mLircFd, line ) )
     {
@@ -158,12 +192,16 @@ RemoteControl::Private::Execute( const char* inCmd, int inKey )
         result = error;
       else if( line == "END" && result != unknown )
         done = true;
-      response += line + "\\n";
+      else if( line == "DATA" )
+        data = true;
+      else if( data && message.empty() && !::isdigit( line[0] ) )
+        message = line;
     }
     if( result != success )
-      Wt::log("error") << response;
+      LOG( Remote, Error, "lircd: {1}: ERROR {2}", cmd, message );
     else
-      Wt::log("info") << response;
+      LOG( Remote, Info, "lircd: {1}: SUCCESS", cmd );
+    Record( result == success );
     return result == success;
   }
   return false;
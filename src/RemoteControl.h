@@ -1,10 +1,14 @@
 #ifndef REMOTE_CONTROL_H
 #define REMOTE_CONTROL_H
 
+#include <string>
+
 class RemoteControl
 {
 public:
-  RemoteControl();
+  // With recorded, lircd's replies are recorded, and stand in for lircd
+  // during replay, see Recorder.h.
+  RemoteControl( const std::string& lircSocket, bool recorded );
   ~RemoteControl();
   bool SendOnce( int key );
   bool StartRepeating( int key );
@@ -0,0 +1,155 @@
+#include "Scenes.h"
+#include "ControlResource.h"
+#include "Log.h"
+
+#include <Wt/WServer>
+#include <algorithm>
+#include <fstream>
+#include <vector>
+
+static Scenes::Settings sSettings;
+
+// State members that make up the register image.
+static float Hardware::State::* const sAudioNumbers[] =
+{
+  &Hardware::State::GainCD, &Hardware::State::GainAUX, &Hardware::State::GainNetwork,
+  &Hardware::State::VolumeL, &Hardware::State::VolumeR,
+  &Hardware::State::Treble, &Hardware::State::Bass,
+};
+
+struct Scenes::Private
+{
+  struct Scene
+  {
+    std::string Name;
+    Hardware::State State;
+    bool HasStream;
+    std::string Registers;
+  };
+  std::vector<Scene> mScenes;
+
+  void Load( const std::string& path );
+};
+
+void
+Scenes::Private::Load( const std::string& path )
+{
+  std::ifstream f( path );
+  std::string line;
+  while( std::getline( f, line ) )
+  {
+    if( !line.empty() && line.back() == '\r' )
+      line.pop_back();
+    if( line.empty() || line[0] == '#' )
+      continue;
+    Scene s;
+    if( !Parse( line, s.Name, s.State, s.HasStream ) )
+    {
+      LOG( General, Error, "Invalid scene in {1}: {2}", path, line );
+      continue;
+    }
+    char buf[8];
+    int len = Hardware::StateToTDA7318( s.State, buf, false );
+    s.Registers.assign( buf, len );
+    mScenes.push_back( s );
+  }
+}
+
+bool
+Scenes::Parse( const std::string& line, std::string& name, Hardware::State& state, bool& hasStream )
+{
+  size_t pos = line.find( '=' );
+  if( pos == 0 || pos >= line.length() )
+    return false;
+  name = line.substr( 0, pos );
+  Wt::Http::ParameterMap params;
+  while( pos < line.length() )
+  {
+    size_t begin = pos + 1, end = line.find( '&', begin );
+    if( end == std::string::npos )
+      end = line.length();
+    size_t eq = line.find( '=', begin );
+    if( eq == std::string::npos || eq > end )
+      return false;
+    params[ControlResource::Unescape( line.substr( begin, eq - begin ) )].push_back(
+      ControlResource::Unescape( line.substr( eq + 1, end - eq - 1 ) ) );
+    pos = end;
+  }
+  if( params.count( "Power" ) )
+    return false;
+  state = Hardware::State();
+  state.Power = true;
+  bool streamChanged = false;
+  hasStream = params.count( "Stream" );
+  return ControlResource::ApplyParameters( params, state, streamChanged );
+}
+
+void
+Scenes::Configure( const Settings& s )
+{
+  sSettings = s;
+}
+
+Scenes*
+Scenes::Instance()
+{
+  static Scenes sInstance;
+  return &sInstance;
+}
+
+Scenes::Scenes()
+: p( new Private )
+{
+  std::string file = sSettings.File;
+  if( file.empty() && Wt::WServer::instance() )
+    file = Wt::WServer::instance()->appRoot() + "etc/scenes.conf";
+  p->Load( file );
+  LOG( General, Info, "{1} scenes in {2}", int( p->mScenes.size() ), file );
+}
+
+Scenes::~Scenes()
+{
+  delete p;
+}
+
+size_t
+Scenes::Count() const
+{
+  return p->mScenes.size();
+}
+
+std::string
+Scenes::Name( size_t i ) const
+{
+  return p->mScenes[i].Name;
+}
+
+bool
+Scenes::Get( const std::string& name, Hardware::State& state, std::string& registers ) const
+{
+  auto scene = std::find_if( p->mScenes.begin(), p->mScenes.end(),
+    [&name]( const Private::Scene& s ) { return s.Name == name; } );
+  if( scene == p->mScenes.end() )
+    return false;
+  state.Source = scene->State.Source;
+  state.Mute = scene->State.Mute;
+  for( auto n : sAudioNumbers )
+    state.*n = scene->State.*n;
+  if( scene->HasStream )
+    state.Stream = scene->State.Stream;
+  registers = scene->Registers;
+  return true;
+}
+
+bool
+Scenes::Apply( const std::string& name, int zone )
+{
+  Wt::Http::ParameterMap params;
+  params["Scene"].push_back( name );
+  if( zone != 0 )
+    params["Zone"].push_back( std::to_string( zone ) );
+  if( !ControlResource::Control( params ) )
+    return false;
+  LOG( General, Info, "Scene {1} in zone {2}", name, zone );
+  return true;
+}
@@ -0,0 +1,44 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "Hardware.h"
+#include <string>
+
+// Named presets of source, gains, volume, tone, mute, and optionally a
+// stream, one per line of etc/scenes.conf, with /control parameters:
+//   Movie night=Source=Network&GainNetwork=3&VolumeL=-20&VolumeR=-20&Bass=6
+// Audio settings not given take their defaults. The register image of
+// each scene is computed once on load, so that recalling a scene is a
+// single state change, one i2c write, and at most one player switch.
+class Scenes
+{
+public:
+  struct Settings
+  {
+    std::string File; // empty for <app root>/etc/scenes.conf
+  };
+  static void Configure( const Settings& ); // call before Instance()
+  static Scenes* Instance();
+
+  size_t Count() const;
+  std::string Name( size_t ) const;
+  // Sets the settings of a scene in a state, and returns the register
+  // image of the result. Returns false if there is no such scene.
+  bool Get( const std::string& name, Hardware::State&, std::string& registers ) const;
+  // As /control?Scene=<name>&Zone=<zone>, returns false if the state
+  // can't be changed.
+  bool Apply( const std::string& name, int zone = 0 );
+
+  // Parses "Name=Param=value&Param=value..." into a scene state.
+  static bool Parse( const std::string& line, std::string& name,
+                     Hardware::State&, bool& hasStream );
+
+private:
+  Scenes();
+  ~Scenes();
+
+  struct Private;
+  Private* p;
+};
+
+#endif // SCENES_H
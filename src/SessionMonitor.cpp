@@ -0,0 +1,223 @@
+#include "SessionMonitor.h"
+#include "Clock.h"
+#include "Log.h"
+#include "Trace.h"
+
+#include <Wt/WApplication>
+#include <Wt/WServer>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <malloc.h>
+#include <unistd.h>
+
+static SessionMonitor::Settings sSettings;
+
+static const int sCheckSeconds = 15;
+
+struct SessionMonitor::Private
+{
+  struct Session
+  {
+    int Id;
+    int64_t LastActiveUs;
+    bool Hibernated = false, Hibernating = false, Quitting = false;
+    int Widgets = 0;
+    boost::function<void()> Hibernate;
+  };
+
+  mutable std::mutex mMutex;
+  std::condition_variable mCond;
+  std::thread* mpThread = nullptr;
+  bool mRunning = true;
+  std::map<std::string, Session> mSessions;
+  int mNextId = 1;
+
+  static void ThreadFunc( Private* );
+  void Check( std::vector<std::pair<std::string, boost::function<void()>>>& posts );
+};
+
+void
+SessionMonitor::Private::ThreadFunc( Private* p )
+{
+  Trace::SetThreadName( "SessionMonitor" );
+  std::unique_lock<std::mutex> lock( p->mMutex );
+  while( p->mRunning )
+  {
+    std::vector<std::pair<std::string, boost::function<void()>>> posts;
+    p->Check( posts );
+    lock.unlock();
+    for( const auto& post : posts )
+      Wt::WServer::instance()->post( post.first, post.second );
+    lock.lock();
+    p->mCond.wait_for( lock, std::chrono::seconds( sCheckSeconds ) );
+  }
+}
+
+// Called locked.
+void
+SessionMonitor::Private::Check( std::vector<std::pair<std::string, boost::function<void()>>>& posts )
+{
+  int64_t now = Clock::NowUs(),
+          hibernateUs = sSettings.HibernateMinutes * 60 * 1000000LL,
+          reapUs = sSettings.ReapMinutes * 60 * 1000000LL;
+  boost::function<void()> quit = []{ wApp->quit(); };
+  std::vector<std::map<std::string, Session>::iterator> alive;
+  for( auto i = mSessions.begin(); i != mSessions.end(); ++i )
+  {
+    Session& s = i->second;
+    if( s.Quitting )
+      continue;
+    int64_t idle = now - s.LastActiveUs;
+    if( reapUs > 0 && idle > reapUs )
+    {
+      LOG( Web, Info, "Quitting session {1}, idle for {2}s", s.Id, idle / 1000000 );
+      s.Quitting = true;
+      posts.push_back( std::make_pair( i->first, quit ) );
+      continue;
+    }
+    if( hibernateUs > 0 && idle > hibernateUs && !s.Hibernated && !s.Hibernating && s.Hibernate )
+    {
+      LOG( Web, Info, "Hibernating session {1}, idle for {2}s", s.Id, idle / 1000000 );
+      s.Hibernating = true;
+      posts.push_back( std::make_pair( i->first, s.Hibernate ) );
+    }
+    alive.push_back( i );
+  }
+  if( sSettings.MaxSessions > 0 && alive.size() > size_t( sSettings.MaxSessions ) )
+  {
+    std::sort( alive.begin(), alive.end(),
+      []( const std::map<std::string, Session>::iterator& a, const std::map<std::string, Session>::iterator& b )
+      { return a->second.LastActiveUs < b->second.LastActiveUs; } );
+    for( size_t n = alive.size() - sSettings.MaxSessions, j = 0; j < n; ++j )
+    {
+      LOG( Web, Info, "Quitting session {1}, more than {2} sessions", alive[j]->second.Id, sSettings.MaxSessions );
+      alive[j]->second.Quitting = true;
+      posts.push_back( std::make_pair( alive[j]->first, quit ) );
+    }
+  }
+}
+
+void
+SessionMonitor::Configure( const Settings& s )
+{
+  sSettings = s;
+}
+
+SessionMonitor*
+SessionMonitor::Instance()
+{
+  static SessionMonitor sInstance;
+  return &sInstance;
+}
+
+SessionMonitor::SessionMonitor()
+: p( new Private )
+{
+}
+
+SessionMonitor::~SessionMonitor()
+{
+  {
+    std::lock_guard<std::mutex> lock( p->mMutex );
+    p->mRunning = false;
+    p->mCond.notify_all();
+  }
+  if( p->mpThread && p->mpThread->joinable() )
+    p->mpThread->join();
+  delete p->mpThread;
+  delete p;
+}
+
+void
+SessionMonitor::Register( const boost::function<void()>& hibernate )
+{
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  Private::Session& s = p->mSessions[wApp->sessionId()];
+  s.Id = p->mNextId++;
+  s.LastActiveUs = Clock::NowUs();
+  s.Hibernate = hibernate;
+  if( !p->mpThread )
+    p->mpThread = new std::thread( &Private::ThreadFunc, p );
+  else if( sSettings.MaxSessions > 0 && p->mSessions.size() > size_t( sSettings.MaxSessions ) )
+    p->mCond.notify_all();
+}
+
+void
+SessionMonitor::Unregister()
+{
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  p->mSessions.erase( wApp->sessionId() );
+}
+
+void
+SessionMonitor::Touch()
+{
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  auto i = p->mSessions.find( wApp->sessionId() );
+  if( i != p->mSessions.end() )
+    i->second.LastActiveUs = Clock::NowUs();
+}
+
+void
+SessionMonitor::SetHibernated( bool hibernated )
+{
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  auto i = p->mSessions.find( wApp->sessionId() );
+  if( i != p->mSessions.end() )
+  {
+    i->second.Hibernated = hibernated;
+    i->second.Hibernating = false;
+  }
+}
+
+void
+SessionMonitor::SetWidgets( int widgets )
+{
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  auto i = p->mSessions.find( wApp->sessionId() );
+  if( i != p->mSessions.end() )
+    i->second.Widgets = widgets;
+}
+
+std::vector<SessionMonitor::Info>
+SessionMonitor::Sessions() const
+{
+  std::vector<Info> result;
+  int64_t now = Clock::NowUs();
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  for( const auto& i : p->mSessions )
+  {
+    const Private::Session& s = i.second;
+    result.push_back( { s.Id, int( ( now - s.LastActiveUs ) / 1000000 ), s.Hibernated, s.Widgets } );
+  }
+  std::sort( result.begin(), result.end(), []( const Info& a, const Info& b ) { return a.Id < b.Id; } );
+  return result;
+}
+
+size_t
+SessionMonitor::ResidentBytes()
+{
+  size_t pages = 0, resident = 0;
+  FILE* fp = ::fopen( "/proc/self/statm", "r" );
+  if( fp )
+  {
+    if( ::fscanf( fp, "%zu %zu", &pages, &resident ) != 2 )
+      resident = 0;
+    ::fclose( fp );
+  }
+  return resident * ::sysconf( _SC_PAGESIZE );
+}
+
+size_t
+SessionMonitor::HeapBytes()
+{
+#if __GLIBC_PREREQ(2, 33)
+  return ::mallinfo2().uordblks;
+#else
+  return unsigned( ::mallinfo().uordblks );
+#endif
+}
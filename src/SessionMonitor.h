@@ -0,0 +1,53 @@
+#ifndef SESSION_MONITOR_H
+#define SESSION_MONITOR_H
+
+#include <boost/function.hpp>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Keeps track of user activity and widgets of web sessions. Optionally,
+// sessions idle for HibernateMinutes are asked to hibernate, i.e. to
+// release their widgets and listeners, and to stop server push. Sessions
+// idle for ReapMinutes, and the least recently active ones beyond
+// MaxSessions, are quit.
+class SessionMonitor
+{
+public:
+  struct Settings
+  {
+    int HibernateMinutes = 0, ReapMinutes = 0, MaxSessions = 0; // 0 disables
+  };
+  static void Configure( const Settings& ); // call before Instance()
+  static SessionMonitor* Instance();
+
+  // Called in the session. The hibernate function is called in the
+  // session, from a server thread.
+  void Register( const boost::function<void()>& hibernate );
+  void Unregister();
+  void Touch(); // user activity, ends hibernation
+  void SetHibernated( bool );
+  void SetWidgets( int );
+
+  struct Info
+  {
+    int Id;
+    int IdleSeconds;
+    bool Hibernated;
+    int Widgets;
+  };
+  std::vector<Info> Sessions() const;
+
+  // Process resident set size, and heap bytes in use.
+  static size_t ResidentBytes();
+  static size_t HeapBytes();
+
+private:
+  SessionMonitor();
+  ~SessionMonitor();
+
+  struct Private;
+  Private* p;
+};
+
+#endif // SESSION_MONITOR_H
@@ -0,0 +1,27 @@
+#include "SessionResource.h"
+#include "SessionMonitor.h"
+#include <Wt/Http/Response>
+
+SessionResource::SessionResource(Wt::WObject *parent)
+: Wt::WStreamResource(parent)
+{
+}
+
+SessionResource::~SessionResource()
+{
+  beingDeleted();
+}
+
+// Process memory, then one session per line: id, state, idle seconds,
+// and widgets of its widget tree, separated by tabs.
+void
+SessionResource::handleRequest( const Wt::Http::Request& req, Wt::Http::Response& rsp )
+{
+  rsp.setMimeType( "text/plain" );
+  rsp.out() << "Resident=" << SessionMonitor::ResidentBytes() << "\n";
+  rsp.out() << "Heap=" << SessionMonitor::HeapBytes() << "\n";
+  for( const auto& s : SessionMonitor::Instance()->Sessions() )
+    rsp.out() << s.Id << '\t' << ( s.Hibernated ? "hibernated" : "active" ) << '\t'
+              << s.IdleSeconds << '\t' << s.Widgets << '\n';
+  rsp.out() << std::endl;
+}
@@ -0,0 +1,14 @@
+#ifndef SESSION_RESOURCE_H
+#define SESSION_RESOURCE_H
+
+#include <Wt/WStreamResource>
+
+class SessionResource : public Wt::WStreamResource
+{
+public:
+  SessionResource(Wt::WObject *parent = 0);
+  ~SessionResource();
+  void handleRequest( const Wt::Http::Request&, Wt::Http::Response& );
+};
+
+#endif // SESSION_RESOURCE_H
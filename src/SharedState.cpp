@@ -0,0 +1,192 @@
+#include "SharedState.h"
+#include "StateSegment.h"
+#include "Hardware.h"
+#include "Player.h"
+#include "Log.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <sys/stat.h>
+
+static SharedState::Settings sSettings;
+static std::atomic<SharedState*> sInstance { nullptr };
+// The time shift grows while paused, without a broadcast, and is
+// published this often then.
+static const int sTimeShiftMs = 1000;
+
+static void Copy( char* dest, const std::string& s )
+{
+  size_t n = s.copy( dest, StateSegment::MaxText - 1 );
+  std::fill( dest + n, dest + StateSegment::MaxText, 0 );
+}
+
+struct SharedState::Private
+{
+  StateSegment::Segment* mpSegment = nullptr;
+  std::thread mThread;
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  bool mChanged = true, mRunning = true;
+  // Used by the thread only.
+  StateSegment::Data mData = {};
+  bool mTimeShiftGrows = false;
+
+  bool Open();
+  void ThreadFunc();
+  void Publish();
+};
+
+bool
+SharedState::Private::Open()
+{
+  // A new file each run, so that nothing left in its place, e.g. a link
+  // into someone else's files, is written to.
+  if( ::unlink( sSettings.Path.c_str() ) < 0 && errno != ENOENT )
+    LOG( General, Warning, "Could not remove {1}: {2}", sSettings.Path, ::strerror( errno ) );
+  int fd = ::open( sSettings.Path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0644 );
+  if( fd < 0 || ::ftruncate( fd, sizeof( StateSegment::Segment ) ) < 0 )
+  {
+    LOG( General, Error, "Could not create {1}: {2}", sSettings.Path, ::strerror( errno ) );
+    if( fd >= 0 )
+      ::close( fd );
+    return false;
+  }
+  ::fchmod( fd, 0644 );
+  void* p = ::mmap( nullptr, sizeof( StateSegment::Segment ), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+  ::close( fd );
+  if( p == MAP_FAILED )
+  {
+    LOG( General, Error, "Could not map {1}: {2}", sSettings.Path, ::strerror( errno ) );
+    return false;
+  }
+  // Zeroed, Sequence and Version start from 0. Readers of an earlier run
+  // keep the removed file, and need to open the path again.
+  mpSegment = static_cast<StateSegment::Segment*>( p );
+  mpSegment->Layout = StateSegment::Layout;
+  mpSegment->Size = sizeof( StateSegment::Segment );
+  mpSegment->Magic = StateSegment::Magic;
+  return true;
+}
+
+void
+SharedState::Private::ThreadFunc()
+{
+  Trace::SetThreadName( "SharedState" );
+  std::unique_lock<std::mutex> lock( mMutex );
+  while( mRunning )
+  {
+    if( !mChanged && !mTimeShiftGrows )
+    {
+      mCondition.wait( lock );
+      continue;
+    }
+    if( !mChanged )
+    {
+      if( mCondition.wait_for( lock, std::chrono::milliseconds( sTimeShiftMs ) ) == std::cv_status::timeout )
+        mChanged = true;
+      continue;
+    }
+    mChanged = false;
+    lock.unlock();
+    Publish();
+    lock.lock();
+  }
+}
+
+void
+SharedState::Private::Publish()
+{
+  TRACE_SCOPE( "SharedState::Publish" );
+  StateSegment::Data& d = mData;
+  d.ZoneCount = std::min<int>( Hardware::Zones(), StateSegment::MaxZones );
+  mTimeShiftGrows = false;
+  for( uint32_t i = 0; i < d.ZoneCount; ++i )
+  {
+    Hardware::State s;
+    Hardware::Instance( i )->GetState( s );
+    Player* pPlayer = Player::Instance( i );
+    StateSegment::Zone& z = d.Zones[i];
+    z.Power = s.Power;
+    z.Mute = s.Mute;
+    z.Source = Key::SourceIndex( s.Source );
+    z.VolumeL = s.VolumeL;
+    z.VolumeR = s.VolumeR;
+    z.Treble = s.Treble;
+    z.Bass = s.Bass;
+    z.GainCD = s.GainCD;
+    z.GainAUX = s.GainAUX;
+    z.GainNetwork = s.GainNetwork;
+    z.Playback = pPlayer->IsPaused() ? StateSegment::Paused
+               : pPlayer->IsPlaying() ? StateSegment::Playing : StateSegment::Idle;
+    z.TimeShiftSeconds = pPlayer->TimeShiftDelay();
+    mTimeShiftGrows |= pPlayer->IsTimeShifted() && pPlayer->IsPaused();
+    Copy( z.Stream, s.Stream );
+    Copy( z.Title, pPlayer->StreamTitle() );
+  }
+  struct timespec t;
+  ::clock_gettime( CLOCK_REALTIME, &t );
+  d.TimeUs = t.tv_sec * int64_t( 1000000 ) + t.tv_nsec / 1000;
+  ++d.Version;
+  StateSegment::Write( *mpSegment, d );
+}
+
+void
+SharedState::Configure( const Settings& s )
+{
+  sSettings = s;
+}
+
+bool
+SharedState::Enabled()
+{
+  return !sSettings.Path.empty();
+}
+
+SharedState*
+SharedState::Instance()
+{
+  static SharedState sSharedState;
+  return &sSharedState;
+}
+
+void
+SharedState::Changed()
+{
+  SharedState* pInstance = sInstance.load( std::memory_order_acquire );
+  if( !pInstance )
+    return;
+  std::lock_guard<std::mutex> lock( pInstance->p->mMutex );
+  pInstance->p->mChanged = true;
+  pInstance->p->mCondition.notify_one();
+}
+
+SharedState::SharedState()
+: p( new Private )
+{
+  if( !Enabled() || !p->Open() )
+    return;
+  LOG( General, Info, "Publishing state to {1}", sSettings.Path );
+  p->mThread = std::thread( &Private::ThreadFunc, p );
+  sInstance = this;
+}
+
+SharedState::~SharedState()
+{
+  sInstance = nullptr;
+  {
+    std::lock_guard<std::mutex> lock( p->mMutex );
+    p->mRunning = false;
+    p->mCondition.notify_one();
+  }
+  if( p->mThread.joinable() )
+    p->mThread.join();
+  if( p->mpSegment )
+    ::munmap( p->mpSegment, sizeof( StateSegment::Segment ) );
+  delete p;
+}
@@ -0,0 +1,33 @@
+#ifndef SHARED_STATE_H
+#define SHARED_STATE_H
+
+#include <string>
+
+// Publishes the state of all zones, of Hardware and Player, into a file in
+// /dev/shm, for local programs that read it without a system call through
+// StateSegment::Reader, see StateSegment.h. Changes are written by a
+// thread of its own, which Hardware and Player wake whenever they
+// broadcast a change.
+class SharedState
+{
+public:
+  struct Settings
+  {
+    std::string Path; // e.g. /dev/shm/goldstard, empty disables
+  };
+  static void Configure( const Settings& ); // call before Instance()
+  static bool Enabled();
+  // Call once Hardware and Player are there.
+  static SharedState* Instance();
+  // Publishes the state soon, once Instance() was called.
+  static void Changed();
+
+private:
+  SharedState();
+  ~SharedState();
+
+  struct Private;
+  Private* p;
+};
+
+#endif // SHARED_STATE_H
@@ -0,0 +1,142 @@
+#ifndef STATE_SEGMENT_H
+#define STATE_SEGMENT_H
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Layout of the state that goldstard publishes into a file in /dev/shm
+// (see SharedState.h), and a reader for local programs, header only:
+//
+//   StateSegment::Reader r;
+//   StateSegment::Data d;
+//   if( r.Open( "/dev/shm/goldstard" ) && r.Read( d ) ) ...
+//
+// The writer increments Sequence to an odd value before changing State, and
+// to the next even value after, so that a copy of State is consistent when
+// Sequence was even and unchanged around it (a seqlock). Reading takes no
+// system calls. Sequence is also a futex word, woken on each change.
+// goldstard creates the file anew when it starts, readers that keep it
+// open see no more changes then, and open it again.
+struct StateSegment
+{
+  enum { Magic = 0x67735331, Layout = 1, MaxZones = 4, MaxText = 256 };
+  enum { SourceCD, SourceAUX, SourceNetwork, SourceTape };
+  enum { Idle, Playing, Paused };
+
+  struct Zone
+  {
+    // As Hardware::State, levels in dB.
+    uint8_t Power, Mute, Source, Reserved;
+    float VolumeL, VolumeR, Treble, Bass, GainCD, GainAUX, GainNetwork;
+    // As Player.
+    int32_t Playback;
+    float TimeShiftSeconds; // behind live, updated each second while paused
+    char Stream[MaxText], Title[MaxText]; // cut, 0-terminated
+  };
+  struct Data
+  {
+    uint64_t Version; // incremented with each change
+    int64_t TimeUs; // of the change, since the epoch
+    uint32_t ZoneCount;
+    Zone Zones[MaxZones];
+  };
+  struct Segment
+  {
+    uint32_t Magic, Layout, Size;
+    std::atomic<uint32_t> Sequence;
+    Data State;
+  };
+
+  // Called by the only writer.
+  static void Write( Segment& s, const Data& d )
+  {
+    uint32_t sequence = s.Sequence.load( std::memory_order_relaxed );
+    s.Sequence.store( sequence + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+    std::memcpy( &s.State, &d, sizeof( d ) );
+    s.Sequence.store( sequence + 2, std::memory_order_release );
+    ::syscall( SYS_futex, &s.Sequence, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0 );
+  }
+
+  class Reader
+  {
+  public:
+    Reader() {}
+    ~Reader() { Close(); }
+    Reader( const Reader& ) = delete;
+    Reader& operator=( const Reader& ) = delete;
+
+    bool Open( const char* path )
+    {
+      Close();
+      int fd = ::open( path, O_RDONLY | O_CLOEXEC );
+      if( fd < 0 )
+        return false;
+      void* p = ::mmap( nullptr, sizeof( Segment ), PROT_READ, MAP_SHARED, fd, 0 );
+      ::close( fd );
+      if( p == MAP_FAILED )
+        return false;
+      mpSegment = static_cast<const Segment*>( p );
+      if( mpSegment->Magic != Magic || mpSegment->Layout != Layout || mpSegment->Size != sizeof( Segment ) )
+      {
+        Close();
+        return false;
+      }
+      return true;
+    }
+    void Close()
+    {
+      if( mpSegment )
+        ::munmap( const_cast<Segment*>( mpSegment ), sizeof( Segment ) );
+      mpSegment = nullptr;
+    }
+    bool IsOpen() const { return mpSegment; }
+
+    // Even while the state is consistent.
+    uint32_t Sequence() const
+    {
+      return mpSegment ? mpSegment->Sequence.load( std::memory_order_acquire ) : 0;
+    }
+    // A consistent copy, false if the writer kept changing it.
+    bool Read( Data& d, int tries = 1000 ) const
+    {
+      while( mpSegment && tries-- > 0 )
+      {
+        uint32_t sequence = mpSegment->Sequence.load( std::memory_order_acquire );
+        if( sequence & 1 )
+          continue;
+        std::memcpy( &d, &mpSegment->State, sizeof( d ) );
+        std::atomic_thread_fence( std::memory_order_acquire );
+        if( mpSegment->Sequence.load( std::memory_order_relaxed ) == sequence )
+          return true;
+      }
+      return false;
+    }
+    // Blocks until Sequence() differs from the one given, or the timeout
+    // (-1 for none) is over. Returns false on timeout, or if waiting failed.
+    bool Wait( uint32_t sequence, int timeoutMs = -1 ) const
+    {
+      struct timespec t = { timeoutMs / 1000, ( timeoutMs % 1000 ) * 1000000L };
+      while( mpSegment && Sequence() == sequence )
+        if( ::syscall( SYS_futex, &mpSegment->Sequence, FUTEX_WAIT, sequence,
+                       timeoutMs < 0 ? nullptr : &t, nullptr, 0 ) < 0 && errno != EAGAIN && errno != EINTR )
+          return false; // timed out, or failed
+      return true;
+    }
+
+  private:
+    const Segment* mpSegment = nullptr;
+  };
+};
+
+#endif // STATE_SEGMENT_H
@@ -0,0 +1,271 @@
+#include "StreamCatalog.h"
+#include "Log.h"
+
+#include <Wt/WServer>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+static StreamCatalog::Settings sSettings;
+
+namespace {
+
+struct Entry
+{
+  uint32_t name, url; // arena offsets
+  uint16_t nameLength, urlLength;
+};
+
+// A word in a folded name.
+struct Word
+{
+  uint32_t offset;
+  uint16_t length;
+  uint32_t entry;
+};
+
+uint32_t Hash( const char* p, size_t n )
+{
+  uint32_t h = 2166136261u; // FNV-1a
+  for( size_t i = 0; i < n; ++i )
+    h = (h ^ static_cast<unsigned char>( p[i] )) * 16777619u;
+  return h;
+}
+
+// Names are matched case insensitively for ASCII; other UTF-8 bytes are
+// word characters, and compared as they are.
+bool IsWordChar( char c )
+{
+  return static_cast<unsigned char>( c ) >= 0x80 || ::isalnum( static_cast<unsigned char>( c ) );
+}
+
+char Fold( char c )
+{
+  return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+std::vector<std::string> Words( const std::string& s )
+{
+  std::vector<std::string> words;
+  std::string word;
+  for( char c : s + ' ' )
+    if( IsWordChar( c ) )
+      word += Fold( c );
+    else if( !word.empty() )
+    {
+      words.push_back( word );
+      word.clear();
+    }
+  return words;
+}
+
+} // namespace
+
+struct StreamCatalog::Private
+{
+  std::string mArena, mFolded; // mFolded has the arena's layout, with names folded
+  std::vector<Entry> mEntries;
+  std::vector<uint32_t> mSlots; // entry + 1 by url hash, 0 for empty
+  std::vector<Word> mWords; // sorted by folded text
+
+  void Load( const std::string& path );
+  void BuildIndex();
+  int Compare( const Word&, const char* p, size_t n ) const;
+  bool HasWordPrefix( const Entry&, const std::string& prefix ) const;
+};
+
+void
+StreamCatalog::Private::Load( const std::string& path )
+{
+  std::ifstream f( path );
+  std::string line;
+  while( std::getline( f, line ) )
+  {
+    size_t pos = line.find( '=' );
+    if( pos >= line.length() )
+      continue;
+    if( !line.empty() && line.back() == '\r' )
+      line.pop_back();
+    size_t urlLength = line.length() - pos - 1;
+    if( pos > 0xffff || urlLength > 0xffff )
+      continue;
+    Entry e = { uint32_t( mArena.length() ), uint32_t( mArena.length() + pos ),
+                uint16_t( pos ), uint16_t( urlLength ) };
+    mArena.append( line, 0, pos );
+    mArena.append( line, pos + 1, urlLength );
+    mEntries.push_back( e );
+  }
+  mArena.shrink_to_fit();
+  mEntries.shrink_to_fit();
+}
+
+void
+StreamCatalog::Private::BuildIndex()
+{
+  mFolded = mArena;
+  for( const auto& e : mEntries )
+    for( size_t i = e.name; i < e.name + e.nameLength; ++i )
+      mFolded[i] = Fold( mFolded[i] );
+
+  size_t size = 1;
+  while( size < 2 * mEntries.size() )
+    size *= 2;
+  mSlots.assign( size, 0 );
+  for( uint32_t i = 0; i < mEntries.size(); ++i )
+  {
+    const Entry& e = mEntries[i];
+    size_t slot = Hash( &mArena[e.url], e.urlLength ) & (size - 1);
+    for( ; mSlots[slot]; slot = (slot + 1) & (size - 1) )
+    {
+      const Entry& other = mEntries[mSlots[slot] - 1];
+      if( other.urlLength == e.urlLength && !::memcmp( &mArena[other.url], &mArena[e.url], e.urlLength ) )
+        break; // the first of duplicate urls is kept
+    }
+    if( !mSlots[slot] )
+      mSlots[slot] = i + 1;
+  }
+
+  for( uint32_t i = 0; i < mEntries.size(); ++i )
+  {
+    const Entry& e = mEntries[i];
+    for( size_t pos = e.name, end = e.name + e.nameLength; pos < end; )
+    {
+      if( !IsWordChar( mFolded[pos] ) )
+      {
+        ++pos;
+        continue;
+      }
+      size_t begin = pos;
+      while( pos < end && IsWordChar( mFolded[pos] ) )
+        ++pos;
+      mWords.push_back( Word { uint32_t( begin ), uint16_t( pos - begin ), i } );
+    }
+  }
+  std::sort( mWords.begin(), mWords.end(), [this]( const Word& a, const Word& b )
+  {
+    return Compare( a, &mFolded[b.offset], b.length ) < 0;
+  } );
+  mWords.shrink_to_fit();
+}
+
+int
+StreamCatalog::Private::Compare( const Word& w, const char* p, size_t n ) const
+{
+  int r = ::memcmp( &mFolded[w.offset], p, std::min<size_t>( w.length, n ) );
+  return r ? r : int( w.length ) - int( n );
+}
+
+bool
+StreamCatalog::Private::HasWordPrefix( const Entry& e, const std::string& prefix ) const
+{
+  for( size_t pos = e.name, end = e.name + e.nameLength; pos + prefix.length() <= end; ++pos )
+    if( IsWordChar( mFolded[pos] ) && (pos == e.name || !IsWordChar( mFolded[pos - 1] ))
+        && !mFolded.compare( pos, prefix.length(), prefix ) )
+      return true;
+  return false;
+}
+
+void
+StreamCatalog::Configure( const Settings& s )
+{
+  sSettings = s;
+}
+
+StreamCatalog*
+StreamCatalog::Instance()
+{
+  static StreamCatalog sInstance;
+  return &sInstance;
+}
+
+StreamCatalog::StreamCatalog()
+: p( new Private )
+{
+  std::string file = sSettings.File;
+  if( file.empty() && Wt::WServer::instance() )
+    file = Wt::WServer::instance()->appRoot() + "etc/network_streams.conf";
+  p->Load( file );
+  p->BuildIndex();
+  LOG( General, Info, "{1} streams in {2}", int( p->mEntries.size() ), file );
+}
+
+StreamCatalog::~StreamCatalog()
+{
+  delete p;
+}
+
+size_t
+StreamCatalog::Count() const
+{
+  return p->mEntries.size();
+}
+
+std::string
+StreamCatalog::Name( size_t i ) const
+{
+  const Entry& e = p->mEntries[i];
+  return p->mArena.substr( e.name, e.nameLength );
+}
+
+std::string
+StreamCatalog::Url( size_t i ) const
+{
+  const Entry& e = p->mEntries[i];
+  return p->mArena.substr( e.url, e.urlLength );
+}
+
+size_t
+StreamCatalog::Find( const std::string& url ) const
+{
+  if( p->mEntries.empty() )
+    return npos;
+  size_t mask = p->mSlots.size() - 1;
+  for( size_t slot = Hash( url.data(), url.length() ) & mask; p->mSlots[slot]; slot = (slot + 1) & mask )
+  {
+    const Entry& e = p->mEntries[p->mSlots[slot] - 1];
+    if( e.urlLength == url.length() && !::memcmp( &p->mArena[e.url], url.data(), url.length() ) )
+      return p->mSlots[slot] - 1;
+  }
+  return npos;
+}
+
+// Candidates come from the prefix range of the longest query word, and
+// are checked for the other words.
+void
+StreamCatalog::Search( const std::string& query, size_t limit, std::vector<uint32_t>& result ) const
+{
+  result.clear();
+  std::vector<std::string> words = Words( query );
+  if( words.empty() )
+  {
+    for( uint32_t i = 0; i < p->mEntries.size() && result.size() < limit; ++i )
+      result.push_back( i );
+    return;
+  }
+  auto longest = std::max_element( words.begin(), words.end(),
+    []( const std::string& a, const std::string& b ) { return a.length() < b.length(); } );
+  std::string prefix = *longest;
+  words.erase( longest );
+
+  auto begin = std::lower_bound( p->mWords.begin(), p->mWords.end(), prefix,
+    [this]( const Word& w, const std::string& s ) { return p->Compare( w, s.data(), s.length() ) < 0; } );
+  std::vector<uint32_t> candidates;
+  for( auto w = begin; w != p->mWords.end() && w->length >= prefix.length()
+       && !p->mFolded.compare( w->offset, prefix.length(), prefix ); ++w )
+    candidates.push_back( w->entry );
+  std::sort( candidates.begin(), candidates.end() );
+  candidates.erase( std::unique( candidates.begin(), candidates.end() ), candidates.end() );
+
+  for( uint32_t i : candidates )
+  {
+    if( result.size() >= limit )
+      break;
+    const Entry& e = p->mEntries[i];
+    bool match = true;
+    for( const auto& word : words )
+      match = match && p->HasWordPrefix( e, word );
+    if( match )
+      result.push_back( i );
+  }
+}
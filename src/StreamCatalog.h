@@ -0,0 +1,40 @@
+#ifndef STREAM_CATALOG_H
+#define STREAM_CATALOG_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Network streams from a "Name=url" file, loaded once and shared by all
+// sessions. Names and urls are kept in a single string arena; a hash table
+// finds entries by url, and a sorted table of the words in names serves
+// prefix search. Sessions see the catalog through StreamCatalogModel.
+class StreamCatalog
+{
+public:
+  struct Settings
+  {
+    std::string File; // empty for etc/network_streams.conf below the app root
+  };
+  static void Configure( const Settings& ); // call before Instance()
+  static StreamCatalog* Instance();
+
+  static const size_t npos = size_t( -1 );
+  size_t Count() const;
+  std::string Name( size_t ) const;
+  std::string Url( size_t ) const;
+  size_t Find( const std::string& url ) const; // npos if not in the catalog
+
+  // Entries with a word in their name starting with each word of the
+  // query, in catalog order. An empty query matches all entries.
+  void Search( const std::string& query, size_t limit, std::vector<uint32_t>& ) const;
+
+private:
+  StreamCatalog();
+  ~StreamCatalog();
+
+  struct Private;
+  Private* p;
+};
+
+#endif // STREAM_CATALOG_H
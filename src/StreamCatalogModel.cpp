@@ -0,0 +1,131 @@
+#include "StreamCatalogModel.h"
+#include "StreamCatalog.h"
+#include "StreamProber.h"
+
+#include <algorithm>
+
+StreamCatalogModel::StreamCatalogModel( Wt::WObject* parent )
+: Wt::WAbstractListModel( parent )
+{
+  Update();
+}
+
+void
+StreamCatalogModel::SetFilter( const std::string& filter )
+{
+  if( filter == mFilter )
+    return;
+  mFilter = filter;
+  Update();
+}
+
+void
+StreamCatalogModel::SetCurrent( const std::string& url )
+{
+  if( url == mCurrent )
+    return;
+  mCurrent = url;
+  Update();
+}
+
+void
+StreamCatalogModel::SetSortByResponse( bool sort )
+{
+  if( sort == mSortByResponse )
+    return;
+  mSortByResponse = sort;
+  Update();
+}
+
+void
+StreamCatalogModel::Refresh()
+{
+  Update();
+}
+
+// Sorting needs all matches, which are only kept until the best are taken.
+void
+StreamCatalogModel::Update()
+{
+  const StreamCatalog* catalog = StreamCatalog::Instance();
+  if( mSortByResponse && StreamProber::Enabled() )
+  {
+    std::vector<std::pair<int, uint32_t>> ranked;
+    catalog->Search( mFilter, catalog->Count(), mRows );
+    ranked.reserve( mRows.size() );
+    for( uint32_t entry : mRows )
+      ranked.push_back( std::make_pair( StreamProber::Instance()->Rank( catalog->Url( entry ) ), entry ) );
+    size_t n = std::min<size_t>( ranked.size(), MaxRows );
+    std::partial_sort( ranked.begin(), ranked.begin() + n, ranked.end() );
+    mRows.resize( n );
+    for( size_t i = 0; i < n; ++i )
+      mRows[i] = ranked[i].second;
+    mRows.shrink_to_fit();
+  }
+  else
+    catalog->Search( mFilter, MaxRows, mRows );
+  size_t current = catalog->Find( mCurrent );
+  mPinned = !mCurrent.empty()
+            && std::find( mRows.begin(), mRows.end(), current ) == mRows.end();
+  reset();
+}
+
+int
+StreamCatalogModel::Row( const std::string& url ) const
+{
+  if( mPinned && url == mCurrent )
+    return 0;
+  size_t entry = StreamCatalog::Instance()->Find( url );
+  auto i = std::find( mRows.begin(), mRows.end(), entry );
+  if( entry == StreamCatalog::npos || i == mRows.end() )
+    return -1;
+  return (i - mRows.begin()) + mPinned;
+}
+
+std::string
+StreamCatalogModel::Url( int row ) const
+{
+  if( mPinned && row == 0 )
+    return mCurrent;
+  row -= mPinned;
+  if( row < 0 || size_t( row ) >= mRows.size() )
+    return "";
+  return StreamCatalog::Instance()->Url( mRows[row] );
+}
+
+int
+StreamCatalogModel::rowCount( const Wt::WModelIndex& parent ) const
+{
+  return parent.isValid() ? 0 : mRows.size() + mPinned;
+}
+
+boost::any
+StreamCatalogModel::data( const Wt::WModelIndex& index, int role ) const
+{
+  if( role != Wt::DisplayRole && role != Wt::ToolTipRole )
+    return boost::any();
+  std::string url = Url( index.row() );
+  StreamProber::Health h;
+  bool probed = StreamProber::Enabled() && StreamProber::Instance()->Get( url, h );
+  const StreamProbe::Result& r = h.Result;
+  if( role == Wt::ToolTipRole )
+  {
+    std::string tip = url;
+    if( probed && r.status == StreamProbe::Ok )
+      tip += "\n" + (r.Codec.empty() ? "" : r.Codec + " ")
+             + (r.Bitrate ? std::to_string( r.Bitrate ) + " kbit/s, " : "")
+             + "connect " + std::to_string( r.ConnectMs ) + " ms, first byte "
+             + std::to_string( r.FirstByteMs ) + " ms";
+    else if( probed && r.status == StreamProbe::Failed )
+      tip += "\ndown: " + r.Error;
+    return Wt::WString::fromUTF8( tip );
+  }
+  // A stream that is not in the catalog shows as its url.
+  size_t entry = StreamCatalog::Instance()->Find( url );
+  std::string name = entry == StreamCatalog::npos ? url : StreamCatalog::Instance()->Name( entry );
+  if( probed && r.status == StreamProbe::Failed )
+    name += " (down)";
+  else if( probed && StreamProber::IsSlow( r ) )
+    name += " (slow)";
+  return Wt::WString::fromUTF8( name );
+}
@@ -0,0 +1,40 @@
+#ifndef STREAM_CATALOG_MODEL_H
+#define STREAM_CATALOG_MODEL_H
+
+#include <Wt/WAbstractListModel>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A session's view of the stream catalog: the entries matching a filter,
+// up to MaxRows, read from the shared catalog when the view asks for
+// them. The current stream is shown as the first row when it is not among
+// the matches, or not in the catalog at all.
+// With the stream prober enabled, rows are marked as slow or down, and
+// may be sorted by responsiveness.
+class StreamCatalogModel : public Wt::WAbstractListModel
+{
+public:
+  enum { MaxRows = 200 };
+  StreamCatalogModel( Wt::WObject* parent = nullptr );
+
+  void SetFilter( const std::string& );
+  void SetCurrent( const std::string& url );
+  void SetSortByResponse( bool );
+  void Refresh(); // after new probe results
+  int Row( const std::string& url ) const; // -1 if not shown
+  std::string Url( int row ) const;
+
+  int rowCount( const Wt::WModelIndex& parent = Wt::WModelIndex() ) const override;
+  boost::any data( const Wt::WModelIndex&, int role = Wt::DisplayRole ) const override;
+
+private:
+  void Update();
+
+  std::string mFilter, mCurrent;
+  std::vector<uint32_t> mRows; // catalog entries
+  bool mPinned = false; // mCurrent is the first row
+  bool mSortByResponse = false;
+};
+
+#endif // STREAM_CATALOG_MODEL_H
@@ -0,0 +1,280 @@
+#include "StreamProbe.h"
+#include "HttpStream.h"
+#include "Clock.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+static const int sConnectTimeoutMs = 5000;
+static const int sResponseTimeoutMs = 5000; // for headers, and the first byte of audio
+static const int sMaxHops = 5; // redirects and playlists
+static const size_t sMaxHeaders = 16 * 1024, sMaxPlaylist = 64 * 1024;
+
+namespace {
+
+std::string Codec( const std::string& contentType )
+{
+  static const struct { const char* type, *codec; } codecs[] =
+  {
+    { "audio/mpeg", "mp3" }, { "audio/mp3", "mp3" },
+    { "audio/aac", "aac" }, { "audio/aacp", "aac" }, { "audio/x-aac", "aac" },
+    { "application/ogg", "ogg" }, { "audio/ogg", "ogg" }, { "audio/opus", "opus" },
+    { "audio/flac", "flac" }, { "video/mp2t", "mpeg-ts" },
+  };
+  for( const auto& c : codecs )
+    if( contentType == c.type )
+      return c.codec;
+  return contentType;
+}
+
+} // namespace
+
+StreamProbe::StreamProbe( const std::string& url )
+: mUrl( url )
+{
+  if( !url.compare( 0, 8, "https://" ) )
+    mResult.Error = "https";
+  else if( url.compare( 0, 7, "http://" ) )
+    mResult.Error = "scheme";
+  else
+    Start( url );
+}
+
+StreamProbe::~StreamProbe()
+{
+  if( mFd >= 0 )
+    ::close( mFd );
+}
+
+bool
+StreamProbe::Start( const std::string& url )
+{
+  HttpStream::Url u;
+  if( !HttpStream::ParseUrl( url, u ) )
+  {
+    Fail( "url" );
+    return false;
+  }
+  mHopUrl = url;
+  mRequest = HttpStream::Request( u, false );
+  mResponse.clear();
+  mPlaylist = false;
+  mResult = Result();
+
+  struct addrinfo hints = {}, *ai = nullptr;
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if( ::getaddrinfo( u.Host.c_str(), u.Port.c_str(), &hints, &ai ) || !ai )
+  {
+    Fail( "dns" );
+    return false;
+  }
+  mFd = ::socket( ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol );
+  int r = mFd < 0 ? -1 : ::connect( mFd, ai->ai_addr, ai->ai_addrlen );
+  ::freeaddrinfo( ai );
+  if( r < 0 && errno != EINPROGRESS )
+  {
+    Fail( errno == ECONNREFUSED ? "refused" : "connect" );
+    return false;
+  }
+  mHopUs = Clock::NowUs();
+  mDeadlineUs = mHopUs + 1000 * sConnectTimeoutMs;
+  mState = connecting;
+  return true;
+}
+
+void
+StreamProbe::Fail( const std::string& error )
+{
+  if( mFd >= 0 )
+    ::close( mFd );
+  mFd = -1;
+  mResult.status = Failed;
+  mResult.Error = error;
+  mState = done;
+}
+
+void
+StreamProbe::Follow( const std::string& location )
+{
+  if( ++mHops > sMaxHops )
+  {
+    Fail( "hops" );
+    return;
+  }
+  std::string url = HttpStream::Resolve( mHopUrl, location );
+  ::close( mFd );
+  mFd = -1;
+  if( url.compare( 0, 7, "http://" ) )
+  {
+    mResult = Result();
+    mResult.Error = url.compare( 0, 8, "https://" ) ? "scheme" : "https";
+    mState = done;
+    return;
+  }
+  Start( url );
+}
+
+void
+StreamProbe::Step( short revents )
+{
+  int64_t now = Clock::NowUs();
+  if( !revents )
+  {
+    Fail( "timeout" );
+    return;
+  }
+  switch( mState )
+  {
+    case connecting:
+    {
+      int error = 0;
+      socklen_t len = sizeof( error );
+      if( ::getsockopt( mFd, SOL_SOCKET, SO_ERROR, &error, &len ) < 0 || error )
+      {
+        Fail( error == ECONNREFUSED ? "refused" : "connect" );
+        return;
+      }
+      mResult.ConnectMs = (now - mHopUs) / 1000;
+      mState = sending;
+    }
+    /* fall through */
+    case sending:
+    {
+      ssize_t n = ::send( mFd, mRequest.data(), mRequest.length(), MSG_NOSIGNAL );
+      if( n < 0 && errno != EAGAIN )
+      {
+        Fail( "send" );
+        return;
+      }
+      mRequest.erase( 0, std::max<ssize_t>( n, 0 ) );
+      if( mRequest.empty() )
+      {
+        mHopUs = now;
+        mDeadlineUs = now + 1000 * sResponseTimeoutMs;
+        mState = headers;
+      }
+      return;
+    }
+    case headers:
+    case body:
+    {
+      char buf[4096];
+      ssize_t n = ::read( mFd, buf, sizeof( buf ) );
+      if( n < 0 )
+      {
+        if( errno != EAGAIN && errno != EINTR )
+          Fail( "read" );
+        return;
+      }
+      if( n == 0 && !(mState == body && mPlaylist) )
+      {
+        Fail( "closed" );
+        return;
+      }
+      mResponse.append( buf, n );
+      if( n == 0 )
+        mResponse += '\n'; // a last playlist entry may lack one
+      if( mState == headers )
+      {
+        size_t end = mResponse.find( "\r\n\r\n" );
+        if( end != std::string::npos )
+          OnHeaders( end );
+        else if( mResponse.length() > sMaxHeaders )
+          Fail( "headers" );
+      }
+      else
+        OnBody();
+      if( n == 0 && mState == body )
+        Fail( "playlist" ); // ended without an entry
+      return;
+    }
+    case done:
+      return;
+  }
+}
+
+void
+StreamProbe::OnHeaders( size_t end )
+{
+  HttpStream::Response r;
+  if( !HttpStream::ParseResponse( mResponse.substr( 0, end + 2 ), r ) )
+  {
+    Fail( "protocol" );
+    return;
+  }
+  mResult.Bitrate = r.Bitrate;
+  if( r.Status / 100 == 3 && !r.Location.empty() )
+  {
+    Follow( r.Location );
+    return;
+  }
+  if( r.Status != 200 )
+  {
+    Fail( "http-" + std::to_string( r.Status ) );
+    return;
+  }
+  HttpStream::Url u;
+  HttpStream::ParseUrl( mHopUrl, u );
+  mPlaylist = HttpStream::IsPlaylist( r.ContentType, u.Path );
+  mResult.Codec = mPlaylist ? "" : Codec( r.ContentType );
+  mResponse.erase( 0, end + 4 );
+  mState = body;
+  OnBody();
+}
+
+// Audio is there with its first byte; a playlist continues with its
+// first entry as soon as that has arrived.
+void
+StreamProbe::OnBody()
+{
+  if( !mPlaylist )
+  {
+    if( mResponse.empty() )
+      return;
+    mResult.FirstByteMs = (Clock::NowUs() - mHopUs) / 1000;
+    mResult.status = Ok;
+    ::close( mFd );
+    mFd = -1;
+    mState = done;
+    return;
+  }
+  std::string entry;
+  if( HttpStream::FirstEntry( mResponse, entry ) )
+  {
+    Follow( entry );
+    return;
+  }
+  if( mResponse.length() > sMaxPlaylist )
+    Fail( "playlist" );
+}
+
+void
+StreamProbe::Poll( std::vector<std::unique_ptr<StreamProbe>>& probes, int maxWaitMs )
+{
+  std::vector<struct pollfd> fds;
+  std::vector<StreamProbe*> polled;
+  int64_t now = Clock::NowUs(), deadline = now + 1000 * int64_t( maxWaitMs );
+  for( auto& p : probes )
+  {
+    if( p->Done() )
+      continue;
+    short events = (p->mState == connecting || p->mState == sending) ? POLLOUT : POLLIN;
+    fds.push_back( { p->mFd, events, 0 } );
+    polled.push_back( p.get() );
+    deadline = std::min( deadline, p->mDeadlineUs );
+  }
+  int timeoutMs = std::max<int64_t>( 0, (deadline - now + 999) / 1000 );
+  if( ::poll( fds.data(), fds.size(), timeoutMs ) < 0 && errno != EINTR )
+    return;
+  now = Clock::NowUs();
+  for( size_t i = 0; i < fds.size(); ++i )
+    if( fds[i].revents )
+      polled[i]->Step( fds[i].revents );
+    else if( now >= polled[i]->mDeadlineUs )
+      polled[i]->Step( 0 );
+}
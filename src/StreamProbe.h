@@ -0,0 +1,52 @@
+#ifndef STREAM_PROBE_H
+#define STREAM_PROBE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Health check of a stream url: connects, follows redirects and playlists
+// (m3u, pls), and waits for the first byte of audio. Each probe is a state
+// machine over a non-blocking socket, so that one thread drives many of
+// them through Poll(). Host names are resolved synchronously.
+class StreamProbe
+{
+public:
+  enum Status { Unsupported, Failed, Ok };
+  struct Result
+  {
+    Status status = Unsupported;
+    int ConnectMs = -1, FirstByteMs = -1; // of the last hop
+    int Bitrate = 0; // kbit/s from icy-br, 0 if not announced
+    std::string Codec, Error; // single words
+  };
+
+  explicit StreamProbe( const std::string& url );
+  ~StreamProbe();
+  const std::string& Url() const { return mUrl; }
+  bool Done() const { return mState == done; }
+  const Result& GetResult() const { return mResult; }
+
+  // Advances the probes that are ready or timed out, waiting at most the
+  // given time for one to become ready.
+  static void Poll( std::vector<std::unique_ptr<StreamProbe>>&, int maxWaitMs );
+
+private:
+  enum State { connecting, sending, headers, body, done };
+  bool Start( const std::string& url );
+  void Step( short revents );
+  void OnHeaders( size_t end );
+  void OnBody();
+  void Fail( const std::string& error );
+  void Follow( const std::string& location );
+
+  std::string mUrl, mHopUrl, mRequest, mResponse;
+  State mState = done;
+  int mFd = -1, mHops = 0;
+  bool mPlaylist = false;
+  int64_t mHopUs = 0, mDeadlineUs = 0;
+  Result mResult;
+};
+
+#endif // STREAM_PROBE_H
@@ -0,0 +1,275 @@
+#include "StreamProber.h"
+#include "StreamCatalog.h"
+#include "Log.h"
+#include "Trace.h"
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <ctime>
+
+static StreamProber::Settings sSettings;
+
+static const int sPollMs = 250;
+// Failures are checked again after this fraction of the time to live.
+static const int sFailedTtlDivisor = 10;
+static const int sSlowMs = 2000;
+static const int sBroadcastIntervalSeconds = 5;
+static const int sSaveIntervalSeconds = 60;
+// When all results are fresh, the catalog is scanned again after this.
+static const int sRescanSeconds = 60;
+
+struct StreamProber::Private
+{
+  StreamProber* mpSelf;
+  std::thread* mpThread = nullptr;
+
+  mutable std::mutex mMutex;
+  std::condition_variable mCond;
+  bool mRunning = true;
+  std::unordered_map<std::string, Health> mIndex;
+  std::deque<std::string> mPriority;
+  std::set<std::string> mInFlight;
+
+  static void ThreadFunc( Private* );
+  bool NextUrl( size_t& cursor, std::string& url );
+  bool Stale( const std::string& url, int64_t now ) const;
+  void LoadIndex();
+  void SaveIndex();
+};
+
+void
+StreamProber::Private::ThreadFunc( Private* p )
+{
+  Trace::SetThreadName( "StreamProber" );
+  std::vector<std::unique_ptr<StreamProbe>> active;
+  size_t cursor = 0;
+  int results = 0;
+  int64_t lastBroadcast = 0, lastSave = ::time( nullptr );
+  bool changed = false, dirty = false;
+  while( true )
+  {
+    std::string url;
+    while( active.size() < size_t( sSettings.Concurrency ) && p->NextUrl( cursor, url ) )
+      active.emplace_back( new StreamProbe( url ) );
+    if( active.empty() )
+    {
+      if( dirty )
+        p->SaveIndex();
+      if( changed )
+        p->mpSelf->Broadcast();
+      if( results > 0 )
+        LOG( General, Info, "{1} streams checked", results );
+      dirty = changed = false;
+      results = 0;
+      std::unique_lock<std::mutex> lock( p->mMutex );
+      p->mCond.wait_for( lock, std::chrono::seconds( sRescanSeconds ),
+        [p] { return !p->mRunning || !p->mPriority.empty(); } );
+      if( !p->mRunning )
+        break;
+      if( p->mPriority.empty() )
+        cursor = 0;
+      continue;
+    }
+    StreamProbe::Poll( active, sPollMs );
+    {
+      std::lock_guard<std::mutex> lock( p->mMutex );
+      if( !p->mRunning )
+        break;
+      for( auto i = active.begin(); i != active.end(); )
+      {
+        if( !(*i)->Done() )
+        {
+          ++i;
+          continue;
+        }
+        Health& h = p->mIndex[(*i)->Url()];
+        h.Result = (*i)->GetResult();
+        h.Checked = ::time( nullptr );
+        p->mInFlight.erase( (*i)->Url() );
+        i = active.erase( i );
+        changed = dirty = true;
+        ++results;
+      }
+    }
+    int64_t now = ::time( nullptr );
+    if( changed && now - lastBroadcast >= sBroadcastIntervalSeconds )
+    {
+      p->mpSelf->Broadcast();
+      lastBroadcast = now;
+      changed = false;
+    }
+    if( dirty && now - lastSave >= sSaveIntervalSeconds )
+    {
+      p->SaveIndex();
+      lastSave = now;
+      dirty = false;
+    }
+  }
+  if( dirty )
+    p->SaveIndex();
+}
+
+// Requested urls first, then the catalog in order.
+bool
+StreamProber::Private::NextUrl( size_t& cursor, std::string& url )
+{
+  std::lock_guard<std::mutex> lock( mMutex );
+  int64_t now = ::time( nullptr );
+  while( !mPriority.empty() )
+  {
+    url = mPriority.front();
+    mPriority.pop_front();
+    if( mInFlight.insert( url ).second )
+      return true;
+  }
+  const StreamCatalog* catalog = StreamCatalog::Instance();
+  while( cursor < catalog->Count() )
+  {
+    url = catalog->Url( cursor++ );
+    if( Stale( url, now ) && mInFlight.insert( url ).second )
+      return true;
+  }
+  return false;
+}
+
+// Called locked.
+bool
+StreamProber::Private::Stale( const std::string& url, int64_t now ) const
+{
+  auto i = mIndex.find( url );
+  if( i == mIndex.end() )
+    return true;
+  int64_t ttl = 60 * int64_t( sSettings.TtlMinutes );
+  if( i->second.Result.status == StreamProbe::Failed )
+    ttl /= sFailedTtlDivisor;
+  return now - i->second.Checked >= ttl;
+}
+
+// One line per stream: status, connect and first byte ms, bitrate, time
+// checked, codec, error, url. Empty words are written as "-".
+void
+StreamProber::Private::LoadIndex()
+{
+  std::ifstream f( sSettings.IndexFile );
+  Health h;
+  int status;
+  std::string url;
+  StreamProbe::Result& r = h.Result;
+  while( f >> status >> r.ConnectMs >> r.FirstByteMs >> r.Bitrate >> h.Checked >> r.Codec >> r.Error
+         && f.ignore() && std::getline( f, url ) )
+  {
+    r.status = StreamProbe::Status( status );
+    for( auto s : { &r.Codec, &r.Error } )
+      if( *s == "-" )
+        s->clear();
+    mIndex[url] = h;
+  }
+}
+
+void
+StreamProber::Private::SaveIndex()
+{
+  std::string tmp = sSettings.IndexFile + ".tmp";
+  std::ofstream f( tmp );
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    for( const auto& i : mIndex )
+    {
+      const StreamProbe::Result& r = i.second.Result;
+      f << r.status << ' ' << r.ConnectMs << ' ' << r.FirstByteMs << ' ' << r.Bitrate << ' '
+        << i.second.Checked << ' ' << (r.Codec.empty() ? "-" : r.Codec) << ' '
+        << (r.Error.empty() ? "-" : r.Error) << ' ' << i.first << '\n';
+    }
+  }
+  f.close();
+  if( f.fail() || ::rename( tmp.c_str(), sSettings.IndexFile.c_str() ) < 0 )
+    LOG( General, Error, "Could not save {1}: {2}", sSettings.IndexFile, ::strerror( errno ) );
+}
+
+void
+StreamProber::Configure( const Settings& s )
+{
+  sSettings = s;
+}
+
+bool
+StreamProber::Enabled()
+{
+  return sSettings.Concurrency > 0;
+}
+
+StreamProber*
+StreamProber::Instance()
+{
+  static StreamProber sInstance;
+  return &sInstance;
+}
+
+StreamProber::StreamProber()
+: p( new Private )
+{
+  p->mpSelf = this;
+  if( Enabled() )
+  {
+    p->LoadIndex();
+    p->mpThread = new std::thread( &Private::ThreadFunc, p );
+  }
+}
+
+StreamProber::~StreamProber()
+{
+  {
+    std::lock_guard<std::mutex> lock( p->mMutex );
+    p->mRunning = false;
+    p->mCond.notify_all();
+  }
+  if( p->mpThread && p->mpThread->joinable() )
+    p->mpThread->join();
+  delete p->mpThread;
+  delete p;
+}
+
+bool
+StreamProber::Get( const std::string& url, Health& h ) const
+{
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  auto i = p->mIndex.find( url );
+  if( i == p->mIndex.end() )
+    return false;
+  h = i->second;
+  return true;
+}
+
+bool
+StreamProber::IsSlow( const StreamProbe::Result& r )
+{
+  return r.status == StreamProbe::Ok && r.ConnectMs + r.FirstByteMs > sSlowMs;
+}
+
+int
+StreamProber::Rank( const std::string& url ) const
+{
+  static const int unknown = 1000000, failed = 2000000;
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  auto i = p->mIndex.find( url );
+  if( i == p->mIndex.end() || i->second.Result.status == StreamProbe::Unsupported )
+    return unknown;
+  const StreamProbe::Result& r = i->second.Result;
+  return r.status == StreamProbe::Ok ? r.ConnectMs + r.FirstByteMs : failed;
+}
+
+void
+StreamProber::Probe( const std::string& url )
+{
+  if( !Enabled() )
+    return;
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  p->mPriority.push_back( url );
+  p->mCond.notify_all();
+}
@@ -0,0 +1,47 @@
+#ifndef STREAM_PROBER_H
+#define STREAM_PROBER_H
+
+#include "Broadcaster.h"
+#include "StreamProbe.h"
+#include <cstdint>
+#include <string>
+
+// Checks the streams of the catalog in the background, a few at a time,
+// and keeps the results in an index file. Results are renewed when they
+// are older than the configured time, failures sooner. Listeners are
+// notified, at most every few seconds, when results have come in.
+class StreamProber : public Broadcaster
+{
+public:
+  struct Settings
+  {
+    int Concurrency = 0; // probes at a time, 0 disables probing
+    int TtlMinutes = 6 * 60;
+    std::string IndexFile = "/var/local/" APPNAME "/probes";
+  };
+  static void Configure( const Settings& ); // call before Instance()
+  static bool Enabled();
+  static StreamProber* Instance();
+
+  struct Health
+  {
+    StreamProbe::Result Result;
+    int64_t Checked = 0; // seconds since the epoch
+  };
+  bool Get( const std::string& url, Health& ) const;
+  static bool IsSlow( const StreamProbe::Result& );
+  // Sort key: responding streams first, by first byte latency, then
+  // streams not checked, then failed streams.
+  int Rank( const std::string& url ) const;
+  // Checks the url ahead of the catalog.
+  void Probe( const std::string& url );
+
+private:
+  StreamProber();
+  ~StreamProber();
+
+  struct Private;
+  Private* p;
+};
+
+#endif // STREAM_PROBER_H
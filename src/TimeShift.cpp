@@ -0,0 +1,621 @@
+#include "TimeShift.h"
+#include "HttpStream.h"
+#include "Clock.h"
+#include "IcyMetadata.h"
+#include "Log.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+static TimeShift::Settings sSettings;
+
+// The ring is sized for this bitrate, and the byte rate of a stream is
+// assumed to be this until it is known.
+static const int sMaxBitrate = 192000;
+static const int sDefaultBitrate = 128000;
+// Byte rate is measured from this time on, after the server's initial burst.
+static const int sRateMeasureDelaySeconds = 10;
+static const int sPollMs = 250;
+static const int sConnectTimeoutMs = 5000;
+static const int sReconnectDelayMs = 2000;
+static const int sMaxHops = 5; // redirects and playlists
+static const size_t sMaxHeaders = 16 * 1024, sMaxPlaylist = 64 * 1024;
+static const size_t sChunkSize = 16 * 1024;
+// Audio in the fifo is heard before a seek takes effect.
+static const int sFifoSize = 16 * 1024;
+// The writer never comes closer to the reader than this.
+static const size_t sMargin = 4 * sChunkSize;
+
+struct TimeShift::Private
+{
+  std::string mFile, mFifo;
+  mutable std::mutex mMutex;
+  std::condition_variable mCond;
+  int mFd = -1;
+  char* mpRing = nullptr;
+  size_t mSize = 0;
+
+  std::string mUrl;
+  std::atomic<bool> mRunning { false };
+  // Readable once stopped, polled along with sockets and the fifo.
+  int mWake[2] = { -1, -1 };
+  std::thread* mpFetcher = nullptr, *mpFeeder = nullptr;
+  boost::function<void( const std::string& )> mTitleListener;
+
+  std::string mTitle;
+  // Used by the fetcher only
+  IcyMetadata mIcy;
+  int mMetaInt = 0;
+
+  // Absolute byte positions in the stream
+  uint64_t mWritePos = 0, mReadPos = 0;
+  int mGeneration = 0;
+  // Byte rate from icy-br, or measured
+  double mByteRate = sDefaultBitrate / 8, mHeaderByteRate = 0;
+  int64_t mRateBeginUs = 0;
+  uint64_t mRateBeginPos = 0;
+
+  bool OpenRing();
+  bool MakeFifo();
+  double ByteRate() const;
+  uint64_t Oldest() const;
+  void Append( const char*, size_t );
+  void Receive( const char*, size_t );
+
+  static void FetcherFunc( Private* );
+  static void FeederFunc( Private* );
+  bool WaitMs( int ); // false when stopped
+  int PollMs( int fd, short events, int ms ); // -1 when stopped
+  int Connect( std::string url, std::string& body );
+  int ConnectSocket( const std::string& host, const std::string& port );
+  int OpenFifo();
+};
+
+bool
+TimeShift::Private::OpenRing()
+{
+  if( mpRing )
+    return true;
+  size_t size = size_t( sSettings.Minutes ) * 60 * sMaxBitrate / 8;
+  const char* path = mFile.c_str();
+  mFd = ::open( path, O_RDWR | O_CREAT | O_CLOEXEC, 0600 );
+  if( mFd < 0 || ::ftruncate( mFd, size ) < 0 )
+  {
+    LOG( Player, Error, "Could not create {1}: {2}", path, ::strerror( errno ) );
+    return false;
+  }
+  void* p = ::mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0 );
+  if( p == MAP_FAILED )
+  {
+    LOG( Player, Error, "Could not map {1}: {2}", path, ::strerror( errno ) );
+    return false;
+  }
+  mpRing = static_cast<char*>( p );
+  mSize = size;
+  return true;
+}
+
+// The fifo must exist before the player is told to open it.
+bool
+TimeShift::Private::MakeFifo()
+{
+  const char* path = mFifo.c_str();
+  struct stat st;
+  if( ::stat( path, &st ) == 0 && !S_ISFIFO( st.st_mode ) )
+  {
+    LOG( Player, Error, "{1} exists and is not a fifo", path );
+    return false;
+  }
+  if( ::mkfifo( path, 0600 ) < 0 && errno != EEXIST )
+  {
+    LOG( Player, Error, "Could not create {1}: {2}", path, ::strerror( errno ) );
+    return false;
+  }
+  return true;
+}
+
+double
+TimeShift::Private::ByteRate() const
+{
+  return mHeaderByteRate > 0 ? mHeaderByteRate : mByteRate;
+}
+
+uint64_t
+TimeShift::Private::Oldest() const
+{
+  return mWritePos > mSize - sMargin ? mWritePos - (mSize - sMargin) : 0;
+}
+
+void
+TimeShift::Private::Append( const char* data, size_t length )
+{
+  std::lock_guard<std::mutex> lock( mMutex );
+  while( length > 0 )
+  {
+    size_t offset = mWritePos % mSize,
+           n = std::min( length, mSize - offset );
+    ::memcpy( mpRing + offset, data, n );
+    mWritePos += n;
+    data += n;
+    length -= n;
+  }
+  // A reader paused for longer than the window loses the oldest data.
+  mReadPos = std::max( mReadPos, Oldest() );
+
+  int64_t now = Clock::NowUs();
+  if( !mRateBeginUs )
+    mRateBeginUs = now + sRateMeasureDelaySeconds * 1000000LL;
+  else if( now > mRateBeginUs && !mRateBeginPos )
+    mRateBeginPos = mWritePos;
+  else if( now > mRateBeginUs + 1000000LL * sRateMeasureDelaySeconds )
+    mByteRate = (mWritePos - mRateBeginPos) * 1e6 / (now - mRateBeginUs);
+  mCond.notify_all();
+}
+
+void
+TimeShift::Private::Receive( const char* data, size_t length )
+{
+  if( !mIcy.Feed( data, length, [this]( const char* audio, size_t n ) { Append( audio, n ); } ) )
+    return;
+  boost::function<void( const std::string& )> listener;
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    mTitle = mIcy.Title();
+    listener = mTitleListener;
+  }
+  LOG( Player, Info, "{1}: {2}", mUrl, mIcy.Title() );
+  if( listener )
+    listener( mIcy.Title() );
+}
+
+bool
+TimeShift::Private::WaitMs( int ms )
+{
+  std::unique_lock<std::mutex> lock( mMutex );
+  mCond.wait_for( lock, std::chrono::milliseconds( ms ), [this]() { return !mRunning; } );
+  return mRunning;
+}
+
+// Returns the events of fd, 0 on timeout, or -1 once stopped.
+int
+TimeShift::Private::PollMs( int fd, short events, int ms )
+{
+  struct pollfd pfd[] = { { fd, events, 0 }, { mWake[0], POLLIN, 0 } };
+  int r = ::poll( pfd, 2, ms );
+  if( !mRunning || pfd[1].revents )
+    return -1;
+  return r > 0 ? pfd[0].revents : 0;
+}
+
+void
+TimeShift::Private::FetcherFunc( Private* p )
+{
+  Trace::SetThreadName( "TimeShift::Fetch" );
+  char buf[sChunkSize];
+  while( p->mRunning )
+  {
+    std::string body;
+    int fd = p->Connect( p->mUrl, body );
+    if( fd < 0 )
+    {
+      LOG( Player, Warning, "Could not connect to {1}, retrying", p->mUrl );
+      p->WaitMs( sReconnectDelayMs );
+      continue;
+    }
+    LOG( Player, Info, "Fetching {1}", p->mUrl );
+    p->mIcy.Reset( p->mMetaInt );
+    p->Receive( body.data(), body.length() );
+    while( p->mRunning )
+    {
+      int r = p->PollMs( fd, POLLIN, sPollMs );
+      if( r < 0 )
+        break;
+      if( r == 0 )
+        continue;
+      ssize_t n = ::read( fd, buf, sizeof( buf ) );
+      if( n > 0 )
+        p->Receive( buf, n );
+      else if( n == 0 || errno != EINTR )
+        break;
+    }
+    ::close( fd );
+    if( p->mRunning )
+      LOG( Player, Warning, "Connection to {1} lost, reconnecting", p->mUrl );
+  }
+}
+
+int
+TimeShift::Private::OpenFifo()
+{
+  const char* path = mFifo.c_str();
+  // Opening for writing fails with ENXIO until the player opens for reading.
+  while( mRunning )
+  {
+    int fd = ::open( path, O_WRONLY | O_NONBLOCK | O_CLOEXEC );
+    if( fd >= 0 )
+      return fd;
+    if( errno != ENXIO )
+    {
+      LOG( Player, Error, "Could not open {1}: {2}", path, ::strerror( errno ) );
+      WaitMs( sReconnectDelayMs );
+    }
+    else
+      WaitMs( 50 );
+  }
+  return -1;
+}
+
+void
+TimeShift::Private::FeederFunc( Private* p )
+{
+  Trace::SetThreadName( "TimeShift::Feed" );
+  // The player closing its end must not raise SIGPIPE.
+  sigset_t mask;
+  sigemptyset( &mask );
+  sigaddset( &mask, SIGPIPE );
+  pthread_sigmask( SIG_BLOCK, &mask, nullptr );
+
+  // Chunks are copied out of the ring, which the fetcher may overwrite
+  // once the lock is released.
+  char buf[sChunkSize];
+  while( p->mRunning )
+  {
+    int fd = p->OpenFifo();
+    if( fd < 0 )
+      continue;
+    ::fcntl( fd, F_SETPIPE_SZ, sFifoSize );
+    int generation = -1;
+    size_t begin = 0, end = 0;
+    bool ok = true;
+    while( ok && p->mRunning )
+    {
+      if( begin == end )
+      {
+        std::unique_lock<std::mutex> lock( p->mMutex );
+        p->mCond.wait_for( lock, std::chrono::milliseconds( sPollMs ), [p]()
+          { return !p->mRunning || p->mReadPos < p->mWritePos; } );
+        if( p->mReadPos == p->mWritePos )
+          continue;
+        size_t offset = p->mReadPos % p->mSize;
+        end = std::min<uint64_t>( { p->mWritePos - p->mReadPos, p->mSize - offset, sChunkSize } );
+        ::memcpy( buf, p->mpRing + offset, end );
+        begin = 0;
+        p->mReadPos += end;
+        generation = p->mGeneration;
+      }
+      int r = p->PollMs( fd, POLLOUT, sPollMs );
+      if( r <= 0 )
+        continue;
+      {
+        // After a seek, the player continues from the new position in the
+        // same fifo, without the rest of a chunk from before.
+        std::lock_guard<std::mutex> lock( p->mMutex );
+        if( p->mGeneration != generation )
+        {
+          begin = end = 0;
+          continue;
+        }
+      }
+      ssize_t written = ::write( fd, buf + begin, end - begin );
+      if( written > 0 )
+        begin += written;
+      else if( written < 0 && errno != EAGAIN && errno != EINTR )
+        ok = false;
+    }
+    ::close( fd );
+  }
+}
+
+namespace {
+
+// A host name lookup on a thread of its own, which cannot be interrupted,
+// and is left to finish by itself when the front end stops meanwhile.
+struct Lookup
+{
+  std::mutex mMutex;
+  std::condition_variable mCond;
+  bool mDone = false;
+  struct addrinfo* mpResult = nullptr;
+
+  ~Lookup()
+  {
+    if( mpResult )
+      ::freeaddrinfo( mpResult );
+  }
+  static void Run( std::shared_ptr<Lookup> lookup, std::string host, std::string port )
+  {
+    struct addrinfo hints = {}, *result = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if( ::getaddrinfo( host.c_str(), port.c_str(), &hints, &result ) )
+      result = nullptr;
+    std::lock_guard<std::mutex> lock( lookup->mMutex );
+    lookup->mpResult = result;
+    lookup->mDone = true;
+    lookup->mCond.notify_all();
+  }
+};
+
+} // namespace
+
+int
+TimeShift::Private::ConnectSocket( const std::string& host, const std::string& port )
+{
+  auto lookup = std::make_shared<Lookup>();
+  std::thread( &Lookup::Run, lookup, host, port ).detach();
+  {
+    std::unique_lock<std::mutex> lock( lookup->mMutex );
+    while( !lookup->mDone && mRunning )
+      lookup->mCond.wait_for( lock, std::chrono::milliseconds( sPollMs ) );
+    if( !lookup->mDone )
+      return -1;
+  }
+  int fd = -1;
+  for( auto ai = lookup->mpResult; ai && fd < 0; ai = ai->ai_next )
+  {
+    fd = ::socket( ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol );
+    if( fd < 0 )
+      continue;
+    if( ::connect( fd, ai->ai_addr, ai->ai_addrlen ) < 0 && errno != EINPROGRESS )
+    {
+      ::close( fd );
+      fd = -1;
+      continue;
+    }
+    int error = 0;
+    socklen_t len = sizeof( error );
+    if( PollMs( fd, POLLOUT, sConnectTimeoutMs ) <= 0
+        || ::getsockopt( fd, SOL_SOCKET, SO_ERROR, &error, &len ) < 0 || error )
+    {
+      ::close( fd );
+      fd = -1;
+    }
+  }
+  return fd;
+}
+
+// Sends a GET request, follows redirects, and playlists served in place of
+// audio, and returns the connected socket with any body data already
+// received.
+int
+TimeShift::Private::Connect( std::string url, std::string& body )
+{
+  for( int hops = 0; hops <= sMaxHops && mRunning; ++hops )
+  {
+    HttpStream::Url u;
+    if( !HttpStream::ParseUrl( url, u ) )
+      return -1;
+    int fd = ConnectSocket( u.Host, u.Port );
+    if( fd < 0 )
+      return -1;
+    std::string request = HttpStream::Request( u, true ), response;
+    size_t end = std::string::npos;
+    bool ok = ::send( fd, request.data(), request.length(), MSG_NOSIGNAL ) == ssize_t( request.length() );
+    while( ok && end == std::string::npos && response.length() < sMaxHeaders )
+    {
+      char buf[4096];
+      ssize_t n = -1;
+      if( PollMs( fd, POLLIN, sConnectTimeoutMs ) > 0 )
+        n = ::read( fd, buf, sizeof( buf ) );
+      ok = n > 0;
+      if( ok )
+      {
+        response.append( buf, n );
+        end = response.find( "\r\n\r\n" );
+      }
+    }
+    HttpStream::Response r;
+    if( !ok || end == std::string::npos || !HttpStream::ParseResponse( response.substr( 0, end + 2 ), r ) )
+    {
+      ::close( fd );
+      return -1;
+    }
+    if( r.Status / 100 == 3 && !r.Location.empty() )
+    {
+      ::close( fd );
+      url = HttpStream::Resolve( url, r.Location );
+      continue;
+    }
+    if( r.Status != 200 )
+    {
+      LOG( Player, Warning, "{1}: HTTP status {2}", url, r.Status );
+      ::close( fd );
+      return -1;
+    }
+    body = response.substr( end + 4 );
+    if( HttpStream::IsPlaylist( r.ContentType, u.Path ) )
+    {
+      std::string entry;
+      ok = true;
+      while( ok && !HttpStream::FirstEntry( body, entry ) && body.length() < sMaxPlaylist )
+      {
+        char buf[4096];
+        ssize_t n = -1;
+        if( PollMs( fd, POLLIN, sConnectTimeoutMs ) > 0 )
+          n = ::read( fd, buf, sizeof( buf ) );
+        if( n > 0 )
+          body.append( buf, n );
+        else
+        {
+          ok = false;
+          if( n == 0 ) // a last entry may lack a line break
+            HttpStream::FirstEntry( body + "\n", entry );
+        }
+      }
+      ::close( fd );
+      if( entry.empty() )
+        return -1;
+      url = HttpStream::Resolve( url, entry );
+      continue;
+    }
+    mMetaInt = r.MetaInt;
+    if( r.Bitrate > 0 )
+    {
+      std::lock_guard<std::mutex> lock( mMutex );
+      mHeaderByteRate = r.Bitrate * 1000 / 8;
+    }
+    return fd;
+  }
+  return -1;
+}
+
+void
+TimeShift::Configure( const Settings& s )
+{
+  sSettings = s;
+}
+
+bool
+TimeShift::Enabled()
+{
+  return sSettings.Minutes > 0;
+}
+
+// Playlists, and anything else mplayer resolves by itself, go to mplayer.
+bool
+TimeShift::Supports( const std::string& url )
+{
+  HttpStream::Url u;
+  return HttpStream::ParseUrl( url, u ) && !HttpStream::IsPlaylist( "", u.Path );
+}
+
+TimeShift*
+TimeShift::Instance( int slot )
+{
+  static TimeShift sFirst( 0 ), sSecond( 1 );
+  return slot ? &sSecond : &sFirst;
+}
+
+// The second slot uses its own ring file and fifo.
+TimeShift::TimeShift( int slot )
+: p( new Private )
+{
+  std::string suffix = slot ? "." + std::to_string( slot + 1 ) : "";
+  p->mFile = sSettings.File + suffix;
+  p->mFifo = sSettings.Fifo + suffix;
+  if( ::pipe2( p->mWake, O_NONBLOCK | O_CLOEXEC ) < 0 )
+    LOG( Player, Error, "Could not create pipe: {1}", ::strerror( errno ) );
+}
+
+TimeShift::~TimeShift()
+{
+  Stop();
+  if( p->mpRing )
+    ::munmap( p->mpRing, p->mSize );
+  if( p->mFd >= 0 )
+    ::close( p->mFd );
+  for( int fd : p->mWake )
+    if( fd >= 0 )
+      ::close( fd );
+  delete p;
+}
+
+bool
+TimeShift::Start( const std::string& url, std::string& path )
+{
+  Stop();
+  if( !Supports( url ) || !p->OpenRing() || !p->MakeFifo() )
+    return false;
+  {
+    std::lock_guard<std::mutex> lock( p->mMutex );
+    p->mUrl = url;
+    p->mWritePos = p->mReadPos = 0;
+    p->mByteRate = sDefaultBitrate / 8;
+    p->mHeaderByteRate = 0;
+    p->mRateBeginUs = 0;
+    p->mRateBeginPos = 0;
+    p->mIcy = IcyMetadata();
+    p->mTitle.clear();
+  }
+  char c;
+  while( ::read( p->mWake[0], &c, 1 ) > 0 )
+    ;
+  p->mRunning = true;
+  p->mpFetcher = new std::thread( &Private::FetcherFunc, p );
+  p->mpFeeder = new std::thread( &Private::FeederFunc, p );
+  path = p->mFifo;
+  return true;
+}
+
+// Returns promptly: the threads wake from their waits and polls, and a
+// host name lookup in progress is left behind.
+void
+TimeShift::Stop()
+{
+  {
+    std::lock_guard<std::mutex> lock( p->mMutex );
+    p->mRunning = false;
+    p->mCond.notify_all();
+  }
+  if( p->mpFetcher || p->mpFeeder )
+  {
+    char c = 0;
+    if( ::write( p->mWake[1], &c, 1 ) < 0 && errno != EAGAIN )
+      LOG( Player, Warning, "Could not wake front end: {1}", ::strerror( errno ) );
+  }
+  for( auto pp : { &p->mpFetcher, &p->mpFeeder } )
+  {
+    if( *pp && (*pp)->joinable() )
+      (*pp)->join();
+    delete *pp;
+    *pp = nullptr;
+  }
+}
+
+bool
+TimeShift::Running() const
+{
+  return p->mRunning;
+}
+
+void
+TimeShift::SetTitleListener( const boost::function<void( const std::string& )>& listener )
+{
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  p->mTitleListener = listener;
+}
+
+std::string
+TimeShift::Title() const
+{
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  return p->mTitle;
+}
+
+void
+TimeShift::Seek( double secondsBehindLive )
+{
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  uint64_t back = std::max( 0.0, secondsBehindLive ) * p->ByteRate();
+  p->mReadPos = std::max( p->Oldest(), p->mWritePos - std::min( back, p->mWritePos ) );
+  ++p->mGeneration;
+  p->mCond.notify_all();
+}
+
+double
+TimeShift::Delay() const
+{
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  return (p->mWritePos - p->mReadPos) / p->ByteRate();
+}
+
+double
+TimeShift::Window() const
+{
+  std::lock_guard<std::mutex> lock( p->mMutex );
+  return (p->mWritePos - p->Oldest()) / p->ByteRate();
+}
@@ -0,0 +1,55 @@
+#ifndef TIME_SHIFT_H
+#define TIME_SHIFT_H
+
+#include <string>
+#include <boost/function.hpp>
+
+// Front end for time shifting of http:// audio streams: goldstard fetches
+// the stream itself into a ring buffer, a memory-mapped file of the
+// configured length, strips ICY metadata, and feeds the player from there
+// through a fifo. Fetching continues while playback is paused, and through
+// short network dropouts, and playback may move backwards within the
+// buffered window, and back to live.
+// Without time shifting, streams go to the player directly.
+class TimeShift
+{
+public:
+  struct Settings
+  {
+    int Minutes = 0; // 0 disables
+    std::string File = "/var/local/" APPNAME "/timeshift",
+      Fifo = "/tmp/" APPNAME ".stream";
+  };
+  static void Configure( const Settings& ); // call before Instance()
+  static bool Enabled(); // time shifting
+  static bool Supports( const std::string& url ); // direct audio streams
+  // One front end per player decoder, so that a new stream may start
+  // while the current one plays on.
+  enum { NumSlots = 2 };
+  static TimeShift* Instance( int slot = 0 );
+
+  // Starts fetching, and returns the path for the player to read from.
+  bool Start( const std::string& url, std::string& path );
+  void Stop();
+  bool Running() const;
+
+  // Called from the fetching thread when the stream title changes.
+  void SetTitleListener( const boost::function<void( const std::string& )>& );
+  std::string Title() const;
+
+  // Moves playback to the given number of seconds behind live, limited to
+  // the buffered window. Data from the new position follows in the open
+  // fifo, after what the player has buffered.
+  void Seek( double secondsBehindLive );
+  double Delay() const; // seconds behind live
+  double Window() const; // seconds buffered
+
+private:
+  TimeShift( int slot );
+  ~TimeShift();
+
+  struct Private;
+  Private* p;
+};
+
+#endif // TIME_SHIFT_H
@@ -0,0 +1,150 @@
+#include "Trace.h"
+
+#include <mutex>
+#include <vector>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+static const int sEventsPerThread = 4096;
+
+namespace {
+
+struct Event
+{
+  const char* name;
+  int64_t begin, end;
+};
+
+// Single writer (the owning thread), any number of readers.
+// Readers detect overwritten slots by re-reading the head afterwards.
+struct Buffer
+{
+  std::atomic<uint64_t> head;
+  Event events[sEventsPerThread];
+  int tid;
+  const char* threadName;
+};
+
+// Buffers of threads that exited are kept, with their events, for threads
+// that start tracing later.
+std::mutex sBuffersMutex;
+std::vector<Buffer*> sBuffers, sFreeBuffers;
+thread_local const char* tpThreadName = nullptr;
+
+// Allocated on the first event, with tracing enabled.
+struct ThreadBuffer
+{
+  Buffer* buffer = nullptr;
+  ~ThreadBuffer()
+  {
+    if( !buffer )
+      return;
+    std::lock_guard<std::mutex> lock( sBuffersMutex );
+    sFreeBuffers.push_back( buffer );
+  }
+  Buffer* Get()
+  {
+    if( buffer )
+      return buffer;
+    std::lock_guard<std::mutex> lock( sBuffersMutex );
+    if( sFreeBuffers.empty() )
+    {
+      buffer = new Buffer;
+      sBuffers.push_back( buffer );
+    }
+    else
+    {
+      buffer = sFreeBuffers.back();
+      sFreeBuffers.pop_back();
+    }
+    buffer->head = 0;
+    buffer->tid = ::syscall( SYS_gettid );
+    buffer->threadName = tpThreadName;
+    return buffer;
+  }
+};
+thread_local ThreadBuffer tBuffer;
+
+} // namespace
+
+std::atomic<bool> Trace::sEnabled( false );
+
+void
+Trace::SetEnabled( bool enabled )
+{
+  sEnabled = enabled;
+}
+
+void
+Trace::SetThreadName( const char* name )
+{
+  tpThreadName = name;
+  if( tBuffer.buffer )
+  {
+    std::lock_guard<std::mutex> lock( sBuffersMutex );
+    tBuffer.buffer->threadName = name;
+  }
+}
+
+int64_t
+Trace::NowUs()
+{
+  struct timespec t;
+  ::clock_gettime( CLOCK_MONOTONIC, &t );
+  return t.tv_sec * int64_t( 1000000 ) + t.tv_nsec / 1000;
+}
+
+void
+Trace::Record( const char* name, int64_t beginUs, int64_t endUs )
+{
+  Buffer* b = tBuffer.Get();
+  uint64_t head = b->head.load( std::memory_order_relaxed );
+  Event& e = b->events[head % sEventsPerThread];
+  e.name = name;
+  e.begin = beginUs;
+  e.end = endUs;
+  b->head.store( head + 1, std::memory_order_release );
+}
+
+void
+Trace::WriteJson( std::ostream& os, int lastSeconds )
+{
+  int64_t since = NowUs() - lastSeconds * int64_t( 1000000 );
+  int pid = ::getpid();
+  const char* sep = "";
+  os << "{\"traceEvents\":[";
+  std::lock_guard<std::mutex> lock( sBuffersMutex );
+  for( Buffer* b : sBuffers )
+  {
+    if( b->threadName )
+    {
+      os << sep << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+         << ",\"tid\":" << b->tid
+         << ",\"args\":{\"name\":\"" << b->threadName << "\"}}";
+      sep = ",\n";
+    }
+    uint64_t head = b->head.load( std::memory_order_acquire ),
+      first = head > sEventsPerThread ? head - sEventsPerThread : 0;
+    std::vector<Event> events;
+    events.reserve( head - first );
+    for( uint64_t i = first; i < head; ++i )
+      events.push_back( b->events[i % sEventsPerThread] );
+    std::atomic_thread_fence( std::memory_order_acquire );
+    // Slots below this index may have been overwritten while copying; the
+    // slot of the head itself may be in the middle of being written.
+    uint64_t valid = b->head.load( std::memory_order_relaxed );
+    valid = valid >= sEventsPerThread ? valid - sEventsPerThread + 1 : 0;
+    for( uint64_t i = std::max( first, valid ); i < head; ++i )
+    {
+      const Event& e = events[i - first];
+      if( e.end < since )
+        continue;
+      os << sep << "{\"name\":\"" << e.name << "\",\"cat\":\"" APPNAME "\",\"ph\":\"X\""
+         << ",\"ts\":" << e.begin << ",\"dur\":" << e.end - e.begin
+         << ",\"pid\":" << pid << ",\"tid\":" << b->tid << "}";
+      sep = ",\n";
+    }
+  }
+  os << "],\"displayTimeUnit\":\"ms\"}" << std::endl;
+}
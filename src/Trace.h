@@ -0,0 +1,45 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+
+// Lightweight trace scopes recorded into per-thread ring buffers.
+// Names must be string literals, as only the pointer is stored.
+class Trace
+{
+public:
+  static bool Enabled() { return sEnabled.load( std::memory_order_relaxed ); }
+  static void SetEnabled( bool );
+  static void SetThreadName( const char* );
+
+  static int64_t NowUs();
+  static void Record( const char* name, int64_t beginUs, int64_t endUs );
+  static void WriteJson( std::ostream&, int lastSeconds );
+
+  class Scope
+  {
+  public:
+    explicit Scope( const char* name )
+    : mName( Enabled() ? name : nullptr ), mBeginUs( mName ? NowUs() : 0 )
+    {}
+    ~Scope()
+    {
+      if( mName )
+        Record( mName, mBeginUs, NowUs() );
+    }
+  private:
+    const char* mName;
+    int64_t mBeginUs;
+  };
+
+private:
+  static std::atomic<bool> sEnabled;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) Trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)( name )
+
+#endif // TRACE_H
@@ -0,0 +1,36 @@
+#include "TraceResource.h"
+#include "Trace.h"
+#include <Wt/Http/Response>
+
+static const int sDefaultSeconds = 10;
+
+TraceResource::TraceResource(Wt::WObject *parent)
+: Wt::WStreamResource(parent)
+{
+}
+
+TraceResource::~TraceResource()
+{
+  beingDeleted();
+}
+
+void
+TraceResource::handleRequest( const Wt::Http::Request& req, Wt::Http::Response& rsp )
+{
+  const auto& params = req.getParameterMap();
+  auto enable = params.find( "enable" );
+  if( enable != params.end() )
+  {
+    Trace::SetEnabled( ::atoi( enable->second.back().c_str() ) );
+    rsp.setMimeType( "text/plain" );
+    rsp.out() << Trace::Enabled() << std::endl;
+    return;
+  }
+  int seconds = sDefaultSeconds;
+  auto s = params.find( "seconds" );
+  if( s != params.end() )
+    seconds = ::atoi( s->second.back().c_str() );
+  rsp.setMimeType( "application/json" );
+  rsp.addHeader( "Content-Disposition", "attachment; filename=" APPNAME "-trace.json" );
+  Trace::WriteJson( rsp.out(), seconds );
+}
@@ -0,0 +1,14 @@
+#ifndef TRACE_RESOURCE_H
+#define TRACE_RESOURCE_H
+
+#include <Wt/WStreamResource>
+
+class TraceResource : public Wt::WStreamResource
+{
+public:
+  TraceResource(Wt::WObject *parent = 0);
+  ~TraceResource();
+  void handleRequest( const Wt::Http::Request&, Wt::Http::Response& );
+};
+
+#endif // TRACE_RESOURCE_H
@@ -0,0 +1,376 @@
+#include "UdpControl.h"
+#include "UdpProtocol.h"
+#include "Hardware.h"
+#include "Clock.h"
+#include "Log.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <thread>
+
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static UdpControl::Settings sSettings;
+
+// Besides on each change, which a server listener of Hardware wakes the
+// thread for.
+static const int sAnnounceMs = 5000;
+// Clients whose last reply is kept for retransmits.
+static const size_t sMaxClients = 64;
+// Hardware applies states in its own thread, and relative operations
+// arriving in between build on the state set last, not on the one
+// still current.
+static const int64_t sPendingUs = 200000;
+
+static const struct { int op; float Hardware::State::* value; float min, max; }
+sLevels[] =
+{
+  { UdpProtocol::VolumeL, &Hardware::State::VolumeL, -48, 0 },
+  { UdpProtocol::VolumeR, &Hardware::State::VolumeR, -48, 0 },
+  { UdpProtocol::Treble, &Hardware::State::Treble, -TDA7318::BassTrebleGainRange, TDA7318::BassTrebleGainRange },
+  { UdpProtocol::Bass, &Hardware::State::Bass, -TDA7318::BassTrebleGainRange, TDA7318::BassTrebleGainRange },
+  { UdpProtocol::GainCD, &Hardware::State::GainCD, 0, TDA7318::InputGainRange },
+  { UdpProtocol::GainAUX, &Hardware::State::GainAUX, 0, TDA7318::InputGainRange },
+  { UdpProtocol::GainNetwork, &Hardware::State::GainNetwork, 0, TDA7318::InputGainRange },
+};
+
+static int16_t Tenths( float value )
+{
+  return int16_t( ::lroundf( value * 10 ) );
+}
+
+static void ToProtocol( const Hardware::State& s, UdpProtocol::State& u )
+{
+  u.Power = s.Power;
+  u.Mute = s.Mute;
+  u.Source = Key::SourceIndex( s.Source );
+  u.VolumeL = Tenths( s.VolumeL );
+  u.VolumeR = Tenths( s.VolumeR );
+  u.Treble = Tenths( s.Treble );
+  u.Bass = Tenths( s.Bass );
+  u.GainCD = Tenths( s.GainCD );
+  u.GainAUX = Tenths( s.GainAUX );
+  u.GainNetwork = Tenths( s.GainNetwork );
+}
+
+struct UdpControl::Private
+{
+  int mSocket = -1;
+  sockaddr_in mGroup = {};
+  std::thread mThread;
+  std::atomic<bool> mRunning { true };
+  // Written to by the hardware listener, and to stop the thread.
+  int mWake[2] = { -1, -1 };
+  int mListener = 0;
+
+  // Used by the thread only.
+  struct Client
+  {
+    uint32_t Sequence;
+    std::string Reply;
+    int64_t LastUs;
+  };
+  std::map<uint32_t, Client> mClients;
+  Hardware::State mSet;
+  int64_t mSetUs = 0;
+  uint8_t mLastState[UdpProtocol::StateSize] = {};
+  uint32_t mVersion = 0;
+
+  bool Open();
+  void Current( Hardware::State& );
+  void ThreadFunc();
+  void Receive();
+  int Apply( const UdpProtocol::Op*, int count, Hardware::State& );
+  uint32_t Version( const Hardware::State& ); // with the state encoded to mLastState
+  void Announce();
+  void Wake();
+};
+
+bool
+UdpControl::Private::Open()
+{
+  mSocket = ::socket( AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0 );
+  if( mSocket < 0 )
+    return false;
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl( INADDR_ANY );
+  addr.sin_port = htons( sSettings.Port );
+  if( ::bind( mSocket, reinterpret_cast<sockaddr*>( &addr ), sizeof( addr ) ) < 0 )
+  {
+    LOG( Remote, Error, "Could not bind UDP port {1}: {2}", sSettings.Port, ::strerror( errno ) );
+    return false;
+  }
+  if( !sSettings.Group.empty() )
+  {
+    if( ::inet_pton( AF_INET, sSettings.Group.c_str(), &mGroup.sin_addr ) != 1 )
+    {
+      LOG( Remote, Error, "Invalid multicast group {1}", sSettings.Group );
+      return false;
+    }
+    unsigned char ttl = 1;
+    ::setsockopt( mSocket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof( ttl ) );
+    mGroup.sin_family = AF_INET;
+    mGroup.sin_port = htons( sSettings.Port );
+  }
+  return true;
+}
+
+void
+UdpControl::Private::Current( Hardware::State& s )
+{
+  if( Clock::NowUs() - mSetUs < sPendingUs )
+    s = mSet;
+  else
+    Hardware::Instance()->GetState( s );
+}
+
+void
+UdpControl::Private::ThreadFunc()
+{
+  Trace::SetThreadName( "UdpControl" );
+  int64_t nextAnnounceUs = 0;
+  while( mRunning )
+  {
+    int64_t now = Clock::NowUs();
+    if( mGroup.sin_family && now >= nextAnnounceUs )
+    {
+      Announce();
+      nextAnnounceUs = now + sAnnounceMs * 1000LL;
+    }
+    else if( mGroup.sin_family )
+    {
+      Hardware::State s;
+      Current( s );
+      uint32_t version = mVersion;
+      if( Version( s ) != version )
+        Announce();
+    }
+    int timeoutMs = -1;
+    if( mGroup.sin_family )
+    {
+      int64_t dueUs = nextAnnounceUs;
+      // A state set here that Hardware did not take is not broadcast.
+      if( now < mSetUs + sPendingUs )
+        dueUs = std::min( dueUs, mSetUs + sPendingUs );
+      timeoutMs = std::max<int64_t>( 0, ( dueUs - now + 999 ) / 1000 );
+    }
+    pollfd fds[] = { { mSocket, POLLIN, 0 }, { mWake[0], POLLIN, 0 } };
+    if( ::poll( fds, 2, timeoutMs ) <= 0 )
+      continue;
+    if( fds[0].revents & POLLIN )
+      Receive();
+    char buf[64];
+    while( ::read( mWake[0], buf, sizeof( buf ) ) > 0 )
+      ;
+  }
+}
+
+void
+UdpControl::Private::Wake()
+{
+  char c = 0;
+  if( ::write( mWake[1], &c, 1 ) < 0 && errno != EAGAIN ) // EAGAIN: a wakeup is pending
+    LOG( Remote, Warning, "Could not wake UDP control thread: {1}", ::strerror( errno ) );
+}
+
+void
+UdpControl::Private::Receive()
+{
+  uint8_t buf[UdpProtocol::MaxSize];
+  sockaddr_in from = {};
+  socklen_t len = sizeof( from );
+  ssize_t n = ::recvfrom( mSocket, buf, sizeof( buf ), 0, reinterpret_cast<sockaddr*>( &from ), &len );
+  UdpProtocol::Header h;
+  UdpProtocol::Op ops[UdpProtocol::MaxOps];
+  int count = n > 0 ? UdpProtocol::GetRequest( buf, n, ops ) : -1;
+  if( count < 0 || !UdpProtocol::GetHeader( buf, n, h ) || h.Type != UdpProtocol::Request )
+    return;
+  TRACE_SCOPE( "UdpControl::Receive" );
+
+  auto i = mClients.find( h.Client );
+  int status = UdpProtocol::Ok;
+  Hardware::State s;
+  if( i != mClients.end() && h.Sequence == i->second.Sequence )
+  {
+    // A retransmit, the reply was lost.
+    i->second.LastUs = Clock::NowUs();
+    ::sendto( mSocket, i->second.Reply.data(), i->second.Reply.size(), MSG_DONTWAIT,
+              reinterpret_cast<const sockaddr*>( &from ), sizeof( from ) );
+    return;
+  }
+  else if( i != mClients.end() && int32_t( h.Sequence - i->second.Sequence ) < 0 )
+  {
+    status = UdpProtocol::Stale;
+    Current( s );
+  }
+  else
+    status = Apply( ops, count, s );
+
+  UdpProtocol::Header reply = h;
+  reply.Type = UdpProtocol::Reply;
+  reply.StateVersion = Version( s );
+  uint8_t out[UdpProtocol::HeaderSize + 1 + UdpProtocol::StateSize];
+  uint8_t* p = UdpProtocol::PutHeader( out, reply );
+  *p++ = status;
+  std::memcpy( p, mLastState, sizeof( mLastState ) );
+  ::sendto( mSocket, out, sizeof( out ), MSG_DONTWAIT, reinterpret_cast<const sockaddr*>( &from ), sizeof( from ) );
+  LOG( Remote, Debug, "UDP request {1} of {2}: {3} ops, status {4}", int64_t( h.Sequence ), int64_t( h.Client ), count, status );
+  if( status == UdpProtocol::Stale )
+    return;
+
+  if( i == mClients.end() && mClients.size() >= sMaxClients )
+    mClients.erase( std::min_element( mClients.begin(), mClients.end(),
+      []( const std::pair<const uint32_t, Client>& a, const std::pair<const uint32_t, Client>& b )
+      { return a.second.LastUs < b.second.LastUs; } ) );
+  Client& c = mClients[h.Client];
+  c.Sequence = h.Sequence;
+  c.Reply.assign( reinterpret_cast<const char*>( out ), sizeof( out ) );
+  c.LastUs = Clock::NowUs();
+  if( mGroup.sin_family && status == UdpProtocol::Ok )
+    Announce();
+}
+
+// As /control, power changes go alone, and other operations need power.
+int
+UdpControl::Private::Apply( const UdpProtocol::Op* ops, int count, Hardware::State& s )
+{
+  Current( s );
+  bool ok = true;
+  for( int i = 0; i < count; ++i )
+  {
+    const UdpProtocol::Op& op = ops[i];
+    bool relative = op.Mode == UdpProtocol::Relative;
+    switch( op.Op )
+    {
+      case UdpProtocol::Power:
+      {
+        bool power = relative ? !s.Power : op.Value != 0;
+        ok = ok && ( count == 1 || ( power && s.Power ) );
+        s.Power = power;
+        continue;
+      }
+      case UdpProtocol::Mute:
+        s.Mute = relative ? !s.Mute : op.Value != 0;
+        break;
+      case UdpProtocol::Source:
+        if( op.Value >= 0 && op.Value < Key::NumSources )
+          s.Source = Key::SourceAt( op.Value );
+        break;
+      case UdpProtocol::Volume:
+      {
+        // Both channels, keeping their balance.
+        float value = op.Value / 10.0f, balance = s.VolumeR - s.VolumeL,
+              volume = relative ? std::max( s.VolumeL, s.VolumeR ) + value : value;
+        volume = std::max<float>( -48, std::min<float>( 0, volume ) );
+        s.VolumeL = balance > 0 ? volume - balance : volume;
+        s.VolumeR = balance < 0 ? volume + balance : volume;
+        break;
+      }
+      default:
+        for( const auto& l : sLevels )
+          if( l.op == op.Op )
+          {
+            float value = op.Value / 10.0f + ( relative ? s.*l.value : 0 );
+            s.*l.value = std::max( l.min, std::min( l.max, value ) );
+          }
+    }
+    ok = ok && s.Power;
+  }
+  if( !ok || !Hardware::Instance()->SetState( s ) )
+  {
+    Current( s );
+    return UdpProtocol::Ignored;
+  }
+  mSet = s;
+  mSetUs = Clock::NowUs();
+  return UdpProtocol::Ok;
+}
+
+uint32_t
+UdpControl::Private::Version( const Hardware::State& s )
+{
+  UdpProtocol::State u;
+  ToProtocol( s, u );
+  uint8_t state[UdpProtocol::StateSize];
+  UdpProtocol::PutState( state, u );
+  if( std::memcmp( state, mLastState, sizeof( state ) ) )
+  {
+    std::memcpy( mLastState, state, sizeof( state ) );
+    ++mVersion;
+  }
+  return mVersion;
+}
+
+void
+UdpControl::Private::Announce()
+{
+  Hardware::State s;
+  Current( s );
+  UdpProtocol::Header h = { UdpProtocol::Announce, 0, 0, Version( s ) };
+  uint8_t out[UdpProtocol::HeaderSize + UdpProtocol::StateSize];
+  std::memcpy( UdpProtocol::PutHeader( out, h ), mLastState, sizeof( mLastState ) );
+  ::sendto( mSocket, out, sizeof( out ), MSG_DONTWAIT, reinterpret_cast<const sockaddr*>( &mGroup ), sizeof( mGroup ) );
+}
+
+void
+UdpControl::Configure( const Settings& s )
+{
+  sSettings = s;
+}
+
+bool
+UdpControl::Enabled()
+{
+  return sSettings.Port > 0;
+}
+
+UdpControl*
+UdpControl::Instance()
+{
+  static UdpControl sInstance;
+  return &sInstance;
+}
+
+UdpControl::UdpControl()
+: p( new Private )
+{
+  if( !Enabled() || !p->Open() )
+    return;
+  if( ::pipe2( p->mWake, O_NONBLOCK | O_CLOEXEC ) < 0 )
+  {
+    LOG( Remote, Error, "Could not create pipe: {1}", ::strerror( errno ) );
+    return;
+  }
+  if( p->mGroup.sin_family )
+    p->mListener = Hardware::Instance()->AddServerListener( boost::bind( &Private::Wake, p ) );
+  LOG( Remote, Info, "UDP control on port {1}", sSettings.Port );
+  p->mThread = std::thread( &Private::ThreadFunc, p );
+}
+
+UdpControl::~UdpControl()
+{
+  if( p->mListener )
+    Hardware::Instance()->RemoveServerListener( p->mListener );
+  p->mRunning = false;
+  if( p->mThread.joinable() )
+  {
+    p->Wake();
+    p->mThread.join();
+  }
+  for( int fd : p->mWake )
+    if( fd >= 0 )
+      ::close( fd );
+  if( p->mSocket >= 0 )
+    ::close( p->mSocket );
+  delete p;
+}
@@ -0,0 +1,36 @@
+#ifndef UDP_CONTROL_H
+#define UDP_CONTROL_H
+
+#include <cstdint>
+#include <string>
+
+// Control of the first zone over UDP, for remotes that cannot afford an
+// HTTP request per button press, see UdpProtocol.h for the datagrams.
+// Requests carry absolute or relative operations, which are applied
+// to Hardware::SetState() in a thread of their own, outside of Wt, and
+// answered with the resulting state and its version.
+// Remotes retransmit until answered: a client's sequence number seen
+// last is answered again without applying it twice, and older ones are
+// answered as stale. State announcements go to an optional multicast
+// group on changes, and every few seconds.
+class UdpControl
+{
+public:
+  struct Settings
+  {
+    int Port = 0; // 0 disables
+    std::string Group; // multicast address for announcements, e.g. 239.255.71.72
+  };
+  static void Configure( const Settings& ); // call before Instance()
+  static bool Enabled();
+  static UdpControl* Instance();
+
+private:
+  UdpControl();
+  ~UdpControl();
+
+  struct Private;
+  Private* p;
+};
+
+#endif // UDP_CONTROL_H
@@ -0,0 +1,139 @@
+#ifndef UDP_PROTOCOL_H
+#define UDP_PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+
+// Binary control datagrams, see UdpControl.h. Header only, for remotes
+// and tools. Numbers are big endian; levels are in tenths of dB.
+//
+//  header   magic "gc", version, type, client id (4), sequence (4),
+//           state version (4)
+//  request  op count, then per op: op, mode, value (2)
+//  reply    status, then the state
+//  announce the state
+//  state    power, mute, source, volume L/R, treble, bass, gain CD/AUX/Network (2 each)
+struct UdpProtocol
+{
+  enum { Magic0 = 'g', Magic1 = 'c', Version = 1 };
+  enum { Request = 1, Reply = 2, Announce = 3 };
+  // Stale: an older sequence number than the last of this client, not applied.
+  enum { Ignored = 0, Ok = 1, Stale = 2 };
+  enum { Power = 1, Mute, Source, Volume, VolumeL, VolumeR, Treble, Bass,
+         GainCD, GainAUX, GainNetwork, NumOps };
+  enum { Absolute = 0, Relative = 1 };
+  enum { SourceCD, SourceAUX, SourceNetwork, SourceTape };
+  enum { HeaderSize = 16, StateSize = 17, MaxOps = 16, MaxSize = HeaderSize + 1 + 4 * MaxOps };
+
+  struct Header
+  {
+    uint8_t Type;
+    uint32_t Client, Sequence, StateVersion;
+  };
+  struct Op
+  {
+    uint8_t Op, Mode;
+    int16_t Value; // tenths of dB, 0/1, or a source
+  };
+  struct State
+  {
+    uint8_t Power, Mute, Source;
+    int16_t VolumeL, VolumeR, Treble, Bass, GainCD, GainAUX, GainNetwork;
+  };
+
+  static uint8_t* Put( uint8_t* p, uint32_t value, int bytes )
+  {
+    while( bytes-- )
+      *p++ = uint8_t( value >> ( 8 * bytes ) );
+    return p;
+  }
+  static const uint8_t* Get( const uint8_t* p, uint32_t& value, int bytes )
+  {
+    value = 0;
+    while( bytes-- )
+      value = value << 8 | *p++;
+    return p;
+  }
+
+  static uint8_t* PutHeader( uint8_t* p, const Header& h )
+  {
+    *p++ = Magic0;
+    *p++ = Magic1;
+    *p++ = Version;
+    *p++ = h.Type;
+    p = Put( p, h.Client, 4 );
+    p = Put( p, h.Sequence, 4 );
+    return Put( p, h.StateVersion, 4 );
+  }
+  static bool GetHeader( const uint8_t* p, size_t size, Header& h )
+  {
+    if( size < HeaderSize || p[0] != Magic0 || p[1] != Magic1 || p[2] != Version )
+      return false;
+    h.Type = p[3];
+    p = Get( p + 4, h.Client, 4 );
+    p = Get( p, h.Sequence, 4 );
+    Get( p, h.StateVersion, 4 );
+    return true;
+  }
+
+  // Returns the size of the request.
+  static size_t PutRequest( uint8_t* buf, const Header& h, const Op* ops, int count )
+  {
+    uint8_t* p = PutHeader( buf, h );
+    *p++ = uint8_t( count );
+    for( int i = 0; i < count; ++i )
+    {
+      *p++ = ops[i].Op;
+      *p++ = ops[i].Mode;
+      p = Put( p, uint16_t( ops[i].Value ), 2 );
+    }
+    return p - buf;
+  }
+  // Returns the number of ops, or -1.
+  static int GetRequest( const uint8_t* buf, size_t size, Op* ops )
+  {
+    if( size < HeaderSize + 1 )
+      return -1;
+    int count = buf[HeaderSize];
+    if( count > MaxOps || size < HeaderSize + 1 + 4 * size_t( count ) )
+      return -1;
+    const uint8_t* p = buf + HeaderSize + 1;
+    for( int i = 0; i < count; ++i )
+    {
+      uint32_t value;
+      ops[i].Op = *p++;
+      ops[i].Mode = *p++;
+      p = Get( p, value, 2 );
+      ops[i].Value = int16_t( value );
+    }
+    return count;
+  }
+
+  static uint8_t* PutState( uint8_t* p, const State& s )
+  {
+    *p++ = s.Power;
+    *p++ = s.Mute;
+    *p++ = s.Source;
+    for( int16_t v : { s.VolumeL, s.VolumeR, s.Treble, s.Bass, s.GainCD, s.GainAUX, s.GainNetwork } )
+      p = Put( p, uint16_t( v ), 2 );
+    return p;
+  }
+  static bool GetState( const uint8_t* p, size_t size, State& s )
+  {
+    if( size < StateSize )
+      return false;
+    s.Power = *p++;
+    s.Mute = *p++;
+    s.Source = *p++;
+    for( int16_t* v : { &s.VolumeL, &s.VolumeR, &s.Treble, &s.Bass, &s.GainCD, &s.GainAUX, &s.GainNetwork } )
+    {
+      uint32_t value;
+      p = Get( p, value, 2 );
+      *v = int16_t( value );
+    }
+    return true;
+  }
+};
+
+#endif // UDP_PROTOCOL_H
@@ -0,0 +1,37 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <benchmark/benchmark.h>
+#include <Wt/WApplication>
+#include <Wt/Test/WTestEnvironment>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+// A Wt session for benchmarks that need wApp.
+struct BenchSession
+{
+  Wt::Test::WTestEnvironment mEnv;
+  Wt::WApplication mApp;
+  BenchSession() : mApp( mEnv ) {}
+};
+
+// Interleaved 16 bit stereo audio, a chord with some noise, so that all
+// frequency bands see signal.
+inline std::vector<int16_t> BenchSignal( int frames, int sampleRate )
+{
+  std::vector<int16_t> pcm( 2 * frames );
+  ::srand( 1 );
+  for( int i = 0; i < frames; ++i )
+  {
+    double t = double( i ) / sampleRate,
+           s = 0.3 * ::sin( 2 * M_PI * 220 * t ) + 0.2 * ::sin( 2 * M_PI * 1760 * t )
+             + 0.1 * ( ::rand() / double( RAND_MAX ) - 0.5 );
+    pcm[2 * i] = 32767 * s;
+    pcm[2 * i + 1] = 32767 * 0.8 * s;
+  }
+  return pcm;
+}
+
+#endif // BENCH_H
@@ -0,0 +1,78 @@
+#include "Bench.h"
+#include "Analyzer.h"
+#include "Loudness.h"
+
+#include <vector>
+
+static const int sSampleRate = 44100;
+static const int sUpdateHz = 15;
+
+// One iteration analyzes a second of 44.1kHz stereo audio, at the update
+// rate of the PCM tap, so CPU time per iteration is the fraction of a core
+// that metering costs in real time.
+static void AnalyzerSecondOfAudio( benchmark::State& bs )
+{
+  const int blocks = (sSampleRate + Analyzer::BlockFrames - 1) / Analyzer::BlockFrames;
+  std::vector<int16_t> pcm = BenchSignal( blocks * Analyzer::BlockFrames, sSampleRate );
+  Analyzer analyzer( sSampleRate );
+  Analyzer::Levels levels;
+  for( auto _ : bs )
+  {
+    for( int i = 0; i < blocks; ++i )
+    {
+      analyzer.Process( pcm.data() + 2 * i * Analyzer::BlockFrames );
+      if( analyzer.Blocks() * Analyzer::BlockFrames >= sSampleRate / sUpdateHz )
+        analyzer.Take( levels );
+    }
+    benchmark::DoNotOptimize( levels );
+  }
+  bs.SetItemsProcessed( bs.iterations() * blocks * Analyzer::BlockFrames );
+  bs.counters["realtime_x"] = benchmark::Counter(
+    double( bs.iterations() ) * blocks * Analyzer::BlockFrames / sSampleRate,
+    benchmark::Counter::kIsRate );
+}
+BENCHMARK( AnalyzerSecondOfAudio )->Unit( benchmark::kMillisecond );
+
+static void AnalyzerPeakSumSq( benchmark::State& bs )
+{
+  std::vector<int16_t> pcm = BenchSignal( Analyzer::BlockFrames, sSampleRate );
+  float peak[2], sumSq[2];
+  for( auto _ : bs )
+  {
+    Analyzer::PeakSumSq( pcm.data(), Analyzer::BlockFrames, peak, sumSq );
+    benchmark::DoNotOptimize( peak );
+    benchmark::DoNotOptimize( sumSq );
+  }
+  bs.SetItemsProcessed( bs.iterations() * Analyzer::BlockFrames );
+}
+BENCHMARK( AnalyzerPeakSumSq );
+
+static void AnalyzerSpectrum( benchmark::State& bs )
+{
+  std::vector<int16_t> pcm = BenchSignal( Analyzer::BlockFrames, sSampleRate );
+  Analyzer analyzer( sSampleRate );
+  float bands[Analyzer::Bands];
+  for( auto _ : bs )
+  {
+    analyzer.Spectrum( pcm.data(), bands );
+    benchmark::DoNotOptimize( bands );
+  }
+  bs.SetItemsProcessed( bs.iterations() * Analyzer::BlockFrames );
+}
+BENCHMARK( AnalyzerSpectrum );
+
+// Loudness measurement of a second of audio, as run alongside the analyzer.
+static void LoudnessSecondOfAudio( benchmark::State& bs )
+{
+  std::vector<int16_t> pcm = BenchSignal( sSampleRate, sSampleRate );
+  Loudness loudness( sSampleRate );
+  float lufs = 0;
+  for( auto _ : bs )
+  {
+    loudness.Process( pcm.data(), sSampleRate );
+    benchmark::DoNotOptimize( loudness.Integrated( lufs ) );
+  }
+  bs.SetItemsProcessed( bs.iterations() * sSampleRate );
+  bs.counters["realtime_x"] = benchmark::Counter( double( bs.iterations() ), benchmark::Counter::kIsRate );
+}
+BENCHMARK( LoudnessSecondOfAudio )->Unit( benchmark::kMillisecond );
@@ -0,0 +1,15 @@
+#include "Bench.h"
+#include "AudioWidget.h"
+
+static void AudioWidgetConstruction( benchmark::State& bs )
+{
+  BenchSession session;
+  for( auto _ : bs )
+  {
+    AudioWidget* w = new AudioWidget( session.mApp.root() );
+    bs.PauseTiming();
+    delete w;
+    bs.ResumeTiming();
+  }
+}
+BENCHMARK( AudioWidgetConstruction )->Unit( benchmark::kMicrosecond );
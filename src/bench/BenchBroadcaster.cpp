@@ -0,0 +1,21 @@
+#include "Bench.h"
+#include "Broadcaster.h"
+
+namespace {
+struct TestBroadcaster : Broadcaster
+{
+  using Broadcaster::Broadcast;
+};
+} // namespace
+
+static void BroadcasterFanOut( benchmark::State& bs )
+{
+  BenchSession session;
+  TestBroadcaster b;
+  for( int i = 0; i < bs.range(0); ++i )
+    b.AddListener( [](){} );
+  for( auto _ : bs )
+    b.Broadcast();
+  bs.SetItemsProcessed( bs.iterations() * bs.range(0) );
+}
+BENCHMARK( BroadcasterFanOut )->RangeMultiplier( 4 )->Range( 1, 256 );
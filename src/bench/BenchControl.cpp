@@ -0,0 +1,41 @@
+#include "Bench.h"
+#include "ControlResource.h"
+
+#include <sstream>
+
+static void ControlParameters( benchmark::State& bs )
+{
+  Wt::Http::ParameterMap params;
+  params["Source"].push_back( "Network" );
+  params["GainNetwork"].push_back( "2" );
+  params["VolumeL"].push_back( "-24" );
+  params["VolumeR"].push_back( "-26" );
+  params["Mute"].push_back( "0" );
+  params["Stream"].push_back( "http://stream.srg-ssr.ch/m/rsj/aacp_96" );
+  Hardware::State s;
+  s.Power = true;
+  for( auto _ : bs )
+  {
+    Hardware::State state = s;
+    bool streamChanged;
+    benchmark::DoNotOptimize( ControlResource::ApplyParameters( params, state, streamChanged ) );
+    benchmark::DoNotOptimize( state );
+  }
+}
+BENCHMARK( ControlParameters );
+
+static void StateSerialization( benchmark::State& bs )
+{
+  Hardware::State s;
+  s.Power = true;
+  s.Source = Key::SourceNetwork;
+  s.Stream = "http://stream.srg-ssr.ch/m/rsj/aacp_96";
+  std::ostringstream oss;
+  for( auto _ : bs )
+  {
+    oss.str( "" );
+    ControlResource::WriteState( oss, s );
+    benchmark::DoNotOptimize( oss.str().data() );
+  }
+}
+BENCHMARK( StateSerialization );
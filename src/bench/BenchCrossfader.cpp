@@ -0,0 +1,36 @@
+#include "Bench.h"
+#include "Crossfader.h"
+
+#include <vector>
+
+static const int sSampleRate = 44100;
+static const int sBlockFrames = 1024;
+
+// One iteration crossfades a second of 44.1kHz stereo audio in blocks, as
+// the PCM tap does during a station switch; the fade is restarted when it
+// ends, so that all blocks are mixed.
+static void CrossfaderSecondOfAudio( benchmark::State& bs )
+{
+  const int blocks = (sSampleRate + sBlockFrames - 1) / sBlockFrames;
+  std::vector<int16_t> outgoing = BenchSignal( blocks * sBlockFrames, sSampleRate ), pcm,
+    incoming( outgoing.rbegin(), outgoing.rend() );
+  Crossfader fader( sSampleRate, 2000 );
+  for( auto _ : bs )
+  {
+    bs.PauseTiming();
+    pcm = outgoing;
+    bs.ResumeTiming();
+    for( int i = 0; i < blocks; ++i )
+    {
+      if( !fader.Active() )
+        fader.Start();
+      fader.Mix( pcm.data() + 2 * i * sBlockFrames, incoming.data() + 2 * i * sBlockFrames, sBlockFrames );
+    }
+    benchmark::DoNotOptimize( pcm.data() );
+  }
+  bs.SetItemsProcessed( bs.iterations() * blocks * sBlockFrames );
+  bs.counters["realtime_x"] = benchmark::Counter(
+    double( bs.iterations() ) * blocks * sBlockFrames / sSampleRate,
+    benchmark::Counter::kIsRate );
+}
+BENCHMARK( CrossfaderSecondOfAudio )->Unit( benchmark::kMillisecond );
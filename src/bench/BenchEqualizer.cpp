@@ -0,0 +1,35 @@
+#include "Bench.h"
+#include "Equalizer.h"
+
+#include <vector>
+
+static const int sSampleRate = 44100;
+static const int sBlockFrames = 1024;
+
+// One iteration equalizes a second of 44.1kHz stereo audio in blocks, as
+// the PCM tap does. CPU time per iteration is the fraction of a core used
+// in real time; realtime_x is the headroom factor.
+static void EqualizerSecondOfAudio( benchmark::State& bs )
+{
+  const int blocks = (sSampleRate + sBlockFrames - 1) / sBlockFrames;
+  std::vector<int16_t> source = BenchSignal( blocks * sBlockFrames, sSampleRate ), pcm;
+  Equalizer eq( sSampleRate );
+  Equalizer::Settings settings;
+  for( int i = 0; i < bs.range( 0 ); ++i )
+    settings.Bands[i].Gain = (i % 2) ? 3 : -3;
+  eq.Set( settings );
+  for( auto _ : bs )
+  {
+    bs.PauseTiming();
+    pcm = source;
+    bs.ResumeTiming();
+    for( int i = 0; i < blocks; ++i )
+      eq.Process( pcm.data() + 2 * i * sBlockFrames, sBlockFrames );
+    benchmark::DoNotOptimize( pcm.data() );
+  }
+  bs.SetItemsProcessed( bs.iterations() * blocks * sBlockFrames );
+  bs.counters["realtime_x"] = benchmark::Counter(
+    double( bs.iterations() ) * blocks * sBlockFrames / sSampleRate,
+    benchmark::Counter::kIsRate );
+}
+BENCHMARK( EqualizerSecondOfAudio )->DenseRange( 0, Equalizer::NumBands )->Unit( benchmark::kMillisecond );
@@ -0,0 +1,23 @@
+#include "Bench.h"
+#include "Hardware.h"
+
+static void StateToTDA7318( benchmark::State& bs )
+{
+  Hardware::State s;
+  s.Power = true;
+  s.Source = Key::SourceNetwork;
+  s.GainNetwork = 6;
+  char buf[8];
+  int i = 0;
+  for( auto _ : bs )
+  {
+    s.VolumeL = -48 + (i % 49);
+    s.VolumeR = -48 + ((i + 7) % 49);
+    s.Bass = -14 + (i % 29);
+    s.Treble = 14 - (i % 29);
+    benchmark::DoNotOptimize( Hardware::StateToTDA7318( s, buf, bs.range(0) ) );
+    benchmark::ClobberMemory();
+    ++i;
+  }
+}
+BENCHMARK( StateToTDA7318 )->Arg( 0 )->Arg( 1 );
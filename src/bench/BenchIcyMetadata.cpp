@@ -0,0 +1,46 @@
+#include "Bench.h"
+#include "IcyMetadata.h"
+
+#include <string>
+
+static const int sMetaInt = 16000;
+static const int sReadSize = 4096;
+
+// A minute of a 128kbps stream with metadata every second, and a title
+// change every tenth block, fed in chunks as read from the socket.
+static void IcyMetadataMinuteOfStream( benchmark::State& bs )
+{
+  std::string stream;
+  for( int i = 0; i < 60; ++i )
+  {
+    stream.append( sMetaInt, char( i ) );
+    std::string meta = "StreamTitle='Artist - Title " + std::to_string( i / 10 ) + "';";
+    meta.resize( (meta.length() + 15) / 16 * 16, '\0' );
+    stream += char( meta.length() / 16 );
+    stream += meta;
+  }
+  size_t audio = 0;
+  for( auto _ : bs )
+  {
+    IcyMetadata icy;
+    icy.Reset( sMetaInt );
+    int changes = 0;
+    for( size_t pos = 0; pos < stream.length(); pos += sReadSize )
+      changes += icy.Feed( stream.data() + pos, std::min<size_t>( sReadSize, stream.length() - pos ),
+        [&audio]( const char* data, size_t n ) { audio += n; benchmark::DoNotOptimize( data ); } );
+    benchmark::DoNotOptimize( changes );
+  }
+  bs.SetBytesProcessed( bs.iterations() * stream.length() );
+}
+BENCHMARK( IcyMetadataMinuteOfStream );
+
+static void IcyMetadataParseTitle( benchmark::State& bs )
+{
+  std::string meta = "StreamTitle='Don''t Stop Me Now - Queen';StreamUrl='';", title;
+  for( auto _ : bs )
+  {
+    benchmark::DoNotOptimize( IcyMetadata::ParseTitle( meta, title ) );
+    benchmark::DoNotOptimize( title.data() );
+  }
+}
+BENCHMARK( IcyMetadataParseTitle );
@@ -0,0 +1,15 @@
+#include "Bench.h"
+#include <Wt/WServer>
+
+// Benchmarks that need a session (Broadcaster, AudioWidget) run inside a
+// test environment. The server is configured but never started, so posted
+// updates are queued only, and we measure the dispatch cost.
+int main( int argc, char** argv )
+{
+  ::benchmark::Initialize( &argc, argv );
+  if( ::benchmark::ReportUnrecognizedArguments( argc, argv ) )
+    return 1;
+  Wt::WServer server( argv[0] );
+  ::benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
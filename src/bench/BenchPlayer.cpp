@@ -0,0 +1,45 @@
+#include "Bench.h"
+#include "Player.h"
+
+static const std::string sMPlayerLines[] =
+{
+  "ANS_TIME_POSITION=1234.5",
+  "ANS_FILENAME='aacp_96'",
+  "ANS_AUDIO_BITRATE='96 kbps'",
+  "ANS_AUDIO_SAMPLES='44100 Hz, 2 ch.'",
+  "ANS_AUDIO_CODEC='ffaac'",
+  "Cache fill:  6.25% (65536 bytes)",
+};
+
+static const std::string sAudiocastLines[] =
+{
+  "packets_lost=0",
+  "buffer_delay=0.0612",
+  "packets_received=123456",
+  "underruns=0",
+};
+
+template<size_t N> static void Parse( benchmark::State& bs,
+  const std::string (&lines)[N],
+  bool (*parse)( const std::string&, std::string&, std::string& ) )
+{
+  std::string name, value;
+  size_t i = 0;
+  for( auto _ : bs )
+  {
+    benchmark::DoNotOptimize( parse( lines[i++ % N], name, value ) );
+    benchmark::DoNotOptimize( value.data() );
+  }
+}
+
+static void PlayerParseAnswer( benchmark::State& bs )
+{
+  Parse( bs, sMPlayerLines, &Player::ParseAnswer );
+}
+BENCHMARK( PlayerParseAnswer );
+
+static void PlayerParseKeyValue( benchmark::State& bs )
+{
+  Parse( bs, sAudiocastLines, &Player::ParseKeyValue );
+}
+BENCHMARK( PlayerParseKeyValue );
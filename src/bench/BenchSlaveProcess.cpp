@@ -0,0 +1,22 @@
+#include "Bench.h"
+#include "SlaveProcess.h"
+
+static void SlaveProcessSpawn( benchmark::State& bs )
+{
+  SlaveProcess process;
+  std::vector<std::string> args = { "/bin/echo", "ANS_TIME_POSITION=0.0" };
+  for( auto _ : bs )
+  {
+    if( !process.Exec( args ) )
+    {
+      bs.SkipWithError( "could not run /bin/echo" );
+      break;
+    }
+    // Time until the child has produced output, i.e. is up and running.
+    process.WaitForOutputMs( 1000 );
+    bs.PauseTiming();
+    process.Kill();
+    bs.ResumeTiming();
+  }
+}
+BENCHMARK( SlaveProcessSpawn )->Unit( benchmark::kMicrosecond );
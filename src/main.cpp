@@ -2,12 +2,36 @@
 #include "AudioWidget.h"
 #include "Hardware.h"
 #include "Player.h"
+#include "AudioPipeline.h"
+#include "TimeShift.h"
+#include "MediaLibrary.h"
+#include "StreamCatalog.h"
+#include "StreamProber.h"
+#include "Scenes.h"
+#include "Cluster.h"
+#include "ClusterResource.h"
+#include "UdpControl.h"
+#include "LocalControl.h"
+#include "SharedState.h"
 #include "PipedResource.h"
 #include "ControlResource.h"
+#include "ApiResource.h"
+#include "TraceResource.h"
+#include "LibraryResource.h"
+#include "SessionResource.h"
+#include "SessionMonitor.h"
+#include "Assets.h"
+#include "AssetResource.h"
+#include "Trace.h"
+#include "Log.h"
+#include "Recorder.h"
 #include <Wt/WLocalizedStrings>
 #include <Wt/WLoadingIndicator>
 #include <Wt/WFileResource>
 #include <Wt/WServer>
+#include <Wt/WPushButton>
+#include <Wt/WEvent>
+#include <algorithm>
 #include <iostream>
 #include <csignal>
 #include <grp.h>
@@ -20,20 +44,68 @@ class Application : public WApplication
   struct LocalizedStrings;
   
 public:
-  Application(const WEnvironment& env) : WApplication(env)
+  Application(const WEnvironment& env) : WApplication(env), mZone(0)
   {
-    useStyleSheet("/src/style.css");
+    const std::string* zone = env.getParameter("zone");
+    if (zone)
+      mZone = std::max(0, std::min(Hardware::Zones() - 1, ::atoi(zone->c_str())));
+    useStyleSheet(Assets::Instance()->Url("src/style.css"));
     setLocalizedStrings(new LocalizedStrings);
     loadingIndicator()->setMessage("Wait...");
-    root()->addWidget(new AudioWidget(root()));
-    enableUpdates();
+    SessionMonitor::Instance()->Register(boost::bind(&Application::Hibernate, this));
+    Resume();
+  }
+  ~Application()
+  {
+    SessionMonitor::Instance()->Unregister();
   }
   static WApplication* Create(const WEnvironment& env)
   {
     return new Application(env);
   }
+
+  void notify(const WEvent& e) override
+  {
+    if (e.eventType() == Wt::UserEvent)
+      SessionMonitor::Instance()->Touch();
+    WApplication::notify(e);
+  }
   
 private:
+  // Releases the widget tree and its listeners, and stops server push,
+  // until the user comes back.
+  void Hibernate()
+  {
+    if (!updatesEnabled())
+      return;
+    root()->clear();
+    WPushButton* resume = new WPushButton("Resume", root());
+    resume->clicked().connect(this, &Application::Resume);
+    SessionMonitor::Instance()->SetHibernated(true);
+    triggerUpdate();
+    enableUpdates(false);
+  }
+  // A new widget tree starts from the current state.
+  void Resume()
+  {
+    root()->clear();
+    AudioWidget* pWidget = new AudioWidget(root(), mZone);
+    root()->addWidget(pWidget);
+    SessionMonitor::Instance()->SetWidgets(CountWidgets(pWidget));
+    SessionMonitor::Instance()->SetHibernated(false);
+    if (!updatesEnabled())
+      enableUpdates(true);
+  }
+  int mZone; // ?zone=<n>, see Hardware.h
+
+  static int CountWidgets(const WWidget* pWidget)
+  {
+    int count = 1;
+    for (const WWidget* pChild : pWidget->children())
+      count += CountWidgets(pChild);
+    return count;
+  }
+
   struct LocalizedStrings : WLocalizedStrings
   {
     bool resolveKey( const std::string& key, std::string& result ) override
@@ -47,16 +119,126 @@ private:
 int main(int argc, char **argv)
 {
   const char* user = nullptr, *config = nullptr;
+  // --zone <n> starts the options of another zone, see Hardware.h.
+  Hardware::Settings hardware[Hardware::MaxZones];
+  Player::Settings player[Hardware::MaxZones];
+  bool stateDir[Hardware::MaxZones] = {};
+  int zone = 0, zones = 1;
+  AudioPipeline::Settings audio;
+  TimeShift::Settings timeShift;
+  MediaLibrary::Settings media;
+  StreamCatalog::Settings streams;
+  StreamProber::Settings prober;
+  SessionMonitor::Settings sessions;
+  Scenes::Settings scenes;
+  Cluster::Settings cluster;
+  UdpControl::Settings udp;
+  LocalControl::Settings local;
+  SharedState::Settings shared;
+  std::string record;
   std::vector<char*> argv_;
-  for( int i = 0; i < argc - 1; ++i )
-    if( !::strcmp( "--user", argv[i] ) )
+  // Options that take a value are only taken as such when one follows.
+  auto option = [argc, argv]( int i, const char* name )
+  { return i + 1 < argc && !::strcmp( name, argv[i] ); };
+  for( int i = 0; i < argc; ++i )
+    if( option( i, "--user" ) )
       user = argv[++i];
-    else if( !::strcmp( "--config", argv[i] ) )
+    else if( option( i, "--config" ) )
       config = argv[++i];
+    else if( option( i, "--zone" ) )
+    {
+      zone = ::atoi( argv[++i] );
+      if( zone < 0 || zone >= Hardware::MaxZones )
+      {
+        std::cerr << "Invalid zone: " << argv[i] << std::endl;
+        return 1;
+      }
+      zones = std::max( zones, zone + 1 );
+    }
+    else if( option( i, "--i2c-bus" ) )
+      hardware[zone].I2cBus = argv[++i];
+    else if( option( i, "--i2c-address" ) )
+      hardware[zone].I2cAddress = ::strtol( argv[++i], nullptr, 0 );
+    else if( option( i, "--alsa-device" ) )
+      player[zone].AlsaDevice = argv[++i];
+    else if( option( i, "--state-dir" ) && zone != 0 )
+    {
+      std::string dir = argv[++i];
+      hardware[zone].StateFile = dir + "/state";
+      hardware[zone].PowerSensor = dir + "/powersensor";
+      stateDir[zone] = true;
+    }
+    else if( option( i, "--state-dir" ) )
+    {
+      std::string dir = argv[++i];
+      hardware[0].StateFile = dir + "/state";
+      hardware[0].PowerSensor = dir + "/powersensor";
+      audio.LoudnessIndex = dir + "/loudness";
+      audio.EqualizerFile = dir + "/equalizer";
+      timeShift.File = dir + "/timeshift";
+      media.IndexFile = dir + "/library";
+      prober.IndexFile = dir + "/probes";
+    }
+    else if( option( i, "--lirc-socket" ) )
+      hardware[zone].LircSocket = argv[++i];
+    else if( option( i, "--record" ) )
+      record = argv[++i];
+    else if( !::strcmp( "--pcm-tap", argv[i] ) )
+      audio.Enabled = true;
+    else if( option( i, "--pcm-device" ) )
+      audio.Device = argv[++i];
+    else if( option( i, "--crossfade-ms" ) )
+      audio.CrossfadeMs = ::atoi( argv[++i] );
+    else if( option( i, "--timeshift-minutes" ) )
+      timeShift.Minutes = ::atoi( argv[++i] );
+    else if( option( i, "--library" ) )
+      media.Directory = argv[++i];
+    else if( option( i, "--streams" ) )
+      streams.File = argv[++i];
+    else if( option( i, "--scenes" ) )
+      scenes.File = argv[++i];
+    else if( option( i, "--cluster-port" ) )
+      cluster.Port = ::atoi( argv[++i] );
+    else if( option( i, "--cluster-peer" ) )
+      cluster.Peers.push_back( argv[++i] );
+    else if( option( i, "--cluster-group" ) )
+      cluster.Group = argv[++i];
+    else if( option( i, "--cluster-node" ) )
+      cluster.NodeId = ::strtoul( argv[++i], nullptr, 0 );
+    else if( option( i, "--cluster-start-delay-ms" ) )
+      cluster.StartDelayMs = ::atoi( argv[++i] );
+    else if( option( i, "--cluster-clock-skew-ms" ) )
+      cluster.ClockSkewMs = ::atoi( argv[++i] );
+    else if( option( i, "--udp-port" ) )
+      udp.Port = ::atoi( argv[++i] );
+    else if( option( i, "--udp-group" ) )
+      udp.Group = argv[++i];
+    else if( option( i, "--control-socket" ) )
+      local.Path = argv[++i];
+    else if( option( i, "--control-socket-group" ) )
+      local.Group = argv[++i];
+    else if( option( i, "--state-segment" ) )
+      shared.Path = argv[++i];
+    else if( option( i, "--probe-streams" ) )
+      prober.Concurrency = ::atoi( argv[++i] );
+    else if( option( i, "--hibernate-minutes" ) )
+      sessions.HibernateMinutes = ::atoi( argv[++i] );
+    else if( option( i, "--reap-minutes" ) )
+      sessions.ReapMinutes = ::atoi( argv[++i] );
+    else if( option( i, "--max-sessions" ) )
+      sessions.MaxSessions = ::atoi( argv[++i] );
+    else if( !::strcmp( "--trace", argv[i] ) )
+      Trace::SetEnabled( true );
+    else if( option( i, "--log-levels" ) )
+    {
+      if( !Log::SetLevels( argv[++i] ) )
+      {
+        std::cerr << "Invalid log levels: " << argv[i] << std::endl;
+        return 1;
+      }
+    }
     else
       argv_.push_back( argv[i] );
-  if( argc > 1 )
-    argv_.push_back( argv[argc-1] );
   
   struct passwd* pUserinfo = nullptr;
   if( user )
@@ -67,11 +249,52 @@ int main(int argc, char **argv)
       std::cerr << "Unknown user: " << user << std::endl;
       return 1;
     }
+    local.Uid = pUserinfo->pw_uid;
   }
   std::string configpath = "/etc/wt/wthttpd";
   if( config )
     configpath = config;
 
+  for( int i = 0; i < zones; ++i )
+  {
+    // Zones without a state directory of their own keep theirs next to
+    // the first zone's.
+    if( i != 0 && !stateDir[i] )
+    {
+      hardware[i].StateFile = hardware[0].StateFile + "." + std::to_string( i );
+      hardware[i].PowerSensor = hardware[0].PowerSensor + "." + std::to_string( i );
+    }
+    for( int j = 0; j < i; ++j )
+      if( hardware[j].I2cBus == hardware[i].I2cBus && hardware[j].I2cAddress == hardware[i].I2cAddress )
+      {
+        std::cerr << "Zones " << j << " and " << i << " have the same amplifier" << std::endl;
+        return 1;
+      }
+    Hardware::Configure( hardware[i], i );
+    Player::Configure( player[i], i );
+  }
+  if( !record.empty() )
+  {
+    Recorder::Settings recorded;
+    recorded.AudioPipeline = audio.Enabled;
+    recorded.CrossfadeMs = audio.CrossfadeMs;
+    if( !Recorder::StartRecording( record, recorded ) )
+    {
+      std::cerr << "Could not record to " << record << std::endl;
+      return 1;
+    }
+  }
+  AudioPipeline::Configure( audio );
+  TimeShift::Configure( timeShift );
+  MediaLibrary::Configure( media );
+  StreamCatalog::Configure( streams );
+  StreamProber::Configure( prober );
+  SessionMonitor::Configure( sessions );
+  Scenes::Configure( scenes );
+  Cluster::Configure( cluster );
+  UdpControl::Configure( udp );
+  LocalControl::Configure( local );
+  SharedState::Configure( shared );
   try
   {
     WServer server;
@@ -93,12 +316,41 @@ int main(int argc, char **argv)
     ControlResource control;
     server.addResource( &control, "/control" );
     server.addResource( &control, "/state" );
+
+    ApiResource api;
+    server.addResource( &api, "/api/state" );
+    server.addResource( &api, "/api/control" );
+    server.addResource( &api, "/api/events" );
+    server.addResource( &api, "/api/streams" );
     
-    Wt::WFileResource info( "text/html", server.appRoot() + "doc/info.html" );
-    server.addResource( &info, "/info" );
+    TraceResource trace;
+    server.addResource( &trace, "/trace" );
+
+    LibraryResource library;
+    server.addResource( &library, "/library" );
+
+    SessionResource sessionInfo;
+    server.addResource( &sessionInfo, "/sessions" );
+
+    ClusterResource clusterInfo;
+    server.addResource( &clusterInfo, "/cluster" );
+
+    AssetResource assets;
+    server.addResource( &assets, "/assets" );
+    AssetResource lite( "src/lite.html" );
+    server.addResource( &lite, "/lite" );
+
+    Wt::WFileResource infoFile( "text/html", server.appRoot() + "doc/info.html" );
+    AssetResource info( "doc/info.html" );
+    if( Assets::Instance()->FindSource( "doc/info.html" ) )
+      server.addResource( &info, "/info" );
+    else
+      server.addResource( &infoFile, "/info" );
 
     if (server.start())
     {
+      if( LocalControl::Enabled() )
+        LocalControl::Instance();
       if( pUserinfo )
       {
         if( ::setgid( pUserinfo->pw_gid ) < 0 )
@@ -118,11 +370,29 @@ int main(int argc, char **argv)
         }
       }
 
-      Hardware::Instance();
-      Player::Instance();
+      for( int i = 0; i < zones; ++i )
+      {
+        Hardware::Instance( i );
+        Player::Instance( i );
+      }
+      AudioPipeline::Instance();
+      MediaLibrary::Instance();
+      StreamCatalog::Instance();
+      StreamProber::Instance();
+      Scenes::Instance();
+      if( Cluster::Enabled() )
+        Cluster::Instance();
+      if( UdpControl::Enabled() )
+        UdpControl::Instance();
+      if( LocalControl::Enabled() )
+        LocalControl::Instance()->Start();
+      if( SharedState::Enabled() )
+        SharedState::Instance();
       int sig = WServer::waitForShutdown(argv[0]);
       std::cerr << "Shutdown (signal = " << sig << ")" << std::endl;
       server.stop();
+      if( LocalControl::Enabled() )
+        LocalControl::Instance()->Stop();
       if (sig == SIGHUP)
         WServer::restart(argc, argv, environ);
     }
@@ -0,0 +1,796 @@
+// goldstard-loadgen
+//
+// Opens a number of Wt AJAX sessions against goldstard, drives slider events
+// and /control, /state requests at configurable rates, and reports how long
+// it takes for a change made through one session (or /control) to show up
+// in every session, along with server memory and CPU cost per session.
+//
+// The browser side of Wt is emulated at the protocol level, as used with
+// URL session tracking and comet server push (see etc/wt_config.xml).
+// With --spawn, the daemon is started against stand-in hardware: a regular
+// file as I2C bus, a power sensor file, and a minimal lircd on a local
+// socket that toggles the power sensor when the power key is sent.
+
+#include <boost/function.hpp>
+#include "Hardware.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+struct Options
+{
+  std::string host = "127.0.0.1", spawn, approot = "..";
+  int port = 8080, pid = 0, sessions = 10;
+  double sliderRate = 1, controlRate = 1, stateRate = 5, duration = 30;
+  std::string sliderSignal = "moved";
+};
+
+int64_t NowUs()
+{
+  using namespace std::chrono;
+  return duration_cast<microseconds>( steady_clock::now().time_since_epoch() ).count();
+}
+
+void SleepUntilUs( int64_t t )
+{
+  int64_t d = t - NowUs();
+  if( d > 0 )
+    std::this_thread::sleep_for( std::chrono::microseconds( d ) );
+}
+
+struct HttpResponse
+{
+  int status = 0;
+  std::string body;
+};
+
+// Minimal HTTP/1.1 client with keep-alive.
+class HttpClient
+{
+public:
+  HttpClient( const std::string& host, int port )
+  : mHost( host ), mPort( port ), mFd( -1 )
+  {}
+  ~HttpClient()
+  {
+    Close();
+  }
+  bool Get( const std::string& target, HttpResponse& rsp )
+  {
+    return Request( "GET", target, "", rsp );
+  }
+  bool Post( const std::string& target, const std::string& body, HttpResponse& rsp )
+  {
+    return Request( "POST", target, body, rsp );
+  }
+  // Unblocks a pending request from another thread.
+  void Abort()
+  {
+    int fd = mFd;
+    if( fd >= 0 )
+      ::shutdown( fd, SHUT_RDWR );
+  }
+
+private:
+  bool Connect()
+  {
+    if( mFd >= 0 )
+      return true;
+    addrinfo hints, *result = nullptr;
+    ::memset( &hints, 0, sizeof(hints) );
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if( ::getaddrinfo( mHost.c_str(), std::to_string( mPort ).c_str(), &hints, &result ) )
+      return false;
+    int fd = ::socket( AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    if( fd >= 0 && ::connect( fd, result->ai_addr, result->ai_addrlen ) < 0 )
+    {
+      ::close( fd );
+      fd = -1;
+    }
+    ::freeaddrinfo( result );
+    if( fd < 0 )
+      return false;
+    int one = 1;
+    ::setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one) );
+    mFd = fd;
+    mBuffer.clear();
+    return true;
+  }
+  void Close()
+  {
+    if( mFd >= 0 )
+      ::close( mFd );
+    mFd = -1;
+  }
+  bool Request( const std::string& method, const std::string& target,
+                const std::string& body, HttpResponse& rsp )
+  {
+    for( int attempt = 0; attempt < 2; ++attempt )
+    {
+      if( !Connect() )
+        return false;
+      std::ostringstream req;
+      req << method << " " << target << " HTTP/1.1\r\n"
+          << "Host: " << mHost << ":" << mPort << "\r\n"
+          << "User-Agent: Mozilla/5.0 (X11; Linux) goldstard-loadgen\r\n"
+          << "Accept: */*\r\n";
+      if( method == "POST" )
+        req << "Content-Type: application/x-www-form-urlencoded\r\n"
+            << "Content-Length: " << body.length() << "\r\n";
+      req << "\r\n" << body;
+      if( WriteAll( req.str() ) && ReadResponse( rsp ) )
+        return true;
+      Close(); // stale keep-alive connection, retry once
+    }
+    return false;
+  }
+  bool WriteAll( const std::string& s )
+  {
+    const char* p = s.data();
+    size_t len = s.length();
+    while( len > 0 )
+    {
+      ssize_t r = ::send( mFd, p, len, MSG_NOSIGNAL );
+      if( r <= 0 )
+        return false;
+      p += r;
+      len -= r;
+    }
+    return true;
+  }
+  bool Fill()
+  {
+    char buf[16384];
+    ssize_t r = ::recv( mFd, buf, sizeof(buf), 0 );
+    if( r <= 0 )
+      return false;
+    mBuffer.append( buf, r );
+    return true;
+  }
+  bool ReadLine( std::string& line )
+  {
+    size_t pos;
+    while( (pos = mBuffer.find( "\r\n" )) == std::string::npos )
+      if( !Fill() )
+        return false;
+    line = mBuffer.substr( 0, pos );
+    mBuffer.erase( 0, pos + 2 );
+    return true;
+  }
+  bool ReadBytes( size_t n, std::string& out )
+  {
+    while( mBuffer.length() < n )
+      if( !Fill() )
+        return false;
+    out.append( mBuffer, 0, n );
+    mBuffer.erase( 0, n );
+    return true;
+  }
+  bool ReadResponse( HttpResponse& rsp )
+  {
+    std::string line;
+    if( !ReadLine( line ) || line.compare( 0, 5, "HTTP/" ) )
+      return false;
+    rsp.status = ::atoi( line.c_str() + line.find( ' ' ) );
+    rsp.body.clear();
+    long long length = -1;
+    bool chunked = false, close = false;
+    while( ReadLine( line ) && !line.empty() )
+    {
+      std::string name = line.substr( 0, line.find( ':' ) );
+      std::transform( name.begin(), name.end(), name.begin(), ::tolower );
+      std::string value = line.substr( std::min( line.length(), name.length() + 2 ) );
+      if( name == "content-length" )
+        length = ::atoll( value.c_str() );
+      else if( name == "transfer-encoding" && value.find( "chunked" ) != std::string::npos )
+        chunked = true;
+      else if( name == "connection" && value.find( "close" ) != std::string::npos )
+        close = true;
+    }
+    bool ok = true;
+    if( chunked )
+    {
+      while( ok && ReadLine( line ) )
+      {
+        size_t size = ::strtoul( line.c_str(), nullptr, 16 );
+        if( size == 0 )
+        {
+          ReadLine( line );
+          break;
+        }
+        std::string crlf;
+        ok = ReadBytes( size, rsp.body ) && ReadBytes( 2, crlf );
+      }
+    }
+    else if( length >= 0 )
+      ok = ReadBytes( length, rsp.body );
+    else
+    {
+      while( Fill() )
+        ;
+      rsp.body.swap( mBuffer );
+      close = true;
+    }
+    if( close )
+      Close();
+    return ok;
+  }
+
+  std::string mHost;
+  int mPort;
+  std::atomic<int> mFd;
+  std::string mBuffer;
+};
+
+struct Percentiles
+{
+  std::vector<double> values;
+  std::string Report() const
+  {
+    std::vector<double> v = values;
+    std::sort( v.begin(), v.end() );
+    auto at = [&v]( double q ) { return v.empty() ? 0.0 : v[std::min<size_t>( v.size() - 1, q * v.size() )]; };
+    std::ostringstream oss;
+    oss << "n=" << v.size() << " p50=" << at( 0.5 ) << " p90=" << at( 0.9 )
+        << " p99=" << at( 0.99 ) << " max=" << (v.empty() ? 0.0 : v.back());
+    return oss.str();
+  }
+};
+
+// Tracks changes until they have been seen by every session.
+class Stats
+{
+public:
+  explicit Stats( int sessions )
+  : mSessions( sessions )
+  {}
+  void Begin( int value )
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    Expire( NowUs() );
+    auto i = mPending.find( value );
+    if( i != mPending.end() )
+      Drop( i );
+    Change& c = mPending[value];
+    c.sentUs = NowUs();
+    c.marker = std::to_string( value ) + "dB";
+    c.seen.assign( mSessions, false );
+    c.remaining = mSessions;
+    c.lastUs = c.sentUs;
+    ++mChanges;
+  }
+  void Seen( int session, const std::string& body )
+  {
+    int64_t now = NowUs();
+    std::lock_guard<std::mutex> lock( mMutex );
+    for( auto i = mPending.begin(); i != mPending.end(); )
+    {
+      Change& c = i->second;
+      if( !c.seen[session] && body.find( c.marker ) != std::string::npos )
+      {
+        c.seen[session] = true;
+        c.lastUs = now;
+        mOne.values.push_back( (now - c.sentUs) * 1e-3 );
+        if( --c.remaining == 0 )
+        {
+          mAll.values.push_back( (c.lastUs - c.sentUs) * 1e-3 );
+          i = mPending.erase( i );
+          continue;
+        }
+      }
+      ++i;
+    }
+  }
+  bool SomePending() const
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    return !mPending.empty();
+  }
+  void Error()
+  {
+    ++mErrors;
+  }
+  void Report( std::ostream& os )
+  {
+    std::lock_guard<std::mutex> lock( mMutex );
+    while( !mPending.empty() )
+      Drop( mPending.begin() );
+    os << "changes=" << mChanges << " lost=" << mLost << " errors=" << mErrors << "\n"
+       << "latency_one_ms " << mOne.Report() << "\n"
+       << "latency_all_ms " << mAll.Report() << "\n";
+  }
+
+private:
+  struct Change
+  {
+    int64_t sentUs, lastUs;
+    std::string marker;
+    std::vector<bool> seen;
+    int remaining;
+  };
+  void Drop( std::map<int, Change>::iterator i )
+  {
+    mLost += i->second.remaining;
+    mPending.erase( i );
+  }
+  void Expire( int64_t now )
+  {
+    static const int64_t timeoutUs = 10000000;
+    for( auto i = mPending.begin(); i != mPending.end(); )
+      if( now - i->second.sentUs > timeoutUs )
+      {
+        mLost += i->second.remaining;
+        i = mPending.erase( i );
+      }
+      else
+        ++i;
+  }
+  mutable std::mutex mMutex;
+  int mSessions;
+  std::map<int, Change> mPending;
+  Percentiles mOne, mAll;
+  int mChanges = 0, mLost = 0;
+  std::atomic<int> mErrors { 0 };
+};
+
+// One emulated browser: bootstraps an AJAX session, keeps a server push
+// poll outstanding, and sends slider events on a second connection.
+class Session
+{
+public:
+  Session( const Options& o, Stats& stats, int index )
+  : mOptions( o ), mStats( stats ), mIndex( index ),
+    mPoll( o.host, o.port ), mEvents( o.host, o.port )
+  {}
+
+  bool Start()
+  {
+    HttpResponse rsp;
+    if( !mEvents.Get( "/", rsp ) || rsp.status != 200 )
+      return false;
+    std::smatch m;
+    static const std::regex wtd( "wtd=([0-9A-Za-z]+)" ), sid( "sid=['\"]?(-?[0-9]+)" );
+    if( !std::regex_search( rsp.body, m, wtd ) )
+      return false;
+    mId = m[1];
+    std::string script = "/?wtd=" + mId + "&request=script&rand=" + std::to_string( ::rand() )
+      + "&ajax=1&htmlHistory=true&deployPath=%2F&scale=1&tz=0&width=400&height=700";
+    if( std::regex_search( rsp.body, m, sid ) )
+      script += "&sid=" + m[1].str();
+    if( !mEvents.Get( script, rsp ) || rsp.status != 200 )
+      return false;
+    Track( rsp.body );
+    return Update( mEvents, "signal=load", rsp ) && rsp.body.find( "ID_" ) != std::string::npos;
+  }
+
+  void Run( const std::atomic<bool>& stop )
+  {
+    HttpResponse rsp;
+    while( !stop )
+    {
+      if( !Update( mPoll, "signal=poll", rsp ) )
+      {
+        if( !stop )
+          mStats.Error();
+        std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+      }
+    }
+  }
+
+  void Abort()
+  {
+    mPoll.Abort();
+  }
+
+  bool Slider( int value )
+  {
+    std::ostringstream oss;
+    oss << "signal=ID_" << Key::VolumeL << "." << mOptions.sliderSignal << "&a0=" << value;
+    HttpResponse rsp;
+    std::lock_guard<std::mutex> lock( mEventMutex );
+    return Update( mEvents, oss.str(), rsp );
+  }
+
+private:
+  bool Update( HttpClient& c, const std::string& signal, HttpResponse& rsp )
+  {
+    std::string body;
+    {
+      std::lock_guard<std::mutex> lock( mMutex );
+      body = "request=jsupdate&" + signal
+        + "&ackId=" + std::to_string( mAckId ) + "&pageId=" + std::to_string( mPageId );
+    }
+    if( !c.Post( "/?wtd=" + mId, body, rsp ) || rsp.status != 200 )
+      return false;
+    Track( rsp.body );
+    return true;
+  }
+  void Track( const std::string& body )
+  {
+    static const std::regex ack( "response\\(([0-9]+)\\)" ), page( "pageId=([0-9]+)" );
+    std::smatch m;
+    {
+      std::lock_guard<std::mutex> lock( mMutex );
+      if( std::regex_search( body, m, ack ) )
+        mAckId = std::max( mAckId, std::stoi( m[1] ) );
+      if( std::regex_search( body, m, page ) )
+        mPageId = std::stoi( m[1] );
+    }
+    mStats.Seen( mIndex, body );
+  }
+
+  const Options& mOptions;
+  Stats& mStats;
+  int mIndex;
+  HttpClient mPoll, mEvents;
+  std::string mId;
+  std::mutex mMutex, mEventMutex;
+  int mAckId = 0, mPageId = 0;
+};
+
+// Stand-in for the amplifier: I2C bus file, power sensor, and lircd.
+class StandIn
+{
+public:
+  bool Create()
+  {
+    char dir[] = "/tmp/goldstard-loadgen.XXXXXX";
+    if( !::mkdtemp( dir ) )
+      return false;
+    mDir = dir;
+    std::ofstream( mDir + "/i2c" );
+    SetPower( true );
+    sockaddr_un addr;
+    ::memset( &addr, 0, sizeof(addr) );
+    addr.sun_family = AF_UNIX;
+    ::strncpy( addr.sun_path, LircSocket().c_str(), sizeof(addr.sun_path) - 1 );
+    mListenFd = ::socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    if( mListenFd < 0
+        || ::bind( mListenFd, (sockaddr*)&addr, sizeof(addr) ) < 0
+        || ::listen( mListenFd, 4 ) < 0 )
+      return false;
+    std::thread( &StandIn::Accept, this ).detach();
+    return true;
+  }
+  void Destroy()
+  {
+    if( mListenFd >= 0 )
+      ::shutdown( mListenFd, SHUT_RDWR );
+    for( auto f : { "/i2c", "/powersensor", "/state", "/lircd" } )
+      ::unlink( (mDir + f).c_str() );
+    ::rmdir( mDir.c_str() );
+  }
+  const std::string& Dir() const { return mDir; }
+  std::string LircSocket() const { return mDir + "/lircd"; }
+
+private:
+  void SetPower( bool on )
+  {
+    std::ofstream( mDir + "/powersensor" ) << (on ? '1' : '0');
+    mPower = on;
+  }
+  void Accept()
+  {
+    int fd;
+    while( (fd = ::accept( mListenFd, nullptr, nullptr )) >= 0 )
+      std::thread( &StandIn::Serve, this, fd ).detach();
+  }
+  void Serve( int fd )
+  {
+    std::string buffer;
+    char buf[256];
+    ssize_t r;
+    while( (r = ::read( fd, buf, sizeof(buf) )) > 0 )
+    {
+      buffer.append( buf, r );
+      size_t pos;
+      while( (pos = buffer.find( '\n' )) != std::string::npos )
+      {
+        std::string cmd = buffer.substr( 0, pos );
+        buffer.erase( 0, pos + 1 );
+        std::string reply = "BEGIN\n" + cmd + "\nSUCCESS\nEND\n";
+        if( ::write( fd, reply.data(), reply.length() ) < 0 )
+          break;
+        // The amplifier reacts to the repeated power key after a while.
+        if( cmd.find( "SEND_START" ) == 0 && cmd.find( " power" ) != std::string::npos )
+        {
+          bool on = !mPower;
+          std::thread( [this, on]()
+          {
+            std::this_thread::sleep_for( std::chrono::seconds( 1 ) );
+            SetPower( on );
+          } ).detach();
+        }
+      }
+    }
+    ::close( fd );
+  }
+  std::string mDir;
+  int mListenFd = -1;
+  std::atomic<bool> mPower { false };
+};
+
+struct ProcessUsage
+{
+  long rssKb = 0;
+  double cpuSeconds = 0;
+  bool Read( int pid )
+  {
+    std::ifstream status( "/proc/" + std::to_string( pid ) + "/status" );
+    std::string line;
+    while( std::getline( status, line ) )
+      if( line.find( "VmRSS:" ) == 0 )
+        rssKb = ::atol( line.c_str() + 6 );
+    std::ifstream stat( "/proc/" + std::to_string( pid ) + "/stat" );
+    std::getline( stat, line );
+    size_t pos = line.rfind( ')' );
+    if( pos == std::string::npos )
+      return false;
+    std::istringstream iss( line.substr( pos + 2 ) );
+    std::string field;
+    for( int i = 3; i < 14; ++i )
+      iss >> field;
+    long utime = 0, stime = 0;
+    iss >> utime >> stime;
+    cpuSeconds = double( utime + stime ) / ::sysconf( _SC_CLK_TCK );
+    return true;
+  }
+};
+
+int Spawn( const Options& o, const StandIn& standIn )
+{
+  std::vector<std::string> args =
+  {
+    o.spawn,
+    "--i2c-bus", standIn.Dir() + "/i2c",
+    "--state-dir", standIn.Dir(),
+    "--lirc-socket", standIn.LircSocket(),
+    "--config", o.approot + "/etc/wthttpd",
+    "--docroot", o.approot,
+    "--approot", o.approot,
+    "--http-address", o.host,
+    "--http-port", std::to_string( o.port ),
+    "-c", o.approot + "/etc/wt_config.xml",
+  };
+  int pid = ::fork();
+  if( pid == 0 )
+  {
+    std::vector<char*> argv;
+    for( auto& s : args )
+      argv.push_back( const_cast<char*>( s.c_str() ) );
+    argv.push_back( nullptr );
+    ::execv( argv[0], argv.data() );
+    ::_exit( 127 );
+  }
+  return pid;
+}
+
+bool WaitForServer( const Options& o, int seconds )
+{
+  for( int i = 0; i < 10 * seconds; ++i )
+  {
+    HttpClient c( o.host, o.port );
+    HttpResponse rsp;
+    if( c.Get( "/state", rsp ) && rsp.status == 200 )
+      return true;
+    std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+  }
+  return false;
+}
+
+// Runs f at the given rate until stop is set.
+template<class F> void Periodic( double rate, const std::atomic<bool>& stop, F f )
+{
+  if( rate <= 0 )
+    return;
+  int64_t interval = 1e6 / rate, next = NowUs();
+  while( !stop )
+  {
+    f();
+    next += interval;
+    SleepUntilUs( next );
+  }
+}
+
+void Usage( const char* name )
+{
+  std::cerr
+    << "Usage: " << name << " [options]\n"
+    << "  --host <addr>          server address (127.0.0.1)\n"
+    << "  --port <port>          server port (8080)\n"
+    << "  --sessions <n>         number of AJAX sessions (10)\n"
+    << "  --slider-rate <hz>     slider events per second, over all sessions (1)\n"
+    << "  --control-rate <hz>    /control requests per second (1)\n"
+    << "  --state-rate <hz>      /state requests per second (5)\n"
+    << "  --duration <s>         measurement duration (30)\n"
+    << "  --pid <pid>            server process for RSS and CPU figures\n"
+    << "  --spawn <binary>       start goldstard against stand-in hardware\n"
+    << "  --approot <dir>        goldstard approot when spawning (..)\n"
+    << "  --slider-signal <name> JavaScript signal name of slider moves (moved)\n";
+}
+
+} // namespace
+
+int main( int argc, char** argv )
+{
+  Options o;
+  for( int i = 1; i < argc; ++i )
+  {
+    std::string arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if( !value )
+    {
+      Usage( argv[0] );
+      return 1;
+    }
+    ++i;
+    if( arg == "--host" ) o.host = value;
+    else if( arg == "--port" ) o.port = ::atoi( value );
+    else if( arg == "--sessions" ) o.sessions = ::atoi( value );
+    else if( arg == "--slider-rate" ) o.sliderRate = ::atof( value );
+    else if( arg == "--control-rate" ) o.controlRate = ::atof( value );
+    else if( arg == "--state-rate" ) o.stateRate = ::atof( value );
+    else if( arg == "--duration" ) o.duration = ::atof( value );
+    else if( arg == "--pid" ) o.pid = ::atoi( value );
+    else if( arg == "--spawn" ) o.spawn = value;
+    else if( arg == "--approot" ) o.approot = value;
+    else if( arg == "--slider-signal" ) o.sliderSignal = value;
+    else
+    {
+      Usage( argv[0] );
+      return 1;
+    }
+  }
+
+  StandIn standIn;
+  if( !o.spawn.empty() )
+  {
+    if( !standIn.Create() )
+    {
+      std::cerr << "Could not create stand-in hardware: " << ::strerror( errno ) << std::endl;
+      return 1;
+    }
+    o.pid = Spawn( o, standIn );
+  }
+  int result = 0;
+  if( !WaitForServer( o, 10 ) )
+  {
+    std::cerr << "No server at " << o.host << ":" << o.port << std::endl;
+    result = 1;
+  }
+  else
+  {
+    ProcessUsage base, opened, done;
+    if( o.pid )
+      base.Read( o.pid );
+
+    Stats stats( o.sessions );
+    std::vector<Session*> sessions;
+    for( int i = 0; i < o.sessions; ++i )
+    {
+      Session* s = new Session( o, stats, i );
+      if( !s->Start() )
+      {
+        std::cerr << "Could not start session " << i << std::endl;
+        delete s;
+        result = 1;
+        break;
+      }
+      sessions.push_back( s );
+    }
+    if( result == 0 )
+    {
+      std::cout << "sessions=" << sessions.size() << std::endl;
+      if( o.pid )
+        opened.Read( o.pid );
+
+      std::atomic<bool> stop( false );
+      std::vector<std::thread> threads;
+      for( auto s : sessions )
+        threads.emplace_back( &Session::Run, s, std::ref( stop ) );
+
+      // Cycle through volume values, so that every change is distinct
+      // from the previous ones still in flight.
+      std::atomic<int> counter( 0 );
+      auto next = [&counter]() { return -47 + (counter++ % 46); };
+      threads.emplace_back( [&]()
+      {
+        Periodic( o.sliderRate, stop, [&]()
+        {
+          int value = next();
+          stats.Begin( value );
+          if( !sessions[::rand() % sessions.size()]->Slider( value ) )
+            stats.Error();
+        } );
+      } );
+      threads.emplace_back( [&]()
+      {
+        HttpClient c( o.host, o.port );
+        Periodic( o.controlRate, stop, [&]()
+        {
+          int value = next();
+          stats.Begin( value );
+          HttpResponse rsp;
+          std::string v = std::to_string( value );
+          if( !c.Get( "/control?VolumeL=" + v + "&VolumeR=" + v, rsp ) || rsp.body.find( '1' ) != 0 )
+            stats.Error();
+        } );
+      } );
+      threads.emplace_back( [&]()
+      {
+        HttpClient c( o.host, o.port );
+        Periodic( o.stateRate, stop, [&]()
+        {
+          HttpResponse rsp;
+          if( !c.Get( "/state", rsp ) || rsp.status != 200 )
+            stats.Error();
+        } );
+      } );
+
+      int64_t begin = NowUs();
+      SleepUntilUs( begin + o.duration * 1e6 );
+      if( o.pid )
+        done.Read( o.pid );
+      double elapsed = (NowUs() - begin) * 1e-6;
+      // Give the last changes a chance to arrive.
+      for( int i = 0; i < 20 && stats.SomePending(); ++i )
+        std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+      stop = true;
+      for( auto s : sessions )
+        s->Abort();
+      for( auto& t : threads )
+        t.join();
+
+      stats.Report( std::cout );
+      if( o.pid )
+      {
+        int n = sessions.size();
+        std::cout << "rss_base_kb=" << base.rssKb
+                  << " rss_sessions_kb=" << opened.rssKb
+                  << " rss_end_kb=" << done.rssKb
+                  << " rss_per_session_kb=" << (opened.rssKb - base.rssKb) / std::max( n, 1 ) << "\n"
+                  << "cpu_pct=" << 100 * (done.cpuSeconds - opened.cpuSeconds) / elapsed
+                  << " cpu_per_session_pct="
+                  << 100 * (done.cpuSeconds - opened.cpuSeconds) / elapsed / std::max( n, 1 )
+                  << std::endl;
+      }
+    }
+    for( auto s : sessions )
+      delete s;
+  }
+  if( !o.spawn.empty() )
+  {
+    if( o.pid > 0 )
+    {
+      ::kill( o.pid, SIGTERM );
+      ::waitpid( o.pid, nullptr, 0 );
+    }
+    standIn.Destroy();
+  }
+  return result;
+}
@@ -0,0 +1,132 @@
+// goldstard-probe
+//
+// Checks stream urls the way the stream prober does, and prints connect
+// time, first byte latency, codec, and bitrate for each. With --self-test,
+// checks the paths of a goldstard-streamserver on the given local port
+// against the expected results, and exits with 1 on a mismatch.
+
+#include "StreamProbe.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void Usage( const char* name )
+{
+  std::cerr << "Usage: " << name << " [--concurrency <n>] <url>...\n"
+            << "       " << name << " --self-test <port>\n";
+}
+
+static const char* sStatus[] = { "unsupported", "failed", "ok" };
+
+static std::string Describe( const StreamProbe::Result& r )
+{
+  std::string s = sStatus[r.status];
+  if( r.status == StreamProbe::Ok )
+    s += " " + r.Codec + " " + std::to_string( r.Bitrate ) + " kbit/s, connect "
+         + std::to_string( r.ConnectMs ) + " ms, first byte " + std::to_string( r.FirstByteMs ) + " ms";
+  else
+    s += " " + r.Error;
+  return s;
+}
+
+// Runs the probes, at most the given number at a time, in order.
+static void Run( const std::vector<std::string>& urls, size_t concurrency,
+                 std::vector<StreamProbe::Result>& results )
+{
+  std::vector<std::unique_ptr<StreamProbe>> active;
+  std::vector<size_t> indices;
+  results.assign( urls.size(), StreamProbe::Result() );
+  size_t next = 0;
+  while( next < urls.size() || !active.empty() )
+  {
+    while( active.size() < concurrency && next < urls.size() )
+    {
+      active.emplace_back( new StreamProbe( urls[next] ) );
+      indices.push_back( next++ );
+    }
+    StreamProbe::Poll( active, 250 );
+    for( size_t i = 0; i < active.size(); )
+      if( active[i]->Done() )
+      {
+        results[indices[i]] = active[i]->GetResult();
+        active.erase( active.begin() + i );
+        indices.erase( indices.begin() + i );
+      }
+      else
+        ++i;
+  }
+}
+
+static int SelfTest( int port )
+{
+  std::string base = "http://127.0.0.1:" + std::to_string( port );
+  struct { std::string path; StreamProbe::Status status; std::string detail; } cases[] =
+  {
+    { "/ok.mp3", StreamProbe::Ok, "mp3" },
+    { "/aac", StreamProbe::Ok, "aac" },
+    { "/slow.mp3", StreamProbe::Ok, "mp3" },
+    { "/redirect", StreamProbe::Ok, "mp3" },
+    { "/redirect-loop", StreamProbe::Failed, "hops" },
+    { "/list.m3u", StreamProbe::Ok, "mp3" },
+    { "/list.pls", StreamProbe::Ok, "aac" },
+    { "/missing", StreamProbe::Failed, "http-404" },
+    { "/hang", StreamProbe::Failed, "timeout" },
+    { "/close", StreamProbe::Failed, "closed" },
+  };
+  std::vector<std::string> urls;
+  for( const auto& c : cases )
+    urls.push_back( base + c.path );
+  urls.push_back( "http://127.0.0.1:" + std::to_string( port + 1 ) + "/" );
+  urls.push_back( "https://127.0.0.1/" );
+  std::vector<StreamProbe::Result> results;
+  auto begin = std::chrono::steady_clock::now();
+  Run( urls, urls.size(), results );
+  double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - begin ).count();
+  int failures = 0;
+  for( size_t i = 0; i < urls.size(); ++i )
+  {
+    StreamProbe::Status status = i < 10 ? cases[i].status : i == 10 ? StreamProbe::Failed : StreamProbe::Unsupported;
+    std::string detail = i < 10 ? cases[i].detail : i == 10 ? "refused" : "https";
+    const auto& r = results[i];
+    bool ok = r.status == status && (status == StreamProbe::Ok ? r.Codec : r.Error) == detail;
+    if( i == 2 )
+      ok = ok && r.FirstByteMs >= 2000;
+    failures += !ok;
+    std::cout << (ok ? "pass " : "FAIL ") << urls[i] << ": " << Describe( r ) << "\n";
+  }
+  std::cout << urls.size() << " probes in " << seconds << " s\n";
+  return failures ? 1 : 0;
+}
+
+int main( int argc, char** argv )
+{
+  size_t concurrency = 8;
+  std::vector<std::string> urls;
+  for( int i = 1; i < argc; ++i )
+  {
+    std::string arg = argv[i];
+    if( arg == "--self-test" && i + 1 < argc )
+      return SelfTest( ::atoi( argv[++i] ) );
+    else if( arg == "--concurrency" && i + 1 < argc )
+      concurrency = std::max( 1, ::atoi( argv[++i] ) );
+    else if( arg[0] == '-' )
+    {
+      Usage( argv[0] );
+      return 1;
+    }
+    else
+      urls.push_back( arg );
+  }
+  if( urls.empty() )
+  {
+    Usage( argv[0] );
+    return 1;
+  }
+  std::vector<StreamProbe::Result> results;
+  Run( urls, concurrency, results );
+  for( size_t i = 0; i < urls.size(); ++i )
+    std::cout << urls[i] << ": " << Describe( results[i] ) << "\n";
+  return 0;
+}
@@ -0,0 +1,116 @@
+// goldstard-replay
+//
+// Feeds a log recorded with "goldstard --record <file>" back into Hardware
+// and Player under a virtual clock, as fast as possible, and prints the
+// resulting state along with timing figures. Replaying a log always takes
+// the same path through the state machines, so captured field traces can
+// be used to reproduce incidents, and as regression benchmarks.
+
+#include "AudioPipeline.h"
+#include "Clock.h"
+#include "ControlResource.h"
+#include "Hardware.h"
+#include "Log.h"
+#include "Player.h"
+#include "Recorder.h"
+
+#include <chrono>
+#include <iostream>
+
+static void Usage( const char* name )
+{
+  std::cerr << "Usage: " << name << " [--settle <seconds>] [--log-levels <levels>] <log file>\n";
+}
+
+int main( int argc, char** argv )
+{
+  int settleSeconds = 10;
+  const char* path = nullptr;
+  Log::SetLevels( "all=warning" );
+  for( int i = 1; i < argc; ++i )
+  {
+    if( !::strcmp( argv[i], "--settle" ) && i + 1 < argc )
+      settleSeconds = ::atoi( argv[++i] );
+    else if( !::strcmp( argv[i], "--log-levels" ) && i + 1 < argc )
+      Log::SetLevels( argv[++i] );
+    else if( !path )
+      path = argv[i];
+    else
+    {
+      Usage( argv[0] );
+      return 1;
+    }
+  }
+  if( !path )
+  {
+    Usage( argv[0] );
+    return 1;
+  }
+  Recorder::Settings recorded;
+  if( !Recorder::StartReplay( path, recorded ) )
+  {
+    std::cerr << "Could not read " << path << std::endl;
+    return 1;
+  }
+  // As recorded, for Player to ask for the same inputs; the pipeline
+  // itself does not run under replay.
+  AudioPipeline::Settings audio;
+  audio.Enabled = recorded.AudioPipeline;
+  audio.CrossfadeMs = recorded.CrossfadeMs;
+  AudioPipeline::Configure( audio );
+
+  auto wallBegin = std::chrono::steady_clock::now();
+  int64_t begin = Clock::NowUs();
+  Hardware* hardware = Hardware::Instance();
+  Player* player = Player::Instance();
+
+  int count = 0;
+  Recorder::Entry e;
+  bool more = Recorder::Next( e );
+  while( more )
+  {
+    int64_t due = hardware->ProcessEvents();
+    if( due >= 0 && due <= e.timeUs )
+    {
+      Clock::AdvanceTo( due );
+      continue;
+    }
+    Clock::AdvanceTo( e.timeUs );
+    switch( e.event )
+    {
+      case Recorder::ControlState:
+      case Recorder::Listeners:
+        hardware->Replay( e.event, e.data );
+        break;
+      default:
+        player->Replay( e.event, e.data );
+    }
+    ++count;
+    more = Recorder::Next( e );
+  }
+  // Let scheduled actions, e.g. after power transitions, complete.
+  int64_t end = Clock::NowUs() + settleSeconds * int64_t( 1000000 ), due;
+  while( (due = hardware->ProcessEvents()) >= 0 && due <= end )
+    Clock::AdvanceTo( due );
+  Clock::AdvanceTo( end );
+
+  double wallSeconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - wallBegin ).count(),
+    virtualSeconds = (Clock::NowUs() - begin) * 1e-6;
+
+  Hardware::State state;
+  hardware->GetState( state );
+  ControlResource::WriteState( std::cout, state );
+  std::cout << "Playing=" << player->IsPlaying() << "\n"
+            << "Idle=" << player->IsIdle() << "\n"
+            << "\n"
+            << "events=" << count << "\n"
+            << "virtual_seconds=" << virtualSeconds << "\n"
+            << "wall_seconds=" << wallSeconds << "\n"
+            << "speedup=" << virtualSeconds / std::max( wallSeconds, 1e-9 ) << "\n";
+  int unconsumed = 0;
+  for( int i = Recorder::PowerSensor; i < Recorder::NumEvents; ++i )
+    unconsumed += Recorder::Remaining( i );
+  // Inputs left over mean that replay took a different path than recording.
+  std::cout << "unconsumed=" << unconsumed << std::endl;
+  return unconsumed ? 2 : 0;
+}
@@ -0,0 +1,78 @@
+// goldstard-statewatch
+//
+// Example reader of the state that goldstard publishes with
+// --state-segment (see StateSegment.h): prints the state of each zone,
+// and again on each change, waiting on the segment's futex. Opens the file
+// again after a second without changes, as goldstard creates it anew when
+// it starts. With --bench, measures the time of a consistent read instead.
+
+#include "StateSegment.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+namespace {
+
+const int sReopenMs = 1000;
+
+const char* const sSourceNames[] = { "CD", "AUX", "Network", "Tape" };
+const char* const sPlaybackNames[] = { "idle", "playing", "paused" };
+
+void Print( const StateSegment::Data& d )
+{
+  std::cout << "version " << d.Version << "\n";
+  for( uint32_t i = 0; i < d.ZoneCount; ++i )
+  {
+    const StateSegment::Zone& z = d.Zones[i];
+    std::cout << "zone " << i << ": Power=" << int( z.Power ) << " Mute=" << int( z.Mute )
+      << " Source=" << ( z.Source < 4 ? sSourceNames[z.Source] : "?" )
+      << " VolumeL=" << z.VolumeL << " VolumeR=" << z.VolumeR
+      << " Treble=" << z.Treble << " Bass=" << z.Bass
+      << " " << ( z.Playback < 3 ? sPlaybackNames[z.Playback] : "?" )
+      << " Stream=" << z.Stream << " Title=" << z.Title << "\n";
+  }
+  std::cout << std::flush;
+}
+
+} // namespace
+
+int main( int argc, char** argv )
+{
+  bool bench = argc > 2 && std::string( argv[1] ) == "--bench";
+  const char* path = argc > 1 ? argv[argc - 1] : "/dev/shm/goldstard";
+  StateSegment::Reader reader;
+  if( !reader.Open( path ) )
+  {
+    std::cerr << "Could not open " << path << std::endl;
+    return 1;
+  }
+  StateSegment::Data d;
+  if( bench )
+  {
+    using namespace std::chrono;
+    const int count = 1000000;
+    int failed = 0;
+    auto start = steady_clock::now();
+    for( int i = 0; i < count; ++i )
+      failed += !reader.Read( d );
+    double ns = duration_cast<nanoseconds>( steady_clock::now() - start ).count() * 1.0 / count;
+    std::cout << ns << " ns per read, " << failed << " failed" << std::endl;
+    return 0;
+  }
+  uint64_t version = 0;
+  int64_t timeUs = 0;
+  for( ;; )
+  {
+    uint32_t sequence = reader.Sequence();
+    if( reader.Read( d ) && ( d.Version != version || d.TimeUs != timeUs ) )
+    {
+      Print( d );
+      version = d.Version;
+      timeUs = d.TimeUs;
+    }
+    if( !reader.Wait( sequence, sReopenMs ) && !reader.Open( path ) )
+      std::this_thread::sleep_for( std::chrono::milliseconds( sReopenMs ) );
+  }
+}
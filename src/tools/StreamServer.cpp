@@ -0,0 +1,104 @@
+// goldstard-streamserver
+//
+// Local stand-in for internet radio servers, for checking the stream
+// prober without network access: "goldstard-streamserver <port>" serves
+//   /ok.mp3         ICY response, audio/mpeg at 128 kbit/s
+//   /aac            HTTP response, audio/aacp at 64 kbit/s
+//   /slow.mp3       headers right away, audio after 2.5 seconds
+//   /redirect       302 to /ok.mp3
+//   /redirect-loop  302 to itself
+//   /list.m3u       m3u playlist with a relative entry for /redirect
+//   /list.pls       pls playlist with an absolute entry for /aac
+//   /missing        404
+//   /hang           accepts, and never answers
+//   /close          closes without answering
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static int sPort = 8900;
+
+static void Send( int fd, const std::string& s )
+{
+  ::send( fd, s.data(), s.length(), MSG_NOSIGNAL );
+}
+
+static void Audio( int fd, int delayMs )
+{
+  std::this_thread::sleep_for( std::chrono::milliseconds( delayMs ) );
+  std::string chunk( 1600, '\xff' );
+  while( ::send( fd, chunk.data(), chunk.length(), MSG_NOSIGNAL ) > 0 )
+    std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+}
+
+static void Serve( int fd )
+{
+  std::string request;
+  char buf[1024];
+  ssize_t n;
+  while( request.find( "\r\n\r\n" ) == std::string::npos && (n = ::read( fd, buf, sizeof( buf ) )) > 0 )
+    request.append( buf, n );
+  std::string path = request.substr( 4, request.find( ' ', 4 ) - 4 ),
+    self = "http://127.0.0.1:" + std::to_string( sPort );
+  if( path == "/ok.mp3" )
+  {
+    Send( fd, "ICY 200 OK\r\ncontent-type: audio/mpeg\r\nicy-br: 128\r\n\r\n" );
+    Audio( fd, 0 );
+  }
+  else if( path == "/aac" )
+  {
+    Send( fd, "HTTP/1.0 200 OK\r\nContent-Type: audio/aacp\r\nicy-br: 64\r\n\r\n" );
+    Audio( fd, 0 );
+  }
+  else if( path == "/slow.mp3" )
+  {
+    Send( fd, "HTTP/1.0 200 OK\r\nContent-Type: audio/mpeg\r\n\r\n" );
+    Audio( fd, 2500 );
+  }
+  else if( path == "/redirect" )
+    Send( fd, "HTTP/1.0 302 Found\r\nLocation: " + self + "/ok.mp3\r\n\r\n" );
+  else if( path == "/redirect-loop" )
+    Send( fd, "HTTP/1.0 302 Found\r\nLocation: /redirect-loop\r\n\r\n" );
+  else if( path == "/list.m3u" )
+    Send( fd, "HTTP/1.0 200 OK\r\nContent-Type: audio/x-mpegurl\r\n\r\n#EXTM3U\n#EXTINF:-1,Test\nredirect\n" );
+  else if( path == "/list.pls" )
+    Send( fd, "HTTP/1.0 200 OK\r\nContent-Type: audio/x-scpls\r\n\r\n[playlist]\nNumberOfEntries=1\nFile1="
+              + self + "/aac\nTitle1=Test\n" );
+  else if( path == "/hang" )
+    std::this_thread::sleep_for( std::chrono::seconds( 30 ) );
+  else if( path != "/close" )
+    Send( fd, "HTTP/1.0 404 Not Found\r\n\r\n" );
+  ::close( fd );
+}
+
+int main( int argc, char** argv )
+{
+  if( argc > 1 )
+    sPort = ::atoi( argv[1] );
+  ::signal( SIGPIPE, SIG_IGN );
+  int s = ::socket( AF_INET, SOCK_STREAM, 0 ), on = 1;
+  ::setsockopt( s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on ) );
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons( sPort );
+  addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+  if( ::bind( s, reinterpret_cast<sockaddr*>( &addr ), sizeof( addr ) ) < 0 || ::listen( s, 64 ) < 0 )
+  {
+    std::cerr << "Could not listen on port " << sPort << ": " << ::strerror( errno ) << std::endl;
+    return 1;
+  }
+  while( true )
+  {
+    int fd = ::accept( s, nullptr, nullptr );
+    if( fd >= 0 )
+      std::thread( Serve, fd ).detach();
+  }
+}
@@ -0,0 +1,234 @@
+// goldstard-udpremote
+//
+// Reference client of the UDP control protocol (see UdpProtocol.h), as
+// a remote would implement it: a request is retransmitted until its reply
+// arrives, with the same sequence number, so that the server applies it
+// once. Reports the state replied, and round trip times over repeated
+// requests. With --listen, prints state announcements instead.
+//
+// Operations are given as Name=value or Name+=value (relative), with
+// levels in dB, e.g. Volume+=-2 Mute=1 Source=Network.
+
+#include "UdpProtocol.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+struct Options
+{
+  std::string host = "127.0.0.1", listen;
+  int port = 8710, repeat = 1, timeoutMs = 50, retries = 8;
+  std::vector<UdpProtocol::Op> ops;
+};
+
+const char* const sOpNames[] =
+{
+  "", "Power", "Mute", "Source", "Volume", "VolumeL", "VolumeR", "Treble", "Bass",
+  "GainCD", "GainAUX", "GainNetwork",
+};
+const char* const sSourceNames[] = { "CD", "AUX", "Network", "Tape" };
+
+int64_t NowUs()
+{
+  using namespace std::chrono;
+  return duration_cast<microseconds>( steady_clock::now().time_since_epoch() ).count();
+}
+
+bool ParseOp( const std::string& arg, UdpProtocol::Op& op )
+{
+  size_t eq = arg.find( '=' );
+  if( eq == std::string::npos || eq == 0 )
+    return false;
+  bool relative = arg[eq - 1] == '+';
+  std::string name = arg.substr( 0, relative ? eq - 1 : eq ), value = arg.substr( eq + 1 );
+  op.Op = std::find( sOpNames + 1, sOpNames + UdpProtocol::NumOps, name ) - sOpNames;
+  op.Mode = relative ? UdpProtocol::Relative : UdpProtocol::Absolute;
+  if( op.Op == UdpProtocol::NumOps )
+    return false;
+  if( op.Op == UdpProtocol::Source )
+  {
+    int source = std::find( sSourceNames, sSourceNames + 4, value ) - sSourceNames;
+    op.Value = source < 4 ? source : ::atoi( value.c_str() );
+  }
+  else if( op.Op == UdpProtocol::Power || op.Op == UdpProtocol::Mute )
+    op.Value = ::atoi( value.c_str() );
+  else
+    op.Value = int16_t( ::lround( ::atof( value.c_str() ) * 10 ) );
+  return true;
+}
+
+void Print( const UdpProtocol::State& s )
+{
+  std::cout << "Power=" << int( s.Power ) << " Mute=" << int( s.Mute )
+    << " Source=" << ( s.Source < 4 ? sSourceNames[s.Source] : "?" )
+    << " VolumeL=" << s.VolumeL / 10.0 << " VolumeR=" << s.VolumeR / 10.0
+    << " Treble=" << s.Treble / 10.0 << " Bass=" << s.Bass / 10.0
+    << " GainCD=" << s.GainCD / 10.0 << " GainAUX=" << s.GainAUX / 10.0
+    << " GainNetwork=" << s.GainNetwork / 10.0;
+}
+
+int Listen( int fd, const Options& o )
+{
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl( INADDR_ANY );
+  addr.sin_port = htons( o.port );
+  int one = 1;
+  ::setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
+  ip_mreq mreq = {};
+  if( ::bind( fd, reinterpret_cast<sockaddr*>( &addr ), sizeof( addr ) ) < 0
+      || ::inet_pton( AF_INET, o.listen.c_str(), &mreq.imr_multiaddr ) != 1
+      || ::setsockopt( fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof( mreq ) ) < 0 )
+  {
+    std::cerr << "Could not join " << o.listen << ":" << o.port << ": " << ::strerror( errno ) << std::endl;
+    return 1;
+  }
+  for( ;; )
+  {
+    uint8_t buf[UdpProtocol::MaxSize];
+    ssize_t n = ::recv( fd, buf, sizeof( buf ), 0 );
+    UdpProtocol::Header h;
+    UdpProtocol::State s;
+    if( n < 0 || !UdpProtocol::GetHeader( buf, n, h ) || h.Type != UdpProtocol::Announce
+        || !UdpProtocol::GetState( buf + UdpProtocol::HeaderSize, n - UdpProtocol::HeaderSize, s ) )
+      continue;
+    std::cout << "version " << h.StateVersion << ": ";
+    Print( s );
+    std::cout << std::endl;
+  }
+}
+
+void Usage( const char* name )
+{
+  std::cerr
+    << "Usage: " << name << " [options] [Name=value|Name+=value ...]\n"
+    << "  --host <addr>          server address (127.0.0.1)\n"
+    << "  --port <port>          server UDP port (8710)\n"
+    << "  --repeat <n>           requests to send, for round trip times (1)\n"
+    << "  --timeout-ms <ms>      before a retransmit (50)\n"
+    << "  --retries <n>          retransmits before giving up (8)\n"
+    << "  --listen <group>       print announcements to a multicast group\n"
+    << "Names: Power Mute Source Volume VolumeL VolumeR Treble Bass GainCD GainAUX GainNetwork\n";
+}
+
+} // namespace
+
+int main( int argc, char** argv )
+{
+  Options o;
+  for( int i = 1; i < argc; ++i )
+  {
+    std::string arg = argv[i];
+    UdpProtocol::Op op;
+    if( arg.compare( 0, 2, "--" ) )
+    {
+      if( !ParseOp( arg, op ) || o.ops.size() == UdpProtocol::MaxOps )
+      {
+        Usage( argv[0] );
+        return 1;
+      }
+      o.ops.push_back( op );
+      continue;
+    }
+    const char* value = i + 1 < argc ? argv[++i] : nullptr;
+    if( !value )
+    {
+      Usage( argv[0] );
+      return 1;
+    }
+    if( arg == "--host" ) o.host = value;
+    else if( arg == "--port" ) o.port = ::atoi( value );
+    else if( arg == "--repeat" ) o.repeat = ::atoi( value );
+    else if( arg == "--timeout-ms" ) o.timeoutMs = ::atoi( value );
+    else if( arg == "--retries" ) o.retries = ::atoi( value );
+    else if( arg == "--listen" ) o.listen = value;
+    else
+    {
+      Usage( argv[0] );
+      return 1;
+    }
+  }
+
+  int fd = ::socket( AF_INET, SOCK_DGRAM, 0 );
+  if( !o.listen.empty() )
+    return Listen( fd, o );
+
+  struct addrinfo hints = {}, *ai = nullptr;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  if( ::getaddrinfo( o.host.c_str(), std::to_string( o.port ).c_str(), &hints, &ai ) || !ai
+      || ::connect( fd, ai->ai_addr, ai->ai_addrlen ) < 0 )
+  {
+    std::cerr << "Could not reach " << o.host << ":" << o.port << std::endl;
+    return 1;
+  }
+  ::freeaddrinfo( ai );
+
+  UdpProtocol::Header h = { UdpProtocol::Request, std::random_device()(), 1, 0 };
+  std::vector<int64_t> rtts;
+  int retransmits = 0, lost = 0;
+  for( int r = 0; r < o.repeat; ++r, ++h.Sequence )
+  {
+    uint8_t request[UdpProtocol::MaxSize], reply[UdpProtocol::MaxSize];
+    size_t size = UdpProtocol::PutRequest( request, h, o.ops.data(), o.ops.size() );
+    int64_t startUs = NowUs();
+    bool answered = false;
+    for( int attempt = 0; attempt <= o.retries && !answered; ++attempt )
+    {
+      if( attempt )
+        ++retransmits;
+      ::send( fd, request, size, 0 );
+      int64_t deadlineUs = NowUs() + o.timeoutMs * 1000LL;
+      for( int64_t now = NowUs(); now < deadlineUs && !answered; now = NowUs() )
+      {
+        pollfd p = { fd, POLLIN, 0 };
+        if( ::poll( &p, 1, ( deadlineUs - now + 999 ) / 1000 ) <= 0 )
+          break;
+        ssize_t n = ::recv( fd, reply, sizeof( reply ), 0 );
+        UdpProtocol::Header rh;
+        UdpProtocol::State s;
+        if( n < UdpProtocol::HeaderSize + 1 || !UdpProtocol::GetHeader( reply, n, rh ) || rh.Type != UdpProtocol::Reply
+            || rh.Client != h.Client || rh.Sequence != h.Sequence
+            || !UdpProtocol::GetState( reply + UdpProtocol::HeaderSize + 1, n - UdpProtocol::HeaderSize - 1, s ) )
+          continue; // a late reply to an earlier request
+        answered = true;
+        rtts.push_back( NowUs() - startUs );
+        if( r == o.repeat - 1 )
+        {
+          static const char* const statuses[] = { "ignored", "ok", "stale" };
+          int status = reply[UdpProtocol::HeaderSize];
+          std::cout << ( status < 3 ? statuses[status] : "?" ) << ", version " << rh.StateVersion << ": ";
+          Print( s );
+          std::cout << std::endl;
+        }
+      }
+    }
+    lost += !answered;
+  }
+  if( rtts.empty() )
+  {
+    std::cerr << "No reply" << std::endl;
+    return 1;
+  }
+  std::sort( rtts.begin(), rtts.end() );
+  if( o.repeat > 1 )
+    std::cout << "round trip us: min " << rtts.front() << " median " << rtts[rtts.size() / 2]
+      << " p99 " << rtts[rtts.size() * 99 / 100] << " max " << rtts.back()
+      << ", retransmits " << retransmits << ", lost " << lost << std::endl;
+  return lost ? 1 : 0;
+}
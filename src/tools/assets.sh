@@ -0,0 +1,45 @@
+#!/bin/sh
+# Builds content-hashed, precompressed copies of static files, see Assets.h.
+# Usage: tools/assets.sh <app root> <output directory> <file>...
+# Files are given relative to the app root, and written as
+# <name>.<hash>.<ext>, with .gz and .br variants where they are smaller.
+# References to earlier files, as "/<file>", are rewritten in html and css
+# files, so list referenced files first. The manifest lists
+# "<file> <hashed name>" lines.
+set -e
+root=$1
+out=$2
+shift 2
+mkdir -p "$out"
+rm -f "$out"/*
+manifest="$out/manifest"
+: > "$manifest.tmp"
+
+for f in "$@"; do
+  base=$(basename "$f")
+  src="$root/$f"
+  case "$base" in
+    *.html|*.css|*.js)
+      # Rewrite references to files hashed so far.
+      tmp="$out/$base.tmp"
+      cp "$src" "$tmp"
+      while read -r from to; do
+        sed -i "s|/$(echo "$from" | sed 's/\./\\./g')\([\"' )]\)|/assets/$to\1|g" "$tmp"
+      done < "$manifest.tmp"
+      src="$tmp"
+      ;;
+  esac
+  hash=$(sha256sum "$src" | cut -c1-12)
+  name="${base%.*}.$hash.${base##*.}"
+  cp "$src" "$out/$name"
+  rm -f "$out/$base.tmp"
+  size=$(stat -c %s "$out/$name")
+  gzip -9 -n -c "$out/$name" > "$out/$name.gz"
+  [ $(stat -c %s "$out/$name.gz") -lt $((size * 9 / 10)) ] || rm "$out/$name.gz"
+  if command -v brotli > /dev/null; then
+    brotli -q 11 -c "$out/$name" > "$out/$name.br"
+    [ $(stat -c %s "$out/$name.br") -lt $((size * 9 / 10)) ] || rm "$out/$name.br"
+  fi
+  echo "$f $name" >> "$manifest.tmp"
+done
+mv "$manifest.tmp" "$manifest"